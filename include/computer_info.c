@@ -8,6 +8,10 @@
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
+#if defined(_MSC_VER)
+#include <intrin.h>          /* for __rdtsc */
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +39,8 @@ extern "C" {
 		CoreType  type;             /* performance vs. efficiency */
 		int* logical_ids;      /* array of logical‐core indices */
 		int       logical_count;    /* length of logical_ids */
+		int       package;          /* physical package (socket) */
+		int       numa_node;        /* index into numa_nodes, -1 if unknown */
 	} PhysicalCoreInfo;
 
 	/* Instruction‐set flags, split by vendor relevance */
@@ -48,7 +54,7 @@ extern "C" {
 		char SSE4_2;
 		char AVX;
 
-		/* Intel‐only */
+		/* leaf 1 / leaf 7 extras, reported on every vendor */
 		char POPCNT;
 		char PCLMULQDQ;
 		char AES;
@@ -74,26 +80,612 @@ extern "C" {
 		char XOP;
 		char FMA4;
 		char THREEDNOW_PLUS;
+
+		/* x86‐64‐v2..v4 prerequisites */
+		char CX16;         /* CMPXCHG16B */
+		char LAHF_SAHF;    /* LAHF/SAHF in 64‐bit mode */
+		char LZCNT;        /* ABM on AMD */
+		char MOVBE;
+		char AVX512CD;
+		char AVX512BW;
+		char AVX512DQ;
+		char AVX512VL;
 	} CPU_Algorithms;
 
+	/* Field groups for get_cpu_data_ex; groups not requested stay NULL/0 */
+#define CPU_FIELD_BRAND      0x01u   /* cpu_name */
+#define CPU_FIELD_ALGORITHMS 0x02u   /* algorithms (CPUID only, no file I/O) */
+#define CPU_FIELD_TOPOLOGY   0x04u   /* cores, physical_core_count */
+#define CPU_FIELD_CACHES     0x08u   /* l1size, l2size, l3size, caches, cache_of, tlbs */
+#define CPU_FIELD_FREQUENCY  0x10u   /* frequency, effective_frequency, limits, governor */
+#define CPU_FIELD_NUMA       0x20u   /* numa_nodes, numa_distance */
+#define CPU_FIELD_BUDGET     0x40u   /* budget */
+#define CPU_FIELD_MEMORY     0x80u   /* memory */
+#define CPU_FIELD_ALL        0xFFu
+
+	/* Thread placement policies for plan_thread_placement */
+	typedef enum {
+		CPU_PLACE_PHYSICAL_FIRST,    /* one per physical core (P first), then SMT siblings */
+		CPU_PLACE_PACK_CACHE,        /* fill one L3, L2 by L2, siblings together */
+		CPU_PLACE_SPREAD_PACKAGES,   /* round‐robin across NUMA nodes / packages */
+		CPU_PLACE_PERFORMANCE_ONLY,  /* P‐cores only, physical first */
+		CPU_PLACE_BOOST_FIRST        /* physical first, best single‐thread boost cores first */
+	} PlacementPolicy;
+
+	/* Source selection for topology and caches (see fallback order below) */
+	typedef enum {
+		CPU_PROBE_AUTO,              /* OS first, CPUID fallback */
+		CPU_PROBE_CPUID,             /* CPUID first, OS fallback */
+		CPU_PROBE_OS                 /* OS only */
+	} CpuProbeMode;
+
+	/* Bit positions in CpuFeatures; CPU_Algorithms mirrors the first 36 */
+	typedef enum {
+		CPU_FEAT_SSE, CPU_FEAT_SSE2, CPU_FEAT_SSE3, CPU_FEAT_SSSE3,
+		CPU_FEAT_SSE4_1, CPU_FEAT_SSE4_2, CPU_FEAT_AVX, CPU_FEAT_POPCNT,
+		CPU_FEAT_PCLMULQDQ, CPU_FEAT_AES, CPU_FEAT_FMA, CPU_FEAT_F16C,
+		CPU_FEAT_XSAVE, CPU_FEAT_OSXSAVE, CPU_FEAT_RDRAND, CPU_FEAT_RDSEED,
+		CPU_FEAT_ADX, CPU_FEAT_MPX, CPU_FEAT_PREFETCHWT1, CPU_FEAT_AVX2,
+		CPU_FEAT_BMI1, CPU_FEAT_BMI2, CPU_FEAT_AVX512F, CPU_FEAT_SHA,
+		CPU_FEAT_SSE4A, CPU_FEAT_XOP, CPU_FEAT_FMA4, CPU_FEAT_THREEDNOW_PLUS,
+		CPU_FEAT_CX16, CPU_FEAT_LAHF_SAHF, CPU_FEAT_LZCNT, CPU_FEAT_MOVBE,
+		CPU_FEAT_AVX512CD, CPU_FEAT_AVX512BW, CPU_FEAT_AVX512DQ, CPU_FEAT_AVX512VL,
+		/* only in CpuFeatures */
+		CPU_FEAT_AVX512_IFMA, CPU_FEAT_AVX512_VBMI, CPU_FEAT_AVX512_VBMI2, CPU_FEAT_AVX512_VNNI,
+		CPU_FEAT_AVX512_BITALG, CPU_FEAT_AVX512_VPOPCNTDQ, CPU_FEAT_AVX512_BF16, CPU_FEAT_AVX512_FP16,
+		CPU_FEAT_AVX_VNNI, CPU_FEAT_AVX_IFMA, CPU_FEAT_AVX_VNNI_INT8, CPU_FEAT_AVX_NE_CONVERT,
+		CPU_FEAT_AMX_TILE, CPU_FEAT_AMX_INT8, CPU_FEAT_AMX_BF16, CPU_FEAT_AMX_FP16,
+		CPU_FEAT_VAES, CPU_FEAT_VPCLMULQDQ, CPU_FEAT_GFNI,
+		CPU_FEAT_COUNT           /* <= 128 */
+	} CpuFeature;
+
+	/* Packed feature bitset; bit CPU_FEAT_x of bits[x / 64] */
+	typedef struct {
+		uint64_t bits[2];
+	} CpuFeatures;
+
+	/* Subset tests: one AND + compare per word */
+	static inline int cpu_feature_has(const CpuFeatures* f, CpuFeature id) {
+		return (int)((f->bits[id >> 6] >> (id & 63)) & 1);
+	}
+	static inline void cpu_feature_add(CpuFeatures* f, CpuFeature id) {
+		f->bits[id >> 6] |= 1ull << (id & 63);
+	}
+	static inline int cpu_features_cover(const CpuFeatures* have, const CpuFeatures* need) {
+		return ((have->bits[0] & need->bits[0]) == need->bits[0]) &
+			((have->bits[1] & need->bits[1]) == need->bits[1]);
+	}
+
+	/* Cache kind */
+	typedef enum {
+		CACHE_TYPE_DATA,
+		CACHE_TYPE_INSTRUCTION,
+		CACHE_TYPE_UNIFIED
+	} CacheType;
+
+	/* One physical cache instance and the logical CPUs behind it */
+	typedef struct {
+		int       level;            /* 1, 2, 3 (4 on some parts) */
+		CacheType type;             /* data / instruction / unified */
+		int       size_kb;          /* KiB */
+		int       line_size;        /* bytes */
+		int       associativity;    /* ways, 0 = fully associative / unknown */
+		int       sets;             /* 0 if unknown */
+		int       inclusive;        /* of the levels below: 1 yes, 0 no, -1 unknown */
+		int* cpus;             /* logical CPUs sharing it */
+		int       cpu_count;        /* length of cpus */
+	} CacheDomain;
+
+	/* Per‐logical indices into CPU_DATA.caches, -1 where there is none */
+	typedef struct {
+		int l1d;
+		int l1i;
+		int l2;
+		int l3;
+	} CacheDomainIndex;
+
+	/* One TLB for one page size */
+	typedef struct {
+		int       level;            /* 1 = L1 DTLB/ITLB, 2 = STLB */
+		CacheType type;             /* data / instruction / unified */
+		int       page_size_kb;     /* 4, 2048, 4096 or 1048576 */
+		int       entries;
+		int       associativity;    /* ways, 0 = fully associative */
+	} TlbInfo;
+
+	/* One NUMA memory node */
+	typedef struct {
+		int       id;               /* OS node number */
+		int* cpus;             /* logical CPUs local to the node */
+		int       cpu_count;        /* length of cpus */
+		uint64_t  mem_total_bytes;  /* local memory, 0 if unknown */
+		uint64_t  mem_free_bytes;   /* free local memory */
+	} NumaNode;
+
+	/* CPUs this process may use, versus the host's logical CPUs */
+	typedef struct {
+		int       host_cpus;        /* online logical CPUs on the machine */
+		int       affinity_cpus;    /* CPUs in the affinity mask */
+		int       cpuset_cpus;      /* CPUs in the cgroup cpuset, 0 if none */
+		double    quota_cpus;       /* CFS quota / period, 0 if unlimited */
+		double    job_cpus;         /* Windows job CPU rate cap, 0 if unlimited */
+		int       recommended_parallelism; /* tightest of the above, >= 1 */
+	} CpuBudget;
+
+	/* Where one logical CPU sits; -1 for groups that were not probed */
+	typedef struct {
+		int       cpu;              /* logical CPU index */
+		int       core;             /* index into cores */
+		int       smt;              /* position in cores[core].logical_ids */
+		int       package;          /* cores[core].package */
+		int       l2;               /* index into caches */
+		int       l3;
+		int       numa_node;        /* index into numa_nodes */
+	} CpuLocation;
+
+	/* One huge page size and its pool */
+	typedef struct {
+		uint64_t  size_bytes;       /* 2 MiB, 1 GiB, ... */
+		uint64_t  total;            /* pages in the pool (nr_hugepages) */
+		uint64_t  free;             /* pages not mapped by anyone */
+		uint64_t  reserved;         /* free pages already promised to mappings */
+		uint64_t  surplus;          /* pages above total from overcommit */
+		uint64_t* node_total;       /* per MemoryInfo.node_ids entry, NULL without NUMA */
+		uint64_t* node_free;
+	} HugePagePool;
+
+	/* Transparent huge page policy (/sys/kernel/mm/transparent_hugepage/enabled) */
+	typedef enum {
+		CPU_THP_UNKNOWN,             /* not Linux, or THP compiled out */
+		CPU_THP_NEVER,
+		CPU_THP_MADVISE,             /* only MADV_HUGEPAGE regions */
+		CPU_THP_ALWAYS
+	} ThpMode;
+
+#define CPU_MAX_HUGEPAGE_SIZES 4
+
+	/* What the memory side offers an allocator */
+	typedef struct {
+		uint64_t  total_bytes;      /* installed RAM the OS manages */
+		uint64_t  available_bytes;  /* allocatable without swapping (MemAvailable) */
+		uint64_t  page_size;        /* base page */
+		uint64_t  large_page_minimum; /* default huge page / GetLargePageMinimum, 0 if none */
+		HugePagePool hugepages[CPU_MAX_HUGEPAGE_SIZES]; /* ascending size */
+		int       hugepage_size_count; /* entries used in hugepages */
+		int* node_ids;         /* NUMA node ids behind node_total / node_free */
+		int       node_count;       /* length of node_ids */
+		ThpMode   thp_mode;
+		char      thp_defrag[16];   /* always, defer, defer+madvise, madvise, never */
+		uint64_t  thp_pmd_bytes;    /* THP size (hpage_pmd_size) */
+		int       large_page_privilege; /* Windows SeLockMemoryPrivilege: 0 no, 1 held, 2 enabled; -1 elsewhere */
+	} MemoryInfo;
+
+	/* Per‐logical clock limits and boost preference */
+	typedef struct {
+		int       min_mhz;          /* lowest hardware clock, 0 if unknown */
+		int       max_mhz;          /* highest boost clock of this CPU */
+		int       base_mhz;         /* guaranteed (nominal) clock */
+		int       scaling_max_mhz;  /* OS cap on the clock, 0 if none known */
+		int       highest_perf;     /* ACPI CPPC highest_perf, 0 if unknown */
+		int       boost_rank;       /* 0 = most preferred for single‐thread boost */
+	} CpuFrequencyLimits;
+
+	/* frequency_warnings bits */
+#define CPU_FREQ_WARN_POWERSAVE    0x01u   /* powersave governor / power saver scheme */
+#define CPU_FREQ_WARN_EPP_ENERGY   0x02u   /* EPP leans to energy, not "performance" */
+#define CPU_FREQ_WARN_MIXED_POLICY 0x04u   /* CPUs disagree on governor or EPP */
+#define CPU_FREQ_WARN_BOOST_OFF    0x08u   /* turbo / boost disabled */
+#define CPU_FREQ_WARN_CAPPED       0x10u   /* OS max clock below the hardware max */
+
+	/* Where tsc.frequency_hz came from */
+	typedef enum {
+		CPU_TSC_UNKNOWN = 0,        /* no usable TSC */
+		CPU_TSC_CPUID,              /* leaf 0x15 crystal * ratio */
+		CPU_TSC_HYPERVISOR,         /* hypervisor leaf 0x40000010 */
+		CPU_TSC_CALIBRATED          /* measured against the monotonic clock */
+	} CpuTscSource;
+
+	/* Time‐stamp counter rate and a division‐free cycles‐to‐ns scale */
+	typedef struct {
+		int       invariant;         /* CPUID 0x80000007 EDX[8]: constant rate in every P/C‐state */
+		int       has_rdtscp;        /* CPUID 0x80000001 EDX[27] */
+		uint32_t  ratio_numerator;   /* leaf 0x15 EBX: TSC = crystal * numerator / denominator */
+		uint32_t  ratio_denominator; /* leaf 0x15 EAX, 0 if the leaf is absent */
+		uint64_t  crystal_hz;        /* leaf 0x15 ECX, or derived from leaf 0x16 */
+		uint64_t  frequency_hz;      /* TSC ticks per second, 0 if unknown */
+		CpuTscSource source;
+		uint32_t  ns_mult;           /* ns = cycles * ns_mult >> ns_shift */
+		uint32_t  ns_shift;
+	} CpuTscInfo;
+
+	/* Raw TSC, 0 on targets without one */
+	static inline uint64_t cpu_rdtsc(void) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		return __rdtsc();
+#elif defined(__i386__) || defined(__x86_64__)
+		uint32_t lo, hi;
+		__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+		return ((uint64_t)hi << 32) | lo;
+#else
+		return 0;
+#endif
+	}
+
+	/* Nanoseconds in `cycles` TSC ticks: two multiplies, no division */
+	static inline uint64_t cpu_tsc_to_ns(const CpuTscInfo* t, uint64_t cycles) {
+		return (((cycles >> 32) * t->ns_mult) << (32 - t->ns_shift))
+			+ (((cycles & 0xFFFFFFFFu) * t->ns_mult) >> t->ns_shift);
+	}
+
 	/* Aggregate CPU data */
 	typedef struct {
 		char* cpu_name;                   /* brand string */
-		int                logical_core_count;         /* total logical CPUs */
+		int                logical_core_count;         /* one past the highest online logical CPU */
 		int                physical_core_count;        /* total physical cores */
 		PhysicalCoreInfo* cores;                      /* length = physical_core_count */
+		int                performance_core_count;     /* physical P‐cores */
+		int                efficiency_core_count;      /* physical E‐cores */
 
 		int* l1size;                     /* per‐logical L1 cache (KiB) */
 		l2cache* l2size;                     /* per‐logical L2 cache info */
 		int* frequency;                  /* per‐logical current MHz */
-		int                l3size;                     /* shared L3 cache (KiB) */
+		int* effective_frequency;        /* per‐logical busy MHz (APERF/MPERF) */
+		CpuFrequencyLimits* frequency_limits;     /* per‐logical clock limits */
+		int                base_mhz;                   /* CPUID 0x16 base clock, 0 if the leaf is absent */
+		int                max_mhz;                    /* CPUID 0x16 maximum clock */
+		int                bus_mhz;                    /* CPUID 0x16 bus (reference) clock */
+		char               scaling_driver[24];         /* intel_pstate, amd‐pstate‐epp, acpi‐cpufreq, ... */
+		char               scaling_governor[24];       /* governor of CPU 0, or the Windows power scheme */
+		char               energy_perf_preference[24]; /* EPP of CPU 0, "" if not exposed */
+		unsigned int       frequency_warnings;         /* CPU_FREQ_WARN_* */
+		CpuTscInfo         tsc;                        /* invariant flag, leaf 0x15 ratio and TSC rate */
+		int                l3size;                     /* L3 slice of logical CPU 0 (KiB) */
+		CacheDomain* caches;                     /* every cache instance, all levels */
+		int                cache_count;                /* length of caches */
+		CacheDomainIndex* cache_of;                   /* per‐logical indices into caches */
+		CpuLocation* cpu_location;               /* per‐logical reverse index, built when packing */
+		TlbInfo* tlbs;                       /* TLBs of the probing CPU, one entry per page size */
+		int                tlb_count;                  /* length of tlbs */
+		int                prefetch_bytes;             /* hardware prefetch granularity */
+		int                false_sharing_bytes;        /* padding that keeps per‐thread data apart */
+		NumaNode* numa_nodes;                 /* memory nodes */
+		int                numa_node_count;            /* length of numa_nodes */
+		int* numa_distance;              /* count x count, row‐major, 10 = local */
+		CpuBudget          budget;                     /* usable CPUs under affinity / cgroup / job limits */
+		MemoryInfo         memory;                     /* RAM, page sizes, huge page pools, THP */
 
 		CPU_Algorithms     algorithms;                 /* instruction‐set flags */
+		CpuFeatures        features;                   /* same plus newer extensions, OS‐enabled only */
+		int                isa_level;                  /* x86‐64 microarchitecture level 1‐4, 0 if below v1 */
+
+		unsigned int       fields;                     /* CPU_FIELD_* groups that were filled */
+		void* arena;                      /* single allocation behind all pointers */
+		size_t             arena_size;                 /* bytes in arena */
+		int                arena_shared;               /* arena is an attached read‐only snapshot */
 	} CPU_DATA;
+	/* Sampler channels for cpu_sampler_create_ex */
+#define CPU_SAMPLE_FREQUENCY	0x01u	/* mhz */
+#define CPU_SAMPLE_THROTTLE		0x02u	/* thermal / power‐limit event counters */
+#define CPU_SAMPLE_TEMPERATURE	0x04u	/* core and package temperatures */
+#define CPU_SAMPLE_ENERGY		0x08u	/* RAPL energy counters */
+#define CPU_SAMPLE_ALL			0x0Fu
+
+#define CPU_TEMP_UNKNOWN		(-274000)	/* below absolute zero */
+
+	/* One timestamped sampler reading; arrays of channels not sampled are NULL */
+	typedef struct {
+		uint64_t           timestamp_ns;               /* monotonic clock */
+		int* mhz;                        /* per‐logical current MHz */
+		uint64_t* core_throttle;              /* per‐logical thermal throttle events (running count) */
+		uint64_t* core_power_limit;           /* per‐logical power‐limit notifications */
+		uint64_t* package_throttle;           /* per‐package thermal throttle events */
+		uint64_t* package_power_limit;        /* per‐package PL1/PL2 limit notifications */
+		int* core_temp_mc;               /* per‐logical millidegrees C, CPU_TEMP_UNKNOWN */
+		int* package_temp_mc;            /* per‐package millidegrees C */
+		uint64_t* energy_uj;                  /* per RAPL zone, microjoules, wraps */
+	} CPU_SAMPLE;
+
+	/* Opaque live sampler with persistent per‐CPU handles */
+	typedef struct CPU_SAMPLER CPU_SAMPLER;
+
+	/* Background watcher keeping a snapshot current across hotplug and policy changes */
+	typedef struct CPU_WATCHER CPU_WATCHER;
+
+	/* Called with the CPU_FIELD_* groups re‐probed, on the watcher thread or in cpu_watcher_refresh */
+	typedef void (*CpuChangeFn)(void* ctx, unsigned int changed_fields, uint64_t generation);
+
+	/* Work‐stealing pool pinned along a placement plan */
+	typedef struct CPU_POOL CPU_POOL;
+
+	/* A pool task; runs on one worker thread */
+	typedef void (*CpuTaskFn)(void* arg);
+
+	/* cpu_pool_submit flags */
+#define CPU_TASK_LATENCY 0x01u       /* run on a P‐core worker when one is free */
+
+	/* Dynamically sized set of logical CPU indices */
+	typedef struct {
+		int       cpu_capacity;     /* bits allocated, a multiple of 64 */
+		uint64_t* bits;             /* cpu_capacity / 64 words */
+	} CpuSet;
+
+	/* Targets of run_memory_benchmark: each cache level, then DRAM */
+	typedef enum {
+		CPU_BENCH_L1,
+		CPU_BENCH_L2,
+		CPU_BENCH_L3,
+		CPU_BENCH_DRAM,
+		CPU_BENCH_LEVELS
+	} MemBenchLevel;
+
+	/* Latency and bandwidth of one working set; bandwidths in GB/s (1e9 bytes) */
+	typedef struct {
+		size_t    working_set_bytes; /* single‐thread working set, 0 if level absent */
+		double    latency_ns;       /* dependent load, random line order */
+		double    read_gbps;        /* one thread */
+		double    write_gbps;
+		double    copy_gbps;        /* bytes read + bytes written */
+		double    read_gbps_all;    /* threads_used threads together */
+		double    write_gbps_all;
+		double    copy_gbps_all;
+	} MemBenchLevelResult;
+
+	/* Memory hierarchy results, filled by run_memory_benchmark */
+	typedef struct {
+		MemBenchLevelResult level[CPU_BENCH_LEVELS];
+		int       threads_used;     /* threads in the *_all columns, 0 without topology */
+		int       duration_ms;      /* length of each measurement */
+	} MEM_BENCH;
+
+	/* One‐way cache‐line transfer latency between every pair of logical CPUs */
+	typedef struct {
+		int       cpu_count;        /* L, the row length */
+		double*   latency_ns;       /* L x L row‐major; 0 on the diagonal, -1 not measured */
+		int*      group_of;         /* per‐logical low‐latency group */
+		int       group_count;
+		double    threshold_ns;     /* grouping cut that produced group_of */
+	} CORE_LATENCY;
+
+	/* get_cpu_data_ex phases reported to the probe hook */
+	typedef enum {
+		CPU_PHASE_BRAND,            /* CPUID brand string */
+		CPU_PHASE_SETUP,            /* logical CPU count, per‐CPU arrays */
+		CPU_PHASE_FREQUENCY,        /* scaling_cur_freq / CallNtPowerInformation */
+		CPU_PHASE_ALGORITHMS,       /* CPUID / XGETBV feature flags */
+		CPU_PHASE_CACHES,           /* sysfs cache tree or CACHE_RELATIONSHIP, TLBs */
+		CPU_PHASE_TOPOLOGY,         /* cores, packages, core types */
+		CPU_PHASE_CPUID_TOPOLOGY,   /* CPUID topology / cache leaves on each CPU */
+		CPU_PHASE_NUMA,             /* memory nodes */
+		CPU_PHASE_BUDGET,           /* affinity, cgroup and job limits */
+		CPU_PHASE_PACK,             /* copy into the result arena */
+		CPU_PHASE_MEMORY,           /* meminfo, huge page pools, THP */
+		CPU_PHASE_COUNT
+	} CpuProbePhase;
+
+	/* Cost of one phase within a single get_cpu_data_ex call */
+	typedef struct {
+		uint64_t  wall_ns;          /* elapsed, monotonic clock */
+		unsigned int files_opened;  /* files, directories and registry keys */
+		uint64_t  bytes_read;
+		unsigned int syscalls;      /* opens, reads and closes (registry: open, query, close) */
+		unsigned int allocations;   /* malloc / calloc / realloc calls */
+		unsigned int runs;          /* times entered, 0 if skipped */
+	} CpuPhaseStats;
+
+	/* Everything one get_cpu_data_ex call cost, passed to the probe hook */
+	typedef struct {
+		CpuPhaseStats phase[CPU_PHASE_COUNT];
+		uint64_t  total_ns;         /* whole call */
+		unsigned int fields;        /* CPU_FIELD_* requested */
+		int       result;           /* the call's return code */
+	} CPU_PROBE_STATS;
+
+	/* Called on the probing thread once per get_cpu_data_ex call */
+	typedef void (*CpuProbeHook)(void* ctx, const CPU_PROBE_STATS* stats);
+
+	/* Generic entry in a dispatch table; cast to the real signature to call */
+	typedef void (*CpuDispatchFn)(void);
+
+	/* Runtime dispatch table: fns[slot] is the best registered variant */
+	typedef struct {
+		CpuDispatchFn* fns;           /* resolved entry per slot, NULL if none fits */
+		int       slot_count;       /* length of fns */
+		int       isa_level;        /* level the table was resolved for */
+		void*     variants;         /* registrations, internal */
+		int       variant_count;
+		int       variant_capacity;
+	} CPU_DISPATCH;
+
+	/* Replacement CPUID / XGETBV source, e.g. a recorded dump in tests */
+	typedef struct {
+		void     (*cpuid)(void* ctx, int leaf, int subleaf, int regs[4]);
+		uint64_t (*xgetbv)(void* ctx, unsigned int index);
+		void*     ctx;
+	} CpuidHook;
+
+	/* GPU vendor, from the PCI vendor id */
+	typedef enum {
+		GPU_VENDOR_UNKNOWN,
+		GPU_VENDOR_NVIDIA,
+		GPU_VENDOR_AMD,
+		GPU_VENDOR_INTEL,
+		GPU_VENDOR_OTHER
+	} GpuVendor;
+
+	/* Where a device's fields came from (GpuDevice.sources) */
+#define GPU_SOURCE_SYSFS     0x01u   /* /sys/class/drm + PCI sysfs */
+#define GPU_SOURCE_DXGI      0x02u   /* DXGI adapter list */
+#define GPU_SOURCE_NVML      0x04u   /* libnvidia-ml / nvml.dll */
+#define GPU_SOURCE_ROCM_SMI  0x08u   /* librocm_smi64 */
+#define GPU_SOURCE_KFD       0x10u   /* /sys/class/kfd topology (AMD compute units) */
+
+	/* One GPU */
+	typedef struct {
+		GpuVendor vendor;
+		unsigned int vendor_id;     /* PCI vendor id */
+		unsigned int device_id;     /* PCI device id */
+		char      name[128];        /* marketing name, else the pci.ids name, else the ids */
+		char      pci_address[16];  /* "0000:01:00.0", "" if unknown */
+		char      driver[32];       /* kernel driver (amdgpu, i915, xe, nvidia), "" on Windows */
+		uint64_t  vram_bytes;       /* dedicated memory, 0 if unknown */
+		uint64_t  shared_bytes;     /* system memory the GPU may map (GTT / shared), 0 if unknown */
+		int       compute_units;    /* SMs (NVIDIA), CUs (AMD), 0 if unknown */
+		int       max_clock_mhz;    /* highest shader clock */
+		int       current_clock_mhz; /* shader clock now */
+		int       memory_clock_mhz; /* highest memory clock */
+		int       pcie_gen;         /* current link generation, drops at idle */
+		int       pcie_width;       /* current lanes */
+		int       pcie_max_gen;     /* best generation device and upstream port both support */
+		int       pcie_max_width;   /* lanes likewise */
+		double    pcie_gbps;        /* GB/s per direction at pcie_max_gen x pcie_max_width */
+		int       numa_node;        /* NUMA node id (NumaNode.id), -1 if unknown */
+		int* cpus;             /* logical CPUs local to the device */
+		int       cpu_count;        /* length of cpus */
+		int       is_boot_vga;      /* firmware console / primary adapter */
+		unsigned int sources;       /* GPU_SOURCE_* */
+	} GpuDevice;
+
+	/* Every GPU; one allocation behind all pointers */
+	typedef struct {
+		GpuDevice* devices;
+		int       device_count;
+		void* arena;                /* single allocation behind all pointers */
+		size_t    arena_size;       /* bytes in arena */
+	} GPU_DATA;
+
 	// -------------------- Exported Function --------------------
 
 	DLL_EXPORT int get_cpu_data(CPU_DATA* data);
 
+	/* Probe only the CPU_FIELD_* groups in `fields` */
+	DLL_EXPORT int get_cpu_data_ex(CPU_DATA* data, unsigned int fields);
+
+	/* Release / duplicate a snapshot (one allocation each); never memcpy a CPU_DATA */
+	DLL_EXPORT void free_cpu_data(CPU_DATA* data);
+	DLL_EXPORT int copy_cpu_data(CPU_DATA* dst, const CPU_DATA* src);
+
+	/* Shared‐memory snapshots: publish once per host, attach read‐only elsewhere */
+	DLL_EXPORT int publish_cpu_data(const CPU_DATA* data, const char* name);
+	DLL_EXPORT int attach_cpu_data(const char* name, CPU_DATA* out);
+	DLL_EXPORT int unpublish_cpu_data(const char* name);
+	DLL_EXPORT int get_cpu_data_shared(const char* name, CPU_DATA* out);
+
+	/* Probe once per process (thread‐safe) and share the result; frequency[] is refreshed atomically */
+	DLL_EXPORT int get_cpu_data_cached(const CPU_DATA** out);
+
+	/* Text for one CPU_FREQ_WARN_* bit, NULL otherwise */
+	DLL_EXPORT const char* cpu_frequency_warning_text(unsigned int warning);
+
+	/* Re‐read the fields that change at run time (frequency) */
+	DLL_EXPORT int refresh_cpu_frequency(CPU_DATA* data);
+	DLL_EXPORT int refresh_cpu_data_cached(void);
+
+	/* Ordered logical CPUs for thread_count threads; out_cpus has thread_count slots */
+	DLL_EXPORT int plan_thread_placement(const CPU_DATA* data, int thread_count,
+		PlacementPolicy policy, int* out_cpus);
+
+	/* Working‐set bytes of cache level 1 (L1d), 2 or 3 for one thread; see notes */
+	DLL_EXPORT size_t cpu_cache_budget(const CPU_DATA* data, int level, int concurrent);
+
+	/* Tile sizes resident in that budget: elements per array / side of a square block */
+	DLL_EXPORT size_t cpu_tile_elements(const CPU_DATA* data, int level, size_t elem_size,
+		int arrays, int concurrent);
+	DLL_EXPORT int cpu_square_tile(const CPU_DATA* data, int level, size_t elem_size,
+		int arrays, int concurrent);
+
+	/* Logical CPU of the caller and, with data, its core / L2 / L3 / node in *out */
+	DLL_EXPORT int current_cpu(const CPU_DATA* data, CpuLocation* out);
+
+	/* Pin the calling thread (sched_setaffinity / SetThreadGroupAffinity) */
+	DLL_EXPORT int pin_current_thread(int logical_cpu);
+
+	/* CPU sets of any size; cpu_set_add grows the set */
+	DLL_EXPORT int cpu_set_init(CpuSet* set, int capacity);
+	DLL_EXPORT void cpu_set_free(CpuSet* set);
+	DLL_EXPORT int cpu_set_add(CpuSet* set, int cpu);
+	DLL_EXPORT int cpu_set_contains(const CpuSet* set, int cpu);
+	DLL_EXPORT int cpu_set_count(const CpuSet* set);
+
+	/* Calling thread's affinity as a CpuSet (cpu_set_free it) / pin to a set */
+	DLL_EXPORT int get_thread_affinity(CpuSet* out);
+	DLL_EXPORT int pin_current_thread_set(const CpuSet* set);
+
+	/* Re‐read affinity, cgroup cpuset / quota and job limits (fills budget too) */
+	DLL_EXPORT int get_cpu_budget(CpuBudget* out);
+
+	/* Re‐measure tsc.frequency_hz against the monotonic clock over interval_ms */
+	DLL_EXPORT int calibrate_tsc(CPU_DATA* data, int interval_ms);
+
+	/* Average busy MHz per logical CPU over interval_ms, into effective_frequency */
+	DLL_EXPORT int measure_effective_frequency(CPU_DATA* data, int interval_ms);
+
+	/* Latency / bandwidth of L1d, L2, L3 and DRAM, one thread and all cores; see notes */
+	DLL_EXPORT int run_memory_benchmark(const CPU_DATA* data, int duration_ms, MEM_BENCH* out);
+
+	/* Core‐to‐core latency matrix (pairs measured in parallel) and its grouping */
+	DLL_EXPORT int measure_core_latency(const CPU_DATA* data, int round_trips, CORE_LATENCY* out);
+	DLL_EXPORT int cluster_core_latency(CORE_LATENCY* m, double threshold_ns);
+	DLL_EXPORT void free_core_latency(CORE_LATENCY* m);
+
+	/* Live sampler; `capacity` samples are kept in a ring */
+	DLL_EXPORT int cpu_sampler_create(int capacity, CPU_SAMPLER** out);
+	DLL_EXPORT int cpu_sampler_create_ex(int capacity, unsigned int channels, CPU_SAMPLER** out);
+	DLL_EXPORT int cpu_sampler_sample(CPU_SAMPLER* s, const CPU_SAMPLE** out);
+	DLL_EXPORT int cpu_sampler_count(const CPU_SAMPLER* s);
+	DLL_EXPORT int cpu_sampler_logical_count(const CPU_SAMPLER* s);
+	DLL_EXPORT int cpu_sampler_package_count(const CPU_SAMPLER* s);
+	DLL_EXPORT int cpu_sampler_package_of(const CPU_SAMPLER* s, int logical_cpu);
+	DLL_EXPORT unsigned int cpu_sampler_channels(const CPU_SAMPLER* s);
+	DLL_EXPORT int cpu_sampler_energy_zone_count(const CPU_SAMPLER* s);
+	DLL_EXPORT const char* cpu_sampler_energy_zone_name(const CPU_SAMPLER* s, int zone);
+	DLL_EXPORT const CPU_SAMPLE* cpu_sampler_get(const CPU_SAMPLER* s, int age);
+	DLL_EXPORT double cpu_sampler_power_watts(const CPU_SAMPLER* s, int zone);
+	DLL_EXPORT void cpu_sampler_destroy(CPU_SAMPLER* s);
+
+	/* Keep `fields` current on CPU hotplug, cpuset / affinity and power‐policy changes */
+	DLL_EXPORT int cpu_watcher_create(unsigned int fields, int poll_ms, CpuChangeFn fn, void* ctx,
+		CPU_WATCHER** out);
+	DLL_EXPORT uint64_t cpu_watcher_generation(CPU_WATCHER* w);
+	DLL_EXPORT int cpu_watcher_snapshot(CPU_WATCHER* w, CPU_DATA* out, uint64_t* generation);
+	DLL_EXPORT int cpu_watcher_refresh(CPU_WATCHER* w, unsigned int fields);
+	DLL_EXPORT void cpu_watcher_destroy(CPU_WATCHER* w);
+
+	/* Topology‐aware work‐stealing pool, one pinned worker per planned CPU */
+	DLL_EXPORT int cpu_pool_create(const CPU_DATA* data, int threads, PlacementPolicy policy,
+		CPU_POOL** out);
+	DLL_EXPORT int cpu_pool_submit(CPU_POOL* p, CpuTaskFn fn, void* arg, unsigned int flags);
+	DLL_EXPORT void cpu_pool_wait(CPU_POOL* p);
+	DLL_EXPORT int cpu_pool_size(const CPU_POOL* p);
+	DLL_EXPORT int cpu_pool_worker_cpu(const CPU_POOL* p, int worker);
+	DLL_EXPORT int cpu_pool_current_worker(const CPU_POOL* p);
+	DLL_EXPORT void cpu_pool_destroy(CPU_POOL* p);
+
+	/* x86‐64‐v1..v4 level implied by a feature set (0 = below v1) */
+	DLL_EXPORT int cpu_isa_level(const CpuFeatures* features);
+
+	/* Function multi‐versioning: register variants per slot, resolve once, call fns[slot] */
+	DLL_EXPORT int cpu_dispatch_init(CPU_DISPATCH* d, int slot_count);
+	DLL_EXPORT int cpu_dispatch_register(CPU_DISPATCH* d, int slot, int min_level,
+		const CpuFeatures* need, CpuDispatchFn fn);
+	DLL_EXPORT int cpu_dispatch_resolve(CPU_DISPATCH* d, const CpuFeatures* have);
+	DLL_EXPORT void cpu_dispatch_free(CPU_DISPATCH* d);
+
+	/* Answer every CPUID / XGETBV from `hook` (copied); NULL restores the hardware */
+	DLL_EXPORT void set_cpuid_hook(const CpuidHook* hook);
+
+	/* Report per‐phase time, files and bytes of every get_cpu_data_ex; set before probing starts */
+	DLL_EXPORT void set_cpu_probe_hook(CpuProbeHook hook, void* ctx);
+
+	/* Choose where topology and caches come from (default CPU_PROBE_AUTO) */
+	DLL_EXPORT void set_cpu_probe_mode(CpuProbeMode mode);
+
+	/* Read /sys and /proc from a recorded tree under root (Linux); NULL restores the live one */
+	DLL_EXPORT int set_cpu_sysfs_root(const char* root);
+
+	/* GPUs (src/gpu_info.c); release with free_gpu_data */
+	DLL_EXPORT int get_gpu_data(GPU_DATA* data);
+	DLL_EXPORT void free_gpu_data(GPU_DATA* data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -105,7 +697,343 @@ extern "C" {
 typedef int (*get_cpu_data_fn)(CPU_DATA*);
 Allocate and zero out a CPU_DATA struct before calling
 
-Free the internal arrays (l1size, frequency, l2size) after use
+Every array (cpu_name, l1size, l2size, frequency, cores and each
+cores[i].logical_ids) lives in one arena; release it with free_cpu_data().
+On error nothing is left allocated. copy_cpu_data() makes an independent
+copy with its own arena and is the only way to duplicate a snapshot: the
+arena holds absolute pointers, so a memcpy'd or assigned CPU_DATA shares
+the original's arena, dangles once either is freed, and a second
+free_cpu_data() on it is a double free. Only shared‐memory snapshots are
+rebased to their mapping (see publish_cpu_data); an arena is not
+position‐independent.
+
+get_cpu_data_ex(data, CPU_FIELD_ALGORITHMS) answers "which SIMD path"
+with a few CPUID instructions and touches neither sysfs nor the registry.
+logical_core_count is filled whenever TOPOLOGY, CACHES or FREQUENCY is
+requested. get_cpu_data() is
+get_cpu_data_ex(data, CPU_FIELD_ALL).
+
+Logical CPU N is OS CPU N: cpuN in sysfs, the number sched_getcpu() and
+affinity masks use. On Linux logical_core_count is one past the highest
+CPU in cpu/online, so a CPU taken offline below that leaves a hole: with
+"0-2,4-7" it is 8, and CPU 3 is in no core, cache or NUMA node, has
+cpu_location[3].core == -1 and frequency[3] == 0. budget.host_cpus counts
+the online CPUs only. Windows numbers its active processors without holes.
+
+Pre‐forked workers can share one probe per host. The first process calls
+publish_cpu_data(&data, "/cpu_info") (Linux: a POSIX shm name, or a path
+such as "/run/myapp/cpu_info" for an mmap‐able file; Windows: a section
+name such as "Local\\cpu_info"); the others call attach_cpu_data(), which
+maps the segment copy‐on‐write, turns its stored offsets back into
+pointers and makes it read‐only: no probing, no heap allocation, and only
+the pages holding cores[], caches[] and numa_nodes[] stop being shared.
+free_cpu_data() unmaps it; refresh_cpu_frequency() and
+measure_effective_frequency() refuse it (216), copy_cpu_data() gives a
+writable copy. get_cpu_data_shared() does both: attach, else probe and
+publish. It claims the name before probing (O_CREAT | O_EXCL on Linux, a
+"<name>.claim" mutex on Windows), so of several processes starting at
+once one probes and the others wait up to 5 s for its snapshot. It never
+removes a name: if the segment stays unfinished because its publisher
+died, callers probe privately until publish_cpu_data() or
+unpublish_cpu_data() replaces or removes it. Snapshots carry a version and the struct sizes, so a library with
+a different CPU_DATA layout gets 219 instead of garbage. Republishing on
+Linux replaces the segment; processes already attached keep the old one.
+A Windows section lives while a handle or view is open: the publisher
+keeps its handle until unpublish_cpu_data(), and a live name cannot be
+republished (use a new name).
+
+get_cpu_data_cached() probes on first use and returns a pointer to a
+process‐wide snapshot shared by all threads. Do not modify or free it.
+Every field except frequency[] is fixed for the life of the process.
+refresh_cpu_data_cached() reads the clocks into a private buffer and then
+stores each frequency[] element atomically, so any thread may read
+frequency[] during a refresh and sees each element's old or new value,
+never a torn or cleared one; elements may come from different refreshes.
+Under ThreadSanitizer, read them with relaxed atomic loads.
+
+cores[].type: Windows uses EfficiencyClass from
+GetLogicalProcessorInformationEx; Linux uses /sys/devices/cpu_core/cpus
+and /sys/devices/cpu_atom/cpus, else CPUID leaf 0x1A run on each core.
+Non‐hybrid parts report every core as CORE_TYPE_PERFORMANCE;
+CORE_TYPE_UNKNOWN means the type could not be determined.
+
+caches[] lists every cache instance separately, e.g. one L3 entry per
+CCD on EPYC or per socket on Xeon, with the logical CPUs sharing it.
+cache_of[cpu].l3 is the L3 that logical CPU `cpu` runs on:
+    data.caches[data.cache_of[cpu].l3].size_kb
+l1size/l2size/l3size are derived from the same list (l1size is L1d).
+Each domain carries line size, ways and sets (sysfs coherency_line_size/
+ways_of_associativity/number_of_sets, Windows CACHE_RELATIONSHIP, or CPUID
+leaf 4 / 0x8000001D, 0x80000005/6 on older AMD); inclusive comes from the
+CPUID leaves on x86 and is -1 elsewhere.
+
+tlbs[] lists one entry per TLB and page size from CPUID leaf 0x18, else
+leaf 2 descriptors (Intel), or 0x80000005/6 and 0x80000019 (AMD).
+false_sharing_bytes is the stride at which per‐thread counters stop
+sharing: two lines on Intel, whose spatial prefetcher fetches 128‐byte
+pairs, one line elsewhere. prefetch_bytes is the leaf 2 prefetch size or
+the line size.
+
+cpu_cache_budget() keeps one way free for stack and streaming data and,
+with `concurrent`, divides by the logical CPUs sharing the cache, so it
+holds when every sharer runs a tile. For a blocked GEMM with A, B and C
+blocks of floats in L2:
+    int nb = cpu_square_tile(&data, 2, sizeof(float), 3, 1);
+cpu_tile_elements() gives the 1‐D equivalent (whole cache lines per
+array), e.g. the bucket count of an L1‐resident hash table. All three
+use logical CPU 0's caches and return 0 without CPU_FIELD_CACHES.
+
+numa_nodes[] comes from /sys/devices/system/node on Linux and
+GetNumaNodeProcessorMaskEx on Windows. numa_distance[i * count + j] is
+the SLIT distance from node i to node j (Linux); Windows does not expose
+it, so 20 is reported for every remote node, and mem_total_bytes is only
+known there on single‐node machines. Without NUMA support one node holds
+every CPU. cores[].numa_node is filled when CPU_FIELD_TOPOLOGY is also
+requested.
+
+plan_thread_placement() needs CPU_FIELD_TOPOLOGY. Thread i of a pool
+calls pin_current_thread(plan[i]) once at start‐up. More threads than
+CPUs wrap around the same order; CPU_PLACE_PERFORMANCE_ONLY uses every
+core when no P‐cores were identified. CPU_PLACE_BOOST_FIRST puts thread 0
+on the core with the lowest frequency_limits[].boost_rank (needs
+CPU_FIELD_FREQUENCY too, else it is CPU_PLACE_PHYSICAL_FIRST).
+
+cpu_location[cpu] inverts cores[], cache_of[] and numa_nodes[]: the core,
+SMT slot, package, L2, L3 and node of each logical CPU, -1 for what was
+not probed (NULL without TOPOLOGY, CACHES or NUMA).
+    CpuLocation here;
+    current_cpu(&data, &here);    // here.l3 indexes data.caches
+current_cpu() reads TSC_AUX with RDPID, else RDTSCP, on x86 Linux (the
+kernel stores the CPU number there; checked against sched_getcpu() on
+first use), else calls sched_getcpu() or GetCurrentProcessorNumberEx().
+The thread may migrate right after, so treat it as a hint unless pinned.
+
+With CPU_FIELD_FREQUENCY, frequency_limits[] holds per CPU the
+cpuinfo_min_freq / cpuinfo_max_freq / scaling_max_freq clocks, the base
+clock (intel_pstate base_frequency, else acpi_cppc nominal_freq, else
+CPUID 0x16) and acpi_cppc highest_perf. boost_rank orders CPUs by
+(highest_perf, max_mhz): on AMD preferred‐core and Intel Turbo Boost Max
+3.0 parts the rank 0 cores reach the highest single‐thread clock; equal
+hardware ranks every CPU 0. scaling_governor / energy_perf_preference are
+CPU 0's. frequency_warnings flags settings that hurt latency‐critical
+hosts (powersave, an EPP other than "performance", boost off, a capped
+maximum, CPUs that disagree); cpu_frequency_warning_text() gives a log
+line per bit. Under intel_pstate and amd‐pstate‐epp in active mode
+"powersave" is the usual governor and the EPP decides the behaviour.
+Windows reports the active power scheme as the governor, its processor
+energy preference (0‐100, PERFEPP) as the EPP, base_mhz from the power
+manager and max_mhz from CPUID only, with min_mhz and highest_perf 0.
+
+effective_frequency is zero until measure_effective_frequency() runs. It
+blocks for interval_ms and stores nominal * dAPERF / dMPERF per CPU, i.e.
+the clock the core actually ran at while not idle (shows AVX‐512 licence
+drops and throttling). Counters come from the perf "msr" PMU, else
+/dev/cpu/N/msr (root); without either, and on Windows, the current clock
+at the end of the interval is stored instead.
+
+tsc (CPU_FIELD_FREQUENCY) describes the time‐stamp counter: invariant
+means it ticks at one rate through P‐states, C‐states and turbo, so it
+can time code; without it use clock_gettime / QueryPerformanceCounter.
+frequency_hz comes from CPUID leaf 0x15 (crystal * EBX / EAX, the crystal
+derived from leaf 0x16 where ECX is 0), else the hypervisor timing leaf
+0x40000010, else a 5 ms calibration against the monotonic clock made
+once per process (source says which); calibrate_tsc() re‐measures over a
+longer interval and later probes reuse its result.
+cpu_tsc_to_ns() is two multiplies and shifts, within 1 ns per second:
+    uint64_t t0 = cpu_rdtsc();
+    work();
+    uint64_t ns = cpu_tsc_to_ns(&data.tsc, cpu_rdtsc() - t0);
+The scale is fixed at probe time; a watcher keeps its first one. TSCs
+are synchronised across cores on invariant parts with a single clock
+domain, but a VM can be migrated to a host with another rate.
+
+cpu_sampler_create() opens the per‐CPU frequency handles once (sysfs
+scaling_cur_freq on Linux, CallNtPowerInformation on Windows).
+cpu_sampler_sample() reads every logical CPU into the next ring slot
+without allocating; cpu_sampler_get(s, 0) is the newest sample. Sample
+pointers stay valid until the slot is overwritten `capacity` samples later.
+
+cpu_sampler_create_ex() adds channels on Linux, each opened once and read
+with one pread per counter: CPU_SAMPLE_THROTTLE reads
+cpuN/thermal_throttle/{core,package}_{throttle,power_limit}_count (package
+counters from the package's first CPU; they only ever grow, so diff two
+samples), CPU_SAMPLE_TEMPERATURE the hwmon coretemp "Core N" / "Package id
+N" inputs, or k10temp / zenpower Tdie (else Tctl) per package, and
+CPU_SAMPLE_ENERGY every readable powercap intel‐rapl zone (energy_uj is
+root‐only on kernels since 5.10). cpu_sampler_channels() reports which
+requested channels found a source; a core with no sensor reads
+CPU_TEMP_UNKNOWN. package_* arrays are indexed by cpu_sampler_package_of().
+cpu_sampler_power_watts() averages a zone over the two newest samples,
+across counter wrap. Windows only has CPU_SAMPLE_FREQUENCY.
+
+run_memory_benchmark() needs CPU_FIELD_CACHES; with CPU_FIELD_TOPOLOGY
+it also fills the *_all columns, one thread per physical core (at most
+budget.recommended_parallelism) placed with CPU_PLACE_PHYSICAL_FIRST, each
+streaming its own buffer. Shared caches are split between the threads on
+them, so read_gbps_all at CPU_BENCH_L3 is the whole L3's bandwidth. Single
+threads use half of each level (at least twice the level below) and DRAM
+four times the total L3, 64 MiB to 1 GiB. Each number is measured for
+duration_ms (0 = 50), about 1.5 s in all plus buffer set‐up. Run it on an
+idle machine; see test/memory_bench.c.
+
+measure_core_latency() needs CPU_FIELD_TOPOLOGY and pins one thread to
+every logical CPU in cores[]. A writes the shared line, B answers, and
+half the round trip is stored in latency_ns[a * L + b] (and [b * L + a]).
+Disjoint pairs run at the same time, L/2 per round and L-1 rounds, so a
+256‐CPU machine takes 255 rounds rather than 32640 pair runs; with
+round_trips 0 (= 2000) that is well under a second. CPUs outside the
+affinity mask stay -1. Typical results: SMT siblings lowest, then the
+same L3 (CCX / ring), cross‐CCD, cross‐socket highest.
+group_of comes from single‐linkage grouping: CPUs closer than
+threshold_ns share a group. measure_core_latency() picks the largest
+relative jump between measured latencies (ignoring jumps under 1.5x);
+call cluster_core_latency(m, ns) to regroup at another cut, e.g. to
+choose which threads share a queue. free_core_latency() releases the
+matrix.
+
+cpu_watcher_create() probes `fields` once and then updates only what an
+event touches: CPUs going on/offline re‐probe TOPOLOGY, CACHES,
+FREQUENCY, NUMA and BUDGET (whichever are watched); a cpuset, affinity or
+quota change BUDGET; a cpufreq policy (governor, min/max) or Windows
+power plan / AC‐DC change FREQUENCY; memory node hotplug NUMA with
+TOPOLOGY and MEMORY; a memory block going on/offline MEMORY. Linux listens for kernel uevents on netlink and, every poll_ms
+(0 = 1000), compares the budget and cpufreq policies, which raise none;
+without netlink (unprivileged network namespace) polling also catches
+hotplug. Windows uses PowerSettingRegisterNotification callbacks and
+polls the active processor count and the budget. Each update bumps the
+generation: keep the value a thread plan was built from and re‐plan when
+cpu_watcher_generation() differs. cpu_watcher_snapshot() returns an
+independent copy (free_cpu_data it) and its generation. The callback runs
+on the watcher thread, except that cpu_watcher_refresh() re‐probes and
+calls it on the refreshing thread before returning, so it can run on two
+threads at once; it must not destroy the watcher.
+
+cpu_pool_create() starts one worker per CPU of plan_thread_placement()
+(threads 0 = budget.recommended_parallelism), each pinned and owning a
+lock‐free Chase‐Lev deque. A task submitted from a worker goes on that
+worker's deque, LIFO, so it runs while its data is still in cache; an idle
+worker steals the oldest task of a sibling in its L2, then its L3, then
+its NUMA node, and only then of a remote worker. Tasks from other threads
+and CPU_TASK_LATENCY tasks queue in shared FIFOs; P‐core workers look at
+the latency FIFO before anything else, other workers only when they have
+nothing left (on non‐hybrid parts every worker counts as a P‐core).
+    CPU_POOL* pool;
+    cpu_pool_create(&data, 0, CPU_PLACE_PACK_CACHE, &pool);
+    for (int i = 0; i < blocks; ++i) cpu_pool_submit(pool, work, &block[i], 0);
+    cpu_pool_wait(pool);
+    cpu_pool_destroy(pool);    // runs what is still queued, then joins
+Needs CPU_FIELD_TOPOLOGY (210 without); CACHES and NUMA sharpen the steal
+order. cpu_pool_wait() returns when every task so far has finished; call
+it from outside the pool, as a task waiting for the pool waits for
+itself. A task may submit more tasks. A full deque (4096 tasks) spills
+into the shared FIFO. test/pool_stress.c covers nested and latency
+submits, create / wait / destroy cycles and an oversubscribed pool, and
+runs clean under ThreadSanitizer (-fsanitize=thread).
+
+budget separates what the host has from what this process may use:
+affinity_cpus is the sched_getaffinity / process affinity mask,
+cpuset_cpus the cgroup (v1 or v2) cpuset, quota_cpus the CFS quota
+divided by its period (the tightest along the cgroup path), job_cpus the
+Windows job object CPU rate cap scaled to host_cpus. Size thread pools from
+recommended_parallelism, the smallest of these with quotas rounded up;
+call get_cpu_budget() again if limits change at run time.
+
+isa_level follows the x86‐64 psABI levels: v2 adds CX16, LAHF/SAHF,
+POPCNT and SSE3..SSE4.2; v3 AVX, AVX2, BMI1/2, F16C, FMA, LZCNT, MOVBE;
+v4 AVX512F/BW/CD/DQ/VL. A dispatch table replaces per‐call flag checks:
+    enum { SUM_SLOT, DOT_SLOT, SLOTS };
+    cpu_dispatch_init(&t, SLOTS);
+    cpu_dispatch_register(&t, SUM_SLOT, 1, NULL, (CpuDispatchFn)sum_sse2);
+    cpu_dispatch_register(&t, SUM_SLOT, 3, NULL, (CpuDispatchFn)sum_avx2);
+    cpu_dispatch_resolve(&t, NULL);              // NULL = this CPU
+    ((float (*)(const float*, int))t.fns[SUM_SLOT])(x, n);
+Per slot the runnable variant with the highest level wins, then the one
+needing the most extra features (`need`, a CpuFeatures built with
+cpu_feature_add()).
+
+features is the packed form of algorithms plus AVX‐512 IFMA/VBMI/VBMI2/
+VNNI/BITALG/VPOPCNTDQ/BF16/FP16, AVX‐VNNI, AVX‐IFMA, AVX‐VNNI‐INT8,
+AVX‐NE‐CONVERT, AMX, VAES, VPCLMULQDQ and GFNI (CPUID leaf 7 subleaves 0
+and 1). Test a kernel's needs with cpu_features_cover(&have, &need).
+AVX‐class bits (AVX, AVX2, FMA, F16C, VAES, ...) are only set when
+OSXSAVE is on and XCR0 shows the OS saves YMM state; AVX‐512 also needs
+the opmask/ZMM state and AMX the tile state, so a set bit is safe to
+execute. Linux additionally requires arch_prctl(ARCH_REQ_XCOMP_PERM)
+before the first AMX instruction.
+Resolve once at start‐up; fns[] is then read‐only and safe to share.
+
+Feature bits come from CPUID on every vendor; only SSE4A, XOP, FMA4 and
+3DNow!+ (AMD‐defined bits of leaf 0x80000001) require an AMD or Hygon
+vendor string. set_cpuid_hook() replays recorded CPUID dumps through the
+same detector (see test/cpuid_regression_test.c); install it before
+probing, it is not synchronised with concurrent get_cpu_data calls.
+
+set_cpu_probe_hook(hook, ctx) reports what each get_cpu_data_ex call
+(including get_cpu_data and the first get_cpu_data_cached) cost, per
+CPU_PHASE_*: wall time, files opened (sysfs, /proc, registry keys),
+bytes read, system calls for those files and heap allocations. The hook
+runs on the probing thread after the call, with stats valid only for its
+duration. Like set_cpuid_hook(), install or clear it before probing
+starts: hook and ctx are two plain variables, not synchronised with
+get_cpu_data_ex calls already running on other threads (a cpu_watcher's
+re‐probes included). Without a hook the probe does no timing or
+counting beyond one thread‐local pointer test per phase and file and a
+thread‐local increment per allocation. CPU_PHASE_CPUID_TOPOLOGY is the
+per‐CPU pinning pass of CPU_PROBE_CPUID or the AUTO fallback;
+get_nprocs()'s own sysfs reads are not counted.
+
+set_cpu_sysfs_root("/path/to/tree") makes the Linux probes read every
+/sys and /proc file under that directory instead, with the logical CPU
+count taken from its sys/devices/system/cpu/online. Together with
+set_cpuid_hook() a recorded machine replays anywhere; test/probe_bench.c
+generates trees from 1 to 512 CPUs (hybrid, multi‐CCD, multi‐socket) and
+checks that per‐phase opens, system calls and allocations stay within
+their scaling bounds. Affinity, pinning and the perf / MSR counters still
+use the live machine; Windows returns 202 for any root.
+
+Logical CPU indices are flat across Windows processor groups: group g
+starts after the active processors of groups 0..g-1, so cores, caches,
+NUMA nodes and pin_current_thread() agree on machines with more than 64
+logical processors. Linux masks are sized at run time, not CPU_SETSIZE.
+A Windows thread runs in one group at a time, so pin_current_thread_set()
+applies only the group of the lowest CPU in the set.
+
+Topology/cache fallback order (set_cpu_probe_mode):
+  CPU_PROBE_AUTO   sysfs (Linux) or GetLogicalProcessorInformationEx
+                   (Windows) first; whatever that cannot provide, e.g. no
+                   /sys in a container, is rebuilt from CPUID
+  CPU_PROBE_CPUID  CPUID leaves 0x1F/0xB (x2APIC topology) plus leaf 4
+                   (Intel) or 0x8000001D (AMD) for caches; pins to each
+                   CPU once, no file I/O.  Falls back to the OS source on
+                   CPUs without these leaves
+  CPU_PROBE_OS     sysfs / Windows API only, never CPUID
+
+CPU_FIELD_MEMORY fills memory: MemTotal / MemAvailable (GlobalMemoryStatusEx
+on Windows), the base page size and every huge page size the kernel
+offers under /sys/kernel/mm/hugepages, with pool, free, reserved and
+surplus counts and, per NUMA node, pool and free. node_ids[i] is the node
+of node_total[i] / node_free[i], in the same order as numa_nodes[]. A
+pool's free count includes its reserved pages; free - reserved is what a
+new mapping can take. thp_mode / thp_defrag are the bracketed choices of
+/sys/kernel/mm/transparent_hugepage. Windows has no standing pool: the
+sizes are GetLargePageMinimum() and, with VirtualAlloc2 and CPUID pdpe1gb,
+1 GiB, with zero counts, and large_page_privilege tells whether the token
+holds SeLockMemoryPrivilege (enable it with AdjustTokenPrivileges before
+MEM_LARGE_PAGES allocations).
+
+get_gpu_data() lists display‐class PCI devices from /sys/class/drm
+(Linux) or DXGI (Windows, software adapters skipped), then fills what
+the OS lacks from NVML and ROCm‐SMI when those libraries load (dlopen /
+LoadLibrary, nothing is linked). amdgpu sysfs gives VRAM, GTT and the
+pp_dpm clock tables, the KFD topology its compute units; i915 / xe give
+clocks only. numa_node and cpus come from the PCI device's numa_node and
+local_cpulist, so they line up with CPU_DATA.numa_nodes[].id and logical
+CPU numbers; pick worker threads from cpus to keep host buffers local.
+pcie_gbps is the link the slot can sustain (the lower of the device's and
+its upstream port's maximum); pcie_gen / pcie_width are the live link,
+which GPUs drop to gen 1 when idle. DXGI has no bus address, clocks,
+link or NUMA data, so on Windows these are only filled for NVIDIA cards
+via NVML.
 
 
 0		Success — no errors
@@ -114,5 +1042,18 @@ Free the internal arrays (l1size, frequency, l2size) after use
 203		Memory allocation failure
 204–207	Windows-specific API failures
 208		Allocation failure for internal arrays
+209		CPUID topology leaves (0xB/0x1F) not available
+210		Topology not probed (CPU_FIELD_TOPOLOGY missing)
+211		Setting thread affinity failed
+212		Reading thread affinity failed
+213		A dispatch slot has no variant this CPU can run
+214		Benchmark threads could not be started
+215		Caches not probed (CPU_FIELD_CACHES missing)
+216		Data is an attached read‐only snapshot
+217		No snapshot published under that name
+218		Snapshot is still being written
+219		Snapshot from an incompatible version or layout
+220		Creating or mapping the shared segment failed
+221		GPU enumeration API (DXGI) could not be created
 
 */
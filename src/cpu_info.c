@@ -4,24 +4,88 @@
  * instruction‐set extensions on Windows and Linux.
  */
 
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE			/* sched_setaffinity, CPU_SET */
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
 
 #if defined(_WIN32)
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <immintrin.h>       /* for __cpuidex */
+#include <intrin.h>          /* for __rdtsc */
 #include <processthreadsapi.h>
+#include <powrprof.h>        /* CallNtPowerInformation */
+#if defined(_MSC_VER)
+#pragma comment(lib, "PowrProf.lib")
+#endif
+#define DLL_EXPORT __declspec(dllexport)
+
+/* Not in the SDK headers; layout from the CallNtPowerInformation docs */
+typedef struct {
+	ULONG Number;
+	ULONG MaxMhz;
+	ULONG CurrentMhz;
+	ULONG MhzLimit;
+	ULONG MaxIdleState;
+	ULONG CurrentIdleState;
+} processor_power_info;
 #else
 #include <unistd.h>
 #include <sched.h>
+#include <pthread.h>
 #include <sys/sysinfo.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 #include <ctype.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <dirent.h>
+#define DLL_EXPORT
+#endif
+
+#if defined(_MSC_VER)
+#define PROBE_TLS __declspec(thread)
+#else
+#define PROBE_TLS __thread
 #endif
 
+/*
+ * Every heap call in this file goes through a per‐thread counter, so the
+ * probe stats can report allocations per phase (see phase_end).
+ */
+static PROBE_TLS unsigned int probe_allocs;
+
+static void* counted_malloc(size_t size) {
+	probe_allocs++;
+	return malloc(size);
+}
+
+static void* counted_calloc(size_t count, size_t size) {
+	probe_allocs++;
+	return calloc(count, size);
+}
+
+static void* counted_realloc(void* p, size_t size) {
+	probe_allocs++;
+	return realloc(p, size);
+}
+
+#define malloc(size)		counted_malloc(size)
+#define calloc(count, size)	counted_calloc(count, size)
+#define realloc(p, size)	counted_realloc(p, size)
+
 /* L2 cache descriptor */
 typedef struct {
 	int l2cache_size; 				/* KiB */
@@ -41,6 +105,8 @@ typedef struct {
 	CoreType  type;			/* performance vs. efficiency */
 	int* logical_ids;		/* array of logical‐core indices */
 	int logical_count;		/* length of logical_ids */
+	int package;			/* physical package (socket) */
+	int numa_node;			/* index into numa_nodes, -1 if unknown */
 } PhysicalCoreInfo;
 
 /* Instruction‐set flags, split by vendor relevance */
@@ -53,7 +119,7 @@ typedef struct {
 	char SSE4_1;
 	char SSE4_2;
 	char AVX;
-	/* Intel‐only */
+	/* leaf 1 / leaf 7 extras, reported on every vendor */
 	char POPCNT;
 	char PCLMULQDQ;
 	char AES;
@@ -77,33 +143,427 @@ typedef struct {
 	char XOP;
 	char FMA4;
 	char THREEDNOW_PLUS;
+	/* x86‐64‐v2..v4 prerequisites */
+	char CX16;		/* CMPXCHG16B */
+	char LAHF_SAHF;	/* LAHF/SAHF in 64‐bit mode */
+	char LZCNT;		/* ABM on AMD */
+	char MOVBE;
+	char AVX512CD;
+	char AVX512BW;
+	char AVX512DQ;
+	char AVX512VL;
 } CPU_Algorithms;
 
+/* Bit positions in CpuFeatures; CPU_Algorithms mirrors the first 36 */
+typedef enum {
+	CPU_FEAT_SSE, CPU_FEAT_SSE2, CPU_FEAT_SSE3, CPU_FEAT_SSSE3,
+	CPU_FEAT_SSE4_1, CPU_FEAT_SSE4_2, CPU_FEAT_AVX, CPU_FEAT_POPCNT,
+	CPU_FEAT_PCLMULQDQ, CPU_FEAT_AES, CPU_FEAT_FMA, CPU_FEAT_F16C,
+	CPU_FEAT_XSAVE, CPU_FEAT_OSXSAVE, CPU_FEAT_RDRAND, CPU_FEAT_RDSEED,
+	CPU_FEAT_ADX, CPU_FEAT_MPX, CPU_FEAT_PREFETCHWT1, CPU_FEAT_AVX2,
+	CPU_FEAT_BMI1, CPU_FEAT_BMI2, CPU_FEAT_AVX512F, CPU_FEAT_SHA,
+	CPU_FEAT_SSE4A, CPU_FEAT_XOP, CPU_FEAT_FMA4, CPU_FEAT_THREEDNOW_PLUS,
+	CPU_FEAT_CX16, CPU_FEAT_LAHF_SAHF, CPU_FEAT_LZCNT, CPU_FEAT_MOVBE,
+	CPU_FEAT_AVX512CD, CPU_FEAT_AVX512BW, CPU_FEAT_AVX512DQ, CPU_FEAT_AVX512VL,
+	/* only in CpuFeatures */
+	CPU_FEAT_AVX512_IFMA, CPU_FEAT_AVX512_VBMI, CPU_FEAT_AVX512_VBMI2, CPU_FEAT_AVX512_VNNI,
+	CPU_FEAT_AVX512_BITALG, CPU_FEAT_AVX512_VPOPCNTDQ, CPU_FEAT_AVX512_BF16, CPU_FEAT_AVX512_FP16,
+	CPU_FEAT_AVX_VNNI, CPU_FEAT_AVX_IFMA, CPU_FEAT_AVX_VNNI_INT8, CPU_FEAT_AVX_NE_CONVERT,
+	CPU_FEAT_AMX_TILE, CPU_FEAT_AMX_INT8, CPU_FEAT_AMX_BF16, CPU_FEAT_AMX_FP16,
+	CPU_FEAT_VAES, CPU_FEAT_VPCLMULQDQ, CPU_FEAT_GFNI,
+	CPU_FEAT_COUNT				/* <= 128 */
+} CpuFeature;
+
+/* Packed feature bitset; bit CPU_FEAT_x of bits[x / 64] */
+typedef struct {
+	uint64_t bits[2];
+} CpuFeatures;
+
+/* Cache kind as reported by sysfs / Windows / CPUID */
+typedef enum {
+	CACHE_TYPE_DATA,
+	CACHE_TYPE_INSTRUCTION,
+	CACHE_TYPE_UNIFIED
+} CacheType;
+
+/* One physical cache instance and the logical CPUs behind it */
+typedef struct {
+	int level;				/* 1, 2, 3 (4 on some parts) */
+	CacheType type;
+	int size_kb;			/* KiB */
+	int line_size;			/* bytes */
+	int associativity;		/* ways, 0 = fully associative / unknown */
+	int sets;				/* 0 if unknown */
+	int inclusive;			/* of the levels below: 1 yes, 0 no, -1 unknown */
+	int* cpus;				/* logical CPUs sharing it */
+	int cpu_count;			/* length of cpus */
+} CacheDomain;
+
+/* Per‐logical indices into CPU_DATA.caches, -1 where there is none */
+typedef struct {
+	int l1d;
+	int l1i;
+	int l2;
+	int l3;
+} CacheDomainIndex;
+
+/* One TLB for one page size */
+typedef struct {
+	int level;				/* 1 = L1 DTLB/ITLB, 2 = STLB */
+	CacheType type;			/* data / instruction / unified */
+	int page_size_kb;		/* 4, 2048, 4096 or 1048576 */
+	int entries;
+	int associativity;		/* ways, 0 = fully associative */
+} TlbInfo;
+
+/* One NUMA memory node */
+typedef struct {
+	int id;						/* OS node number */
+	int* cpus;					/* logical CPUs local to the node */
+	int cpu_count;				/* length of cpus */
+	uint64_t mem_total_bytes;	/* local memory, 0 if unknown */
+	uint64_t mem_free_bytes;	/* free local memory */
+} NumaNode;
+
+/* CPUs this process may use, versus the host's logical CPUs */
+typedef struct {
+	int host_cpus;				/* online logical CPUs on the machine */
+	int affinity_cpus;			/* CPUs in the affinity mask */
+	int cpuset_cpus;			/* CPUs in the cgroup cpuset, 0 if none */
+	double quota_cpus;			/* CFS quota / period, 0 if unlimited */
+	double job_cpus;			/* Windows job CPU rate cap, 0 if unlimited */
+	int recommended_parallelism;	/* tightest of the above, >= 1 */
+} CpuBudget;
+
+/* Where one logical CPU sits; -1 for groups that were not probed */
+typedef struct {
+	int cpu;					/* logical CPU index */
+	int core;					/* index into cores */
+	int smt;					/* position in cores[core].logical_ids */
+	int package;				/* cores[core].package */
+	int l2;						/* index into caches */
+	int l3;
+	int numa_node;				/* index into numa_nodes */
+} CpuLocation;
+
+/* One huge page size and its pool */
+typedef struct {
+	uint64_t size_bytes;		/* 2 MiB, 1 GiB, ... */
+	uint64_t total;				/* pages in the pool (nr_hugepages) */
+	uint64_t free;				/* pages not mapped by anyone */
+	uint64_t reserved;			/* free pages already promised to mappings */
+	uint64_t surplus;			/* pages above total from overcommit */
+	uint64_t* node_total;		/* per MemoryInfo.node_ids entry, NULL without NUMA */
+	uint64_t* node_free;
+} HugePagePool;
+
+/* Transparent huge page policy (/sys/kernel/mm/transparent_hugepage/enabled) */
+typedef enum {
+	CPU_THP_UNKNOWN,			/* not Linux, or THP compiled out */
+	CPU_THP_NEVER,
+	CPU_THP_MADVISE,			/* only MADV_HUGEPAGE regions */
+	CPU_THP_ALWAYS
+} ThpMode;
+
+#define CPU_MAX_HUGEPAGE_SIZES 4
+
+/* What the memory side offers an allocator */
+typedef struct {
+	uint64_t total_bytes;		/* installed RAM the OS manages */
+	uint64_t available_bytes;	/* allocatable without swapping (MemAvailable) */
+	uint64_t page_size;			/* base page */
+	uint64_t large_page_minimum;	/* default huge page / GetLargePageMinimum, 0 if none */
+	HugePagePool hugepages[CPU_MAX_HUGEPAGE_SIZES];	/* ascending size */
+	int hugepage_size_count;	/* entries used in hugepages */
+	int* node_ids;				/* NUMA node ids behind node_total / node_free */
+	int node_count;				/* length of node_ids */
+	ThpMode thp_mode;
+	char thp_defrag[16];		/* always, defer, defer+madvise, madvise, never */
+	uint64_t thp_pmd_bytes;		/* THP size (hpage_pmd_size) */
+	int large_page_privilege;	/* Windows SeLockMemoryPrivilege: 0 no, 1 held, 2 enabled; -1 elsewhere */
+} MemoryInfo;
+
+/* Per‐logical clock limits and boost preference */
+typedef struct {
+	int min_mhz;				/* lowest hardware clock, 0 if unknown */
+	int max_mhz;				/* highest boost clock of this CPU */
+	int base_mhz;				/* guaranteed (nominal) clock */
+	int scaling_max_mhz;		/* OS cap on the clock, 0 if none known */
+	int highest_perf;			/* ACPI CPPC highest_perf, 0 if unknown */
+	int boost_rank;				/* 0 = most preferred for single‐thread boost */
+} CpuFrequencyLimits;
+
+/* frequency_warnings bits */
+#define CPU_FREQ_WARN_POWERSAVE		0x01u	/* powersave governor / power saver scheme */
+#define CPU_FREQ_WARN_EPP_ENERGY	0x02u	/* EPP leans to energy, not "performance" */
+#define CPU_FREQ_WARN_MIXED_POLICY	0x04u	/* CPUs disagree on governor or EPP */
+#define CPU_FREQ_WARN_BOOST_OFF		0x08u	/* turbo / boost disabled */
+#define CPU_FREQ_WARN_CAPPED		0x10u	/* OS max clock below the hardware max */
+
+/* Where tsc.frequency_hz came from */
+typedef enum {
+	CPU_TSC_UNKNOWN = 0,		/* no usable TSC */
+	CPU_TSC_CPUID,				/* leaf 0x15 crystal * ratio */
+	CPU_TSC_HYPERVISOR,			/* hypervisor leaf 0x40000010 */
+	CPU_TSC_CALIBRATED			/* measured against the monotonic clock */
+} CpuTscSource;
+
+/* Time‐stamp counter rate and a division‐free cycles‐to‐ns scale */
+typedef struct {
+	int invariant;				/* CPUID 0x80000007 EDX[8]: constant rate in every P/C‐state */
+	int has_rdtscp;				/* CPUID 0x80000001 EDX[27] */
+	uint32_t ratio_numerator;	/* leaf 0x15 EBX: TSC = crystal * numerator / denominator */
+	uint32_t ratio_denominator;	/* leaf 0x15 EAX, 0 if the leaf is absent */
+	uint64_t crystal_hz;		/* leaf 0x15 ECX, or derived from leaf 0x16 */
+	uint64_t frequency_hz;		/* TSC ticks per second, 0 if unknown */
+	CpuTscSource source;
+	uint32_t ns_mult;			/* ns = cycles * ns_mult >> ns_shift */
+	uint32_t ns_shift;
+} CpuTscInfo;
+
 /* Aggregate CPU data */
 typedef struct {
 	char* cpu_name;				/* brand string */
-	int logical_core_count;		/* total logical CPUs */
+	int logical_core_count;		/* one past the highest online logical CPU */
 	int physical_core_count;	/* total physical cores */
 	PhysicalCoreInfo* cores;	/* length = physical_core_count */
+	int performance_core_count;	/* physical cores of CORE_TYPE_PERFORMANCE */
+	int efficiency_core_count;	/* physical cores of CORE_TYPE_EFFICIENCY */
 	int* l1size;				/* per‐logical L1 cache (KiB) */
 	l2cache* l2size;			/* per‐logical L2 cache info */
 	int* frequency;				/* per‐logical current MHz */
-	int l3size;					/* shared L3 cache (KiB) */
+	int* effective_frequency;	/* per‐logical busy MHz (APERF/MPERF) */
+	CpuFrequencyLimits* frequency_limits;	/* per‐logical clock limits */
+	int base_mhz;				/* CPUID 0x16 base clock, 0 if the leaf is absent */
+	int max_mhz;				/* CPUID 0x16 maximum clock */
+	int bus_mhz;				/* CPUID 0x16 bus (reference) clock */
+	char scaling_driver[24];	/* intel_pstate, amd‐pstate‐epp, acpi‐cpufreq, ... */
+	char scaling_governor[24];	/* governor of CPU 0, or the Windows power scheme */
+	char energy_perf_preference[24];	/* EPP of CPU 0, "" if not exposed */
+	unsigned int frequency_warnings;	/* CPU_FREQ_WARN_* */
+	CpuTscInfo tsc;				/* invariant flag, leaf 0x15 ratio and TSC rate */
+	int l3size;					/* L3 slice of logical CPU 0 (KiB) */
+	CacheDomain* caches;		/* every cache instance, all levels */
+	int cache_count;			/* length of caches */
+	CacheDomainIndex* cache_of;	/* per‐logical indices into caches */
+	CpuLocation* cpu_location;	/* per‐logical reverse index, built when packing */
+	TlbInfo* tlbs;				/* TLBs of the probing CPU, one entry per page size */
+	int tlb_count;				/* length of tlbs */
+	int prefetch_bytes;			/* hardware prefetch granularity */
+	int false_sharing_bytes;	/* padding that keeps per‐thread data apart */
+	NumaNode* numa_nodes;		/* memory nodes */
+	int numa_node_count;		/* length of numa_nodes */
+	int* numa_distance;			/* count x count, row‐major, 10 = local */
+	CpuBudget budget;			/* usable CPUs under affinity / cgroup / job limits */
+	MemoryInfo memory;			/* RAM, page sizes, huge page pools, THP */
 	CPU_Algorithms algorithms;	/* instruction‐set flags */
+	CpuFeatures features;		/* same plus newer extensions, OS‐enabled only */
+	int isa_level;				/* x86‐64 microarchitecture level 1‐4, 0 if below v1 */
+	unsigned int fields;		/* CPU_FIELD_* groups that were filled */
+	void* arena;				/* single allocation behind all pointers */
+	size_t arena_size;			/* bytes in arena */
+	int arena_shared;			/* arena is an attached read‐only snapshot, see attach_cpu_data */
 } CPU_DATA;
 
-/* Inline CPUID wrapper */
-static inline void cpu_cpuid(int leaf, int subleaf, int regs[4]) {
+/* Field groups for get_cpu_data_ex */
+#define CPU_FIELD_BRAND			0x01u	/* cpu_name */
+#define CPU_FIELD_ALGORITHMS	0x02u	/* algorithms (CPUID only) */
+#define CPU_FIELD_TOPOLOGY		0x04u	/* cores, physical_core_count */
+#define CPU_FIELD_CACHES		0x08u	/* l1size, l2size, l3size, caches, cache_of, tlbs */
+#define CPU_FIELD_FREQUENCY		0x10u	/* frequency, effective_frequency, limits, governor */
+#define CPU_FIELD_NUMA			0x20u	/* numa_nodes, numa_distance */
+#define CPU_FIELD_BUDGET		0x40u	/* budget */
+#define CPU_FIELD_MEMORY		0x80u	/* memory */
+#define CPU_FIELD_ALL			0xFFu
+
+/* Thread placement policies for plan_thread_placement */
+typedef enum {
+	CPU_PLACE_PHYSICAL_FIRST,
+	CPU_PLACE_PACK_CACHE,
+	CPU_PLACE_SPREAD_PACKAGES,
+	CPU_PLACE_PERFORMANCE_ONLY,
+	CPU_PLACE_BOOST_FIRST
+} PlacementPolicy;
+
+/* Source selection for topology and caches */
+typedef enum {
+	CPU_PROBE_AUTO,		/* OS first, CPUID fallback */
+	CPU_PROBE_CPUID,	/* CPUID first, OS fallback */
+	CPU_PROBE_OS		/* OS only */
+} CpuProbeMode;
+
+/* Sampler channels for cpu_sampler_create_ex */
+#define CPU_SAMPLE_FREQUENCY	0x01u	/* mhz */
+#define CPU_SAMPLE_THROTTLE		0x02u	/* thermal / power‐limit event counters */
+#define CPU_SAMPLE_TEMPERATURE	0x04u	/* core and package temperatures */
+#define CPU_SAMPLE_ENERGY		0x08u	/* RAPL energy counters */
+#define CPU_SAMPLE_ALL			0x0Fu
+
+#define CPU_TEMP_UNKNOWN		(-274000)	/* below absolute zero */
+
+/* One timestamped sampler reading; arrays of channels not sampled are NULL */
+typedef struct {
+	uint64_t timestamp_ns;		/* monotonic clock */
+	int* mhz;					/* per‐logical current MHz */
+	uint64_t* core_throttle;	/* per‐logical thermal throttle events (running count) */
+	uint64_t* core_power_limit;	/* per‐logical power‐limit notifications */
+	uint64_t* package_throttle;	/* per‐package thermal throttle events */
+	uint64_t* package_power_limit;	/* per‐package PL1/PL2 limit notifications */
+	int* core_temp_mc;			/* per‐logical millidegrees C, CPU_TEMP_UNKNOWN */
+	int* package_temp_mc;		/* per‐package millidegrees C */
+	uint64_t* energy_uj;		/* per RAPL zone, microjoules, wraps */
+} CPU_SAMPLE;
+
+typedef struct CPU_SAMPLER CPU_SAMPLER;
+
+/* Background watcher keeping a snapshot current across hotplug and policy changes */
+typedef struct CPU_WATCHER CPU_WATCHER;
+
+/* Called with the CPU_FIELD_* groups re‐probed, on the watcher thread or in cpu_watcher_refresh */
+typedef void (*CpuChangeFn)(void* ctx, unsigned int changed_fields, uint64_t generation);
+
+/* Work‐stealing pool pinned along a placement plan */
+typedef struct CPU_POOL CPU_POOL;
+
+/* A pool task; runs on one worker thread */
+typedef void (*CpuTaskFn)(void* arg);
+
+/* cpu_pool_submit flags */
+#define CPU_TASK_LATENCY	0x01u	/* run on a P‐core worker when one is free */
+
+/* Generic entry in a dispatch table; cast to the real signature to call */
+typedef void (*CpuDispatchFn)(void);
+
+/* Runtime dispatch table: fns[slot] is the best registered variant */
+typedef struct {
+	CpuDispatchFn* fns;			/* resolved entry per slot, NULL if none fits */
+	int slot_count;				/* length of fns */
+	int isa_level;				/* level the table was resolved for */
+	void* variants;				/* registrations, internal */
+	int variant_count;
+	int variant_capacity;
+} CPU_DISPATCH;
+
+/* Replacement CPUID / XGETBV source, e.g. a recorded dump in tests */
+typedef struct {
+	void (*cpuid)(void* ctx, int leaf, int subleaf, int regs[4]);
+	uint64_t (*xgetbv)(void* ctx, unsigned int index);
+	void* ctx;
+} CpuidHook;
+
+/* Dynamically sized set of logical CPU indices */
+typedef struct {
+	int cpu_capacity;			/* bits allocated, a multiple of 64 */
+	uint64_t* bits;				/* cpu_capacity / 64 words */
+} CpuSet;
+
+/* Targets of run_memory_benchmark: each cache level, then DRAM */
+typedef enum {
+	CPU_BENCH_L1,
+	CPU_BENCH_L2,
+	CPU_BENCH_L3,
+	CPU_BENCH_DRAM,
+	CPU_BENCH_LEVELS
+} MemBenchLevel;
+
+/* Latency and bandwidth of one working set; bandwidths in GB/s (1e9 bytes) */
+typedef struct {
+	size_t working_set_bytes;	/* single‐thread working set, 0 if level absent */
+	double latency_ns;			/* dependent load, random line order */
+	double read_gbps;			/* one thread */
+	double write_gbps;
+	double copy_gbps;			/* bytes read + bytes written */
+	double read_gbps_all;		/* threads_used threads together */
+	double write_gbps_all;
+	double copy_gbps_all;
+} MemBenchLevelResult;
+
+/* Memory hierarchy results, filled by run_memory_benchmark */
+typedef struct {
+	MemBenchLevelResult level[CPU_BENCH_LEVELS];
+	int threads_used;			/* threads in the *_all columns, 0 without topology */
+	int duration_ms;			/* length of each measurement */
+} MEM_BENCH;
+
+/* One‐way cache‐line transfer latency between every pair of logical CPUs */
+typedef struct {
+	int cpu_count;				/* L, the row length */
+	double* latency_ns;			/* L x L row‐major; 0 on the diagonal, -1 not measured */
+	int* group_of;				/* per‐logical low‐latency group */
+	int group_count;
+	double threshold_ns;		/* grouping cut that produced group_of */
+} CORE_LATENCY;
+
+/* get_cpu_data_ex phases reported to the probe hook */
+typedef enum {
+	CPU_PHASE_BRAND,			/* CPUID brand string */
+	CPU_PHASE_SETUP,			/* logical CPU count, per‐CPU arrays */
+	CPU_PHASE_FREQUENCY,		/* scaling_cur_freq / CallNtPowerInformation */
+	CPU_PHASE_ALGORITHMS,		/* CPUID / XGETBV feature flags */
+	CPU_PHASE_CACHES,			/* sysfs cache tree or CACHE_RELATIONSHIP, TLBs */
+	CPU_PHASE_TOPOLOGY,			/* cores, packages, core types */
+	CPU_PHASE_CPUID_TOPOLOGY,	/* CPUID topology / cache leaves on each CPU */
+	CPU_PHASE_NUMA,				/* memory nodes */
+	CPU_PHASE_BUDGET,			/* affinity, cgroup and job limits */
+	CPU_PHASE_PACK,				/* copy into the result arena */
+	CPU_PHASE_MEMORY,			/* meminfo, huge page pools, THP */
+	CPU_PHASE_COUNT
+} CpuProbePhase;
+
+/* Cost of one phase within a single get_cpu_data_ex call */
+typedef struct {
+	uint64_t wall_ns;			/* elapsed, monotonic clock */
+	unsigned int files_opened;	/* files, directories and registry keys */
+	uint64_t bytes_read;
+	unsigned int syscalls;		/* opens, reads and closes (registry: open, query, close) */
+	unsigned int allocations;	/* malloc / calloc / realloc calls */
+	unsigned int runs;			/* times entered, 0 if skipped */
+} CpuPhaseStats;
+
+/* Everything one get_cpu_data_ex call cost, passed to the probe hook */
+typedef struct {
+	CpuPhaseStats phase[CPU_PHASE_COUNT];
+	uint64_t total_ns;			/* whole call */
+	unsigned int fields;		/* CPU_FIELD_* requested */
+	int result;					/* the call's return code */
+} CPU_PROBE_STATS;
+
+/* Called on the probing thread once per get_cpu_data_ex call */
+typedef void (*CpuProbeHook)(void* ctx, const CPU_PROBE_STATS* stats);
+
+/* Installed by set_cpuid_hook(); NULL means the real instruction */
+static const CpuidHook* cpuid_hook;
+static CpuidHook cpuid_hook_copy;
+
+DLL_EXPORT void set_cpuid_hook(const CpuidHook* hook) {
+	if (hook) {
+		cpuid_hook_copy = *hook;
+	}
+	cpuid_hook = hook ? &cpuid_hook_copy : NULL;
+}
+
+/* The CPUID instruction itself, for decisions a hook must not fake */
+static inline void hw_cpuid(int leaf, int subleaf, int regs[4]) {
 #if defined(_MSC_VER)
 	__cpuidex(regs, leaf, subleaf);
 #elif defined(__i386__) || defined(__x86_64__)
 	unsigned int a = (unsigned int)leaf, c = (unsigned int)subleaf;
 	__asm__ volatile( "cpuid" : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3]) : "a"(a), "c"(c) );
 #else
+	(void)leaf; (void)subleaf;
 	regs[0] = regs[1] = regs[2] = regs[3] = 0;
 #endif
 }
 
+/* Inline CPUID wrapper */
+static inline void cpu_cpuid(int leaf, int subleaf, int regs[4]) {
+	if (cpuid_hook && cpuid_hook->cpuid) {
+		cpuid_hook->cpuid(cpuid_hook->ctx, leaf, subleaf, regs);
+		return;
+	}
+	hw_cpuid(leaf, subleaf, regs);
+}
+
 /* Read the CPU brand string (leaves 0x80000002..4) */
 static int get_cpu_brand(char** out_name) {
 	char* brand = malloc(49);
@@ -134,447 +594,6749 @@ static void get_cpu_vendor(char vendor[13]) {
 	vendor[12] = '\0';
 }
 
-/* Populate instruction‐set flags, gating AMD/Intel extras by vendor */
-static void get_supported_algorithms(CPU_Algorithms* alg) {
-	int regs[4];
+static inline void feature_set(CpuFeatures* f, CpuFeature id, int on) {
+	if (on) {
+		f->bits[id >> 6] |= 1ull << (id & 63);
+	}
+}
+
+static inline int feature_has(const CpuFeatures* f, CpuFeature id) {
+	return (int)((f->bits[id >> 6] >> (id & 63)) & 1);
+}
+
+/* (have & need) == need over both words */
+static inline int features_cover(const CpuFeatures* have, const CpuFeatures* need) {
+	return ((have->bits[0] & need->bits[0]) == need->bits[0]) &
+		((have->bits[1] & need->bits[1]) == need->bits[1]);
+}
+
+/* XCR0: which register state the OS saves on context switch */
+static uint64_t cpu_xgetbv(unsigned int index) {
+	if (cpuid_hook) {
+		return cpuid_hook->xgetbv ? cpuid_hook->xgetbv(cpuid_hook->ctx, index) : 0;
+	}
+#if defined(_MSC_VER)
+	return _xgetbv(index);
+#elif defined(__i386__) || defined(__x86_64__)
+	unsigned int lo, hi;
+	__asm__ volatile( "xgetbv" : "=a"(lo), "=d"(hi) : "c"(index) );
+	return ((uint64_t)hi << 32) | lo;
+#else
+	(void)index;
+	return 0;
+#endif
+}
+
+#define XCR0_YMM	0x06ull			/* SSE + AVX state */
+#define XCR0_ZMM	0xE6ull			/* + opmask, ZMM_Hi256, Hi16_ZMM */
+#define XCR0_TILE	0x60000ull		/* XTILECFG + XTILEDATA */
+
+/*
+ * Feature bits from CPUID.  Register‐state extensions (AVX, AVX‐512, AMX)
+ * are only reported when OSXSAVE is set and XCR0 shows the OS saves that
+ * state; otherwise using them faults even though CPUID advertises them.
+ */
+static void detect_features(CpuFeatures* f) {
+	int regs[4], max_leaf, max_ext, sub7 = 0;
 	char vendor[13];
-	memset(alg, 0, sizeof(*alg));
+	memset(f, 0, sizeof(*f));
 
+	/* only the AMD‐defined 0x80000001 bits need a vendor check */
 	get_cpu_vendor(vendor);
-	int is_intel = (strcmp(vendor, "GenuineIntel") == 0);
-	int is_amd = (strcmp(vendor, "AuthenticAMD") == 0);
+	int is_amd = (strcmp(vendor, "AuthenticAMD") == 0 || strcmp(vendor, "HygonGenuine") == 0);
+
+	cpu_cpuid(0, 0, regs);
+	max_leaf = regs[0];
+	cpu_cpuid(0x80000000, 0, regs);
+	max_ext = regs[0];
 
-	/* leaf 1: common SSE/AVX + Intel‐common extras */
+	/* leaf 1: SSE family, CX16, MOVBE, POPCNT, AES, RDRAND, AVX/FMA/F16C */
 	cpu_cpuid(1, 0, regs);
-	alg->SSE = !!(regs[3] & (1 << 25));
-	alg->SSE2 = !!(regs[3] & (1 << 26));
-	alg->SSE3 = !!(regs[2] & (1 << 0));
-	alg->SSSE3 = !!(regs[2] & (1 << 9));
-	alg->SSE4_1 = !!(regs[2] & (1 << 19));
-	alg->SSE4_2 = !!(regs[2] & (1 << 20));
-	alg->AVX = !!(regs[2] & (1 << 28));
-
-	if (is_intel) {
-		alg->POPCNT = !!(regs[2] & (1 << 23));
-		alg->PCLMULQDQ = !!(regs[2] & (1 << 1));
-		alg->AES = !!(regs[2] & (1 << 25));
-		alg->FMA = !!(regs[2] & (1 << 12));
-		alg->F16C = !!(regs[2] & (1 << 29));
-		alg->XSAVE = !!(regs[2] & (1 << 26));
-		alg->OSXSAVE = !!(regs[2] & (1 << 27));
-		alg->RDRAND = !!(regs[2] & (1 << 30));
-	}
-
-	/* leaf 7 subleaf 0: AVX2, BMI, AVX‐512, SHA, plus Intel‐only */
-	cpu_cpuid(7, 0, regs);
-	alg->AVX2 = !!(regs[1] & (1 << 5));
-	alg->BMI1 = !!(regs[1] & (1 << 3));
-	alg->BMI2 = !!(regs[1] & (1 << 8));
-	alg->AVX512F = !!(regs[1] & (1 << 16));
-	alg->SHA = !!(regs[2] & (1 << 29));
+	int osxsave = !!(regs[2] & (1 << 27));
+	uint64_t xcr0 = osxsave ? cpu_xgetbv(0) : 0;
+	int ymm = (xcr0 & XCR0_YMM) == XCR0_YMM;
+	int zmm = (xcr0 & XCR0_ZMM) == XCR0_ZMM;
+	int tile = (xcr0 & XCR0_TILE) == XCR0_TILE;
+
+	feature_set(f, CPU_FEAT_SSE, regs[3] & (1 << 25));
+	feature_set(f, CPU_FEAT_SSE2, regs[3] & (1 << 26));
+	feature_set(f, CPU_FEAT_SSE3, regs[2] & (1 << 0));
+	feature_set(f, CPU_FEAT_SSSE3, regs[2] & (1 << 9));
+	feature_set(f, CPU_FEAT_SSE4_1, regs[2] & (1 << 19));
+	feature_set(f, CPU_FEAT_SSE4_2, regs[2] & (1 << 20));
+	feature_set(f, CPU_FEAT_CX16, regs[2] & (1 << 13));
+	feature_set(f, CPU_FEAT_MOVBE, regs[2] & (1 << 22));
+	feature_set(f, CPU_FEAT_POPCNT, regs[2] & (1 << 23));
+	feature_set(f, CPU_FEAT_OSXSAVE, osxsave);
+	feature_set(f, CPU_FEAT_AVX, ymm && (regs[2] & (1 << 28)));
+	feature_set(f, CPU_FEAT_FMA, ymm && (regs[2] & (1 << 12)));
+	feature_set(f, CPU_FEAT_F16C, ymm && (regs[2] & (1 << 29)));
+	feature_set(f, CPU_FEAT_PCLMULQDQ, regs[2] & (1 << 1));
+	feature_set(f, CPU_FEAT_AES, regs[2] & (1 << 25));
+	feature_set(f, CPU_FEAT_XSAVE, regs[2] & (1 << 26));
+	feature_set(f, CPU_FEAT_RDRAND, regs[2] & (1 << 30));
+
+	/* leaf 7 subleaf 0: AVX2, BMI, ADX, RDSEED, SHA, AVX‐512, VAES/GFNI, AMX */
+	if (max_leaf >= 7) {
+		cpu_cpuid(7, 0, regs);
+		sub7 = regs[0];
+		feature_set(f, CPU_FEAT_AVX2, ymm && (regs[1] & (1 << 5)));
+		feature_set(f, CPU_FEAT_BMI1, regs[1] & (1 << 3));
+		feature_set(f, CPU_FEAT_BMI2, regs[1] & (1 << 8));
+		feature_set(f, CPU_FEAT_RDSEED, regs[1] & (1 << 18));
+		feature_set(f, CPU_FEAT_ADX, regs[1] & (1 << 19));
+		feature_set(f, CPU_FEAT_SHA, regs[1] & (1 << 29));
+		feature_set(f, CPU_FEAT_MPX, regs[1] & (1 << 14));
+		feature_set(f, CPU_FEAT_PREFETCHWT1, regs[2] & (1 << 0));
+		feature_set(f, CPU_FEAT_GFNI, regs[2] & (1 << 8));
+		feature_set(f, CPU_FEAT_VAES, ymm && (regs[2] & (1 << 9)));
+		feature_set(f, CPU_FEAT_VPCLMULQDQ, ymm && (regs[2] & (1 << 10)));
 
-	if (is_intel) {
-		alg->RDSEED = !!(regs[1] & (1 << 18));
-		alg->ADX = !!(regs[1] & (1 << 19));
-		alg->MPX = !!(regs[1] & (1 << 14));
-		alg->PREFETCHWT1 = !!(regs[2] & (1 << 0));
+		feature_set(f, CPU_FEAT_AVX512F, zmm && (regs[1] & (1 << 16)));
+		feature_set(f, CPU_FEAT_AVX512DQ, zmm && (regs[1] & (1 << 17)));
+		feature_set(f, CPU_FEAT_AVX512_IFMA, zmm && (regs[1] & (1 << 21)));
+		feature_set(f, CPU_FEAT_AVX512CD, zmm && (regs[1] & (1 << 28)));
+		feature_set(f, CPU_FEAT_AVX512BW, zmm && (regs[1] & (1 << 30)));
+		feature_set(f, CPU_FEAT_AVX512VL, zmm && (regs[1] & (1U << 31)));
+		feature_set(f, CPU_FEAT_AVX512_VBMI, zmm && (regs[2] & (1 << 1)));
+		feature_set(f, CPU_FEAT_AVX512_VBMI2, zmm && (regs[2] & (1 << 6)));
+		feature_set(f, CPU_FEAT_AVX512_VNNI, zmm && (regs[2] & (1 << 11)));
+		feature_set(f, CPU_FEAT_AVX512_BITALG, zmm && (regs[2] & (1 << 12)));
+		feature_set(f, CPU_FEAT_AVX512_VPOPCNTDQ, zmm && (regs[2] & (1 << 14)));
+		feature_set(f, CPU_FEAT_AVX512_FP16, zmm && (regs[3] & (1 << 23)));
+
+		feature_set(f, CPU_FEAT_AMX_BF16, tile && (regs[3] & (1 << 22)));
+		feature_set(f, CPU_FEAT_AMX_TILE, tile && (regs[3] & (1 << 24)));
+		feature_set(f, CPU_FEAT_AMX_INT8, tile && (regs[3] & (1 << 25)));
 	}
 
-	/* AMD‐only leaf 0x80000001 */
-	if (is_amd) {
+	/* leaf 7 subleaf 1: AVX‐VNNI, AVX‐IFMA, BF16, AMX‐FP16 */
+	if (max_leaf >= 7 && sub7 >= 1) {
+		cpu_cpuid(7, 1, regs);
+		feature_set(f, CPU_FEAT_AVX_VNNI, ymm && (regs[0] & (1 << 4)));
+		feature_set(f, CPU_FEAT_AVX512_BF16, zmm && (regs[0] & (1 << 5)));
+		feature_set(f, CPU_FEAT_AMX_FP16, tile && (regs[0] & (1 << 21)));
+		feature_set(f, CPU_FEAT_AVX_IFMA, ymm && (regs[0] & (1 << 23)));
+		feature_set(f, CPU_FEAT_AVX_VNNI_INT8, ymm && (regs[3] & (1 << 4)));
+		feature_set(f, CPU_FEAT_AVX_NE_CONVERT, ymm && (regs[3] & (1 << 5)));
+	}
+
+	/* leaf 0x80000001: LAHF/SAHF and LZCNT on both vendors; the rest are AMD‐defined */
+	if ((unsigned int)max_ext >= 0x80000001u) {
 		cpu_cpuid(0x80000001, 0, regs);
-		alg->SSE4A = !!(regs[2] & (1 << 6));
-		alg->XOP = !!(regs[2] & (1 << 11));
-		alg->FMA4 = !!(regs[2] & (1 << 16));
-		alg->THREEDNOW_PLUS = !!(regs[3] & (1U << 31));
+		feature_set(f, CPU_FEAT_LAHF_SAHF, regs[2] & (1 << 0));
+		feature_set(f, CPU_FEAT_LZCNT, regs[2] & (1 << 5));
+		if (is_amd) {
+			feature_set(f, CPU_FEAT_SSE4A, regs[2] & (1 << 6));
+			feature_set(f, CPU_FEAT_XOP, ymm && (regs[2] & (1 << 11)));
+			feature_set(f, CPU_FEAT_FMA4, ymm && (regs[2] & (1 << 16)));
+			feature_set(f, CPU_FEAT_THREEDNOW_PLUS, regs[3] & (1U << 31));
+		}
 	}
 }
 
-#if defined(_WIN32)
-static int get_core_topology(CPU_DATA* data) {
-	DWORD len = 0;
-	BOOL ok;
+/* The char‐per‐flag view, mapped by name so neither layout depends on the other */
+static void algorithms_from_features(const CpuFeatures* f, CPU_Algorithms* alg) {
+#define ALG_FLAG(name) alg->name = (char)feature_has(f, CPU_FEAT_##name)
+	ALG_FLAG(SSE);
+	ALG_FLAG(SSE2);
+	ALG_FLAG(SSE3);
+	ALG_FLAG(SSSE3);
+	ALG_FLAG(SSE4_1);
+	ALG_FLAG(SSE4_2);
+	ALG_FLAG(AVX);
+	ALG_FLAG(POPCNT);
+	ALG_FLAG(PCLMULQDQ);
+	ALG_FLAG(AES);
+	ALG_FLAG(FMA);
+	ALG_FLAG(F16C);
+	ALG_FLAG(XSAVE);
+	ALG_FLAG(OSXSAVE);
+	ALG_FLAG(RDRAND);
+	ALG_FLAG(RDSEED);
+	ALG_FLAG(ADX);
+	ALG_FLAG(MPX);
+	ALG_FLAG(PREFETCHWT1);
+	ALG_FLAG(AVX2);
+	ALG_FLAG(BMI1);
+	ALG_FLAG(BMI2);
+	ALG_FLAG(AVX512F);
+	ALG_FLAG(SHA);
+	ALG_FLAG(SSE4A);
+	ALG_FLAG(XOP);
+	ALG_FLAG(FMA4);
+	ALG_FLAG(THREEDNOW_PLUS);
+	ALG_FLAG(CX16);
+	ALG_FLAG(LAHF_SAHF);
+	ALG_FLAG(LZCNT);
+	ALG_FLAG(MOVBE);
+	ALG_FLAG(AVX512CD);
+	ALG_FLAG(AVX512BW);
+	ALG_FLAG(AVX512DQ);
+	ALG_FLAG(AVX512VL);
+#undef ALG_FLAG
+}
 
-	ok = GetLogicalProcessorInformationEx(RelationProcessorCore, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)NULL, &len);
-	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
-		return 204;
-	}
+/*
+ * x86‐64 psABI microarchitecture levels, each a superset of the last:
+ *   v1  SSE, SSE2 (the x86‐64 baseline)
+ *   v2  + CX16, LAHF/SAHF, POPCNT, SSE3, SSSE3, SSE4.1, SSE4.2
+ *   v3  + AVX, AVX2, BMI1, BMI2, F16C, FMA, LZCNT, MOVBE, OSXSAVE
+ *   v4  + AVX512F, AVX512BW, AVX512CD, AVX512DQ, AVX512VL
+ * All of them live in bits[0].
+ */
+#define FEAT_BIT(id) (1ull << (id))
+static const uint64_t isa_level_mask[4] = {
+	FEAT_BIT(CPU_FEAT_SSE) | FEAT_BIT(CPU_FEAT_SSE2),
+	FEAT_BIT(CPU_FEAT_CX16) | FEAT_BIT(CPU_FEAT_LAHF_SAHF) | FEAT_BIT(CPU_FEAT_POPCNT) |
+		FEAT_BIT(CPU_FEAT_SSE3) | FEAT_BIT(CPU_FEAT_SSSE3) | FEAT_BIT(CPU_FEAT_SSE4_1) |
+		FEAT_BIT(CPU_FEAT_SSE4_2),
+	FEAT_BIT(CPU_FEAT_AVX) | FEAT_BIT(CPU_FEAT_AVX2) | FEAT_BIT(CPU_FEAT_BMI1) |
+		FEAT_BIT(CPU_FEAT_BMI2) | FEAT_BIT(CPU_FEAT_F16C) | FEAT_BIT(CPU_FEAT_FMA) |
+		FEAT_BIT(CPU_FEAT_LZCNT) | FEAT_BIT(CPU_FEAT_MOVBE) | FEAT_BIT(CPU_FEAT_OSXSAVE),
+	FEAT_BIT(CPU_FEAT_AVX512F) | FEAT_BIT(CPU_FEAT_AVX512BW) | FEAT_BIT(CPU_FEAT_AVX512CD) |
+		FEAT_BIT(CPU_FEAT_AVX512DQ) | FEAT_BIT(CPU_FEAT_AVX512VL)
+};
 
-	PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX buffer =
-		malloc(len);
-	if (!buffer) {
-		return 203;
+DLL_EXPORT int cpu_isa_level(const CpuFeatures* f) {
+	uint64_t need = 0;
+	int level = 0;
+	while (f && level < 4) {
+		need |= isa_level_mask[level];
+		if ((f->bits[0] & need) != need) {
+			break;
+		}
+		level++;
 	}
+	return level;
+}
 
-	ok = GetLogicalProcessorInformationEx(RelationProcessorCore, buffer, &len);
-	if (!ok) {
-		free(buffer);
-		return 205;
+static int feature_count(const CpuFeatures* f) {
+	int n = 0;
+	for (int w = 0; w < 2; ++w) {
+		for (uint64_t v = f->bits[w]; v; v &= v - 1) {
+			n++;
+		}
 	}
+	return n;
+}
 
-	char* ptr = (char*)buffer;
-	DWORD offset = 0, core_count = 0;
-	while (offset < len) {
-		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
-		core_count++;
-		offset += info->Size;
-		ptr += info->Size;
-	}
+/* One registered implementation of a dispatch slot */
+typedef struct {
+	int slot;
+	int min_level;
+	CpuFeatures need;
+	int need_count;
+	CpuDispatchFn fn;
+} dispatch_variant;
 
-	data->physical_core_count = (int)core_count;
-	data->cores = calloc(core_count, sizeof(*data->cores));
-	if (!data->cores) {
-		free(buffer);
+DLL_EXPORT int cpu_dispatch_init(CPU_DISPATCH* d, int slot_count) {
+	if (!d || slot_count <= 0) {
+		return 201;
+	}
+	memset(d, 0, sizeof(*d));
+	d->fns = calloc(slot_count, sizeof(CpuDispatchFn));
+	if (!d->fns) {
 		return 203;
 	}
+	d->slot_count = slot_count;
+	return 0;
+}
 
-	ptr = (char*)buffer;
-	offset = 0;
-	for (DWORD i = 0; i < core_count; ++i) {
-		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
-
-		data->cores[i].id = (int)i;
-		data->cores[i].type = CORE_TYPE_UNKNOWN;
-
-		KAFFINITY mask = info->Processor.GroupMask[0].Mask;
-		int count = 0;
-		for (int b = 0; b < 64; ++b) {
-			if (mask & (1ULL << b)) {
-				count++;
-			}
-		}
-
-		data->cores[i].logical_count = count;
-		data->cores[i].logical_ids = malloc(count * sizeof(int));
-
-		int idx = 0;
-		for (int b = 0; b < 64; ++b) {
-			if (mask & (1ULL << b)) {
-				data->cores[i].logical_ids[idx++] = b;
-			}
+/* Add a variant of `slot` needing x86‐64 level `min_level` plus `need` (may be NULL) */
+DLL_EXPORT int cpu_dispatch_register(CPU_DISPATCH* d, int slot, int min_level,
+	const CpuFeatures* need, CpuDispatchFn fn) {
+	if (!d || !fn || slot < 0 || slot >= d->slot_count) {
+		return 201;
+	}
+	if (d->variant_count == d->variant_capacity) {
+		int cap = d->variant_capacity ? d->variant_capacity * 2 : 8;
+		dispatch_variant* grown = realloc(d->variants, cap * sizeof(dispatch_variant));
+		if (!grown) {
+			return 203;
 		}
-
-		offset += info->Size;
-		ptr += info->Size;
+		d->variants = grown;
+		d->variant_capacity = cap;
+	}
+	dispatch_variant* v = &((dispatch_variant*)d->variants)[d->variant_count++];
+	memset(v, 0, sizeof(*v));
+	v->slot = slot;
+	v->min_level = min_level;
+	v->fn = fn;
+	if (need) {
+		v->need = *need;
+		v->need_count = feature_count(need);
 	}
-
-	free(buffer);
 	return 0;
 }
-#else
-static int get_core_topology(CPU_DATA* data) {
-	int L = data->logical_core_count;
-	int* keys = calloc(L, sizeof(int));
-	PhysicalCoreInfo* temp = calloc(L, sizeof(*temp));
-	if (!keys || !temp) return 203;
 
-	int unique = 0;
-	for (int cpu = 0; cpu < L; ++cpu) {
-		char path_phy[128], path_core[128], buf[32];
-		snprintf(path_phy, sizeof(path_phy), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
-		snprintf(path_core, sizeof(path_core), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+/*
+ * Pick, per slot, the runnable variant with the highest level, then the
+ * most required flags; ties keep the first registered.  `have` may be
+ * NULL to use this CPU.  Returns 213 if some slot has no runnable variant
+ * (its entry stays NULL), but fills every other slot.
+ */
+DLL_EXPORT int cpu_dispatch_resolve(CPU_DISPATCH* d, const CpuFeatures* have) {
+	if (!d || !d->fns) {
+		return 201;
+	}
+	CpuFeatures own;
+	if (!have) {
+		detect_features(&own);
+		have = &own;
+	}
+	d->isa_level = cpu_isa_level(have);
 
-		FILE* f = fopen(path_phy, "r");
-		int phy = 0;
-		if (f) {
-			fgets(buf, sizeof(buf), f);
-			phy = atoi(buf);
-			fclose(f);
+	int* best = malloc(d->slot_count * sizeof(int));
+	if (!best) {
+		return 203;
+	}
+	for (int i = 0; i < d->slot_count; ++i) {
+		best[i] = -1;
+		d->fns[i] = NULL;
+	}
+	const dispatch_variant* vs = d->variants;
+	for (int k = 0; k < d->variant_count; ++k) {
+		const dispatch_variant* v = &vs[k];
+		if (v->min_level > d->isa_level || !features_cover(have, &v->need)) {
+			continue;
 		}
-
-		f = fopen(path_core, "r");
-		int core = 0;
-		if (f) {
-			fgets(buf, sizeof(buf), f);
-			core = atoi(buf);
-			fclose(f);
+		int b = best[v->slot];
+		if (b < 0 || v->min_level > vs[b].min_level ||
+			(v->min_level == vs[b].min_level && v->need_count > vs[b].need_count)) {
+			best[v->slot] = k;
 		}
+	}
 
-		int key = (phy << 16) | (core & 0xFFFF);
-		int idx = 0;
-		while (idx < unique && keys[idx] != key) idx++;
-		if (idx == unique) {
-			keys[unique] = key;
-			temp[unique].id = key;
-			temp[unique].type = CORE_TYPE_UNKNOWN;
-			temp[unique].logical_count = 0;
-			unique++;
+	int rc = 0;
+	for (int i = 0; i < d->slot_count; ++i) {
+		if (best[i] < 0) {
+			rc = 213;
+		}
+		else {
+			d->fns[i] = vs[best[i]].fn;
 		}
-		temp[idx].logical_count++;
 	}
+	free(best);
+	return rc;
+}
 
-	data->physical_core_count = unique;
-	data->cores = calloc(unique, sizeof(*data->cores));
-	if (!data->cores) {
-		free(keys);
-		free(temp);
-		return 203;
+DLL_EXPORT void cpu_dispatch_free(CPU_DISPATCH* d) {
+	if (d) {
+		free(d->fns);
+		free(d->variants);
+		memset(d, 0, sizeof(*d));
 	}
+}
 
-	for (int i = 0; i < unique; ++i) {
-		data->cores[i] = temp[i];
-		data->cores[i].logical_ids =
-			malloc(temp[i].logical_count * sizeof(int));
-		data->cores[i].logical_count = 0;
-	}
+/*
+ * Assign each of n keys a dense group index (in order of first appearance)
+ * through an open‐addressed hash table.  group_of[i] receives the group of
+ * keys[i], group_key[g] the key of group g.  Returns the group count, or
+ * -1 on allocation failure.
+ */
+static int group_keys(const int* keys, int n, int* group_of, int* group_key) {
+	int cap = 16;
+	while (cap < 2 * n) cap <<= 1;
 
-	for (int cpu = 0; cpu < L; ++cpu) {
-		char path_phy[128], path_core[128], buf[32];
-		snprintf(path_phy, sizeof(path_phy), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
-		snprintf(path_core, sizeof(path_core), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+	int* slot_key = malloc(cap * sizeof(int));
+	int* slot_idx = malloc(cap * sizeof(int));
+	if (!slot_key || !slot_idx) {
+		free(slot_key); free(slot_idx);
+		return -1;
+	}
+	memset(slot_idx, -1, cap * sizeof(int));
 
-		FILE* f = fopen(path_phy, "r");
-		int phy = 0;
-		if (f) {
-			fgets(buf, sizeof(buf), f);
-			phy = atoi(buf);
-			fclose(f);
+	int unique = 0;
+	for (int i = 0; i < n; ++i) {
+		unsigned int h = (unsigned int)keys[i] * 2654435761u;
+		int s = (int)(h & (unsigned int)(cap - 1));
+		while (slot_idx[s] >= 0 && slot_key[s] != keys[i]) {
+			s = (s + 1) & (cap - 1);
 		}
-
-		f = fopen(path_core, "r");
-		int core = 0;
-		if (f) {
-			fgets(buf, sizeof(buf), f);
-			core = atoi(buf);
-			fclose(f);
+		if (slot_idx[s] < 0) {
+			slot_key[s] = keys[i];
+			slot_idx[s] = unique;
+			if (group_key) group_key[unique] = keys[i];
+			unique++;
 		}
-
-		int key = (phy << 16) | (core & 0xFFFF);
-		int idx = 0;
-		while (keys[idx] != key) idx++;
-
-		data->cores[idx].logical_ids[data->cores[idx].logical_count++] = cpu;
+		group_of[i] = slot_idx[s];
 	}
 
-	free(keys);
-	free(temp);
-	return 0;
+	free(slot_key); free(slot_idx);
+	return unique;
 }
-#endif
 
-#if defined(_WIN32)
 /*
- * Parse Windows cache relationships via
- * GetLogicalProcessorInformationEx(RelationCache, ...)
+ * Group logical CPUs into physical cores by a per‐logical key
+ * ((package << 16) | core), -1 for an offline CPU, which no core lists.
+ * O(L) thanks to group_keys().
  */
-static void populate_caches_and_freq(CPU_DATA* data) {
-	/* first, zero‐out arrays */
-	memset(data->l1size, 0, data->logical_core_count * sizeof(int));
-	for (int i = 0; i < data->logical_core_count; ++i) {
-		data->l2size[i].l2cache_size = 0;
-		data->l2size[i].shared_with_core_number = 0;
+static int build_cores_from_keys(CPU_DATA* data, const int* keys) {
+	int L = data->logical_core_count;
+	int* cpus = malloc((L ? L : 1) * sizeof(int));
+	int* packed = malloc((L ? L : 1) * sizeof(int));
+	int* core_of = malloc((L ? L : 1) * sizeof(int));
+	int* ids = malloc((L ? L : 1) * sizeof(int));
+	int* counts = calloc(L ? L : 1, sizeof(int));
+	int n = 0;
+	for (int cpu = 0; cpus && packed && cpu < L; ++cpu) {
+		if (keys[cpu] >= 0) {
+			cpus[n] = cpu;
+			packed[n++] = keys[cpu];
+		}
+	}
+	int unique = (cpus && packed && core_of && ids && counts) ? group_keys(packed, n, core_of, ids) : -1;
+	if (unique < 0) {
+		free(cpus); free(packed); free(core_of); free(ids); free(counts);
+		return 203;
+	}
+	for (int k = 0; k < n; ++k) {
+		counts[core_of[k]]++;
 	}
-	data->l3size = 0;
 
-	/* frequency via registry (~MHz) */
-	for (int cpu = 0; cpu < data->logical_core_count; ++cpu) {
-		char keypath[128];
-		HKEY hKey;
-		DWORD freq = 0, size = sizeof(freq);
-		snprintf(keypath, sizeof(keypath), "HARDWARE\\DESCRIPTION\\System\\CentralProcessor\\%d", cpu);
-		if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, keypath, 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-			RegQueryValueExA(hKey, "~MHz", NULL, NULL, (LPBYTE)&freq, &size);
-			RegCloseKey(hKey);
+	data->physical_core_count = unique;
+	data->cores = calloc(unique, sizeof(*data->cores));
+	int rc = data->cores ? 0 : 203;
+	for (int i = 0; i < unique && rc == 0; ++i) {
+		data->cores[i].id = ids[i];
+		data->cores[i].package = ids[i] >> 16;
+		data->cores[i].numa_node = -1;
+		data->cores[i].type = CORE_TYPE_UNKNOWN;
+		data->cores[i].logical_ids = malloc(counts[i] * sizeof(int));
+		if (!data->cores[i].logical_ids) {
+			rc = 203;
 		}
-		data->frequency[cpu] = (int)freq;
 	}
-
-	/* now caches */
+	if (rc == 0) {
+		for (int k = 0; k < n; ++k) {
+			PhysicalCoreInfo* pc = &data->cores[core_of[k]];
+			pc->logical_ids[pc->logical_count++] = cpus[k];
+		}
+	}
+	else if (data->cores) {
+		for (int i = 0; i < unique; ++i) {
+			free(data->cores[i].logical_ids);
+		}
+		free(data->cores);
+		data->cores = NULL;
+		data->physical_core_count = 0;
+	}
+
+	free(cpus); free(packed); free(core_of); free(ids); free(counts);
+	return rc;
+}
+
+/* The CacheDomainIndex slot for a (level, type), NULL if not tracked */
+static int* cache_slot(CacheDomainIndex* idx, int level, CacheType type) {
+	switch (level) {
+		case 1: return type == CACHE_TYPE_INSTRUCTION ? &idx->l1i : &idx->l1d;
+		case 2: return &idx->l2;
+		case 3: return &idx->l3;
+		default: return NULL;
+	}
+}
+
+/* Drop all cache domains so another source can start over */
+static void reset_cache_domains(CPU_DATA* data) {
+	for (int i = 0; i < data->cache_count; ++i) {
+		free(data->caches[i].cpus);
+	}
+	free(data->caches);
+	data->caches = NULL;
+	data->cache_count = 0;
+	for (int cpu = 0; cpu < data->logical_core_count; ++cpu) {
+		data->cache_of[cpu].l1d = data->cache_of[cpu].l1i = -1;
+		data->cache_of[cpu].l2 = data->cache_of[cpu].l3 = -1;
+	}
+}
+
+/* Append one cache instance shared by cpus[0..n) and index it per logical */
+static int add_cache_domain(CPU_DATA* data, const CacheDomain* proto, const int* cpus, int n) {
+	int count = data->cache_count;
+	if ((count & (count - 1)) == 0) {		/* grow at powers of two */
+		CacheDomain* grown = realloc(data->caches, (count ? 2 * count : 4) * sizeof(*grown));
+		if (!grown) {
+			return 203;
+		}
+		data->caches = grown;
+	}
+
+	CacheDomain* d = &data->caches[count];
+	*d = *proto;
+	if (d->sets == 0 && d->associativity > 0 && d->line_size > 0) {
+		d->sets = d->size_kb * 1024 / (d->associativity * d->line_size);
+	}
+	d->cpus = malloc((n ? n : 1) * sizeof(int));
+	if (!d->cpus) {
+		return 203;
+	}
+	d->cpu_count = 0;
+	for (int i = 0; i < n; ++i) {
+		if (cpus[i] < 0 || cpus[i] >= data->logical_core_count) {
+			continue;
+		}
+		d->cpus[d->cpu_count++] = cpus[i];
+		int* slot = cache_slot(&data->cache_of[cpus[i]], d->level, d->type);
+		if (slot) {
+			*slot = count;
+		}
+	}
+	data->cache_count = count + 1;
+	return 0;
+}
+
+/* Rebuild l1size / l2size / l3size from the domain list */
+static void derive_cache_summary(CPU_DATA* data) {
+	for (int cpu = 0; cpu < data->logical_core_count; ++cpu) {
+		const CacheDomainIndex* idx = &data->cache_of[cpu];
+		data->l1size[cpu] = idx->l1d >= 0 ? data->caches[idx->l1d].size_kb : 0;
+		data->l2size[cpu].l2cache_size = idx->l2 >= 0 ? data->caches[idx->l2].size_kb : 0;
+		data->l2size[cpu].shared_with_core_number = idx->l2 >= 0 ? data->caches[idx->l2].cpu_count : 0;
+	}
+	data->l3size = (data->logical_core_count > 0 && data->cache_of[0].l3 >= 0)
+		? data->caches[data->cache_of[0].l3].size_kb : 0;
+}
+
+DLL_EXPORT int cpu_set_init(CpuSet* set, int capacity) {
+	if (!set) {
+		return 201;
+	}
+	int words = capacity > 0 ? (capacity + 63) / 64 : 1;
+	set->bits = calloc(words, sizeof(uint64_t));
+	set->cpu_capacity = set->bits ? words * 64 : 0;
+	return set->bits ? 0 : 203;
+}
+
+DLL_EXPORT void cpu_set_free(CpuSet* set) {
+	if (set) {
+		free(set->bits);
+		set->bits = NULL;
+		set->cpu_capacity = 0;
+	}
+}
+
+/* Add one CPU, growing the set as needed */
+DLL_EXPORT int cpu_set_add(CpuSet* set, int cpu) {
+	if (!set || cpu < 0) {
+		return 201;
+	}
+	if (cpu >= set->cpu_capacity) {
+		int old_words = set->cpu_capacity / 64;
+		int words = old_words ? old_words : 1;
+		while (words * 64 <= cpu) {
+			words *= 2;
+		}
+		uint64_t* grown = realloc(set->bits, words * sizeof(uint64_t));
+		if (!grown) {
+			return 203;
+		}
+		memset(grown + old_words, 0, (words - old_words) * sizeof(uint64_t));
+		set->bits = grown;
+		set->cpu_capacity = words * 64;
+	}
+	set->bits[cpu / 64] |= 1ull << (cpu % 64);
+	return 0;
+}
+
+DLL_EXPORT int cpu_set_contains(const CpuSet* set, int cpu) {
+	if (!set || !set->bits || cpu < 0 || cpu >= set->cpu_capacity) {
+		return 0;
+	}
+	return (int)((set->bits[cpu / 64] >> (cpu % 64)) & 1);
+}
+
+DLL_EXPORT int cpu_set_count(const CpuSet* set) {
+	int n = 0;
+	for (int w = 0; set && set->bits && w < set->cpu_capacity / 64; ++w) {
+		for (uint64_t v = set->bits[w]; v; v &= v - 1) {
+			n++;
+		}
+	}
+	return n;
+}
+
+#if defined(_WIN32)
+/* Flat logical index of bit 0 in processor group `group` */
+static int group_base(WORD group) {
+	int base = 0;
+	for (WORD g = 0; g < group; ++g) {
+		base += (int)GetActiveProcessorCount(g);
+	}
+	return base;
+}
+
+/* Map a flat logical index to its (group, bit) pair */
+static int logical_to_group(int cpu, WORD* group, BYTE* number) {
+	WORD groups = GetActiveProcessorGroupCount();
+	for (WORD g = 0; g < groups; ++g) {
+		int n = (int)GetActiveProcessorCount(g);
+		if (cpu < n) {
+			*group = g;
+			*number = (BYTE)cpu;
+			return 0;
+		}
+		cpu -= n;
+	}
+	return -1;
+}
+
+/* Append the flat indices in one group mask to out[], returning the new length */
+static int expand_group_mask(const GROUP_AFFINITY* ga, int* out, int n) {
+	int base = group_base(ga->Group);
+	for (int b = 0; b < (int)(8 * sizeof(KAFFINITY)); ++b) {
+		if (ga->Mask & ((KAFFINITY)1 << b)) {
+			out[n++] = base + b;
+		}
+	}
+	return n;
+}
+#endif
+
+/* Allocate `n` empty NUMA nodes and the n x n distance matrix */
+static int alloc_numa_nodes(CPU_DATA* data, int n) {
+	data->numa_nodes = calloc(n, sizeof(NumaNode));
+	data->numa_distance = malloc((size_t)n * n * sizeof(int));
+	if (!data->numa_nodes || !data->numa_distance) {
+		return 203;
+	}
+	data->numa_node_count = n;
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < n; ++j) {
+			data->numa_distance[i * n + j] = (i == j) ? 10 : 20;
+		}
+	}
+	return 0;
+}
+
+/*
+ * No NUMA information: one node holding all memory and every CPU, or only
+ * those set in online[0..known) when a mask is given
+ */
+static int single_numa_node(CPU_DATA* data, const signed char* online, int known, uint64_t total, uint64_t avail) {
+	int rc = alloc_numa_nodes(data, 1);
+	if (rc != 0) {
+		return rc;
+	}
+	NumaNode* node = &data->numa_nodes[0];
+	node->cpus = malloc((data->logical_core_count ? data->logical_core_count : 1) * sizeof(int));
+	if (!node->cpus) {
+		return 203;
+	}
+	node->cpu_count = 0;
+	for (int cpu = 0; cpu < data->logical_core_count; ++cpu) {
+		if (!online || (cpu < known && online[cpu])) {
+			node->cpus[node->cpu_count++] = cpu;
+		}
+	}
+	node->mem_total_bytes = total;
+	node->mem_free_bytes = avail;
+	return 0;
+}
+
+/* cores[].numa_node from the node CPU lists */
+static void link_cores_to_nodes(CPU_DATA* data) {
+	int L = data->logical_core_count;
+	int* node_of = malloc((L ? L : 1) * sizeof(int));
+	if (!data->cores || !node_of) {
+		free(node_of);
+		return;
+	}
+	for (int cpu = 0; cpu < L; ++cpu) node_of[cpu] = -1;
+	for (int n = 0; n < data->numa_node_count; ++n) {
+		for (int k = 0; k < data->numa_nodes[n].cpu_count; ++k) {
+			node_of[data->numa_nodes[n].cpus[k]] = n;
+		}
+	}
+	for (int i = 0; i < data->physical_core_count; ++i) {
+		PhysicalCoreInfo* pc = &data->cores[i];
+		pc->numa_node = pc->logical_count ? node_of[pc->logical_ids[0]] : -1;
+	}
+	free(node_of);
+}
+
+/* Monotonic clock in nanoseconds */
+static uint64_t monotonic_ns(void) {
+#if defined(_WIN32)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (!freq.QuadPart) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* Raw time‐stamp counter, 0 where there is none */
+static uint64_t read_tsc(void) {
+#if defined(_MSC_VER)
+	return __rdtsc();
+#elif defined(__i386__) || defined(__x86_64__)
+	unsigned int lo, hi;
+	__asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+#else
+	return 0;
+#endif
+}
+
+static void sleep_ms(int ms) {
+#if defined(_WIN32)
+	Sleep((DWORD)ms);
+#else
+	struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+	while (nanosleep(&ts, &ts) != 0) {
+	}
+#endif
+}
+
+/*
+ * Probe instrumentation.  Only active while a hook is installed: the
+ * calling thread then points probe_stats at its own CPU_PROBE_STATS, and
+ * each phase and file helper costs one test of that pointer otherwise.
+ * Like cpuid_hook, hook and ctx are set before probing starts.
+ */
+static CpuProbeHook probe_hook;
+static void* probe_hook_ctx;
+static PROBE_TLS CPU_PROBE_STATS* probe_stats;
+static PROBE_TLS unsigned int probe_files;
+static PROBE_TLS uint64_t probe_bytes;
+static PROBE_TLS unsigned int probe_syscalls;
+
+DLL_EXPORT void set_cpu_probe_hook(CpuProbeHook hook, void* ctx) {
+	probe_hook_ctx = ctx;
+	probe_hook = hook;
+}
+
+static inline void probe_io(unsigned int opened, uint64_t bytes, unsigned int syscalls) {
+	if (probe_stats) {
+		probe_files += opened;
+		probe_bytes += bytes;
+		probe_syscalls += syscalls;
+	}
+}
+
+typedef struct {
+	uint64_t t0;
+	unsigned int files;
+	uint64_t bytes;
+	unsigned int syscalls;
+	unsigned int allocs;
+} probe_mark;
+
+static inline void phase_begin(probe_mark* m) {
+	if (probe_stats) {
+		m->t0 = monotonic_ns();
+		m->files = probe_files;
+		m->bytes = probe_bytes;
+		m->syscalls = probe_syscalls;
+		m->allocs = probe_allocs;
+	}
+}
+
+/* Phases can be entered more than once (e.g. the CPUID fallback); they add up */
+static inline void phase_end(const probe_mark* m, CpuProbePhase phase) {
+	if (probe_stats) {
+		CpuPhaseStats* ps = &probe_stats->phase[phase];
+		ps->wall_ns += monotonic_ns() - m->t0;
+		ps->files_opened += probe_files - m->files;
+		ps->bytes_read += probe_bytes - m->bytes;
+		ps->syscalls += probe_syscalls - m->syscalls;
+		ps->allocations += probe_allocs - m->allocs;
+		ps->runs++;
+	}
+}
+
+#if defined(_WIN32)
+/* cores[].package from the RelationProcessorPackage masks */
+static void assign_packages(CPU_DATA* data) {
 	DWORD len = 0;
-	GetLogicalProcessorInformationEx(RelationCache, NULL, &len);
+	GetLogicalProcessorInformationEx(RelationProcessorPackage, NULL, &len);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+		return;
+	}
 	PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX buffer = malloc(len);
-	GetLogicalProcessorInformationEx(RelationCache, buffer, &len);
+	if (!buffer || !GetLogicalProcessorInformationEx(RelationProcessorPackage, buffer, &len)) {
+		free(buffer);
+		return;
+	}
+
+	/* a package spans one GroupMask per processor group it touches */
+	CpuSet members;
+	if (cpu_set_init(&members, data->logical_core_count) != 0) {
+		free(buffer);
+		return;
+	}
+	char* ptr = (char*)buffer;
+	DWORD offset = 0;
+	int package = 0;
+	while (offset < len) {
+		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
+		memset(members.bits, 0, members.cpu_capacity / 8);
+		for (WORD g = 0; g < info->Processor.GroupCount; ++g) {
+			const GROUP_AFFINITY* ga = &info->Processor.GroupMask[g];
+			int base = group_base(ga->Group);
+			for (int b = 0; b < (int)(8 * sizeof(KAFFINITY)); ++b) {
+				if (ga->Mask & ((KAFFINITY)1 << b)) {
+					cpu_set_add(&members, base + b);
+				}
+			}
+		}
+		for (int i = 0; i < data->physical_core_count; ++i) {
+			PhysicalCoreInfo* pc = &data->cores[i];
+			if (pc->logical_count && cpu_set_contains(&members, pc->logical_ids[0])) {
+				pc->package = package;
+			}
+		}
+		package++;
+		offset += info->Size;
+		ptr += info->Size;
+	}
+	cpu_set_free(&members);
+	free(buffer);
+}
+
+static int get_core_topology(CPU_DATA* data) {
+	DWORD len = 0;
+	BOOL ok;
+
+	ok = GetLogicalProcessorInformationEx(RelationProcessorCore, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)NULL, &len);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+		return 204;
+	}
+
+	PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX buffer =
+		malloc(len);
+	if (!buffer) {
+		return 203;
+	}
+
+	ok = GetLogicalProcessorInformationEx(RelationProcessorCore, buffer, &len);
+	if (!ok) {
+		free(buffer);
+		return 205;
+	}
+
+	char* ptr = (char*)buffer;
+	DWORD offset = 0, core_count = 0;
+	while (offset < len) {
+		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
+		core_count++;
+		offset += info->Size;
+		ptr += info->Size;
+	}
+
+	data->physical_core_count = (int)core_count;
+	data->cores = calloc(core_count, sizeof(*data->cores));
+	if (!data->cores) {
+		free(buffer);
+		return 203;
+	}
+
+	ptr = (char*)buffer;
+	offset = 0;
+	BYTE max_class = 0;
+	for (DWORD i = 0; i < core_count; ++i) {
+		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
+		if (info->Processor.EfficiencyClass > max_class) {
+			max_class = info->Processor.EfficiencyClass;
+		}
+
+		data->cores[i].id = (int)i;
+		data->cores[i].type = CORE_TYPE_UNKNOWN;
+		data->cores[i].numa_node = -1;
+
+		/* a core never straddles groups, but index it from its group's base */
+		data->cores[i].logical_ids = malloc(8 * sizeof(KAFFINITY) * sizeof(int));
+		if (!data->cores[i].logical_ids) {
+			free(buffer);
+			return 203;
+		}
+		data->cores[i].logical_count = expand_group_mask(&info->Processor.GroupMask[0],
+			data->cores[i].logical_ids, 0);
+
+		offset += info->Size;
+		ptr += info->Size;
+	}
+
+	/* higher EfficiencyClass = faster core; all equal means not hybrid */
+	ptr = (char*)buffer;
+	for (DWORD i = 0; i < core_count; ++i) {
+		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
+		data->cores[i].type = (info->Processor.EfficiencyClass == max_class)
+			? CORE_TYPE_PERFORMANCE : CORE_TYPE_EFFICIENCY;
+		ptr += info->Size;
+	}
+
+	free(buffer);
+	assign_packages(data);
+	return 0;
+}
+
+/* Windows numbers the active processors of every group without holes */
+static int probe_online_cpus(signed char** mask, int* online) {
+	int L = (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+	if (online) {
+		*online = L;
+	}
+	if (mask) {
+		*mask = malloc(L > 0 ? L : 1);
+		if (!*mask) {
+			return -1;
+		}
+		memset(*mask, 1, L);
+	}
+	return L;
+}
+#else
+/* Directory absolute probe paths resolve under; AT_FDCWD = the live / */
+static int probe_root_fd = AT_FDCWD;
+
+/*
+ * File access for the probes; opens and bytes count toward the probe
+ * stats, each open as two system calls since every probe closes its fd.
+ */
+static int probe_openat(int dirfd, const char* rel, int flags) {
+	if (rel[0] == '/' && probe_root_fd != AT_FDCWD) {
+		dirfd = probe_root_fd;
+		rel++;
+	}
+	int fd = openat(dirfd, rel, flags | O_CLOEXEC);
+	probe_io(fd >= 0, 0, fd >= 0 ? 2 : 1);
+	return fd;
+}
+
+static ssize_t probe_pread(int fd, void* buf, size_t size, off_t offset) {
+	ssize_t n = pread(fd, buf, size, offset);
+	probe_io(0, n > 0 ? (uint64_t)n : 0, 1);
+	return n;
+}
+
+/* A stream counts one read: the files read this way fit one stdio buffer */
+static FILE* probe_fopen(const char* path) {
+	int fd = probe_openat(AT_FDCWD, path, O_RDONLY);
+	FILE* f = fd >= 0 ? fdopen(fd, "r") : NULL;
+	if (!f && fd >= 0) {
+		close(fd);
+	}
+	probe_io(0, 0, f != NULL);
+	return f;
+}
+
+static char* probe_fgets(char* buf, int size, FILE* f) {
+	char* line = fgets(buf, size, f);
+	if (line) {
+		probe_io(0, strlen(line), 0);
+	}
+	return line;
+}
+
+/* Read a whole sysfs file (AT_FDCWD for absolute paths); NUL‐terminated */
+static int read_text_at(int dirfd, const char* rel, char* buf, size_t size) {
+	int fd = probe_openat(dirfd, rel, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	size_t total = 0;
+	while (total + 1 < size) {
+		ssize_t n = probe_pread(fd, buf + total, size - 1 - total, (off_t)total);
+		if (n <= 0) {
+			break;
+		}
+		total += (size_t)n;
+	}
+	close(fd);
+	buf[total] = '\0';
+	return (int)total;
+}
+
+/* Set out[cpu] = value for each CPU of a "0-3,8,10-11" list below L */
+static void mark_cpu_list(const char* list, signed char* out, int L, int value) {
+	const char* p = list;
+	while (*p) {
+		char* end;
+		long a = strtol(p, &end, 10), b;
+		if (end == p) {
+			break;
+		}
+		b = a;
+		if (*end == '-') {
+			p = end + 1;
+			b = strtol(p, &end, 10);
+		}
+		for (long c = a; c <= b && c < L; ++c) {
+			if (c >= 0) out[c] = (signed char)value;
+		}
+		p = (*end == ',') ? end + 1 : end;
+		if (*end != ',') {
+			break;
+		}
+	}
+}
+
+/* Read a small decimal sysfs attribute relative to an open directory */
+static int read_int_at(int dirfd, const char* rel, int* out) {
+	char buf[32];
+	int fd = probe_openat(dirfd, rel, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	ssize_t n = probe_pread(fd, buf, sizeof(buf) - 1, 0);
+	close(fd);
+	if (n <= 0) {
+		return -1;
+	}
+	buf[n] = '\0';
+	*out = atoi(buf);
+	return 0;
+}
+
+/*
+ * The online CPUs of cpu/online (of the tree set with set_cpu_sysfs_root,
+ * if any) as a mask over ids 0..L-1, L one past the highest; an offline CPU
+ * below that leaves a 0.  get_nprocs() CPUs, all online, if the list cannot
+ * be read.  Returns L, or -1 without memory; `mask` and `online` may be NULL.
+ */
+static int probe_online_cpus(signed char** mask, int* online) {
+	char buf[4096];
+	int L = 0;
+	if (read_text_at(AT_FDCWD, "/sys/devices/system/cpu/online", buf, sizeof(buf)) > 0) {
+		for (const char* p = buf; *p; ) {
+			char* end;
+			long a = strtol(p, &end, 10), b;
+			if (end == p) {
+				break;
+			}
+			b = a;
+			if (*end == '-') {
+				b = strtol(end + 1, &end, 10);
+			}
+			if (b >= L && b < INT_MAX) {
+				L = (int)b + 1;
+			}
+			if (*end != ',') {
+				break;
+			}
+			p = end + 1;
+		}
+	}
+	int listed = L > 0;
+	if (!listed) {
+		L = get_nprocs();
+	}
+
+	signed char* m = malloc(L > 0 ? L : 1);
+	if (!m) {
+		return -1;
+	}
+	memset(m, !listed, L);
+	if (listed) {
+		mark_cpu_list(buf, m, L, 1);
+	}
+	if (online) {
+		*online = 0;
+		for (int cpu = 0; cpu < L; ++cpu) *online += m[cpu];
+	}
+	if (mask) {
+		*mask = m;
+	}
+	else {
+		free(m);
+	}
+	return L;
+}
+
+/* One past the highest online CPU id: the length of the per‐logical arrays */
+static int probe_logical_count(void) {
+	int L = probe_online_cpus(NULL, NULL);
+	return L > 0 ? L : get_nprocs();
+}
+
+static int get_core_topology(CPU_DATA* data) {
+	int L = data->logical_core_count;
+	int* keys = calloc(L, sizeof(int));
+	signed char* online = NULL;
+	int known = probe_online_cpus(&online, NULL);
+	if (!keys || known < 0) {
+		free(keys);
+		return 203;
+	}
+
+	/* one open of the cpu directory, then one read per attribute */
+	int dirfd = probe_openat(AT_FDCWD, "/sys/devices/system/cpu", O_RDONLY | O_DIRECTORY);
+	int rc = (dirfd >= 0) ? 0 : 202;
+	for (int cpu = 0; cpu < L && rc == 0; ++cpu) {
+		char rel[64];
+		int phy = 0, core = 0;
+		if (cpu >= known || !online[cpu]) {
+			keys[cpu] = -1;		/* offline: no topology directory */
+			continue;
+		}
+		snprintf(rel, sizeof(rel), "cpu%d/topology/physical_package_id", cpu);
+		if (read_int_at(dirfd, rel, &phy) != 0) {
+			rc = 202;	/* /sys missing or only partly mounted */
+		}
+		snprintf(rel, sizeof(rel), "cpu%d/topology/core_id", cpu);
+		if (read_int_at(dirfd, rel, &core) != 0) {
+			rc = 202;
+		}
+		keys[cpu] = (phy << 16) | (core & 0xFFFF);
+	}
+	if (dirfd >= 0) {
+		close(dirfd);
+	}
+
+	if (rc == 0) {
+		rc = build_cores_from_keys(data, keys);
+	}
+	free(keys);
+	free(online);
+	return rc;
+}
+#endif
+
+#if defined(_WIN32)
+/*
+ * ProcessorInformation only reports the calling thread's processor group,
+ * so visit each group in turn and fill its slice of out[] (flat logical
+ * order, see group_base).  0 if any group answered; the rest stay zero.
+ */
+static int read_power_info(processor_power_info* out, int L) {
+	WORD groups = GetActiveProcessorGroupCount();
+	GROUP_AFFINITY saved;
+	int answered = 0, moved = 0;
+	memset(out, 0, (size_t)L * sizeof(*out));
+	if (groups > 1 && !GetThreadGroupAffinity(GetCurrentThread(), &saved)) {
+		groups = 1;
+	}
+	for (WORD g = 0; g < groups; ++g) {
+		int base = group_base(g);
+		int n = (int)GetActiveProcessorCount(g);
+		if (n > L - base) n = L - base;
+		if (n <= 0) {
+			continue;
+		}
+		if (groups > 1) {
+			GROUP_AFFINITY ga;
+			memset(&ga, 0, sizeof(ga));
+			ga.Group = g;
+			ga.Mask = n >= (int)(sizeof(KAFFINITY) * 8) ? ~(KAFFINITY)0 : ((KAFFINITY)1 << n) - 1;
+			if (!SetThreadGroupAffinity(GetCurrentThread(), &ga, NULL)) {
+				continue;
+			}
+			moved = 1;
+		}
+		ULONG bytes = (ULONG)(n * sizeof(processor_power_info));
+		if (CallNtPowerInformation(ProcessorInformation, NULL, 0, out + base, bytes) == 0) {
+			answered = 1;
+		}
+	}
+	if (moved) {
+		SetThreadGroupAffinity(GetCurrentThread(), &saved, NULL);
+	}
+	return answered ? 0 : -1;
+}
+
+/*
+ * Windows: freq from CallNtPowerInformation (registry ~MHz as fallback),
+ * caches via
+ * GetLogicalProcessorInformationEx(RelationCache, ...)
+ */
+static void read_frequency(const CPU_DATA* data, int* mhz) {
+	/* live clock from the power manager, if it answers */
+	ULONG bytes = (ULONG)(data->logical_core_count * sizeof(processor_power_info));
+	processor_power_info* ppi = malloc(bytes);
+	if (ppi && read_power_info(ppi, data->logical_core_count) == 0) {
+		for (int cpu = 0; cpu < data->logical_core_count; ++cpu) {
+			mhz[cpu] = (int)ppi[cpu].CurrentMhz;
+		}
+		free(ppi);
+		return;
+	}
+	free(ppi);
+
+	/* otherwise the nominal clock from the registry (~MHz) */
+	for (int cpu = 0; cpu < data->logical_core_count; ++cpu) {
+		char keypath[128];
+		HKEY hKey;
+		DWORD freq = 0, size = sizeof(freq);
+		snprintf(keypath, sizeof(keypath), "HARDWARE\\DESCRIPTION\\System\\CentralProcessor\\%d", cpu);
+		if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, keypath, 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
+			LONG q = RegQueryValueExA(hKey, "~MHz", NULL, NULL, (LPBYTE)&freq, &size);
+			probe_io(1, q == ERROR_SUCCESS ? size : 0, 3);
+			RegCloseKey(hKey);
+		}
+		mhz[cpu] = (int)freq;
+	}
+}
+
+/* Power schemes and processor power settings (winnt.h only declares them with INITGUID) */
+static const GUID scheme_high_performance = { 0x8c5e7fda, 0xe8bf, 0x4a96, { 0x9a, 0x85, 0xa6, 0xe2, 0x3a, 0x8c, 0x63, 0x5c } };
+static const GUID scheme_ultimate = { 0xe9a42b02, 0xd5df, 0x448d, { 0xaa, 0x00, 0x03, 0xf1, 0x47, 0x49, 0xeb, 0x61 } };
+static const GUID scheme_balanced = { 0x381b4222, 0xf694, 0x41f0, { 0x96, 0x85, 0xff, 0x5b, 0xb2, 0x60, 0xdf, 0x2e } };
+static const GUID scheme_power_saver = { 0xa1841308, 0x3541, 0x4fab, { 0xbc, 0x81, 0xf7, 0x15, 0x56, 0xf2, 0x0b, 0x4a } };
+static const GUID processor_subgroup = { 0x54533251, 0x82be, 0x4824, { 0x96, 0xc1, 0x47, 0xb6, 0x0b, 0x74, 0x0d, 0x00 } };
+static const GUID processor_epp = { 0x36687f9e, 0xe3a5, 0x4dbf, { 0xb1, 0xdc, 0x15, 0xeb, 0x38, 0x1c, 0x68, 0x63 } };
+static const GUID processor_boost_mode = { 0xbe337238, 0x0d82, 0x4146, { 0xa9, 0x60, 0x4f, 0x37, 0x49, 0xd4, 0x70, 0xc7 } };
+static const GUID processor_throttle_max = { 0xbc5038f7, 0x23e0, 0x4960, { 0x96, 0xda, 0x33, 0xab, 0xaf, 0x59, 0x35, 0xec } };
+
+/* One processor setting of the active scheme, for the current power source */
+static int read_processor_setting(const GUID* scheme, const GUID* setting, DWORD* out) {
+	SYSTEM_POWER_STATUS ps;
+	int on_battery = GetSystemPowerStatus(&ps) && ps.ACLineStatus == 0;
+	DWORD rc = on_battery
+		? PowerReadDCValueIndex(NULL, scheme, &processor_subgroup, setting, out)
+		: PowerReadACValueIndex(NULL, scheme, &processor_subgroup, setting, out);
+	return rc == ERROR_SUCCESS ? 0 : -1;
+}
+
+/*
+ * Windows has no per‐CPU cpufreq: base clock from the power manager, the
+ * active power scheme as the governor and its PERFEPP value as the EPP.
+ * Boost mode 0 and a maximum processor state below 100 % are flagged.
+ */
+static void populate_frequency_limits(CPU_DATA* data) {
+	ULONG bytes = (ULONG)(data->logical_core_count * sizeof(processor_power_info));
+	processor_power_info* ppi = malloc(bytes);
+	if (ppi && read_power_info(ppi, data->logical_core_count) == 0) {
+		for (int cpu = 0; cpu < data->logical_core_count; ++cpu) {
+			data->frequency_limits[cpu].base_mhz = (int)ppi[cpu].MaxMhz;
+		}
+	}
+	free(ppi);
+
+	GUID* scheme = NULL;
+	if (PowerGetActiveScheme(NULL, &scheme) != ERROR_SUCCESS || !scheme) {
+		return;
+	}
+	const char* name = "custom";
+	if (IsEqualGUID(scheme, &scheme_high_performance)) name = "high-performance";
+	else if (IsEqualGUID(scheme, &scheme_ultimate)) name = "ultimate-performance";
+	else if (IsEqualGUID(scheme, &scheme_balanced)) name = "balanced";
+	else if (IsEqualGUID(scheme, &scheme_power_saver)) name = "power-saver";
+	snprintf(data->scaling_governor, sizeof(data->scaling_governor), "%s", name);
+	if (IsEqualGUID(scheme, &scheme_power_saver)) {
+		data->frequency_warnings |= CPU_FREQ_WARN_POWERSAVE;
+	}
+
+	DWORD value;
+	if (read_processor_setting(scheme, &processor_epp, &value) == 0) {
+		snprintf(data->energy_perf_preference, sizeof(data->energy_perf_preference), "%lu", (unsigned long)value);
+		if (value > 0) {
+			data->frequency_warnings |= CPU_FREQ_WARN_EPP_ENERGY;
+		}
+	}
+	if (read_processor_setting(scheme, &processor_boost_mode, &value) == 0 && value == 0) {
+		data->frequency_warnings |= CPU_FREQ_WARN_BOOST_OFF;
+	}
+	if (read_processor_setting(scheme, &processor_throttle_max, &value) == 0 && value < 100) {
+		data->frequency_warnings |= CPU_FREQ_WARN_CAPPED;
+	}
+	LocalFree(scheme);
+}
+
+static int populate_caches(CPU_DATA* data) {
+	reset_cache_domains(data);
+
+	DWORD len = 0;
+	GetLogicalProcessorInformationEx(RelationCache, NULL, &len);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+		return 206;
+	}
+	PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX buffer = malloc(len);
+	int* cpus = malloc((data->logical_core_count + 8 * sizeof(KAFFINITY)) * sizeof(int));
+	if (!buffer || !cpus) {
+		free(buffer);
+		free(cpus);
+		return 203;
+	}
+	if (!GetLogicalProcessorInformationEx(RelationCache, buffer, &len)) {
+		free(buffer);
+		free(cpus);
+		return 206;
+	}
+
+	int rc = 0;
+	char* ptr = (char*)buffer;
+	DWORD offset = 0;
+	while (offset < len && rc == 0) {
+		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
+
+		if (info->Relationship == RelationCache) {
+			CACHE_RELATIONSHIP* c = &info->Cache;
+			CacheDomain proto;
+			memset(&proto, 0, sizeof(proto));
+			proto.level = c->Level;
+			proto.type = c->Type == CacheInstruction ? CACHE_TYPE_INSTRUCTION
+				: c->Type == CacheData ? CACHE_TYPE_DATA : CACHE_TYPE_UNIFIED;
+			proto.size_kb = (int)(c->CacheSize / 1024);
+			proto.line_size = c->LineSize;
+			proto.associativity = c->Associativity == CACHE_FULLY_ASSOCIATIVE ? 0 : c->Associativity;
+			proto.inclusive = -1;
+
+			/* GroupCount (older SDKs: reserved, reads 0) covers caches spanning groups */
+			int n = 0;
+#if defined(NTDDI_WIN10_FE)
+			WORD groups = c->GroupCount ? c->GroupCount : 1;
+			for (WORD g = 0; g < groups; ++g) {
+				n = expand_group_mask(&c->GroupMasks[g], cpus, n);
+			}
+#else
+			n = expand_group_mask(&c->GroupMask, cpus, n);
+#endif
+			rc = add_cache_domain(data, &proto, cpus, n);
+		}
+
+		offset += info->Size;
+		ptr += info->Size;
+	}
+
+	free(buffer);
+	free(cpus);
+	derive_cache_summary(data);
+	return rc;
+}
+/*
+ * NUMA nodes from GetNumaHighestNodeNumber / GetNumaProcessorNodeEx.
+ * Windows exposes neither per‐node memory totals nor the SLIT, so the
+ * total is only known for single‐node machines and distances are 10/20.
+ */
+static int populate_numa(CPU_DATA* data) {
+	MEMORYSTATUSEX ms;
+	ULONG highest = 0;
+	ms.dwLength = sizeof(ms);
+	GlobalMemoryStatusEx(&ms);
+	if (!GetNumaHighestNodeNumber(&highest) || highest == 0) {
+		return single_numa_node(data, NULL, 0, ms.ullTotalPhys, ms.ullAvailPhys);
+	}
+
+	int L = data->logical_core_count;
+	int rc = alloc_numa_nodes(data, (int)highest + 1);
+	for (ULONG n = 0; n <= highest && rc == 0; ++n) {
+		NumaNode* node = &data->numa_nodes[n];
+		ULONGLONG avail = 0;
+		node->id = (int)n;
+		node->cpus = malloc((L ? L : 1) * sizeof(int));
+		if (!node->cpus) {
+			rc = 203;
+			break;
+		}
+		if (GetNumaAvailableMemoryNodeEx((USHORT)n, &avail)) {
+			node->mem_free_bytes = avail;
+		}
+	}
+
+	/* per CPU rather than per node mask: a node can span processor groups */
+	for (int cpu = 0; cpu < L && rc == 0; ++cpu) {
+		PROCESSOR_NUMBER pn;
+		USHORT node = 0;
+		memset(&pn, 0, sizeof(pn));
+		if (logical_to_group(cpu, &pn.Group, &pn.Number) == 0 &&
+			GetNumaProcessorNodeEx(&pn, &node) && node <= highest) {
+			NumaNode* nn = &data->numa_nodes[node];
+			nn->cpus[nn->cpu_count++] = cpu;
+		}
+	}
+	return rc;
+}
+#else
+/*
+ * Linux: freq from scaling_cur_freq, caches via sysfs cache/index*
+ */
+/* Expand a "0-3,8,10-11" list into out[] (room for L), ignoring CPUs >= L */
+static int parse_cpu_list(const char* list, int* out, int L) {
+	const char* p = list;
+	int n = 0;
+	while (*p) {
+		char* end;
+		long a = strtol(p, &end, 10), b;
+		if (end == p) {
+			break;
+		}
+		b = a;
+		if (*end == '-') {
+			p = end + 1;
+			b = strtol(p, &end, 10);
+		}
+		for (long c = a; c <= b && c < L && n < L; ++c) {
+			if (c >= 0) out[n++] = (int)c;
+		}
+		if (*end != ',') {
+			break;
+		}
+		p = end + 1;
+	}
+	return n;
+}
+
+static void read_frequency(const CPU_DATA* data, int* mhz) {
+	signed char* online = NULL;
+	int known = probe_online_cpus(&online, NULL);
+	/* frequency from /sys */
+	for (int cpu = 0; cpu < data->logical_core_count; ++cpu) {
+		char path[128], buf[32];
+		mhz[cpu] = 0;
+		if (cpu >= known || !online[cpu]) {
+			continue;	/* offline: no cpufreq directory */
+		}
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+		FILE* f = probe_fopen(path);
+		if (f) {
+			if (probe_fgets(buf, sizeof(buf), f)) {
+				/* file is in kHz */
+				mhz[cpu] = atoi(buf) / 1000;
+			}
+			fclose(f);
+		}
+	}
+	free(online);
+}
+
+/* First line of a sysfs attribute without the newline, "" if unreadable */
+static void read_word_at(int dirfd, const char* rel, char* buf, size_t size) {
+	if (read_text_at(dirfd, rel, buf, size) <= 0) {
+		buf[0] = '\0';
+	}
+	buf[strcspn(buf, "\n")] = '\0';
+}
+
+/* One kHz cpufreq attribute in MHz, 0 if absent */
+static int read_khz_at(int dirfd, const char* rel) {
+	int khz;
+	return read_int_at(dirfd, rel, &khz) == 0 ? khz / 1000 : 0;
+}
+
+/*
+ * cpufreq limits per CPU, CPPC highest_perf (the preferred‐core ranking
+ * amd‐pstate and ITMT boost by), and the governor / EPP of every policy.
+ * base_frequency is intel_pstate's, acpi_cppc/nominal_freq the CPPC one.
+ */
+static void populate_frequency_limits(CPU_DATA* data) {
+	int dirfd = probe_openat(AT_FDCWD, "/sys/devices/system/cpu", O_RDONLY | O_DIRECTORY);
+	if (dirfd < 0) {
+		return;
+	}
+	signed char* online = NULL;
+	int known = probe_online_cpus(&online, NULL);
+	for (int cpu = 0; cpu < data->logical_core_count; ++cpu) {
+		CpuFrequencyLimits* f = &data->frequency_limits[cpu];
+		char rel[96], word[24];
+		int v;
+		if (cpu >= known || !online[cpu]) {
+			continue;
+		}
+		snprintf(rel, sizeof(rel), "cpu%d/cpufreq/cpuinfo_min_freq", cpu);
+		f->min_mhz = read_khz_at(dirfd, rel);
+		snprintf(rel, sizeof(rel), "cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+		f->max_mhz = read_khz_at(dirfd, rel);
+		snprintf(rel, sizeof(rel), "cpu%d/cpufreq/scaling_max_freq", cpu);
+		f->scaling_max_mhz = read_khz_at(dirfd, rel);
+		snprintf(rel, sizeof(rel), "cpu%d/cpufreq/base_frequency", cpu);
+		f->base_mhz = read_khz_at(dirfd, rel);
+		snprintf(rel, sizeof(rel), "cpu%d/acpi_cppc/nominal_freq", cpu);
+		if (!f->base_mhz && read_int_at(dirfd, rel, &v) == 0) {
+			f->base_mhz = v;
+		}
+		snprintf(rel, sizeof(rel), "cpu%d/acpi_cppc/highest_perf", cpu);
+		if (read_int_at(dirfd, rel, &v) == 0) {
+			f->highest_perf = v;
+		}
+
+		snprintf(rel, sizeof(rel), "cpu%d/cpufreq/scaling_governor", cpu);
+		read_word_at(dirfd, rel, word, sizeof(word));
+		if (!data->scaling_governor[0]) {
+			snprintf(data->scaling_governor, sizeof(data->scaling_governor), "%s", word);
+		} else if (word[0] && strcmp(word, data->scaling_governor) != 0) {
+			data->frequency_warnings |= CPU_FREQ_WARN_MIXED_POLICY;
+		}
+		if (!strcmp(word, "powersave")) {
+			data->frequency_warnings |= CPU_FREQ_WARN_POWERSAVE;
+		}
+
+		snprintf(rel, sizeof(rel), "cpu%d/cpufreq/energy_performance_preference", cpu);
+		read_word_at(dirfd, rel, word, sizeof(word));
+		if (!data->energy_perf_preference[0]) {
+			snprintf(data->energy_perf_preference, sizeof(data->energy_perf_preference), "%s", word);
+		} else if (word[0] && strcmp(word, data->energy_perf_preference) != 0) {
+			data->frequency_warnings |= CPU_FREQ_WARN_MIXED_POLICY;
+		}
+		/* "performance" or raw 0; default, balance_* and power all trade latency */
+		if (word[0] && strcmp(word, "performance") != 0 && !(isdigit((unsigned char)word[0]) && atoi(word) == 0)) {
+			data->frequency_warnings |= CPU_FREQ_WARN_EPP_ENERGY;
+		}
+	}
+	read_word_at(dirfd, "cpu0/cpufreq/scaling_driver", data->scaling_driver, sizeof(data->scaling_driver));
+
+	int v;
+	if ((read_int_at(dirfd, "cpufreq/boost", &v) == 0 && v == 0)
+		|| (read_int_at(dirfd, "intel_pstate/no_turbo", &v) == 0 && v == 1)) {
+		data->frequency_warnings |= CPU_FREQ_WARN_BOOST_OFF;
+	}
+	free(online);
+	close(dirfd);
+}
+
+#define CACHE_LIST_BUF 65536
+#define CACHE_MAX_INDEX 16
+
+/*
+ * Walk cpuN/cache/indexM of the online CPUs.  The index layout (level,
+ * type) is read from the first one once; after that a CPU's index is only
+ * read if no domain of that level/type covers it yet, so the cost grows
+ * with the number of cache instances rather than CPUs x indices.
+ */
+static int populate_caches(CPU_DATA* data) {
+	int L = data->logical_core_count;
+	reset_cache_domains(data);
+
+	signed char* online = NULL;
+	int known = probe_online_cpus(&online, NULL);
+	if (known < 0) {
+		derive_cache_summary(data);
+		return 203;
+	}
+	int first = 0;
+	while (first < known && first < L && !online[first]) first++;
+
+	int dirfd = probe_openat(AT_FDCWD, "/sys/devices/system/cpu", O_RDONLY | O_DIRECTORY);
+	if (dirfd < 0) {
+		free(online);
+		derive_cache_summary(data);
+		return 202;
+	}
+
+	int levels[CACHE_MAX_INDEX];
+	CacheType types[CACHE_MAX_INDEX];
+	int nidx = 0;
+	char rel[96], small[64];
+	for (; nidx < CACHE_MAX_INDEX; ++nidx) {
+		snprintf(rel, sizeof(rel), "cpu%d/cache/index%d/level", first, nidx);
+		if (read_int_at(dirfd, rel, &levels[nidx]) != 0) {
+			break;
+		}
+		snprintf(rel, sizeof(rel), "cpu%d/cache/index%d/type", first, nidx);
+		if (read_text_at(dirfd, rel, small, sizeof(small)) < 0) {
+			small[0] = '\0';
+		}
+		types[nidx] = small[0] == 'I' ? CACHE_TYPE_INSTRUCTION
+			: small[0] == 'D' ? CACHE_TYPE_DATA : CACHE_TYPE_UNIFIED;
+	}
+
+	char* list = malloc(CACHE_LIST_BUF);
+	int* cpus = malloc(L * sizeof(int));
+	int rc = (list && cpus) ? 0 : 203;
+	for (int cpu = first; cpu < L && rc == 0; ++cpu) {
+		if (cpu >= known || !online[cpu]) {
+			continue;	/* offline: no cache directory */
+		}
+		for (int idx = 0; idx < nidx && rc == 0; ++idx) {
+			int* slot = cache_slot(&data->cache_of[cpu], levels[idx], types[idx]);
+			if ((slot && *slot >= 0) || (!slot && cpu > first)) {
+				continue;	/* covered, or an untracked level read from the first CPU only */
+			}
+
+			CacheDomain proto;
+			memset(&proto, 0, sizeof(proto));
+			proto.level = levels[idx];
+			proto.type = types[idx];
+
+			snprintf(rel, sizeof(rel), "cpu%d/cache/index%d/size", cpu, idx);
+			if (read_text_at(dirfd, rel, small, sizeof(small)) <= 0) {
+				continue;
+			}
+			proto.size_kb = atoi(small);
+			if (strchr(small, 'M') || strchr(small, 'm')) {
+				proto.size_kb *= 1024;
+			}
+			snprintf(rel, sizeof(rel), "cpu%d/cache/index%d/coherency_line_size", cpu, idx);
+			read_int_at(dirfd, rel, &proto.line_size);
+			snprintf(rel, sizeof(rel), "cpu%d/cache/index%d/ways_of_associativity", cpu, idx);
+			read_int_at(dirfd, rel, &proto.associativity);
+			snprintf(rel, sizeof(rel), "cpu%d/cache/index%d/number_of_sets", cpu, idx);
+			read_int_at(dirfd, rel, &proto.sets);
+			proto.inclusive = -1;
+
+			int n = 0;
+			snprintf(rel, sizeof(rel), "cpu%d/cache/index%d/shared_cpu_list", cpu, idx);
+			if (read_text_at(dirfd, rel, list, CACHE_LIST_BUF) > 0) {
+				n = parse_cpu_list(list, cpus, L);
+			}
+			if (n == 0) {
+				cpus[n++] = cpu;
+			}
+			rc = add_cache_domain(data, &proto, cpus, n);
+			if (rc == 0 && slot && *slot < 0) {
+				*slot = data->cache_count - 1;	/* list did not name us */
+			}
+		}
+	}
+
+	free(list);
+	free(cpus);
+	free(online);
+	close(dirfd);
+	derive_cache_summary(data);
+	if (rc != 0) {
+		return rc;
+	}
+	return nidx ? 0 : 202;
+}
+/* "Node 0 MemTotal:   16318508 kB" -> bytes */
+static uint64_t meminfo_field(const char* text, const char* key) {
+	const char* p = strstr(text, key);
+	if (!p) {
+		return 0;
+	}
+	return (uint64_t)strtoull(p + strlen(key), NULL, 10) * 1024ull;
+}
+
+/* NUMA nodes from /sys/devices/system/node/nodeN/{cpulist,meminfo,distance} */
+static int populate_numa(CPU_DATA* data) {
+	int L = data->logical_core_count;
+	int dirfd = probe_openat(AT_FDCWD, "/sys/devices/system/node", O_RDONLY | O_DIRECTORY);
+	char* buf = malloc(CACHE_LIST_BUF);
+	int* ids = malloc(1024 * sizeof(int));
+	int n = 0, rc = (buf && ids) ? 0 : 203;
+
+	if (rc == 0 && dirfd >= 0 && read_text_at(dirfd, "online", buf, CACHE_LIST_BUF) > 0) {
+		n = parse_cpu_list(buf, ids, 1024);
+	}
+	if (rc == 0 && n == 0) {
+		struct sysinfo si;
+		uint64_t total = 0, avail = 0;
+		if (sysinfo(&si) == 0) {
+			total = (uint64_t)si.totalram * si.mem_unit;
+			avail = (uint64_t)si.freeram * si.mem_unit;
+		}
+		signed char* online = NULL;
+		int known = probe_online_cpus(&online, NULL);
+		rc = known < 0 ? 203 : single_numa_node(data, online, known, total, avail);
+		free(online);
+	}
+	else if (rc == 0) {
+		rc = alloc_numa_nodes(data, n);
+		for (int k = 0; k < n && rc == 0; ++k) {
+			NumaNode* node = &data->numa_nodes[k];
+			char rel[64];
+			node->id = ids[k];
+			node->cpus = malloc((L ? L : 1) * sizeof(int));
+			if (!node->cpus) {
+				rc = 203;
+				break;
+			}
+			snprintf(rel, sizeof(rel), "node%d/cpulist", ids[k]);
+			if (read_text_at(dirfd, rel, buf, CACHE_LIST_BUF) > 0) {
+				node->cpu_count = parse_cpu_list(buf, node->cpus, L);
+			}
+			snprintf(rel, sizeof(rel), "node%d/meminfo", ids[k]);
+			if (read_text_at(dirfd, rel, buf, CACHE_LIST_BUF) > 0) {
+				node->mem_total_bytes = meminfo_field(buf, "MemTotal:");
+				node->mem_free_bytes = meminfo_field(buf, "MemFree:");
+			}
+			snprintf(rel, sizeof(rel), "node%d/distance", ids[k]);
+			if (read_text_at(dirfd, rel, buf, CACHE_LIST_BUF) > 0) {
+				char* p = buf;
+				for (int j = 0; j < n; ++j) {
+					char* end;
+					long d = strtol(p, &end, 10);
+					if (end == p) {
+						break;
+					}
+					data->numa_distance[k * n + j] = (int)d;
+					p = end;
+				}
+			}
+		}
+	}
+
+	if (dirfd >= 0) {
+		close(dirfd);
+	}
+	free(buf);
+	free(ids);
+	return rc;
+}
+#endif
+
+/*
+ * Memory report.  Pools are sorted by size; their per‐node arrays follow
+ * the node order of populate_numa(), so node_ids[i] == numa_nodes[i].id
+ * when both groups are probed.
+ */
+static void sort_hugepage_pools(MemoryInfo* m) {
+	for (int i = 1; i < m->hugepage_size_count; ++i) {
+		HugePagePool p = m->hugepages[i];
+		int j = i;
+		for (; j > 0 && m->hugepages[j - 1].size_bytes > p.size_bytes; --j) {
+			m->hugepages[j] = m->hugepages[j - 1];
+		}
+		m->hugepages[j] = p;
+	}
+}
+
+#if defined(_WIN32)
+/* SeLockMemoryPrivilege in the process token: 0 absent, 1 present, 2 enabled */
+static int lock_memory_privilege(void) {
+	HANDLE token;
+	LUID luid;
+	int state = 0;
+	if (!LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &luid)
+		|| !OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+		return 0;
+	}
+	DWORD len = 0;
+	GetTokenInformation(token, TokenPrivileges, NULL, 0, &len);
+	TOKEN_PRIVILEGES* tp = len ? malloc(len) : NULL;
+	if (tp && GetTokenInformation(token, TokenPrivileges, tp, len, &len)) {
+		for (DWORD i = 0; i < tp->PrivilegeCount; ++i) {
+			const LUID_AND_ATTRIBUTES* p = &tp->Privileges[i];
+			if (p->Luid.LowPart == luid.LowPart && p->Luid.HighPart == luid.HighPart) {
+				state = (p->Attributes & SE_PRIVILEGE_ENABLED) ? 2 : 1;
+			}
+		}
+	}
+	free(tp);
+	CloseHandle(token);
+	return state;
+}
+
+/*
+ * Windows has no standing huge page pool: large pages are carved out of
+ * free memory at VirtualAlloc time, so counts stay 0.  1 GiB pages need
+ * VirtualAlloc2 (MEM_EXTENDED_PARAMETER_NONPAGED_HUGE) and CPU support.
+ */
+static int populate_memory(MemoryInfo* m) {
+	MEMORYSTATUSEX ms;
+	SYSTEM_INFO si;
+	ms.dwLength = sizeof(ms);
+	if (GlobalMemoryStatusEx(&ms)) {
+		m->total_bytes = ms.ullTotalPhys;
+		m->available_bytes = ms.ullAvailPhys;
+	}
+	GetSystemInfo(&si);
+	m->page_size = si.dwPageSize;
+	m->large_page_minimum = GetLargePageMinimum();
+	if (m->large_page_minimum) {
+		m->hugepages[m->hugepage_size_count++].size_bytes = m->large_page_minimum;
+		int regs[4];
+		cpu_cpuid(0x80000001, 0, regs);
+		HMODULE kb = GetModuleHandleA("kernelbase.dll");
+		if ((regs[3] & (1 << 26)) && kb && GetProcAddress(kb, "VirtualAlloc2")) {
+			m->hugepages[m->hugepage_size_count++].size_bytes = 1ull << 30;
+		}
+	}
+	m->large_page_privilege = lock_memory_privilege();
+	return 0;
+}
+#else
+static uint64_t read_u64_at(int dirfd, const char* rel) {
+	char buf[32];
+	return read_text_at(dirfd, rel, buf, sizeof(buf)) > 0 ? strtoull(buf, NULL, 10) : 0;
+}
+
+/* "always [madvise] never" -> "madvise" */
+static void bracketed_word(const char* text, char* out, size_t size) {
+	const char* open = strchr(text, '[');
+	const char* close = open ? strchr(open, ']') : NULL;
+	size_t n = close ? (size_t)(close - open - 1) : 0;
+	if (n >= size) n = size - 1;
+	memcpy(out, open ? open + 1 : text, n);
+	out[n] = '\0';
+}
+
+static int populate_memory(MemoryInfo* m) {
+	char buf[4096];
+	m->page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+	m->large_page_privilege = -1;
+	if (read_text_at(AT_FDCWD, "/proc/meminfo", buf, sizeof(buf)) > 0) {
+		m->total_bytes = meminfo_field(buf, "MemTotal:");
+		m->available_bytes = meminfo_field(buf, "MemAvailable:");
+		m->large_page_minimum = meminfo_field(buf, "Hugepagesize:");
+	}
+
+	/* one hugepages-<N>kB directory per size the kernel and CPU support */
+	int fd = probe_openat(AT_FDCWD, "/sys/kernel/mm/hugepages", O_RDONLY | O_DIRECTORY);
+	DIR* dir = fd >= 0 ? fdopendir(fd) : NULL;
+	if (!dir && fd >= 0) {
+		close(fd);
+	}
+	for (struct dirent* e; dir && (e = readdir(dir)) && m->hugepage_size_count < CPU_MAX_HUGEPAGE_SIZES; ) {
+		unsigned long long kb;
+		if (sscanf(e->d_name, "hugepages-%llukB", &kb) == 1) {
+			m->hugepages[m->hugepage_size_count++].size_bytes = (uint64_t)kb * 1024;
+		}
+	}
+	if (dir) {
+		closedir(dir);
+	}
+	sort_hugepage_pools(m);
+	for (int i = 0; i < m->hugepage_size_count; ++i) {
+		HugePagePool* p = &m->hugepages[i];
+		char rel[128];
+		unsigned long long kb = (unsigned long long)(p->size_bytes / 1024);
+		snprintf(rel, sizeof(rel), "/sys/kernel/mm/hugepages/hugepages-%llukB/nr_hugepages", kb);
+		p->total = read_u64_at(AT_FDCWD, rel);
+		snprintf(rel, sizeof(rel), "/sys/kernel/mm/hugepages/hugepages-%llukB/free_hugepages", kb);
+		p->free = read_u64_at(AT_FDCWD, rel);
+		snprintf(rel, sizeof(rel), "/sys/kernel/mm/hugepages/hugepages-%llukB/resv_hugepages", kb);
+		p->reserved = read_u64_at(AT_FDCWD, rel);
+		snprintf(rel, sizeof(rel), "/sys/kernel/mm/hugepages/hugepages-%llukB/surplus_hugepages", kb);
+		p->surplus = read_u64_at(AT_FDCWD, rel);
+	}
+
+	/* per‐node pools */
+	int ids[1024];
+	int n = 0;
+	int nodefd = probe_openat(AT_FDCWD, "/sys/devices/system/node", O_RDONLY | O_DIRECTORY);
+	if (nodefd >= 0 && m->hugepage_size_count && read_text_at(nodefd, "online", buf, sizeof(buf)) > 0) {
+		n = parse_cpu_list(buf, ids, 1024);
+	}
+	if (n > 0) {
+		m->node_ids = malloc(n * sizeof(int));
+		int ok = m->node_ids != NULL;
+		for (int i = 0; i < m->hugepage_size_count; ++i) {
+			m->hugepages[i].node_total = calloc(n, sizeof(uint64_t));
+			m->hugepages[i].node_free = calloc(n, sizeof(uint64_t));
+			ok = ok && m->hugepages[i].node_total && m->hugepages[i].node_free;
+		}
+		if (!ok) {
+			close(nodefd);
+			return 203;
+		}
+		memcpy(m->node_ids, ids, n * sizeof(int));
+		m->node_count = n;
+		for (int i = 0; i < m->hugepage_size_count; ++i) {
+			HugePagePool* p = &m->hugepages[i];
+			unsigned long long kb = (unsigned long long)(p->size_bytes / 1024);
+			for (int k = 0; k < n; ++k) {
+				char rel[128];
+				snprintf(rel, sizeof(rel), "node%d/hugepages/hugepages-%llukB/nr_hugepages", ids[k], kb);
+				p->node_total[k] = read_u64_at(nodefd, rel);
+				snprintf(rel, sizeof(rel), "node%d/hugepages/hugepages-%llukB/free_hugepages", ids[k], kb);
+				p->node_free[k] = read_u64_at(nodefd, rel);
+			}
+		}
+	}
+	if (nodefd >= 0) {
+		close(nodefd);
+	}
+
+	if (read_text_at(AT_FDCWD, "/sys/kernel/mm/transparent_hugepage/enabled", buf, sizeof(buf)) > 0) {
+		char mode[16];
+		bracketed_word(buf, mode, sizeof(mode));
+		m->thp_mode = !strcmp(mode, "always") ? CPU_THP_ALWAYS : !strcmp(mode, "madvise") ? CPU_THP_MADVISE
+			: !strcmp(mode, "never") ? CPU_THP_NEVER : CPU_THP_UNKNOWN;
+	}
+	if (read_text_at(AT_FDCWD, "/sys/kernel/mm/transparent_hugepage/defrag", buf, sizeof(buf)) > 0) {
+		bracketed_word(buf, m->thp_defrag, sizeof(m->thp_defrag));
+	}
+	m->thp_pmd_bytes = read_u64_at(AT_FDCWD, "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+	return 0;
+}
+#endif
+
+/*
+ * Pin the calling thread to one logical CPU and restore it afterwards.
+ * Used by the CPUID probes that need per‐CPU answers (x2APIC ID and,
+ * on hybrid parts, the cache leaves).
+ */
+#if defined(_WIN32)
+typedef struct {
+	GROUP_AFFINITY saved;
+	int valid;
+} affinity_save;
+
+static void save_affinity(affinity_save* s) {
+	s->valid = GetThreadGroupAffinity(GetCurrentThread(), &s->saved) ? 1 : 0;
+}
+
+static int pin_to_logical(int cpu) {
+	GROUP_AFFINITY ga;
+	WORD group;
+	BYTE number;
+	if (logical_to_group(cpu, &group, &number) != 0) {
+		return -1;
+	}
+	memset(&ga, 0, sizeof(ga));
+	ga.Group = group;
+	ga.Mask = (KAFFINITY)1 << number;
+	return SetThreadGroupAffinity(GetCurrentThread(), &ga, NULL) ? 0 : -1;
+}
+
+static void restore_affinity(const affinity_save* s) {
+	if (s->valid) {
+		SetThreadGroupAffinity(GetCurrentThread(), &s->saved, NULL);
+	}
+}
+#else
+/* cpu_set_t only holds CPU_SETSIZE (1024) CPUs; these masks are CPU_ALLOC'd */
+typedef struct {
+	cpu_set_t* saved;
+	size_t size;
+} affinity_save;
+
+/* Current thread mask, grown until the kernel's nr_cpu_ids fits */
+static cpu_set_t* read_affinity(int* cpus, size_t* size) {
+	int n = get_nprocs_conf();
+	for (n = n > 64 ? n : 64; n <= (1 << 20); n *= 2) {
+		cpu_set_t* set = CPU_ALLOC(n);
+		if (!set) {
+			return NULL;
+		}
+		*size = CPU_ALLOC_SIZE(n);
+		if (sched_getaffinity(0, *size, set) == 0) {
+			*cpus = n;
+			return set;
+		}
+		CPU_FREE(set);
+		if (errno != EINVAL) {
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+static void save_affinity(affinity_save* s) {
+	int n;
+	s->saved = read_affinity(&n, &s->size);
+}
+
+static int pin_to_logical(int cpu) {
+	if (cpu < 0) {
+		return -1;
+	}
+	cpu_set_t* set = CPU_ALLOC(cpu + 1);
+	if (!set) {
+		return -1;
+	}
+	size_t size = CPU_ALLOC_SIZE(cpu + 1);
+	CPU_ZERO_S(size, set);
+	CPU_SET_S(cpu, size, set);
+	int rc = sched_setaffinity(0, size, set);
+	CPU_FREE(set);
+	return rc;
+}
+
+/* Restore and release the saved mask */
+static void restore_affinity(const affinity_save* s) {
+	if (s->saved) {
+		sched_setaffinity(0, s->size, s->saved);
+		CPU_FREE(s->saved);
+	}
+}
+#endif
+
+/* Where topology and cache data come from; see the header for the order */
+static CpuProbeMode probe_mode = CPU_PROBE_AUTO;
+
+DLL_EXPORT void set_cpu_probe_mode(CpuProbeMode mode) {
+	probe_mode = mode;
+}
+
+/* Resolve the probes' /sys and /proc paths under root (NULL = the live tree) */
+DLL_EXPORT int set_cpu_sysfs_root(const char* root) {
+#if defined(_WIN32)
+	return root ? 202 : 0;
+#else
+	int fd = AT_FDCWD;
+	if (root && (fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+		return 202;
+	}
+	int old = probe_root_fd;
+	probe_root_fd = fd;
+	if (old != AT_FDCWD) {
+		close(old);
+	}
+	return 0;
+#endif
+}
+
+/* One deterministic cache descriptor from leaf 4 / 0x8000001D */
+typedef struct {
+	int level;
+	int type;			/* 1 data, 2 instruction, 3 unified */
+	int size_kb;
+	int line_size;
+	int ways;			/* 0 = fully associative */
+	int sets;
+	int inclusive;		/* of lower levels, -1 unknown */
+	int share_shift;	/* APIC‐ID bits covered by the sharing domain */
+} cpuid_cache;
+
+#define CPUID_MAX_CACHES 8
+
+static int ceil_log2(unsigned int v) {
+	int s = 0;
+	while ((1u << s) < v) s++;
+	return s;
+}
+
+/*
+ * AMD 0x80000006 associativity field -> ways (0 = full or reserved,
+ * -1 = none).  Zen parts report 9 for "see leaf 0x8000001D".
+ */
+#define AMD_ASSOC_SEE_1D	(-2)
+static int amd_assoc(int code) {
+	static const int ways[16] = { -1, 1, 2, 3, 4, 6, 8, 0, 16, AMD_ASSOC_SEE_1D, 32, 48, 64, 96, 128, 0 };
+	return ways[code & 0xF];
+}
+
+/* Ways of the unified level‐`level` cache from leaf 0x8000001D, 0 if absent */
+static int amd_leaf_1d_ways(unsigned int max_ext, int level) {
+	int regs[4];
+	if (max_ext < 0x8000001Du) {
+		return 0;
+	}
+	for (int sub = 0; sub < 16; ++sub) {
+		cpu_cpuid(0x8000001D, sub, regs);
+		int type = regs[0] & 0x1F;
+		if (type == 0) {
+			break;
+		}
+		if (type == 3 && ((regs[0] >> 5) & 0x7) == level) {
+			return (regs[0] & (1 << 9)) ? 0 : (int)(((regs[1] >> 22) & 0x3FF) + 1);
+		}
+	}
+	return 0;
+}
+
+/* Ways of a legacy L2/L3 from its 0x80000006 field */
+static int amd_cache_ways(unsigned int max_ext, int level, int code) {
+	int ways = amd_assoc(code);
+	if (ways == AMD_ASSOC_SEE_1D) {
+		return amd_leaf_1d_ways(max_ext, level);
+	}
+	return ways > 0 ? ways : 0;
+}
+
+/*
+ * SMT and package shifts from the extended topology leaf (0x1F if it is
+ * populated, else 0xB).  Returns -1 when neither leaf is available.
+ */
+static int cpuid_topology_leaf(int* leaf, int* smt_shift, int* pkg_shift) {
+	int regs[4];
+	cpu_cpuid(0, 0, regs);
+	int max_leaf = regs[0];
+	if (max_leaf < 0xB) {
+		return -1;
+	}
+
+	*leaf = 0xB;
+	if (max_leaf >= 0x1F) {
+		cpu_cpuid(0x1F, 0, regs);
+		if (regs[1] != 0) {
+			*leaf = 0x1F;
+		}
+	}
+	cpu_cpuid(*leaf, 0, regs);
+	if (regs[1] == 0) {
+		return -1;
+	}
+
+	*smt_shift = 0;
+	*pkg_shift = 0;
+	for (int sub = 0; sub < 8; ++sub) {
+		cpu_cpuid(*leaf, sub, regs);
+		int type = (regs[2] >> 8) & 0xFF;
+		if (type == 0) {
+			break;
+		}
+		if (type == 1) {
+			*smt_shift = regs[0] & 0x1F;
+		}
+		*pkg_shift = regs[0] & 0x1F;	/* last level spans the package */
+	}
+	return 0;
+}
+
+/*
+ * Pre‐TOPOEXT AMD parts: L1 from 0x80000005, L2/L3 from 0x80000006.
+ * These cores have no SMT, so L1/L2 are per core and L3 spans the
+ * package (the ApicIdCoreIdSize bits of 0x80000008).
+ */
+static int legacy_amd_caches(const char* vendor, cpuid_cache* out) {
+	int regs[4], n = 0;
+	if (strcmp(vendor, "AuthenticAMD") != 0) {
+		return 0;
+	}
+	cpu_cpuid(0x80000000, 0, regs);
+	unsigned int max_ext = (unsigned int)regs[0];
+	if (max_ext < 0x80000006u) {
+		return 0;
+	}
+	int core_bits = 0;
+	if (max_ext >= 0x80000008u) {
+		cpu_cpuid(0x80000008, 0, regs);
+		core_bits = (regs[2] >> 12) & 0xF;
+		if (core_bits == 0) {
+			core_bits = ceil_log2((unsigned int)(regs[2] & 0xFF) + 1);
+		}
+	}
+
+	cpu_cpuid(0x80000005, 0, regs);
+	for (int r = 2; r <= 3; ++r) {
+		unsigned int v = (unsigned int)regs[r];
+		int assoc = (v >> 16) & 0xFF;
+		if (v >> 24) {
+			cpuid_cache* c = &out[n++];
+			memset(c, 0, sizeof(*c));
+			c->level = 1;
+			c->type = r == 2 ? 1 : 2;
+			c->size_kb = (int)(v >> 24);
+			c->line_size = v & 0xFF;
+			c->ways = assoc == 0xFF ? 0 : assoc;
+			c->inclusive = -1;
+		}
+	}
+
+	cpu_cpuid(0x80000006, 0, regs);
+	unsigned int l2 = (unsigned int)regs[2], l3 = (unsigned int)regs[3];
+	if (l2 >> 16) {
+		cpuid_cache* c = &out[n++];
+		memset(c, 0, sizeof(*c));
+		c->level = 2;
+		c->type = 3;
+		c->size_kb = (int)(l2 >> 16);
+		c->line_size = l2 & 0xFF;
+		c->ways = amd_cache_ways(max_ext, 2, (int)(l2 >> 12));
+		c->inclusive = -1;
+	}
+	if (l3 >> 18) {
+		cpuid_cache* c = &out[n++];
+		memset(c, 0, sizeof(*c));
+		c->level = 3;
+		c->type = 3;
+		c->size_kb = (int)(l3 >> 18) * 512;
+		c->line_size = l3 & 0xFF;
+		c->ways = amd_cache_ways(max_ext, 3, (int)(l3 >> 12));
+		c->inclusive = -1;
+		c->share_shift = core_bits;
+	}
+	for (int i = 0; i < n; ++i) {
+		if (out[i].ways > 0 && out[i].line_size > 0) {
+			out[i].sets = out[i].size_kb * 1024 / (out[i].ways * out[i].line_size);
+		}
+	}
+	return n;
+}
+
+/* Cache descriptors of the CPU we are running on */
+static int cpuid_cache_leaves(cpuid_cache* out) {
+	int regs[4], leaf = 0, n = 0;
+	char vendor[13];
+	get_cpu_vendor(vendor);
+
+	if (strcmp(vendor, "AuthenticAMD") == 0 || strcmp(vendor, "HygonGenuine") == 0) {
+		cpu_cpuid(0x80000001, 0, regs);
+		if (regs[2] & (1 << 22)) {		/* TOPOEXT */
+			leaf = 0x8000001D;
+		}
+	}
+	else {
+		cpu_cpuid(0, 0, regs);
+		if (regs[0] >= 4) {
+			leaf = 4;
+		}
+	}
+	if (!leaf) {
+		return legacy_amd_caches(vendor, out);
+	}
+
+	for (int sub = 0; sub < 16 && n < CPUID_MAX_CACHES; ++sub) {
+		cpu_cpuid(leaf, sub, regs);
+		int type = regs[0] & 0x1F;
+		if (type == 0) {
+			break;
+		}
+		unsigned int sharing = ((regs[0] >> 14) & 0xFFF) + 1;
+		long long line = (regs[1] & 0xFFF) + 1;
+		long long parts = ((regs[1] >> 12) & 0x3FF) + 1;
+		long long ways = ((regs[1] >> 22) & 0x3FF) + 1;
+		long long sets = (long long)(unsigned int)regs[2] + 1;
+
+		out[n].level = (regs[0] >> 5) & 0x7;
+		out[n].type = type;
+		out[n].size_kb = (int)(ways * parts * line * sets / 1024);
+		out[n].line_size = (int)line;
+		out[n].ways = (regs[0] & (1 << 9)) ? 0 : (int)ways;
+		out[n].sets = (int)sets;
+		out[n].inclusive = !!(regs[3] & (1 << 1));
+		out[n].share_shift = ceil_log2(sharing);
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Turn per‐CPU descriptors into cache domains: two CPUs share an instance
+ * when level, type and APIC ID >> share_shift agree.  CPUs we could not
+ * pin get private instances.
+ */
+static int cpuid_cache_domains(CPU_DATA* data, const unsigned int* apic, const signed char* pinned,
+	const cpuid_cache* caches, const int* ncaches) {
+	int L = data->logical_core_count;
+	int total = 0;
+	for (int cpu = 0; cpu < L; ++cpu) total += ncaches[cpu];
+
+	reset_cache_domains(data);
+	int* keys = malloc((total ? total : 1) * sizeof(int));
+	int* group_of = malloc((total ? total : 1) * sizeof(int));
+	int* owner = malloc((total ? total : 1) * sizeof(int));
+	int* desc = malloc((total ? total : 1) * sizeof(int));
+	int* order = malloc((total ? total : 1) * sizeof(int));
+	int* start = calloc((size_t)total + 1, sizeof(int));
+	int* cpus = malloc((L ? L : 1) * sizeof(int));
+	int rc = (keys && group_of && owner && desc && order && start && cpus) ? 0 : 203;
+
+	int e = 0;
+	for (int cpu = 0; cpu < L && rc == 0; ++cpu) {
+		for (int c = 0; c < ncaches[cpu]; ++c, ++e) {
+			const cpuid_cache* cc = &caches[(size_t)cpu * CPUID_MAX_CACHES + c];
+			unsigned int inst = pinned[cpu] ? (apic[cpu] >> cc->share_shift) : (0x1000000u | (unsigned int)cpu);
+			keys[e] = (int)(((unsigned int)cc->level << 28) | ((unsigned int)cc->type << 26) | (inst & 0x3FFFFFFu));
+			owner[e] = cpu;
+			desc[e] = cpu * CPUID_MAX_CACHES + c;
+		}
+	}
+
+	int groups = rc == 0 ? group_keys(keys, total, group_of, NULL) : -1;
+	if (groups < 0) {
+		rc = 203;
+	}
+	else {
+		/* bucket entries by group, preserving CPU order */
+		for (int i = 0; i < total; ++i) start[group_of[i] + 1]++;
+		for (int g = 0; g < groups; ++g) start[g + 1] += start[g];
+		for (int i = 0; i < total; ++i) order[start[group_of[i]]++] = i;
+		for (int g = groups; g > 0; --g) start[g] = start[g - 1];
+		start[0] = 0;
+
+		for (int g = 0; g < groups && rc == 0; ++g) {
+			int first = order[start[g]];
+			int n = 0;
+			for (int k = start[g]; k < start[g + 1]; ++k) cpus[n++] = owner[order[k]];
+
+			const cpuid_cache* cc = &caches[desc[first]];
+
+			CacheDomain proto;
+			memset(&proto, 0, sizeof(proto));
+			proto.level = cc->level;
+			proto.type = cc->type == 2 ? CACHE_TYPE_INSTRUCTION : cc->type == 1 ? CACHE_TYPE_DATA : CACHE_TYPE_UNIFIED;
+			proto.size_kb = cc->size_kb;
+			proto.line_size = cc->line_size;
+			proto.associativity = cc->ways;
+			proto.sets = cc->sets;
+			proto.inclusive = cc->inclusive;
+			rc = add_cache_domain(data, &proto, cpus, n);
+		}
+	}
+
+	free(keys); free(group_of); free(owner); free(desc); free(order); free(start); free(cpus);
+	derive_cache_summary(data);
+	return rc;
+}
+
+/*
+ * Fill inclusive (and sets where the OS left it out) on the OS‐probed
+ * domains from this CPU's deterministic cache leaves.
+ */
+static void annotate_cache_domains(CPU_DATA* data) {
+	cpuid_cache desc[CPUID_MAX_CACHES];
+	int n = cpuid_cache_leaves(desc);
+	for (int i = 0; i < data->cache_count; ++i) {
+		CacheDomain* d = &data->caches[i];
+		for (int k = 0; k < n; ++k) {
+			CacheType t = desc[k].type == 2 ? CACHE_TYPE_INSTRUCTION
+				: desc[k].type == 1 ? CACHE_TYPE_DATA : CACHE_TYPE_UNIFIED;
+			if (desc[k].level != d->level || t != d->type) {
+				continue;
+			}
+			if (d->inclusive < 0) {
+				d->inclusive = desc[k].inclusive;
+			}
+			if (d->sets == 0) {
+				d->sets = desc[k].sets;
+			}
+			break;
+		}
+	}
+}
+
+/* Page‐size bits used by the TLB tables below */
+#define TLB_4K	1
+#define TLB_2M	2
+#define TLB_4M	4
+#define TLB_1G	8
+
+/* One leaf 2 TLB descriptor (a byte may describe two TLBs) */
+typedef struct {
+	unsigned char code;
+	unsigned char level;
+	unsigned char type;		/* 1 data, 2 instruction, 3 unified */
+	unsigned char pages;	/* TLB_* mask */
+	short entries;
+	short ways;				/* 0 = fully associative */
+} tlb_descriptor;
+
+/* Intel SDM vol. 2A table 3‐12, TLB rows only */
+static const tlb_descriptor leaf2_tlbs[] = {
+	{ 0x01, 1, 2, TLB_4K, 32, 4 },			{ 0x02, 1, 2, TLB_4M, 2, 0 },
+	{ 0x03, 1, 1, TLB_4K, 64, 4 },			{ 0x04, 1, 1, TLB_4M, 8, 4 },
+	{ 0x05, 1, 1, TLB_4M, 32, 4 },			{ 0x0B, 1, 2, TLB_4M, 4, 4 },
+	{ 0x4F, 1, 2, TLB_4K, 32, 0 },			{ 0x50, 1, 2, TLB_4K | TLB_2M | TLB_4M, 64, 0 },
+	{ 0x51, 1, 2, TLB_4K | TLB_2M | TLB_4M, 128, 0 },
+	{ 0x52, 1, 2, TLB_4K | TLB_2M | TLB_4M, 256, 0 },
+	{ 0x55, 1, 2, TLB_2M | TLB_4M, 7, 0 },	{ 0x56, 1, 1, TLB_4M, 16, 4 },
+	{ 0x57, 1, 1, TLB_4K, 16, 4 },			{ 0x59, 1, 1, TLB_4K, 16, 0 },
+	{ 0x5A, 1, 1, TLB_2M | TLB_4M, 32, 4 },	{ 0x5B, 1, 1, TLB_4K | TLB_4M, 64, 0 },
+	{ 0x5C, 1, 1, TLB_4K | TLB_4M, 128, 0 },	{ 0x5D, 1, 1, TLB_4K | TLB_4M, 256, 0 },
+	{ 0x61, 1, 2, TLB_4K, 48, 0 },			{ 0x63, 1, 1, TLB_2M | TLB_4M, 32, 4 },
+	{ 0x63, 1, 1, TLB_1G, 4, 4 },			{ 0x64, 1, 1, TLB_4K, 512, 4 },
+	{ 0x6A, 1, 1, TLB_4K, 64, 8 },			{ 0x6B, 1, 1, TLB_4K, 256, 8 },
+	{ 0x6C, 1, 1, TLB_2M | TLB_4M, 128, 8 },	{ 0x6D, 1, 1, TLB_1G, 16, 0 },
+	{ 0x76, 1, 2, TLB_2M | TLB_4M, 8, 0 },	{ 0xA0, 1, 1, TLB_4K, 32, 0 },
+	{ 0xB0, 1, 2, TLB_4K, 128, 4 },			{ 0xB1, 1, 2, TLB_2M, 8, 4 },
+	{ 0xB2, 1, 2, TLB_4K, 64, 4 },			{ 0xB3, 1, 1, TLB_4K, 128, 4 },
+	{ 0xB4, 1, 1, TLB_4K, 256, 4 },			{ 0xB5, 1, 2, TLB_4K, 64, 8 },
+	{ 0xB6, 1, 2, TLB_4K, 128, 8 },			{ 0xBA, 1, 1, TLB_4K, 64, 4 },
+	{ 0xC0, 1, 1, TLB_4K | TLB_4M, 8, 4 },	{ 0xC1, 2, 3, TLB_4K | TLB_2M, 1024, 8 },
+	{ 0xC2, 1, 1, TLB_4K | TLB_2M, 16, 4 },	{ 0xC3, 2, 3, TLB_4K | TLB_2M, 1536, 6 },
+	{ 0xC3, 2, 3, TLB_1G, 16, 4 },			{ 0xC4, 1, 1, TLB_2M | TLB_4M, 32, 4 },
+	{ 0xCA, 2, 3, TLB_4K, 512, 4 },
+};
+
+static int add_tlb(CPU_DATA* data, int level, int type, int pages, int entries, int ways) {
+	static const int page_kb[4] = { 4, 2048, 4096, 1048576 };
+	for (int b = 0; b < 4; ++b) {
+		if (!(pages & (1 << b)) || entries <= 0) {
+			continue;
+		}
+		int count = data->tlb_count;
+		if ((count & (count - 1)) == 0) {
+			TlbInfo* grown = realloc(data->tlbs, (count ? 2 * count : 4) * sizeof(*grown));
+			if (!grown) {
+				return 203;
+			}
+			data->tlbs = grown;
+		}
+		TlbInfo* t = &data->tlbs[count];
+		t->level = level;
+		t->type = type == 2 ? CACHE_TYPE_INSTRUCTION : type == 1 ? CACHE_TYPE_DATA : CACHE_TYPE_UNIFIED;
+		t->page_size_kb = page_kb[b];
+		t->entries = entries;
+		t->associativity = ways;
+		data->tlb_count = count + 1;
+	}
+	return 0;
+}
+
+/* One 0x80000005‐style 8/8/8/8 register: D assoc, D entries, I assoc, I entries */
+static int add_amd_tlbs_8(CPU_DATA* data, unsigned int r, int pages) {
+	int rc = add_tlb(data, 1, 1, pages, (r >> 16) & 0xFF, ((r >> 24) & 0xFF) == 0xFF ? 0 : (int)((r >> 24) & 0xFF));
+	if (rc == 0) {
+		rc = add_tlb(data, 1, 2, pages, r & 0xFF, ((r >> 8) & 0xFF) == 0xFF ? 0 : (int)((r >> 8) & 0xFF));
+	}
+	return rc;
+}
+
+/*
+ * One 0x80000006‐style 4/12/4/12 register (also 0x80000019).  Leaf
+ * 0x8000001D describes no TLBs, so a "see 0x8000001D" field keeps the
+ * TLB with its ways unknown.
+ */
+static int add_amd_tlbs_12(CPU_DATA* data, unsigned int r, int level, int pages) {
+	int rc = 0;
+	int dways = amd_assoc((int)(r >> 28)), iways = amd_assoc((int)(r >> 12));
+	if (dways != -1) {
+		rc = add_tlb(data, level, 1, pages, (r >> 16) & 0xFFF, dways > 0 ? dways : 0);
+	}
+	if (rc == 0 && iways != -1) {
+		rc = add_tlb(data, level, 2, pages, r & 0xFFF, iways > 0 ? iways : 0);
+	}
+	return rc;
+}
+
+/*
+ * TLBs from CPUID: Intel leaf 0x18 (deterministic) or leaf 2 descriptors,
+ * AMD 0x80000005/0x80000006 and 0x80000019 for 1 GiB pages.  Also sets
+ * the prefetch and false‐sharing strides.
+ */
+static int populate_tlbs(CPU_DATA* data) {
+	int regs[4], rc = 0;
+	char vendor[13];
+	get_cpu_vendor(vendor);
+	int is_amd = (strcmp(vendor, "AuthenticAMD") == 0 || strcmp(vendor, "HygonGenuine") == 0);
+	int is_intel = strcmp(vendor, "GenuineIntel") == 0;
+	cpu_cpuid(0, 0, regs);
+	int max_leaf = regs[0];
+	cpu_cpuid(0x80000000, 0, regs);
+	unsigned int max_ext = (unsigned int)regs[0];
+
+	int line = (data->logical_core_count > 0 && data->cache_of[0].l1d >= 0)
+		? data->caches[data->cache_of[0].l1d].line_size : 64;
+	data->prefetch_bytes = line;
+	/* Intel's spatial prefetcher pulls lines in 128‐byte aligned pairs */
+	data->false_sharing_bytes = is_intel ? 2 * line : line;
+
+	free(data->tlbs);
+	data->tlbs = NULL;
+	data->tlb_count = 0;
+
+	if (is_amd) {
+		if (max_ext >= 0x80000005u) {
+			cpu_cpuid(0x80000005, 0, regs);
+			/* the 2M/4M TLBs are listed as 2M: long mode has no 4M pages */
+			rc = add_amd_tlbs_8(data, (unsigned int)regs[0], TLB_2M);
+			if (rc == 0) rc = add_amd_tlbs_8(data, (unsigned int)regs[1], TLB_4K);
+		}
+		if (rc == 0 && max_ext >= 0x80000006u) {
+			cpu_cpuid(0x80000006, 0, regs);
+			rc = add_amd_tlbs_12(data, (unsigned int)regs[0], 2, TLB_2M);
+			if (rc == 0) rc = add_amd_tlbs_12(data, (unsigned int)regs[1], 2, TLB_4K);
+		}
+		if (rc == 0 && max_ext >= 0x80000019u) {
+			cpu_cpuid(0x80000019, 0, regs);
+			rc = add_amd_tlbs_12(data, (unsigned int)regs[0], 1, TLB_1G);
+			if (rc == 0) rc = add_amd_tlbs_12(data, (unsigned int)regs[1], 2, TLB_1G);
+		}
+		return rc;
+	}
+
+	if (max_leaf >= 0x18) {
+		cpu_cpuid(0x18, 0, regs);
+		int subleaves = regs[0];
+		for (int sub = 0; sub <= subleaves && rc == 0; ++sub) {
+			cpu_cpuid(0x18, sub, regs);
+			int type = regs[3] & 0x1F;
+			if (type == 0) {
+				continue;
+			}
+			int ways = (regs[3] & (1 << 8)) ? 0 : (int)((regs[1] >> 16) & 0xFFFF);
+			int entries = (int)((regs[1] >> 16) & 0xFFFF) * regs[2];
+			/* 4 = load‐only, 5 = store‐only: both data‐side */
+			rc = add_tlb(data, (regs[3] >> 5) & 0x7, type >= 4 ? 1 : type, regs[1] & 0xF, entries, ways);
+		}
+		if (data->tlb_count > 0 || rc != 0) {
+			return rc;
+		}
+	}
+
+	if (max_leaf >= 2) {
+		cpu_cpuid(2, 0, regs);
+		for (int r = 0; r < 4 && rc == 0; ++r) {
+			if (regs[r] & (1U << 31)) {
+				continue;		/* register holds no descriptors */
+			}
+			for (int byte = (r == 0) ? 1 : 0; byte < 4 && rc == 0; ++byte) {
+				unsigned char code = (unsigned char)(regs[r] >> (8 * byte));
+				if (code == 0xF0) data->prefetch_bytes = 64;
+				if (code == 0xF1) data->prefetch_bytes = 128;
+				for (size_t k = 0; k < sizeof(leaf2_tlbs) / sizeof(leaf2_tlbs[0]); ++k) {
+					const tlb_descriptor* t = &leaf2_tlbs[k];
+					if (t->code == code) {
+						rc = add_tlb(data, t->level, t->type, t->pages, t->entries, t->ways);
+					}
+				}
+			}
+		}
+	}
+	return rc;
+}
+
+/*
+ * Tuning helpers.  The budget keeps one way free for stack, pointers and
+ * the output stream, and with `concurrent` set splits the cache between
+ * the logical CPUs sharing it (every sharer running its own tile).
+ */
+static const CacheDomain* tile_cache(const CPU_DATA* data, int level) {
+	if (!data || !data->cache_of || data->logical_core_count <= 0) {
+		return NULL;
+	}
+	const CacheDomainIndex* idx = &data->cache_of[0];
+	int i = level == 1 ? idx->l1d : level == 2 ? idx->l2 : level == 3 ? idx->l3 : -1;
+	return i >= 0 ? &data->caches[i] : NULL;
+}
+
+DLL_EXPORT size_t cpu_cache_budget(const CPU_DATA* data, int level, int concurrent) {
+	const CacheDomain* c = tile_cache(data, level);
+	if (!c || c->size_kb <= 0) {
+		return 0;
+	}
+	size_t bytes = (size_t)c->size_kb * 1024;
+	if (c->associativity > 1) {
+		bytes = bytes / c->associativity * (c->associativity - 1);
+	}
+	if (concurrent && c->cpu_count > 1) {
+		bytes /= c->cpu_count;
+	}
+	return bytes;
+}
+
+/* Elements per array when `arrays` arrays share the budget, whole cache lines */
+DLL_EXPORT size_t cpu_tile_elements(const CPU_DATA* data, int level, size_t elem_size,
+	int arrays, int concurrent) {
+	const CacheDomain* c = tile_cache(data, level);
+	if (!c || elem_size == 0 || arrays <= 0) {
+		return 0;
+	}
+	size_t line = c->line_size > 0 ? (size_t)c->line_size : 64;
+	size_t per_array = cpu_cache_budget(data, level, concurrent) / (size_t)arrays;
+	per_array -= per_array % line;
+	return per_array / elem_size;
+}
+
+/* Side of a square block, rounded down to whole lines of elements when it allows */
+DLL_EXPORT int cpu_square_tile(const CPU_DATA* data, int level, size_t elem_size,
+	int arrays, int concurrent) {
+	size_t n = cpu_tile_elements(data, level, elem_size, arrays, concurrent);
+	size_t side = 0;
+	while ((side + 1) * (side + 1) <= n) {
+		side++;
+	}
+	const CacheDomain* c = tile_cache(data, level);
+	size_t per_line = (c && c->line_size > 0 && elem_size < (size_t)c->line_size)
+		? (size_t)c->line_size / elem_size : 1;
+	if (side >= per_line) {
+		side -= side % per_line;
+	}
+	return (int)side;
+}
+
+/*
+ * Build topology and/or caches from CPUID alone.  Each logical CPU is
+ * visited once to read its x2APIC ID; the cache leaves are read on every
+ * CPU only on hybrid parts, where P‐ and E‐cores report different caches.
+ * CPUs we may not run on (restricted affinity) are reported as their own
+ * core with the caches of the first CPU.
+ */
+static int cpuid_probe(CPU_DATA* data, int want_topology, int want_caches) {
+	int leaf, smt_shift, pkg_shift;
+	if (cpuid_topology_leaf(&leaf, &smt_shift, &pkg_shift) != 0) {
+		return 209;
+	}
+
+	int regs[4];
+	cpu_cpuid(7, 0, regs);
+	int hybrid = !!(regs[3] & (1 << 15));
+
+	int L = data->logical_core_count;
+	unsigned int* apic = malloc(L * sizeof(unsigned int));
+	signed char* pinned = calloc(L, 1);
+	cpuid_cache* caches = calloc((size_t)L * CPUID_MAX_CACHES, sizeof(cpuid_cache));
+	int* ncaches = calloc(L, sizeof(int));
+	int* keys = malloc(L * sizeof(int));
+	signed char* online = NULL;
+	int known = probe_online_cpus(&online, NULL);
+	if (!apic || !pinned || !caches || !ncaches || !keys || known < 0) {
+		free(apic); free(pinned); free(caches); free(ncaches); free(keys); free(online);
+		return 203;
+	}
+
+	affinity_save save;
+	int have_caches = 0;
+	save_affinity(&save);
+	for (int cpu = 0; cpu < L; ++cpu) {
+		if (cpu >= known || !online[cpu]) {
+			continue;	/* offline: nothing to pin to, and not a core */
+		}
+		if (L > 1 && pin_to_logical(cpu) != 0) {
+			continue;
+		}
+		pinned[cpu] = 1;
+		cpu_cpuid(leaf, 0, regs);
+		apic[cpu] = (unsigned int)regs[3];
+		if (want_caches && (hybrid || !have_caches)) {
+			ncaches[cpu] = cpuid_cache_leaves(&caches[(size_t)cpu * CPUID_MAX_CACHES]);
+			have_caches = 1;
+		}
+	}
+	restore_affinity(&save);
+
+	/* online CPUs without their own descriptors inherit the first one found */
+	int ref = 0;
+	while (ref < L && ncaches[ref] == 0) ref++;
+	for (int cpu = 0; cpu < L && ref < L; ++cpu) {
+		if (ncaches[cpu] == 0 && cpu < known && online[cpu]) {
+			memcpy(&caches[(size_t)cpu * CPUID_MAX_CACHES], &caches[(size_t)ref * CPUID_MAX_CACHES],
+				CPUID_MAX_CACHES * sizeof(cpuid_cache));
+			ncaches[cpu] = ncaches[ref];
+		}
+	}
+
+	int rc = 0;
+	if (want_caches) {
+		rc = cpuid_cache_domains(data, apic, pinned, caches, ncaches);
+	}
+
+	if (want_topology && rc == 0) {
+		unsigned int core_mask = (1u << (pkg_shift - smt_shift)) - 1;
+		for (int cpu = 0; cpu < L; ++cpu) {
+			if (pinned[cpu]) {
+				unsigned int pkg = apic[cpu] >> pkg_shift;
+				unsigned int core = (apic[cpu] >> smt_shift) & core_mask;
+				keys[cpu] = (int)((pkg << 16) | (core & 0xFFFF));
+			}
+			else if (cpu < known && online[cpu]) {
+				keys[cpu] = 0x7FFF0000 | cpu;	/* unknown: a core of its own */
+			}
+			else {
+				keys[cpu] = -1;
+			}
+		}
+		rc = build_cores_from_keys(data, keys);
+	}
+
+	free(apic); free(pinned); free(caches); free(ncaches); free(keys); free(online);
+	return rc;
+}
+
+/*
+ * Fill cores[] and the cache fields following the probe mode:
+ *   AUTO   OS source first, CPUID for whatever it could not provide
+ *   CPUID  CPUID first, OS source if CPUID lacks topology leaves
+ *   OS     OS source only
+ */
+static int probe_topology_and_caches(CPU_DATA* data, int want_topology, int want_caches) {
+	if (!want_topology && !want_caches) {
+		return 0;
+	}
+	probe_mark mark = { 0 };
+	if (probe_mode == CPU_PROBE_CPUID) {
+		phase_begin(&mark);
+		int rc = cpuid_probe(data, want_topology, want_caches);
+		phase_end(&mark, CPU_PHASE_CPUID_TOPOLOGY);
+		if (rc == 0) {
+			return 0;
+		}
+	}
+
+	int cache_rc = 0, topo_rc = 0;
+	if (want_caches) {
+		phase_begin(&mark);
+		cache_rc = populate_caches(data);
+		phase_end(&mark, CPU_PHASE_CACHES);
+	}
+	if (want_topology) {
+		phase_begin(&mark);
+		topo_rc = get_core_topology(data);
+		phase_end(&mark, CPU_PHASE_TOPOLOGY);
+	}
+	if (probe_mode == CPU_PROBE_AUTO && (topo_rc != 0 || cache_rc != 0)) {
+		phase_begin(&mark);
+		if (cpuid_probe(data, topo_rc != 0, cache_rc != 0) == 0) {
+			topo_rc = cache_rc = 0;
+		}
+		phase_end(&mark, CPU_PHASE_CPUID_TOPOLOGY);
+	}
+	/* a topology failure is the more useful code; otherwise report the caches */
+	return topo_rc ? topo_rc : cache_rc;
+}
+
+/* CPUID leaf 0x1A core type of the CPU we are running on */
+static CoreType cpuid_core_type(void) {
+	int regs[4];
+	cpu_cpuid(0x1A, 0, regs);
+	switch ((regs[0] >> 24) & 0xFF) {
+		case 0x40: return CORE_TYPE_PERFORMANCE;	/* Core */
+		case 0x20: return CORE_TYPE_EFFICIENCY;		/* Atom */
+		default:   return CORE_TYPE_UNKNOWN;
+	}
+}
+
+/*
+ * Resolve cores[].type where the topology source left it unknown and
+ * count the two kinds.  Linux: the cpu_core / cpu_atom PMU cpu lists;
+ * then, on hybrid parts (CPUID.7.EDX[15]), leaf 0x1A run on one logical
+ * CPU of each core.  Non‐hybrid x86 parts are all performance cores.
+ */
+static void classify_core_types(CPU_DATA* data) {
+	int L = data->logical_core_count;
+	int unresolved = 0;
+
+	for (int i = 0; i < data->physical_core_count; ++i) {
+		unresolved += (data->cores[i].type == CORE_TYPE_UNKNOWN);
+	}
+
+#if !defined(_WIN32)
+	signed char* type_of = unresolved ? malloc(L) : NULL;
+	if (type_of) {
+		char* buf = malloc(65536);
+		memset(type_of, CORE_TYPE_UNKNOWN, L);
+		if (buf && read_text_at(AT_FDCWD, "/sys/devices/cpu_core/cpus", buf, 65536) > 0) {
+			mark_cpu_list(buf, type_of, L, CORE_TYPE_PERFORMANCE);
+			if (read_text_at(AT_FDCWD, "/sys/devices/cpu_atom/cpus", buf, 65536) > 0) {
+				mark_cpu_list(buf, type_of, L, CORE_TYPE_EFFICIENCY);
+			}
+			for (int i = 0; i < data->physical_core_count; ++i) {
+				PhysicalCoreInfo* pc = &data->cores[i];
+				if (pc->type == CORE_TYPE_UNKNOWN && pc->logical_count) {
+					pc->type = (CoreType)type_of[pc->logical_ids[0]];
+					unresolved -= (pc->type != CORE_TYPE_UNKNOWN);
+				}
+			}
+		}
+		free(buf);
+		free(type_of);
+	}
+#endif
+
+	if (unresolved) {
+		int regs[4], max_leaf;
+		cpu_cpuid(0, 0, regs);
+		max_leaf = regs[0];
+		cpu_cpuid(7, 0, regs);
+		int hybrid = max_leaf >= 7 && (regs[3] & (1 << 15));
+
+		if (hybrid && max_leaf >= 0x1A) {
+			affinity_save save;
+			save_affinity(&save);
+			for (int i = 0; i < data->physical_core_count; ++i) {
+				PhysicalCoreInfo* pc = &data->cores[i];
+				if (pc->type == CORE_TYPE_UNKNOWN && pc->logical_count &&
+					pin_to_logical(pc->logical_ids[0]) == 0) {
+					pc->type = cpuid_core_type();
+				}
+			}
+			restore_affinity(&save);
+		}
+		else if (max_leaf > 0 && !hybrid) {
+			for (int i = 0; i < data->physical_core_count; ++i) {
+				if (data->cores[i].type == CORE_TYPE_UNKNOWN) {
+					data->cores[i].type = CORE_TYPE_PERFORMANCE;
+				}
+			}
+		}
+	}
+
+	data->performance_core_count = 0;
+	data->efficiency_core_count = 0;
+	for (int i = 0; i < data->physical_core_count; ++i) {
+		data->performance_core_count += (data->cores[i].type == CORE_TYPE_PERFORMANCE);
+		data->efficiency_core_count += (data->cores[i].type == CORE_TYPE_EFFICIENCY);
+	}
+}
+
+/* Defined with the affinity helpers further down */
+DLL_EXPORT int get_cpu_budget(CpuBudget* out);
+
+static int compare_u64_desc(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* Largest shift whose multiplier still fits 32 bits; see cpu_tsc_to_ns() */
+static void tsc_set_scale(CpuTscInfo* t, uint64_t hz) {
+	t->frequency_hz = hz;
+	t->ns_mult = 0;
+	t->ns_shift = 0;
+	for (int shift = 32; hz && shift >= 0; --shift) {
+		uint64_t mult = ((1000000000ull << shift) + hz / 2) / hz;
+		if (mult <= 0xFFFFFFFFu) {
+			t->ns_mult = (uint32_t)mult;
+			t->ns_shift = (uint32_t)shift;
+			break;
+		}
+	}
+}
+
+/* TSC and monotonic time read as close together as possible */
+static void tsc_pair(uint64_t* cycles, uint64_t* ns) {
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < 5; ++i) {
+		uint64_t a = read_tsc(), t = monotonic_ns(), b = read_tsc();
+		if (b - a < best) {
+			best = b - a;
+			*cycles = a + (b - a) / 2;
+			*ns = t;
+		}
+	}
+}
+
+/* Calibrated rate shared by later probes; the TSC does not change speed */
+static uint64_t calibrated_tsc_hz;
+
+/* 64‐bit atomic so 32‐bit builds never see half a store */
+static uint64_t load_calibrated_hz(void) {
+#if defined(_WIN32)
+	return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)&calibrated_tsc_hz, 0, 0);
+#else
+	return __atomic_load_n(&calibrated_tsc_hz, __ATOMIC_RELAXED);
+#endif
+}
+
+static void store_calibrated_hz(uint64_t hz) {
+#if defined(_WIN32)
+	InterlockedExchange64((volatile LONG64*)&calibrated_tsc_hz, (LONG64)hz);
+#else
+	__atomic_store_n(&calibrated_tsc_hz, hz, __ATOMIC_RELAXED);
+#endif
+}
+
+static uint64_t measure_tsc_hz(int interval_ms) {
+	uint64_t c0 = 0, t0 = 0, c1 = 0, t1 = 0;
+	tsc_pair(&c0, &t0);
+	sleep_ms(interval_ms);
+	tsc_pair(&c1, &t1);
+	if (t1 <= t0 || c1 <= c0) {
+		return 0;
+	}
+	return (uint64_t)((double)(c1 - c0) * 1e9 / (double)(t1 - t0) + 0.5);
+}
+
+/*
+ * TSC rate from CPUID where it is enumerated: leaf 0x15 (crystal from ECX,
+ * or base clock * denominator / numerator via leaf 0x16 as the SDM
+ * describes), else the VMware / KVM timing leaf; otherwise a short
+ * calibration.
+ */
+static void populate_tsc(CpuTscInfo* t) {
+	int regs[4];
+	memset(t, 0, sizeof(*t));
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+	cpu_cpuid(0, 0, regs);
+	int max_leaf = regs[0];
+	cpu_cpuid(0x80000000, 0, regs);
+	unsigned int max_ext = (unsigned int)regs[0];
+	if (max_ext >= 0x80000001u) {
+		cpu_cpuid(0x80000001, 0, regs);
+		t->has_rdtscp = (regs[3] >> 27) & 1;
+	}
+	if (max_ext >= 0x80000007u) {
+		cpu_cpuid(0x80000007, 0, regs);
+		t->invariant = (regs[3] >> 8) & 1;
+	}
+
+	uint64_t hz = 0;
+	if (max_leaf >= 0x15) {
+		cpu_cpuid(0x15, 0, regs);
+		t->ratio_denominator = (uint32_t)regs[0];
+		t->ratio_numerator = (uint32_t)regs[1];
+		t->crystal_hz = (uint32_t)regs[2];
+		if (!t->crystal_hz && t->ratio_denominator && max_leaf >= 0x16) {
+			cpu_cpuid(0x16, 0, regs);
+			t->crystal_hz = (uint64_t)(regs[0] & 0xFFFF) * 1000000ull * t->ratio_denominator
+				/ (t->ratio_numerator ? t->ratio_numerator : 1);
+		}
+		if (t->crystal_hz && t->ratio_denominator && t->ratio_numerator) {
+			hz = t->crystal_hz * t->ratio_numerator / t->ratio_denominator;
+			t->source = CPU_TSC_CPUID;
+		}
+	}
+	if (!hz) {
+		cpu_cpuid(1, 0, regs);
+		if ((regs[2] >> 31) & 1) {
+			cpu_cpuid(0x40000000, 0, regs);
+			if ((unsigned int)regs[0] >= 0x40000010u) {
+				cpu_cpuid(0x40000010, 0, regs);
+				hz = (uint64_t)(uint32_t)regs[0] * 1000ull;
+				if (hz) t->source = CPU_TSC_HYPERVISOR;
+			}
+		}
+	}
+	if (!hz && read_tsc()) {
+		hz = load_calibrated_hz();
+		if (!hz) {
+			hz = measure_tsc_hz(5);
+			store_calibrated_hz(hz);
+		}
+		if (hz) t->source = CPU_TSC_CALIBRATED;
+	}
+	tsc_set_scale(t, hz);
+#else
+	(void)regs;
+#endif
+}
+
+/*
+ * CPUID 0x16 clocks, which also fill per‐CPU gaps, the CAPPED warning and
+ * boost_rank: dense rank of (highest_perf, max_mhz), best first.  CPUs
+ * that report the same pair share a rank, so all zero means no preference.
+ */
+static int finish_frequency_limits(CPU_DATA* data) {
+	int regs[4];
+	cpu_cpuid(0, 0, regs);
+	if (regs[0] >= 0x16) {
+		cpu_cpuid(0x16, 0, regs);
+		data->base_mhz = regs[0] & 0xFFFF;
+		data->max_mhz = regs[1] & 0xFFFF;
+		data->bus_mhz = regs[2] & 0xFFFF;
+	}
+
+	int L = data->logical_core_count;
+	uint64_t* keys = malloc((size_t)(L ? L : 1) * sizeof(uint64_t));
+	if (!keys) {
+		return 203;
+	}
+	for (int cpu = 0; cpu < L; ++cpu) {
+		CpuFrequencyLimits* f = &data->frequency_limits[cpu];
+		if (!f->base_mhz) f->base_mhz = data->base_mhz;
+		if (!f->max_mhz) f->max_mhz = data->max_mhz;
+		if (f->scaling_max_mhz && f->max_mhz && f->scaling_max_mhz < f->max_mhz) {
+			data->frequency_warnings |= CPU_FREQ_WARN_CAPPED;
+		}
+		keys[cpu] = ((uint64_t)(uint32_t)f->highest_perf << 32) | (uint32_t)f->max_mhz;
+	}
+	qsort(keys, L, sizeof(uint64_t), compare_u64_desc);
+	int unique = 0;
+	for (int i = 0; i < L; ++i) {
+		if (i == 0 || keys[i] != keys[unique - 1]) keys[unique++] = keys[i];
+	}
+	for (int cpu = 0; cpu < L; ++cpu) {
+		CpuFrequencyLimits* f = &data->frequency_limits[cpu];
+		uint64_t key = ((uint64_t)(uint32_t)f->highest_perf << 32) | (uint32_t)f->max_mhz;
+		int lo = 0, hi = unique - 1;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (keys[mid] > key) lo = mid + 1; else hi = mid;
+		}
+		f->boost_rank = lo;
+	}
+	free(keys);
+	return 0;
+}
+
+/*
+ * Probe into a scratch CPU_DATA whose arrays are individual mallocs;
+ * pack_cpu_data() later moves everything into one arena.
+ */
+static int probe_cpu_data(CPU_DATA* data, unsigned int fields) {
+	int rc;
+	probe_mark mark = { 0 };
+
+	/* brand string */
+	if (fields & CPU_FIELD_BRAND) {
+		phase_begin(&mark);
+		rc = get_cpu_brand(&data->cpu_name);
+		phase_end(&mark, CPU_PHASE_BRAND);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	phase_begin(&mark);
+
+	/* logical cores (cpu/online is a sysfs read, so only when a per‐CPU group is wanted) */
+	if (fields & (CPU_FIELD_TOPOLOGY | CPU_FIELD_CACHES | CPU_FIELD_FREQUENCY | CPU_FIELD_NUMA)) {
+#if defined(_WIN32)
+		data->logical_core_count = (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+#else
+		data->logical_core_count = probe_logical_count();
+#endif
+	}
+
+	/* allocate arrays, only for the groups asked for */
+	if (fields & CPU_FIELD_CACHES) {
+		data->l1size = calloc(data->logical_core_count, sizeof(int));
+		data->l2size = calloc(data->logical_core_count, sizeof(l2cache));
+		data->cache_of = malloc(data->logical_core_count * sizeof(CacheDomainIndex));
+		if (!data->l1size || !data->l2size || !data->cache_of) {
+			return 203;
+		}
+		reset_cache_domains(data);
+	}
+	if (fields & CPU_FIELD_FREQUENCY) {
+		data->frequency = calloc(data->logical_core_count, sizeof(int));
+		data->effective_frequency = calloc(data->logical_core_count, sizeof(int));
+		data->frequency_limits = calloc(data->logical_core_count, sizeof(CpuFrequencyLimits));
+		if (!data->frequency || !data->effective_frequency || !data->frequency_limits) {
+			return 203;
+		}
+	}
+	data->l3size = 0;
+	phase_end(&mark, CPU_PHASE_SETUP);
+
+	/* frequency */
+	if (fields & CPU_FIELD_FREQUENCY) {
+		phase_begin(&mark);
+		read_frequency(data, data->frequency);
+		populate_frequency_limits(data);
+		populate_tsc(&data->tsc);
+		rc = finish_frequency_limits(data);
+		phase_end(&mark, CPU_PHASE_FREQUENCY);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	/* instruction‐set flags */
+	if (fields & CPU_FIELD_ALGORITHMS) {
+		phase_begin(&mark);
+		detect_features(&data->features);
+		algorithms_from_features(&data->features, &data->algorithms);
+		data->isa_level = cpu_isa_level(&data->features);
+		phase_end(&mark, CPU_PHASE_ALGORITHMS);
+	}
+
+	/* physical‐core topology and caches */
+	rc = probe_topology_and_caches(data, !!(fields & CPU_FIELD_TOPOLOGY), !!(fields & CPU_FIELD_CACHES));
+	if (rc != 0) {
+		return rc;
+	}
+	if (fields & CPU_FIELD_TOPOLOGY) {
+		phase_begin(&mark);
+		classify_core_types(data);
+		phase_end(&mark, CPU_PHASE_TOPOLOGY);
+	}
+	if (fields & CPU_FIELD_CACHES) {
+		phase_begin(&mark);
+		annotate_cache_domains(data);
+		rc = populate_tlbs(data);
+		phase_end(&mark, CPU_PHASE_CACHES);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	/* memory nodes */
+	if (fields & CPU_FIELD_NUMA) {
+		phase_begin(&mark);
+		rc = populate_numa(data);
+		if (rc == 0) {
+			link_cores_to_nodes(data);
+		}
+		phase_end(&mark, CPU_PHASE_NUMA);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	/* usable CPUs under container / job limits */
+	if (fields & CPU_FIELD_BUDGET) {
+		phase_begin(&mark);
+		get_cpu_budget(&data->budget);
+		phase_end(&mark, CPU_PHASE_BUDGET);
+	}
+
+	/* RAM, page sizes, huge page pools */
+	if (fields & CPU_FIELD_MEMORY) {
+		phase_begin(&mark);
+		rc = populate_memory(&data->memory);
+		phase_end(&mark, CPU_PHASE_MEMORY);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	data->fields = fields & CPU_FIELD_ALL;
+	return 0;
+}
+
+/* Release the separate allocations of a scratch CPU_DATA */
+static void free_scratch(CPU_DATA* s) {
+	free(s->cpu_name);
+	free(s->l1size);
+	free(s->l2size);
+	free(s->frequency);
+	free(s->effective_frequency);
+	free(s->frequency_limits);
+	for (int i = 0; i < s->cache_count; ++i) {
+		free(s->caches[i].cpus);
+	}
+	free(s->caches);
+	free(s->cache_of);
+	free(s->tlbs);
+	for (int i = 0; i < s->numa_node_count; ++i) {
+		free(s->numa_nodes[i].cpus);
+	}
+	free(s->numa_nodes);
+	free(s->numa_distance);
+	free(s->memory.node_ids);
+	for (int i = 0; i < s->memory.hugepage_size_count; ++i) {
+		free(s->memory.hugepages[i].node_total);
+		free(s->memory.hugepages[i].node_free);
+	}
+	if (s->cores) {
+		for (int i = 0; i < s->physical_core_count; ++i) {
+			free(s->cores[i].logical_ids);
+		}
+		free(s->cores);
+	}
+	memset(s, 0, sizeof(*s));
+}
+
+/*
+ * Bump allocator over the snapshot arena.  With base == NULL it only
+ * measures, so the same packing code sizes the arena and then fills it.
+ */
+typedef struct {
+	char* base;
+	size_t used;
+} arena;
+
+#define ARENA_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+static void* arena_copy(arena* a, const void* src, size_t bytes) {
+	if (!src) {
+		return NULL;
+	}
+	char* p = a->base ? a->base + a->used : NULL;
+	if (p) {
+		memcpy(p, src, bytes);
+	}
+	a->used += ARENA_ALIGN(bytes);
+	return p;
+}
+
+/* Uninitialised room for `bytes`; NULL while measuring */
+static void* arena_alloc(arena* a, size_t bytes) {
+	char* p = a->base ? a->base + a->used : NULL;
+	a->used += ARENA_ALIGN(bytes);
+	return p;
+}
+
+/* Invert cores[].logical_ids, cache_of and numa_nodes[].cpus per logical CPU */
+static void build_cpu_location(const CPU_DATA* d, CpuLocation* loc) {
+	int L = d->logical_core_count;
+	for (int cpu = 0; cpu < L; ++cpu) {
+		CpuLocation* c = &loc[cpu];
+		c->cpu = cpu;
+		c->core = c->smt = c->package = c->l2 = c->l3 = c->numa_node = -1;
+		if (d->cache_of) {
+			c->l2 = d->cache_of[cpu].l2;
+			c->l3 = d->cache_of[cpu].l3;
+		}
+	}
+	for (int i = 0; d->cores && i < d->physical_core_count; ++i) {
+		const PhysicalCoreInfo* pc = &d->cores[i];
+		for (int j = 0; j < pc->logical_count; ++j) {
+			int cpu = pc->logical_ids[j];
+			if (cpu >= 0 && cpu < L) {
+				loc[cpu].core = i;
+				loc[cpu].smt = j;
+				loc[cpu].package = pc->package;
+			}
+		}
+	}
+	for (int k = 0; d->numa_nodes && k < d->numa_node_count; ++k) {
+		for (int j = 0; j < d->numa_nodes[k].cpu_count; ++j) {
+			int cpu = d->numa_nodes[k].cpus[j];
+			if (cpu >= 0 && cpu < L) loc[cpu].numa_node = k;
+		}
+	}
+}
+
+static void pack_into(arena* a, CPU_DATA* dst, const CPU_DATA* src) {
+	int L = src->logical_core_count;
+	int P = src->physical_core_count;
+
+	dst->cores = arena_copy(a, src->cores, P * sizeof(*src->cores));
+	for (int i = 0; i < P && src->cores; ++i) {
+		int* ids = arena_copy(a, src->cores[i].logical_ids, src->cores[i].logical_count * sizeof(int));
+		if (dst->cores) {
+			dst->cores[i].logical_ids = ids;
+		}
+	}
+	dst->caches = arena_copy(a, src->caches, src->cache_count * sizeof(*src->caches));
+	for (int i = 0; i < src->cache_count && src->caches; ++i) {
+		int* cpus = arena_copy(a, src->caches[i].cpus, src->caches[i].cpu_count * sizeof(int));
+		if (dst->caches) {
+			dst->caches[i].cpus = cpus;
+		}
+	}
+	dst->cache_of = arena_copy(a, src->cache_of, L * sizeof(CacheDomainIndex));
+	dst->tlbs = arena_copy(a, src->tlbs, src->tlb_count * sizeof(*src->tlbs));
+	dst->numa_nodes = arena_copy(a, src->numa_nodes, src->numa_node_count * sizeof(*src->numa_nodes));
+	for (int i = 0; i < src->numa_node_count && src->numa_nodes; ++i) {
+		int* cpus = arena_copy(a, src->numa_nodes[i].cpus, src->numa_nodes[i].cpu_count * sizeof(int));
+		if (dst->numa_nodes) {
+			dst->numa_nodes[i].cpus = cpus;
+		}
+	}
+	dst->numa_distance = arena_copy(a, src->numa_distance,
+		(size_t)src->numa_node_count * src->numa_node_count * sizeof(int));
+	int N = src->memory.node_count;
+	dst->memory.node_ids = arena_copy(a, src->memory.node_ids, N * sizeof(int));
+	for (int i = 0; i < src->memory.hugepage_size_count; ++i) {
+		dst->memory.hugepages[i].node_total = arena_copy(a, src->memory.hugepages[i].node_total, N * sizeof(uint64_t));
+		dst->memory.hugepages[i].node_free = arena_copy(a, src->memory.hugepages[i].node_free, N * sizeof(uint64_t));
+	}
+	dst->l2size = arena_copy(a, src->l2size, L * sizeof(l2cache));
+	dst->l1size = arena_copy(a, src->l1size, L * sizeof(int));
+	dst->frequency = arena_copy(a, src->frequency, L * sizeof(int));
+	dst->effective_frequency = arena_copy(a, src->effective_frequency, L * sizeof(int));
+	dst->frequency_limits = arena_copy(a, src->frequency_limits, L * sizeof(CpuFrequencyLimits));
+	dst->cpu_name = arena_copy(a, src->cpu_name, src->cpu_name ? strlen(src->cpu_name) + 1 : 0);
+
+	/* derived, so copies and watcher merges of single groups stay consistent */
+	dst->cpu_location = NULL;
+	if (L > 0 && (src->cores || src->cache_of || src->numa_nodes)) {
+		dst->cpu_location = arena_alloc(a, L * sizeof(CpuLocation));
+		if (dst->cpu_location) {
+			build_cpu_location(src, dst->cpu_location);
+		}
+	}
+}
+
+/* Copy src into a single freshly allocated arena owned by dst */
+static int pack_cpu_data(const CPU_DATA* src, CPU_DATA* dst) {
+	CPU_DATA sized;
+	arena a = { NULL, 0 };
+	pack_into(&a, &sized, src);
+
+	char* base = malloc(a.used ? a.used : 1);
+	if (!base) {
+		return 203;
+	}
+
+	*dst = *src;
+	a.base = base;
+	a.used = 0;
+	pack_into(&a, dst, src);
+	dst->arena = base;
+	dst->arena_size = a.used;
+	dst->arena_shared = 0;
+	return 0;
+}
+
+/*
+ * Shared snapshots.  A segment holds a header, the CPU_DATA with every
+ * pointer stored as an offset from the segment start, and the packed
+ * arena.  The first nonzero offset is past the header, so 0 stays NULL.
+ * Attaching maps the segment copy‐on‐write, turns the offsets back into
+ * pointers (which dirties only the pages holding cores[], caches[] and
+ * numa_nodes[]) and then drops write access.
+ */
+#define SNAPSHOT_MAGIC		"CPUSNAP"
+#define SNAPSHOT_VERSION	3
+#define SNAPSHOT_WAIT_MS	5000
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t layout[9];			/* sizes of CPU_DATA and every arena element type */
+	uint64_t total_size;		/* header + CPU_DATA + arena */
+	uint64_t data_offset;
+	uint64_t arena_offset;
+	volatile long ready;		/* set last, once everything else is written */
+} snapshot_header;
+
+static void snapshot_layout(uint32_t layout[9]) {
+	layout[0] = (uint32_t)sizeof(CPU_DATA);
+	layout[1] = (uint32_t)sizeof(PhysicalCoreInfo);
+	layout[2] = (uint32_t)sizeof(CacheDomain);
+	layout[3] = (uint32_t)sizeof(CacheDomainIndex);
+	layout[4] = (uint32_t)sizeof(TlbInfo);
+	layout[5] = (uint32_t)sizeof(NumaNode);
+	layout[6] = (uint32_t)sizeof(l2cache);
+	layout[7] = (uint32_t)sizeof(CpuFrequencyLimits);
+	layout[8] = (uint32_t)sizeof(CpuLocation);
+}
+
+static void* rebase(void* p, uintptr_t delta) {
+	return p ? (void*)((uintptr_t)p + delta) : NULL;
+}
+
+/*
+ * Add delta to every pointer.  Nested pointers are reached through the
+ * top‐level arrays, so when those hold offsets (decode) they are moved
+ * first, otherwise last.
+ */
+static void relocate_cpu_data(CPU_DATA* d, uintptr_t delta, int decode) {
+	for (int pass = 0; pass < 2; ++pass) {
+		if (pass == !decode) {
+			d->cpu_name = rebase(d->cpu_name, delta);
+			d->cores = rebase(d->cores, delta);
+			d->l1size = rebase(d->l1size, delta);
+			d->l2size = rebase(d->l2size, delta);
+			d->frequency = rebase(d->frequency, delta);
+			d->effective_frequency = rebase(d->effective_frequency, delta);
+			d->frequency_limits = rebase(d->frequency_limits, delta);
+			d->caches = rebase(d->caches, delta);
+			d->cache_of = rebase(d->cache_of, delta);
+			d->cpu_location = rebase(d->cpu_location, delta);
+			d->tlbs = rebase(d->tlbs, delta);
+			d->numa_nodes = rebase(d->numa_nodes, delta);
+			d->numa_distance = rebase(d->numa_distance, delta);
+			d->memory.node_ids = rebase(d->memory.node_ids, delta);
+			for (int i = 0; i < d->memory.hugepage_size_count; ++i) {
+				d->memory.hugepages[i].node_total = rebase(d->memory.hugepages[i].node_total, delta);
+				d->memory.hugepages[i].node_free = rebase(d->memory.hugepages[i].node_free, delta);
+			}
+			continue;
+		}
+		for (int i = 0; d->cores && i < d->physical_core_count; ++i) {
+			d->cores[i].logical_ids = rebase(d->cores[i].logical_ids, delta);
+		}
+		for (int i = 0; d->caches && i < d->cache_count; ++i) {
+			d->caches[i].cpus = rebase(d->caches[i].cpus, delta);
+		}
+		for (int i = 0; d->numa_nodes && i < d->numa_node_count; ++i) {
+			d->numa_nodes[i].cpus = rebase(d->numa_nodes[i].cpus, delta);
+		}
+	}
+}
+
+static int snapshot_ready(volatile long* ready) {
+#if defined(_WIN32)
+	return (int)InterlockedCompareExchange(ready, 0, 0);
+#else
+	return (int)__atomic_load_n(ready, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/* Segment bytes for `data`: header, CPU_DATA, then the packed arena */
+static size_t snapshot_size(const CPU_DATA* data) {
+	CPU_DATA scratch;
+	arena sized = { NULL, 0 };
+	pack_into(&sized, &scratch, data);
+	return ARENA_ALIGN(ARENA_ALIGN(sizeof(snapshot_header)) + sizeof(CPU_DATA)) + sized.used;
+}
+
+/* Fill a zeroed segment of snapshot_size(src) bytes; ready is set last */
+static void snapshot_write(char* seg, size_t total, const CPU_DATA* src) {
+	snapshot_header* h = (snapshot_header*)seg;
+	h->data_offset = ARENA_ALIGN(sizeof(snapshot_header));
+	h->arena_offset = ARENA_ALIGN(h->data_offset + sizeof(CPU_DATA));
+	h->total_size = total;
+
+	CPU_DATA* d = (CPU_DATA*)(seg + h->data_offset);
+	arena a = { seg + h->arena_offset, 0 };
+	*d = *src;
+	pack_into(&a, d, src);
+	d->arena = NULL;
+	d->arena_size = 0;
+	d->arena_shared = 0;
+	relocate_cpu_data(d, (uintptr_t)0 - (uintptr_t)seg, 0);
+
+	memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+	h->version = SNAPSHOT_VERSION;
+	snapshot_layout(h->layout);
+#if defined(_WIN32)
+	InterlockedExchange(&h->ready, 1);
+#else
+	__atomic_store_n(&h->ready, 1, __ATOMIC_RELEASE);
+#endif
+}
+
+/* Validate a private mapping of `size` bytes and hand it to `out` */
+static int snapshot_adopt(char* seg, size_t size, CPU_DATA* out) {
+	const snapshot_header* h = (const snapshot_header*)seg;
+	uint32_t layout[9];
+	if (size < sizeof(*h) || !snapshot_ready((volatile long*)&h->ready)) {
+		return 218;
+	}
+	snapshot_layout(layout);
+	if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 || h->version != SNAPSHOT_VERSION
+		|| memcmp(h->layout, layout, sizeof(layout)) != 0 || h->total_size > size) {
+		return 219;
+	}
+	*out = *(const CPU_DATA*)(seg + h->data_offset);
+	relocate_cpu_data(out, (uintptr_t)seg, 1);
+	out->arena = seg;
+	out->arena_size = size;
+	out->arena_shared = 1;
+	return 0;
+}
+
+#if defined(_WIN32)
+/* The publisher keeps its section open; a section lives while any handle or view does */
+static HANDLE published_section;
+
+static void snapshot_unmap(CPU_DATA* data) {
+	UnmapViewOfFile(data->arena);
+}
+
+DLL_EXPORT int publish_cpu_data(const CPU_DATA* data, const char* name) {
+	if (!data || !name) {
+		return 201;
+	}
+	size_t total = snapshot_size(data);
+	HANDLE h = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)((uint64_t)total >> 32), (DWORD)total, name);
+	if (!h) {
+		return 220;
+	}
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		/* sections cannot be replaced while mapped; publish under a new name */
+		CloseHandle(h);
+		return 220;
+	}
+	char* seg = MapViewOfFile(h, FILE_MAP_WRITE, 0, 0, total);
+	if (!seg) {
+		CloseHandle(h);
+		return 220;
+	}
+	snapshot_write(seg, total, data);
+	UnmapViewOfFile(seg);
+	if (published_section) {
+		CloseHandle(published_section);
+	}
+	published_section = h;
+	return 0;
+}
+
+DLL_EXPORT int unpublish_cpu_data(const char* name) {
+	(void)name;
+	if (published_section) {
+		CloseHandle(published_section);
+		published_section = NULL;
+	}
+	return 0;
+}
+
+DLL_EXPORT int attach_cpu_data(const char* name, CPU_DATA* out) {
+	if (!name || !out) {
+		return 201;
+	}
+	HANDLE h = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_COPY, FALSE, name);
+	if (!h) {
+		return GetLastError() == ERROR_FILE_NOT_FOUND ? 217 : 220;
+	}
+	char* seg = MapViewOfFile(h, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(h);		/* the view keeps the section alive */
+	if (!seg) {
+		return 220;
+	}
+	MEMORY_BASIC_INFORMATION mbi;
+	size_t size = VirtualQuery(seg, &mbi, sizeof(mbi)) ? mbi.RegionSize : 0;
+	CPU_DATA d;
+	int rc = snapshot_adopt(seg, size, &d);
+	DWORD old;
+	if (rc != 0 || !VirtualProtect(seg, size, PAGE_READONLY, &old)) {
+		UnmapViewOfFile(seg);
+		return rc ? rc : 220;
+	}
+	*out = d;
+	return 0;
+}
+
+/*
+ * get_cpu_data_shared claims a name before probing.  A section's size is
+ * only known after the probe, so the claim is a named mutex beside it;
+ * it dies with its holder, which lets a waiter claim again.
+ */
+typedef HANDLE snapshot_claim_t;
+
+static int snapshot_claim(const char* name, snapshot_claim_t* claim) {
+	char lock[MAX_PATH];
+	if (snprintf(lock, sizeof(lock), "%s.claim", name) >= (int)sizeof(lock)) {
+		return 220;
+	}
+	*claim = CreateMutexA(NULL, FALSE, lock);
+	if (!*claim) {
+		return 220;
+	}
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		CloseHandle(*claim);
+		return 218;
+	}
+	return 0;
+}
+
+static int snapshot_fill(snapshot_claim_t claim, const char* name, const CPU_DATA* data) {
+	int rc = publish_cpu_data(data, name);
+	CloseHandle(claim);
+	return rc;
+}
+
+static void snapshot_abandon(snapshot_claim_t claim, const char* name) {
+	(void)name;
+	CloseHandle(claim);
+}
+#else
+/* "/name" is a POSIX shm object; a path with more slashes is a regular file, e.g. under /run */
+static int snapshot_is_file(const char* name) {
+	return name[0] == '/' && strchr(name + 1, '/') != NULL;
+}
+
+static int snapshot_open(const char* name, int flags, mode_t mode) {
+	return snapshot_is_file(name) ? open(name, flags | O_CLOEXEC, mode) : shm_open(name, flags, mode);
+}
+
+static void snapshot_unmap(CPU_DATA* data) {
+	munmap(data->arena, data->arena_size);
+}
+
+DLL_EXPORT int unpublish_cpu_data(const char* name) {
+	if (!name) {
+		return 201;
+	}
+	int rc = snapshot_is_file(name) ? unlink(name) : shm_unlink(name);
+	return (rc == 0 || errno == ENOENT) ? 0 : 220;
+}
+
+/*
+ * A claim is the descriptor of a segment this process created with
+ * O_CREAT | O_EXCL: nobody else can create the name until it is unlinked,
+ * and attachers see 218 until snapshot_fill() sets the ready flag.
+ */
+typedef int snapshot_claim_t;
+
+static int snapshot_claim(const char* name, snapshot_claim_t* claim) {
+	*claim = snapshot_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (*claim < 0) {
+		return errno == EEXIST ? 218 : 220;
+	}
+	return 0;
+}
+
+/* Size, map and write a claimed segment; a failed one is unlinked again */
+static int snapshot_fill(snapshot_claim_t claim, const char* name, const CPU_DATA* data) {
+	size_t total = snapshot_size(data);
+	char* seg = MAP_FAILED;
+	if (ftruncate(claim, (off_t)total) == 0) {
+		seg = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, claim, 0);
+	}
+	close(claim);
+	if (seg == MAP_FAILED) {
+		unpublish_cpu_data(name);
+		return 220;
+	}
+	snapshot_write(seg, total, data);
+	munmap(seg, total);
+	return 0;
+}
+
+/* Drop a claim that was never filled; nobody can have adopted it */
+static void snapshot_abandon(snapshot_claim_t claim, const char* name) {
+	close(claim);
+	unpublish_cpu_data(name);
+}
+
+/*
+ * Replace whatever is published under `name`.  Processes attached to the
+ * old segment keep it until they detach; new attachers see "not ready"
+ * until the header's ready flag is set.
+ */
+DLL_EXPORT int publish_cpu_data(const CPU_DATA* data, const char* name) {
+	if (!data || !name) {
+		return 201;
+	}
+	snapshot_claim_t claim;
+	int rc = 218;
+	for (int attempt = 0; attempt < 3 && rc == 218; ++attempt) {
+		unpublish_cpu_data(name);
+		rc = snapshot_claim(name, &claim);
+	}
+	return rc == 0 ? snapshot_fill(claim, name, data) : 220;
+}
+
+DLL_EXPORT int attach_cpu_data(const char* name, CPU_DATA* out) {
+	if (!name || !out) {
+		return 201;
+	}
+	int fd = snapshot_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return errno == ENOENT ? 217 : 220;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(snapshot_header)) {
+		close(fd);
+		return 218;		/* still being created */
+	}
+	size_t size = (size_t)st.st_size;
+	char* seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (seg == MAP_FAILED) {
+		return 220;
+	}
+	CPU_DATA d;
+	int rc = snapshot_adopt(seg, size, &d);
+	if (rc != 0 || mprotect(seg, size, PROT_READ) != 0) {
+		munmap(seg, size);
+		return rc ? rc : 220;
+	}
+	*out = d;
+	return 0;
+}
+#endif
+
+/* Fill only the field groups in `fields` (CPU_FIELD_* bits) */
+DLL_EXPORT int get_cpu_data_ex(CPU_DATA* data, unsigned int fields) {
+	if (!data) {
+		return 201;
+	}
+
+	/* read the hook once; set_cpu_probe_hook() is documented as set‐before‐probing */
+	CpuProbeHook hook = probe_hook;
+	void* hook_ctx = probe_hook_ctx;
+	CPU_PROBE_STATS stats;
+	uint64_t t0 = 0;
+	if (hook) {
+		memset(&stats, 0, sizeof(stats));
+		stats.fields = fields;
+		probe_stats = &stats;
+		t0 = monotonic_ns();
+	}
+
+	CPU_DATA scratch;
+	probe_mark mark = { 0 };
+	memset(&scratch, 0, sizeof(scratch));
+	int rc = probe_cpu_data(&scratch, fields);
+	if (rc == 0) {
+		phase_begin(&mark);
+		rc = pack_cpu_data(&scratch, data);
+		phase_end(&mark, CPU_PHASE_PACK);
+	}
+	free_scratch(&scratch);
+
+	if (hook) {
+		probe_stats = NULL;
+		stats.total_ns = monotonic_ns() - t0;
+		stats.result = rc;
+		hook(hook_ctx, &stats);
+	}
+	return rc;
+}
+
+/* Top‐level entry: fills CPU_DATA fields */
+DLL_EXPORT int get_cpu_data(CPU_DATA* data) {
+	return get_cpu_data_ex(data, CPU_FIELD_ALL);
+}
+
+/* Release a snapshot filled by get_cpu_data / copy_cpu_data */
+DLL_EXPORT void free_cpu_data(CPU_DATA* data) {
+	if (!data) {
+		return;
+	}
+	if (data->arena_shared) {
+		snapshot_unmap(data);
+	} else {
+		free(data->arena);
+	}
+	memset(data, 0, sizeof(*data));
+}
+
+/* Deep‐copy a snapshot into a new arena */
+DLL_EXPORT int copy_cpu_data(CPU_DATA* dst, const CPU_DATA* src) {
+	if (!dst || !src) {
+		return 201;
+	}
+	return pack_cpu_data(src, dst);
+}
+
+/*
+ * Attach to `name`, or probe and publish it when nobody has.  The name is
+ * claimed before probing, so of several racing processes one probes and
+ * the rest wait for its snapshot.  This path never removes a name: one
+ * that stays unfinished (its publisher died) or is incompatible (another
+ * library version) is left alone and this process probes privately.
+ */
+DLL_EXPORT int get_cpu_data_shared(const char* name, CPU_DATA* out) {
+	if (!name || !out) {
+		return 201;
+	}
+	int rc = attach_cpu_data(name, out);
+	for (int waited = 0; rc == 217 || rc == 218; waited += 10) {
+		if (rc == 217) {
+			snapshot_claim_t claim;
+			rc = snapshot_claim(name, &claim);
+			if (rc == 0) {
+				rc = get_cpu_data(out);
+				if (rc == 0) {
+					snapshot_fill(claim, name, out);	/* best effort; out stays a private copy */
+				}
+				else {
+					snapshot_abandon(claim, name);
+				}
+				return rc;
+			}
+			if (rc != 218) {
+				break;
+			}
+		}
+		if (waited >= SNAPSHOT_WAIT_MS) {
+			break;
+		}
+		sleep_ms(10);
+		rc = attach_cpu_data(name, out);
+	}
+	return rc == 0 ? 0 : get_cpu_data(out);
+}
+
+/* One candidate CPU with its lexicographic sort key */
+typedef struct {
+	int key[4];
+	int cpu;
+} placement_slot;
+
+static int compare_slots(const void* a, const void* b) {
+	const placement_slot* x = a;
+	const placement_slot* y = b;
+	for (int i = 0; i < 4; ++i) {
+		if (x->key[i] != y->key[i]) {
+			return x->key[i] < y->key[i] ? -1 : 1;
+		}
+	}
+	return x->cpu - y->cpu;
+}
+
+/*
+ * Order logical CPUs for `thread_count` threads:
+ *   PHYSICAL_FIRST    one per physical core (P‐cores first), then SMT siblings
+ *   PACK_CACHE        fill one L3 domain, L2 domain by L2 domain with SMT
+ *                     siblings together, before moving on (packages when
+ *                     caches were not probed)
+ *   SPREAD_PACKAGES   round‐robin over NUMA nodes (packages on single‐node
+ *                     machines), physical cores first
+ *   PERFORMANCE_ONLY  PHYSICAL_FIRST restricted to P‐cores
+ *   BOOST_FIRST       PHYSICAL_FIRST with cores ordered by boost_rank, so
+ *                     thread 0 lands on the best single‐thread core
+ * More threads than CPUs wrap around the same order.  Writes thread_count
+ * entries to out_cpus.
+ */
+DLL_EXPORT int plan_thread_placement(const CPU_DATA* data, int thread_count, PlacementPolicy policy, int* out_cpus) {
+	if (!data || !out_cpus || thread_count <= 0) {
+		return 201;
+	}
+	if (!data->cores || data->physical_core_count <= 0) {
+		return 210;
+	}
+
+	int L = data->logical_core_count;
+	int P = data->physical_core_count;
+	int have_p = (policy == CPU_PLACE_PERFORMANCE_ONLY) && data->performance_core_count > 0;
+	placement_slot* slots = malloc(L * sizeof(*slots));
+	int* per_package = calloc(P, sizeof(int));
+	int* pkg_ids = malloc(P * sizeof(int));
+	int* pkg_of = malloc(P * sizeof(int));
+	if (!slots || !per_package || !pkg_ids || !pkg_of) {
+		free(slots); free(per_package); free(pkg_ids); free(pkg_of);
+		return 203;
+	}
+	/* spread over NUMA nodes when there are several, else over packages */
+	int by_node = data->numa_node_count > 1;
+	for (int i = 0; i < P; ++i) {
+		pkg_ids[i] = (by_node && data->cores[i].numa_node >= 0) ? data->cores[i].numa_node : data->cores[i].package;
+	}
+	if (group_keys(pkg_ids, P, pkg_of, NULL) < 0) {
+		free(slots); free(per_package); free(pkg_ids); free(pkg_of);
+		return 203;
+	}
+
+	int n = 0;
+	for (int i = 0; i < P; ++i) {
+		const PhysicalCoreInfo* pc = &data->cores[i];
+		int type_rank = pc->type == CORE_TYPE_PERFORMANCE ? 0 : pc->type == CORE_TYPE_UNKNOWN ? 1 : 2;
+		int nth_in_package = per_package[pkg_of[i]]++;
+		int boost_rank = type_rank;
+		if (data->frequency_limits) {
+			boost_rank = INT_MAX;
+			for (int j = 0; j < pc->logical_count; ++j) {
+				int r = data->frequency_limits[pc->logical_ids[j]].boost_rank;
+				if (r < boost_rank) boost_rank = r;
+			}
+		}
+		int l2 = -1, l3 = -1;
+		if (data->cache_of && pc->logical_count) {
+			l2 = data->cache_of[pc->logical_ids[0]].l2;
+			l3 = data->cache_of[pc->logical_ids[0]].l3;
+		}
+		if (have_p && pc->type != CORE_TYPE_PERFORMANCE) {
+			continue;
+		}
+		for (int j = 0; j < pc->logical_count && n < L; ++j) {
+			placement_slot* sl = &slots[n++];
+			sl->cpu = pc->logical_ids[j];
+			switch (policy) {
+				case CPU_PLACE_PACK_CACHE:
+					sl->key[0] = l3 >= 0 ? l3 : pkg_of[i];
+					sl->key[1] = l2 >= 0 ? l2 : nth_in_package;
+					sl->key[2] = nth_in_package; sl->key[3] = j;
+					break;
+				case CPU_PLACE_SPREAD_PACKAGES:
+					sl->key[0] = j; sl->key[1] = nth_in_package; sl->key[2] = pkg_of[i]; sl->key[3] = 0;
+					break;
+				case CPU_PLACE_BOOST_FIRST:
+					sl->key[0] = j; sl->key[1] = boost_rank; sl->key[2] = type_rank; sl->key[3] = i;
+					break;
+				default:
+					sl->key[0] = j; sl->key[1] = type_rank; sl->key[2] = i; sl->key[3] = 0;
+					break;
+			}
+		}
+	}
+	if (n == 0) {
+		/* no core passed the policy filter (or none lists a logical CPU) */
+		free(slots); free(per_package); free(pkg_ids); free(pkg_of);
+		return 210;
+	}
+	qsort(slots, n, sizeof(*slots), compare_slots);
+
+	for (int t = 0; t < thread_count; ++t) {
+		out_cpus[t] = slots[t % n].cpu;
+	}
+
+	free(slots); free(per_package); free(pkg_ids); free(pkg_of);
+	return 0;
+}
+
+/*
+ * Current CPU.  On x86 Linux the kernel keeps (node << 12) | cpu in
+ * TSC_AUX, which RDPID reads in one instruction and RDTSCP alongside the
+ * TSC; the encoding is checked against sched_getcpu() once before it is
+ * trusted.  Otherwise sched_getcpu() (vDSO getcpu), and on Windows
+ * GetCurrentProcessorNumberEx() with the group bases cached.
+ */
+enum { WHERE_UNRESOLVED, WHERE_RDPID, WHERE_RDTSCP, WHERE_OS };
+static volatile int where_method = WHERE_UNRESOLVED;
+
+#if defined(_WIN32)
+#define WHERE_MAX_GROUPS 64
+static int where_group_base[WHERE_MAX_GROUPS];
+#endif
+
+static int os_current_cpu(void) {
+#if defined(_WIN32)
+	PROCESSOR_NUMBER pn;
+	GetCurrentProcessorNumberEx(&pn);
+	return pn.Group < WHERE_MAX_GROUPS ? where_group_base[pn.Group] + pn.Number : -1;
+#else
+	return sched_getcpu();
+#endif
+}
+
+#if !defined(_WIN32) && (defined(__i386__) || defined(__x86_64__))
+static inline unsigned int read_tsc_aux_rdpid(void) {
+	unsigned long aux;
+	__asm__ volatile(".byte 0xf3, 0x0f, 0xc7, 0xf8" : "=a"(aux));	/* rdpid %rax / %eax */
+	return (unsigned int)aux;
+}
+
+static inline unsigned int read_tsc_aux_rdtscp(void) {
+	unsigned int lo, hi, aux;
+	__asm__ volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+	(void)lo; (void)hi;
+	return aux;
+}
+
+/* Does TSC_AUX & 0xFFF track sched_getcpu() on this kernel? */
+static int tsc_aux_is_cpu(unsigned int (*read_aux)(void)) {
+	for (int attempt = 0; attempt < 8; ++attempt) {
+		int before = sched_getcpu();
+		int aux = (int)(read_aux() & 0xFFF);
+		if (before >= 0 && before == sched_getcpu()) {
+			return aux == before;
+		}
+	}
+	return 0;
+}
+#endif
+
+static int resolve_where_method(void) {
+	int method = WHERE_OS;
+#if defined(_WIN32)
+	WORD groups = GetActiveProcessorGroupCount();
+	for (WORD g = 0; g < groups && g < WHERE_MAX_GROUPS; ++g) {
+		where_group_base[g] = group_base(g);
+	}
+#elif defined(__i386__) || defined(__x86_64__)
+	int regs[4];
+	hw_cpuid(0, 0, regs);
+	int has_rdpid = 0, has_rdtscp = 0;
+	if (regs[0] >= 7) {
+		hw_cpuid(7, 0, regs);
+		has_rdpid = (regs[2] >> 22) & 1;
+	}
+	hw_cpuid(0x80000000, 0, regs);
+	if ((unsigned int)regs[0] >= 0x80000001u) {
+		hw_cpuid(0x80000001, 0, regs);
+		has_rdtscp = (regs[3] >> 27) & 1;
+	}
+	/* 12 bits of CPU number only */
+	if (get_nprocs_conf() <= 4096) {
+		if (has_rdpid && tsc_aux_is_cpu(read_tsc_aux_rdpid)) method = WHERE_RDPID;
+		else if (has_rdtscp && tsc_aux_is_cpu(read_tsc_aux_rdtscp)) method = WHERE_RDTSCP;
+	}
+#endif
+	where_method = method;
+	return method;
+}
+
+/*
+ * Logical CPU the caller is running on (it may migrate right after), -1
+ * if unknown.  With data and out, *out is that CPU's cpu_location entry.
+ */
+DLL_EXPORT int current_cpu(const CPU_DATA* data, CpuLocation* out) {
+	int method = where_method;
+	if (method == WHERE_UNRESOLVED) {
+		method = resolve_where_method();
+	}
+	int cpu;
+	switch (method) {
+#if !defined(_WIN32) && (defined(__i386__) || defined(__x86_64__))
+		case WHERE_RDPID: cpu = (int)(read_tsc_aux_rdpid() & 0xFFF); break;
+		case WHERE_RDTSCP: cpu = (int)(read_tsc_aux_rdtscp() & 0xFFF); break;
+#endif
+		default: cpu = os_current_cpu(); break;
+	}
+	if (out) {
+		if (data && data->cpu_location && cpu >= 0 && cpu < data->logical_core_count) {
+			*out = data->cpu_location[cpu];
+		} else {
+			out->cpu = cpu;
+			out->core = out->smt = out->package = out->l2 = out->l3 = out->numa_node = -1;
+		}
+	}
+	return cpu;
+}
+
+/* Pin the calling thread to one logical CPU of a plan */
+DLL_EXPORT int pin_current_thread(int logical_cpu) {
+	return pin_to_logical(logical_cpu) == 0 ? 0 : 211;
+}
+
+/*
+ * Thread affinity as a CpuSet.  On Windows a thread runs in one processor
+ * group, so only the group of the lowest CPU in the set is applied.
+ */
+DLL_EXPORT int get_thread_affinity(CpuSet* out) {
+	if (!out) {
+		return 201;
+	}
+#if defined(_WIN32)
+	GROUP_AFFINITY ga;
+	int rc = cpu_set_init(out, (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+	if (rc != 0) {
+		return rc;
+	}
+	if (!GetThreadGroupAffinity(GetCurrentThread(), &ga)) {
+		cpu_set_free(out);
+		return 212;
+	}
+	int base = group_base(ga.Group);
+	for (int b = 0; b < (int)(8 * sizeof(KAFFINITY)); ++b) {
+		if (ga.Mask & ((KAFFINITY)1 << b)) {
+			cpu_set_add(out, base + b);
+		}
+	}
+#else
+	int n;
+	size_t size;
+	cpu_set_t* set = read_affinity(&n, &size);
+	if (!set) {
+		return 212;
+	}
+	int rc = cpu_set_init(out, n);
+	for (int cpu = 0; cpu < n && rc == 0; ++cpu) {
+		if (CPU_ISSET_S(cpu, size, set)) {
+			rc = cpu_set_add(out, cpu);
+		}
+	}
+	CPU_FREE(set);
+	if (rc != 0) {
+		return rc;
+	}
+#endif
+	return 0;
+}
+
+DLL_EXPORT int pin_current_thread_set(const CpuSet* set) {
+	if (!set || !set->bits) {
+		return 201;
+	}
+#if defined(_WIN32)
+	GROUP_AFFINITY ga;
+	WORD group = 0;
+	BYTE number;
+	int first = -1;
+	memset(&ga, 0, sizeof(ga));
+	for (int cpu = 0; cpu < set->cpu_capacity; ++cpu) {
+		if (!cpu_set_contains(set, cpu) || logical_to_group(cpu, &group, &number) != 0) {
+			continue;
+		}
+		if (first < 0) {
+			first = cpu;
+			ga.Group = group;
+		}
+		if (group == ga.Group) {
+			ga.Mask |= (KAFFINITY)1 << number;
+		}
+	}
+	if (first < 0 || !SetThreadGroupAffinity(GetCurrentThread(), &ga, NULL)) {
+		return 211;
+	}
+#else
+	size_t size = CPU_ALLOC_SIZE(set->cpu_capacity);
+	cpu_set_t* mask = CPU_ALLOC(set->cpu_capacity);
+	if (!mask) {
+		return 203;
+	}
+	CPU_ZERO_S(size, mask);
+	for (int cpu = 0; cpu < set->cpu_capacity; ++cpu) {
+		if (cpu_set_contains(set, cpu)) {
+			CPU_SET_S(cpu, size, mask);
+		}
+	}
+	int rc = sched_setaffinity(0, size, mask);
+	CPU_FREE(mask);
+	if (rc != 0) {
+		return 211;
+	}
+#endif
+	return 0;
+}
+
+/*
+ * CPU budget: how many CPUs this process may actually use, which inside a
+ * container is usually far fewer than the host's logical_core_count.
+ */
+#if defined(_WIN32)
+static void probe_cpu_budget(CpuBudget* b) {
+	/* a process spanning several groups may use all of their processors */
+	USHORT groups[64];
+	USHORT group_count = 64;
+	DWORD_PTR process_mask = 0, system_mask = 0;
+	if (GetProcessGroupAffinity(GetCurrentProcess(), &group_count, groups) && group_count > 1) {
+		for (USHORT g = 0; g < group_count; ++g) {
+			b->affinity_cpus += (int)GetActiveProcessorCount(groups[g]);
+		}
+	}
+	else if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+		for (DWORD_PTR m = process_mask; m; m &= m - 1) {
+			b->affinity_cpus++;
+		}
+	}
+
+	/* CpuRate / MaxRate are in 1/100 % of the whole machine */
+	JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate;
+	memset(&rate, 0, sizeof(rate));
+	if (QueryInformationJobObject(NULL, JobObjectCpuRateControlInformation, &rate, sizeof(rate), NULL) &&
+		(rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_ENABLE)) {
+		DWORD cap = 0;
+		if (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP) {
+			cap = rate.CpuRate;
+		}
+		else if (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_MIN_MAX_RATE) {
+			cap = rate.MaxRate;
+		}
+		if (cap > 0 && cap < 10000) {
+			b->job_cpus = b->host_cpus * (double)cap / 10000.0;
+		}
+	}
+}
+#else
+/* Number of CPUs in a "0-3,8,10-11" list */
+static int count_cpu_list(const char* list) {
+	const char* p = list;
+	int n = 0;
+	while (*p) {
+		char* end;
+		long a = strtol(p, &end, 10), b;
+		if (end == p) {
+			break;
+		}
+		b = a;
+		if (*end == '-') {
+			p = end + 1;
+			b = strtol(p, &end, 10);
+		}
+		if (b >= a) {
+			n += (int)(b - a + 1);
+		}
+		if (*end != ',') {
+			break;
+		}
+		p = end + 1;
+	}
+	return n;
+}
+
+/* `token` is one of the comma‐separated words in `list` */
+static int has_token(const char* list, const char* token) {
+	size_t len = strlen(token);
+	for (const char* p = list; p && *p; ) {
+		const char* comma = strchr(p, ',');
+		size_t n = comma ? (size_t)(comma - p) : strlen(p);
+		if (n == len && strncmp(p, token, len) == 0) {
+			return 1;
+		}
+		p = comma ? comma + 1 : NULL;
+	}
+	return 0;
+}
+
+/*
+ * Directory of this process's cgroup for a v1 `controller`, or the v2
+ * unified hierarchy when controller is NULL.  /proc/self/cgroup gives the
+ * path, /proc/self/mountinfo where (and from which root) it is mounted.
+ * `mount_len` receives the length of the mount point prefix.
+ */
+static int cgroup_dir(const char* controller, char* out, size_t size, size_t* mount_len) {
+	char line[4096], path[1024] = "";
+	int found = 0;
+	FILE* f = probe_fopen("/proc/self/cgroup");
+	if (!f) {
+		return -1;
+	}
+	while (!found && probe_fgets(line, sizeof(line), f)) {
+		char* c1 = strchr(line, ':');
+		char* c2 = c1 ? strchr(c1 + 1, ':') : NULL;
+		if (!c2) {
+			continue;
+		}
+		*c2 = '\0';
+		line[strcspn(line, ":")] = '\0';
+		int v2 = strcmp(line, "0") == 0 && c1[1] == '\0';
+		if (controller ? (!v2 && has_token(c1 + 1, controller)) : v2) {
+			snprintf(path, sizeof(path), "%s", c2 + 1);
+			path[strcspn(path, "\n")] = '\0';
+			found = 1;
+		}
+	}
+	fclose(f);
+	if (!found || !(f = probe_fopen("/proc/self/mountinfo"))) {
+		return -1;
+	}
+
+	found = 0;
+	while (!found && probe_fgets(line, sizeof(line), f)) {
+		char root[1024], mnt[1024], fstype[64], super[1024];
+		char* dash = strstr(line, " - ");
+		if (!dash || sscanf(line, "%*s %*s %*s %1023s %1023s", root, mnt) != 2 ||
+			sscanf(dash + 3, "%63s %*s %1023s", fstype, super) != 2) {
+			continue;
+		}
+		if (controller ? (strcmp(fstype, "cgroup") == 0 && has_token(super, controller))
+			: strcmp(fstype, "cgroup2") == 0) {
+			/* path is relative to the hierarchy root; the mount may start below it */
+			size_t rl = strlen(root);
+			const char* rel = path;
+			if (strcmp(root, "/") != 0 && strncmp(path, root, rl) == 0) {
+				rel = path + rl;
+			}
+			*mount_len = strlen(mnt);
+			snprintf(out, size, "%s%s", mnt, strcmp(rel, "/") == 0 ? "" : rel);
+			found = 1;
+		}
+	}
+	fclose(f);
+	return found ? 0 : -1;
+}
+
+/*
+ * Tightest CFS quota from the leaf cgroup up to the mount point, in CPUs.
+ * v2 cpu.max is "quota period" or "max period"; v1 splits it over
+ * cpu.cfs_quota_us (-1 = unlimited) and cpu.cfs_period_us.
+ */
+static double cgroup_quota(void) {
+	char dir[2048], rel[2100], buf[64];
+	size_t mount_len = 0;
+	double best = 0;
+	int v1 = cgroup_dir("cpu", dir, sizeof(dir), &mount_len) == 0;
+	if (!v1 && cgroup_dir(NULL, dir, sizeof(dir), &mount_len) != 0) {
+		return 0;
+	}
+	for (;;) {
+		long long quota = -1, period = 0;
+		if (v1) {
+			snprintf(rel, sizeof(rel), "%s/cpu.cfs_quota_us", dir);
+			if (read_text_at(AT_FDCWD, rel, buf, sizeof(buf)) > 0) {
+				quota = strtoll(buf, NULL, 10);
+			}
+			snprintf(rel, sizeof(rel), "%s/cpu.cfs_period_us", dir);
+			if (read_text_at(AT_FDCWD, rel, buf, sizeof(buf)) > 0) {
+				period = strtoll(buf, NULL, 10);
+			}
+		}
+		else {
+			snprintf(rel, sizeof(rel), "%s/cpu.max", dir);
+			if (read_text_at(AT_FDCWD, rel, buf, sizeof(buf)) > 0 && strncmp(buf, "max", 3) != 0) {
+				char* end;
+				quota = strtoll(buf, &end, 10);
+				period = strtoll(end, NULL, 10);
+			}
+		}
+		if (quota > 0 && period > 0) {
+			double cpus = (double)quota / (double)period;
+			if (best == 0 || cpus < best) {
+				best = cpus;
+			}
+		}
+		char* slash = strrchr(dir, '/');
+		if (!slash || (size_t)(slash - dir) < mount_len) {
+			break;
+		}
+		*slash = '\0';
+	}
+	return best;
+}
+
+/* Effective cpuset of this process's cgroup, 0 if not restricted */
+static int cgroup_cpuset(void) {
+	char dir[2048], rel[2100];
+	char* buf = malloc(CACHE_LIST_BUF);
+	size_t mount_len = 0;
+	int n = 0;
+	if (!buf) {
+		return 0;
+	}
+	if (cgroup_dir("cpuset", dir, sizeof(dir), &mount_len) == 0) {
+		snprintf(rel, sizeof(rel), "%s/cpuset.effective_cpus", dir);
+		if (read_text_at(AT_FDCWD, rel, buf, CACHE_LIST_BUF) <= 0) {
+			snprintf(rel, sizeof(rel), "%s/cpuset.cpus", dir);
+		}
+		if (read_text_at(AT_FDCWD, rel, buf, CACHE_LIST_BUF) > 0) {
+			n = count_cpu_list(buf);
+		}
+	}
+	if (n == 0 && cgroup_dir(NULL, dir, sizeof(dir), &mount_len) == 0) {
+		snprintf(rel, sizeof(rel), "%s/cpuset.cpus.effective", dir);
+		if (read_text_at(AT_FDCWD, rel, buf, CACHE_LIST_BUF) > 0) {
+			n = count_cpu_list(buf);
+		}
+	}
+	free(buf);
+	return n;
+}
+
+static void probe_cpu_budget(CpuBudget* b) {
+	CpuSet mask;
+	if (get_thread_affinity(&mask) == 0) {
+		b->affinity_cpus = cpu_set_count(&mask);
+		cpu_set_free(&mask);
+	}
+	b->cpuset_cpus = cgroup_cpuset();
+	b->quota_cpus = cgroup_quota();
+}
+#endif
+
+DLL_EXPORT int get_cpu_budget(CpuBudget* out) {
+	if (!out) {
+		return 201;
+	}
+	memset(out, 0, sizeof(*out));
+	if (probe_online_cpus(NULL, &out->host_cpus) < 0 || out->host_cpus <= 0) {
+		out->host_cpus = 1;
+	}
+	probe_cpu_budget(out);
+
+	/* tightest limit wins; fractional quotas round up so 2.5 CPUs -> 3 threads */
+	int n = out->host_cpus;
+	int quota = (int)out->quota_cpus + (out->quota_cpus > (int)out->quota_cpus);
+	int job = (int)out->job_cpus + (out->job_cpus > (int)out->job_cpus);
+	if (out->affinity_cpus > 0 && out->affinity_cpus < n) n = out->affinity_cpus;
+	if (out->cpuset_cpus > 0 && out->cpuset_cpus < n) n = out->cpuset_cpus;
+	if (quota > 0 && quota < n) n = quota;
+	if (job > 0 && job < n) n = job;
+	out->recommended_parallelism = n > 0 ? n : 1;
+	return 0;
+}
+
+/*
+ * Process‐wide cached snapshot.  The first caller probes, everyone else
+ * waits on the one‐time initialiser and then shares the same CPU_DATA.
+ * Only refresh_cpu_data_cached() writes to it afterwards, and only the
+ * frequency array: it reads into a private buffer and stores each element
+ * with one relaxed atomic store, so readers, who take no lock, see every
+ * element either before or after a refresh.  cache_lock only keeps two
+ * refreshes apart.
+ */
+static CPU_DATA cache_data;
+static int cache_rc;
+
+#if defined(_WIN32)
+static INIT_ONCE cache_once = INIT_ONCE_STATIC_INIT;
+static SRWLOCK cache_lock = SRWLOCK_INIT;
+
+static BOOL CALLBACK cache_init(PINIT_ONCE once, PVOID param, PVOID* ctx) {
+	(void)once; (void)param; (void)ctx;
+	cache_rc = get_cpu_data(&cache_data);
+	return TRUE;
+}
+#else
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void cache_init(void) {
+	cache_rc = get_cpu_data(&cache_data);
+}
+#endif
+
+/* Probe once per process and hand out a pointer to the shared result */
+DLL_EXPORT int get_cpu_data_cached(const CPU_DATA** out) {
+	if (!out) {
+		return 201;
+	}
+
+#if defined(_WIN32)
+	InitOnceExecuteOnce(&cache_once, cache_init, NULL, NULL);
+#else
+	pthread_once(&cache_once, cache_init);
+#endif
+
+	if (cache_rc != 0) {
+		*out = NULL;
+		return cache_rc;
+	}
+	*out = &cache_data;
+	return 0;
+}
+
+/*
+ * One line per CPU_FREQ_WARN_* bit, for logs on hosts that should run
+ * latency‐critical work; NULL for bits that are not a single warning.
+ */
+DLL_EXPORT const char* cpu_frequency_warning_text(unsigned int warning) {
+	switch (warning) {
+		case CPU_FREQ_WARN_POWERSAVE:
+			return "powersave governor / power saver scheme: clocks ramp slowly under load";
+		case CPU_FREQ_WARN_EPP_ENERGY:
+			return "energy_performance_preference is not \"performance\": wake-up and ramp latency traded for energy";
+		case CPU_FREQ_WARN_MIXED_POLICY:
+			return "CPUs run different governors or EPP values";
+		case CPU_FREQ_WARN_BOOST_OFF:
+			return "turbo / boost is disabled";
+		case CPU_FREQ_WARN_CAPPED:
+			return "OS maximum clock is below the hardware maximum";
+		default:
+			return NULL;
+	}
+}
+
+/* Re‐read the per‐logical frequency of a caller‐owned snapshot */
+DLL_EXPORT int refresh_cpu_frequency(CPU_DATA* data) {
+	if (!data || !data->frequency) {
+		return 201;
+	}
+	if (data->arena_shared) {
+		return 216;
+	}
+	read_frequency(data, data->frequency);
+	return 0;
+}
+
+/* Store one element of the cached frequency[]; readers may load it meanwhile */
+static void publish_mhz(int* slot, int mhz) {
+#if defined(_WIN32)
+	InterlockedExchange((volatile LONG*)slot, (LONG)mhz);
+#else
+	__atomic_store_n(slot, mhz, __ATOMIC_RELAXED);
+#endif
+}
+
+/* Re‐read the volatile fields (frequency) of the cached snapshot, in place */
+DLL_EXPORT int refresh_cpu_data_cached(void) {
+	const CPU_DATA* cached;
+	int rc = get_cpu_data_cached(&cached);
+	if (rc != 0) {
+		return rc;
+	}
+	int L = cached->logical_core_count;
+	int* mhz = malloc((L ? L : 1) * sizeof(int));
+	if (!mhz) {
+		return 203;
+	}
+
+#if defined(_WIN32)
+	AcquireSRWLockExclusive(&cache_lock);
+#else
+	pthread_mutex_lock(&cache_lock);
+#endif
+	read_frequency(&cache_data, mhz);
+	for (int cpu = 0; cpu < L; ++cpu) {
+		publish_mhz(&cache_data.frequency[cpu], mhz[cpu]);
+	}
+#if defined(_WIN32)
+	ReleaseSRWLockExclusive(&cache_lock);
+#else
+	pthread_mutex_unlock(&cache_lock);
+#endif
+	free(mhz);
+	return 0;
+}
+
+/*
+ * Change watcher.  A background thread owns a snapshot and re‐probes only
+ * the groups an event touches: CPU hotplug re‐reads every per‐CPU group
+ * (their arrays are sized by the online count), cpufreq policy changes
+ * FREQUENCY, affinity / cpuset / quota changes BUDGET, memory node
+ * hotplug NUMA and MEMORY.  The result is repacked into a new arena and
+ * the generation bumped, so a reader compares one integer to know
+ * whether its thread plan is stale.
+ *
+ * Linux listens to kernel uevents (netlink) for cpu, node and memory
+ * devices and every poll_ms compares the affinity / cgroup budget and the
+ * cpufreq policy limits and governors, which raise no uevent.  Windows registers
+ * for power plan and AC/DC notifications and polls the active processor
+ * count and the budget.
+ */
+#define WATCH_PER_CPU (CPU_FIELD_TOPOLOGY | CPU_FIELD_CACHES | CPU_FIELD_FREQUENCY | CPU_FIELD_NUMA)
+#define WATCH_DEFAULT_MS 1000
+
+struct CPU_WATCHER {
+	unsigned int fields;		/* groups kept in data */
+	int poll_ms;
+	CpuChangeFn fn;
+	void* ctx;
+	CPU_DATA data;				/* current snapshot, replaced under lock */
+	volatile uint64_t generation;
+	uint64_t cpus_seen;			/* online_cpus() at the last probe */
+	uint64_t policy_seen;		/* cpufreq policy signature (Linux) */
+#if defined(_WIN32)
+	SRWLOCK lock;
+	HANDLE thread;
+	HANDLE wake;				/* set by stop and by the power callback */
+	volatile LONG stop;
+	volatile LONG pending;		/* CPU_FIELD_* raised by callbacks */
+	HPOWERNOTIFY power[2];
+	DEVICE_NOTIFY_SUBSCRIBE_PARAMETERS subscribe;
+#else
+	pthread_mutex_t lock;
+	pthread_t thread;
+	volatile long stop;			/* checked every wake‐up, so a lost pipe write only delays */
+	int stop_pipe[2];
+	int uevent_fd;				/* -1 without netlink (e.g. unprivileged netns) */
+#endif
+};
+
+/* FNV‐1a over the online mask, so a CPU swapped for another also counts */
+static uint64_t online_cpus(void) {
+	uint64_t h = 0xcbf29ce484222325ull;
+	signed char* online = NULL;
+	int L = probe_online_cpus(&online, NULL);
+	for (int cpu = 0; cpu < L; ++cpu) {
+		h = (h ^ (unsigned char)online[cpu]) * 0x100000001b3ull;
+	}
+	free(online);
+	return (h ^ (uint64_t)(L + 1)) * 0x100000001b3ull;
+}
+
+/* Take the `fields` groups from fresh and the rest from data */
+static void merge_groups(CPU_DATA* view, const CPU_DATA* fresh, unsigned int fields) {
+	if (fields & WATCH_PER_CPU) {
+		view->logical_core_count = fresh->logical_core_count;
+	}
+	if (fields & CPU_FIELD_BRAND) {
+		view->cpu_name = fresh->cpu_name;
+	}
+	if (fields & CPU_FIELD_ALGORITHMS) {
+		view->algorithms = fresh->algorithms;
+		view->features = fresh->features;
+		view->isa_level = fresh->isa_level;
+	}
+	if (fields & CPU_FIELD_TOPOLOGY) {
+		view->cores = fresh->cores;
+		view->physical_core_count = fresh->physical_core_count;
+		view->performance_core_count = fresh->performance_core_count;
+		view->efficiency_core_count = fresh->efficiency_core_count;
+	}
+	if (fields & CPU_FIELD_CACHES) {
+		view->l1size = fresh->l1size;
+		view->l2size = fresh->l2size;
+		view->l3size = fresh->l3size;
+		view->caches = fresh->caches;
+		view->cache_count = fresh->cache_count;
+		view->cache_of = fresh->cache_of;
+		view->tlbs = fresh->tlbs;
+		view->tlb_count = fresh->tlb_count;
+		view->prefetch_bytes = fresh->prefetch_bytes;
+		view->false_sharing_bytes = fresh->false_sharing_bytes;
+	}
+	if (fields & CPU_FIELD_FREQUENCY) {
+		view->frequency = fresh->frequency;
+		view->effective_frequency = fresh->effective_frequency;
+		view->frequency_limits = fresh->frequency_limits;
+		view->base_mhz = fresh->base_mhz;
+		view->max_mhz = fresh->max_mhz;
+		view->bus_mhz = fresh->bus_mhz;
+		memcpy(view->scaling_driver, fresh->scaling_driver, sizeof(view->scaling_driver));
+		memcpy(view->scaling_governor, fresh->scaling_governor, sizeof(view->scaling_governor));
+		memcpy(view->energy_perf_preference, fresh->energy_perf_preference, sizeof(view->energy_perf_preference));
+		view->frequency_warnings = fresh->frequency_warnings;
+		/* the rate is fixed, so keep the first scale and conversions stay stable */
+		if (!view->tsc.frequency_hz) {
+			view->tsc = fresh->tsc;
+		}
+	}
+	if (fields & CPU_FIELD_NUMA) {
+		view->numa_nodes = fresh->numa_nodes;
+		view->numa_node_count = fresh->numa_node_count;
+		view->numa_distance = fresh->numa_distance;
+	}
+	if (fields & CPU_FIELD_BUDGET) {
+		view->budget = fresh->budget;
+	}
+	if (fields & CPU_FIELD_MEMORY) {
+		view->memory = fresh->memory;
+	}
+}
+
+static uint64_t watcher_generation_load(CPU_WATCHER* w) {
+#if defined(_WIN32)
+	return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)&w->generation, 0, 0);
+#else
+	return __atomic_load_n(&w->generation, __ATOMIC_ACQUIRE);
+#endif
+}
+
+#if !defined(_WIN32)
+/* FNV‐1a over every policy's limits and governor */
+static uint64_t cpufreq_policy_signature(void) {
+	uint64_t h = 0xcbf29ce484222325ull;
+	int dirfd = open("/sys/devices/system/cpu/cpufreq", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0) {
+		return 0;
+	}
+	static const char* attrs[] = { "scaling_min_freq", "scaling_max_freq", "scaling_governor" };
+	int L = get_nprocs_conf();
+	for (int p = 0; p < L; ++p) {
+		for (int a = 0; a < 3; ++a) {
+			char rel[96], buf[64];
+			snprintf(rel, sizeof(rel), "policy%d/%s", p, attrs[a]);
+			int n = read_text_at(dirfd, rel, buf, sizeof(buf));
+			for (int i = 0; i < n; ++i) {
+				h = (h ^ (unsigned char)buf[i]) * 0x100000001b3ull;
+			}
+			h = (h ^ (uint64_t)(n + 1)) * 0x100000001b3ull;
+		}
+	}
+	close(dirfd);
+	return h;
+}
+
+/* Groups touched by the uevents waiting on the socket */
+static unsigned int drain_uevents(int fd) {
+	unsigned int changed = 0;
+	char msg[4096];
+	ssize_t n;
+	while ((n = recv(fd, msg, sizeof(msg) - 1, MSG_DONTWAIT)) > 0) {
+		msg[n] = '\0';		/* first string is "action@devpath" */
+		char* at = strchr(msg, '@');
+		if (!at) {
+			continue;
+		}
+		size_t alen = (size_t)(at - msg);
+		const char* path = at + 1;
+		int hotplug = (alen == 6 && (!strncmp(msg, "online", 6) || !strncmp(msg, "remove", 6)))
+			|| (alen == 7 && !strncmp(msg, "offline", 7)) || (alen == 3 && !strncmp(msg, "add", 3));
+		if (!strncmp(path, "/devices/system/cpu/cpu", 23) && isdigit((unsigned char)path[23])) {
+			changed |= hotplug ? WATCH_PER_CPU | CPU_FIELD_BUDGET : CPU_FIELD_FREQUENCY;
+		} else if (!strncmp(path, "/devices/system/node/node", 25) && hotplug) {
+			changed |= CPU_FIELD_NUMA | CPU_FIELD_MEMORY;
+		} else if (!strncmp(path, "/devices/system/memory/memory", 29) && hotplug) {
+			changed |= CPU_FIELD_MEMORY;	/* a block on/offline moves MemTotal and node sizes */
+		}
+	}
+	return changed;
+}
+#endif
+
+/* Changes found by polling; also refreshes the seen values */
+static unsigned int watcher_scan(CPU_WATCHER* w) {
+	unsigned int changed = 0;
+	uint64_t cpus = online_cpus();
+	if (cpus != w->cpus_seen) {
+		changed |= WATCH_PER_CPU | CPU_FIELD_BUDGET;
+	}
+	if (w->fields & CPU_FIELD_BUDGET) {
+		CpuBudget b, seen;
+		get_cpu_budget(&b);
+		/* cpu_watcher_refresh() may be replacing data on another thread */
+#if defined(_WIN32)
+		AcquireSRWLockShared(&w->lock);
+		seen = w->data.budget;
+		ReleaseSRWLockShared(&w->lock);
+#else
+		pthread_mutex_lock(&w->lock);
+		seen = w->data.budget;
+		pthread_mutex_unlock(&w->lock);
+#endif
+		if (memcmp(&b, &seen, sizeof(b)) != 0) {
+			changed |= CPU_FIELD_BUDGET;
+		}
+	}
+#if !defined(_WIN32)
+	if (w->fields & CPU_FIELD_FREQUENCY) {
+		uint64_t sig = cpufreq_policy_signature();
+		if (sig != w->policy_seen) {
+			changed |= CPU_FIELD_FREQUENCY;
+		}
+	}
+#endif
+	return changed;
+}
+
+/* Re‐probe `changed`, swap the snapshot in and tell the callback */
+static int watcher_apply(CPU_WATCHER* w, unsigned int changed) {
+	/* cores[].numa_node links the two groups, so they move together */
+	if (changed & (CPU_FIELD_TOPOLOGY | CPU_FIELD_NUMA)) {
+		changed |= CPU_FIELD_TOPOLOGY | CPU_FIELD_NUMA;
+	}
+	changed &= w->fields;
+	if (!changed) {
+		return 0;
+	}
+	CPU_DATA fresh, next;
+	uint64_t gen = 0;
+	memset(&fresh, 0, sizeof(fresh));
+	int rc = get_cpu_data_ex(&fresh, changed);
+	if (rc != 0) {
+		return rc;
+	}
+
+#if defined(_WIN32)
+	AcquireSRWLockExclusive(&w->lock);
+#else
+	pthread_mutex_lock(&w->lock);
+#endif
+	CPU_DATA view = w->data;
+	merge_groups(&view, &fresh, changed);
+	rc = pack_cpu_data(&view, &next);
+	if (rc == 0) {
+		free_cpu_data(&w->data);
+		w->data = next;
+		w->cpus_seen = online_cpus();
+#if !defined(_WIN32)
+		if (changed & CPU_FIELD_FREQUENCY) {
+			w->policy_seen = cpufreq_policy_signature();
+		}
+#endif
+#if defined(_WIN32)
+		gen = (uint64_t)InterlockedIncrement64((volatile LONG64*)&w->generation);
+#else
+		gen = __atomic_add_fetch(&w->generation, 1, __ATOMIC_RELEASE);
+#endif
+	}
+#if defined(_WIN32)
+	ReleaseSRWLockExclusive(&w->lock);
+#else
+	pthread_mutex_unlock(&w->lock);
+#endif
+	free_cpu_data(&fresh);
+	if (rc == 0 && w->fn) {
+		w->fn(w->ctx, changed, gen);
+	}
+	return rc;
+}
+
+#if defined(_WIN32)
+static ULONG CALLBACK watcher_power_event(PVOID ctx, ULONG type, PVOID setting) {
+	CPU_WATCHER* w = ctx;
+	(void)type; (void)setting;
+	InterlockedOr(&w->pending, (LONG)CPU_FIELD_FREQUENCY);
+	SetEvent(w->wake);
+	return 0;
+}
+
+static DWORD WINAPI watcher_thread(LPVOID arg) {
+	CPU_WATCHER* w = arg;
+	while (!w->stop) {
+		WaitForSingleObject(w->wake, (DWORD)w->poll_ms);
+		if (w->stop) {
+			break;
+		}
+		unsigned int changed = (unsigned int)InterlockedExchange(&w->pending, 0);
+		watcher_apply(w, changed | watcher_scan(w));
+	}
+	return 0;
+}
+#else
+static void* watcher_thread(void* arg) {
+	CPU_WATCHER* w = arg;
+	while (!__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+		struct pollfd fds[2] = { { w->stop_pipe[0], POLLIN, 0 }, { w->uevent_fd, POLLIN, 0 } };
+		int n = poll(fds, w->uevent_fd >= 0 ? 2 : 1, w->poll_ms);
+		if (n < 0 && errno != EINTR) {
+			break;
+		}
+		if (fds[0].revents || __atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		unsigned int changed = 0;
+		if (w->uevent_fd >= 0 && (fds[1].revents & POLLIN)) {
+			changed = drain_uevents(w->uevent_fd);
+			/* a hotplug burst (e.g. a whole socket) arrives as many events */
+			sleep_ms(50);
+			changed |= drain_uevents(w->uevent_fd);
+		}
+		watcher_apply(w, changed | watcher_scan(w));
+	}
+	return NULL;
+}
+
+static int open_uevent_socket(void) {
+	int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		return -1;
+	}
+	struct sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;		/* kernel events, before udev rules */
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+#endif
+
+DLL_EXPORT void cpu_watcher_destroy(CPU_WATCHER* w) {
+	if (!w) {
+		return;
+	}
+#if defined(_WIN32)
+	if (w->thread) {
+		InterlockedExchange(&w->stop, 1);
+		SetEvent(w->wake);
+		WaitForSingleObject(w->thread, INFINITE);
+		CloseHandle(w->thread);
+	}
+	for (int i = 0; i < 2; ++i) {
+		if (w->power[i]) {
+			PowerSettingUnregisterNotification(w->power[i]);
+		}
+	}
+	if (w->wake) {
+		CloseHandle(w->wake);
+	}
+#else
+	if (w->stop_pipe[1] >= 0) {
+		/* the flag alone stops the thread within poll_ms; the byte just wakes it now */
+		__atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+		while (write(w->stop_pipe[1], "x", 1) < 0 && (errno == EINTR || errno == EAGAIN)) {
+		}
+		pthread_join(w->thread, NULL);
+		close(w->stop_pipe[1]);
+	}
+	if (w->stop_pipe[0] >= 0) close(w->stop_pipe[0]);
+	if (w->uevent_fd >= 0) close(w->uevent_fd);
+	pthread_mutex_destroy(&w->lock);
+#endif
+	free_cpu_data(&w->data);
+	free(w);
+}
+
+/*
+ * Probe `fields` now and keep them current in the background.  fn (may
+ * be NULL) runs after each update with the groups that were re‐probed and
+ * the new generation: on the watcher thread, or on the caller's thread
+ * for cpu_watcher_refresh().
+ */
+DLL_EXPORT int cpu_watcher_create(unsigned int fields, int poll_ms, CpuChangeFn fn, void* ctx,
+	CPU_WATCHER** out) {
+	if (!out) {
+		return 201;
+	}
+	*out = NULL;
+	CPU_WATCHER* w = calloc(1, sizeof(*w));
+	if (!w) {
+		return 203;
+	}
+	w->fields = fields & CPU_FIELD_ALL;
+	w->poll_ms = poll_ms > 0 ? poll_ms : WATCH_DEFAULT_MS;
+	w->fn = fn;
+	w->ctx = ctx;
+	w->cpus_seen = online_cpus();
+#if defined(_WIN32)
+	InitializeSRWLock(&w->lock);
+#else
+	w->stop_pipe[0] = w->stop_pipe[1] = w->uevent_fd = -1;
+	pthread_mutex_init(&w->lock, NULL);
+	w->policy_seen = cpufreq_policy_signature();
+#endif
+	int rc = get_cpu_data_ex(&w->data, w->fields);
+	if (rc != 0) {
+		cpu_watcher_destroy(w);
+		return rc;
+	}
+
+#if defined(_WIN32)
+	static const GUID power_settings[2] = {
+		{ 0x245d8541, 0x3943, 0x4422, { 0xb0, 0x25, 0x13, 0xa7, 0x84, 0xf6, 0x79, 0xb7 } },	/* GUID_POWERSCHEME_PERSONALITY */
+		{ 0x5d3e9a59, 0xe9d5, 0x4b00, { 0xa6, 0xbd, 0xff, 0x34, 0xff, 0x51, 0x65, 0x48 } }	/* GUID_ACDC_POWER_SOURCE */
+	};
+	w->wake = CreateEventA(NULL, FALSE, FALSE, NULL);
+	if (!w->wake) {
+		cpu_watcher_destroy(w);
+		return 214;
+	}
+	w->subscribe.Callback = watcher_power_event;
+	w->subscribe.Context = w;
+	for (int i = 0; i < 2 && (w->fields & CPU_FIELD_FREQUENCY); ++i) {
+		/* optional: polling still covers processor count and budget */
+		PowerSettingRegisterNotification(&power_settings[i], DEVICE_NOTIFY_CALLBACK,
+			(HANDLE)&w->subscribe, &w->power[i]);
+	}
+	w->thread = CreateThread(NULL, 0, watcher_thread, w, 0, NULL);
+	if (!w->thread) {
+		cpu_watcher_destroy(w);
+		return 214;
+	}
+#else
+	w->uevent_fd = open_uevent_socket();
+	if (pipe2(w->stop_pipe, O_CLOEXEC) != 0) {
+		w->stop_pipe[0] = w->stop_pipe[1] = -1;
+		cpu_watcher_destroy(w);
+		return 214;
+	}
+	if (pthread_create(&w->thread, NULL, watcher_thread, w) != 0) {
+		close(w->stop_pipe[1]);
+		w->stop_pipe[1] = -1;
+		cpu_watcher_destroy(w);
+		return 214;
+	}
+#endif
+	*out = w;
+	return 0;
+}
+
+/* Bumped on every update; compare with the value a plan was built from */
+DLL_EXPORT uint64_t cpu_watcher_generation(CPU_WATCHER* w) {
+	return w ? watcher_generation_load(w) : 0;
+}
+
+/* Independent copy of the current snapshot and the generation it belongs to */
+DLL_EXPORT int cpu_watcher_snapshot(CPU_WATCHER* w, CPU_DATA* out, uint64_t* generation) {
+	if (!w || !out) {
+		return 201;
+	}
+#if defined(_WIN32)
+	AcquireSRWLockShared(&w->lock);
+#else
+	pthread_mutex_lock(&w->lock);
+#endif
+	int rc = copy_cpu_data(out, &w->data);
+	if (generation) {
+		*generation = watcher_generation_load(w);
+	}
+#if defined(_WIN32)
+	ReleaseSRWLockShared(&w->lock);
+#else
+	pthread_mutex_unlock(&w->lock);
+#endif
+	return rc;
+}
+
+/* Re‐probe `fields` (0 = all watched) now, e.g. after changing our own affinity; fn runs here */
+DLL_EXPORT int cpu_watcher_refresh(CPU_WATCHER* w, unsigned int fields) {
+	if (!w) {
+		return 201;
+	}
+	return watcher_apply(w, fields ? fields : w->fields);
+}
+
+/*
+ * Live sampler: per‐CPU handles are opened once at creation, and every
+ * sample lands in a preallocated ring slot.  Sampling itself does no
+ * allocation and, on Linux, one pread per open counter.
+ */
+#define SAMPLE_MAX_ZONES 16
+
+struct CPU_SAMPLER {
+	int logical_count;
+	int package_count;
+	int zone_count;			/* RAPL zones with a readable counter */
+	unsigned int channels;	/* CPU_SAMPLE_* with at least one source */
+	int capacity;
+	int head;				/* next slot to write */
+	int count;				/* valid samples, <= capacity */
+	CPU_SAMPLE* ring;
+	int* int_storage;		/* mhz, core_temp_mc, package_temp_mc per slot */
+	uint64_t* u64_storage;	/* throttle / power‐limit counters, energy per slot */
+	int* package_of;		/* per‐logical dense package index */
+	char zone_names[SAMPLE_MAX_ZONES][48];
+	uint64_t zone_range_uj[SAMPLE_MAX_ZONES];	/* counter wraps here, 0 if unknown */
+#if defined(_WIN32)
+	processor_power_info* ppi;
+	ULONG ppi_bytes;
+#else
+	int* fds;				/* every counter below, -1 if absent */
+	int* freq_fd;			/* per logical: scaling_cur_freq */
+	int* core_thr_fd;		/* per logical: core_throttle_count */
+	int* core_pl_fd;		/* per logical: core_power_limit_count */
+	int* core_temp_fd;		/* per logical: coretemp "Core N" */
+	int* pkg_thr_fd;		/* per package */
+	int* pkg_pl_fd;
+	int* pkg_temp_fd;
+	int* zone_fd;			/* per zone: energy_uj */
+	int fd_count;
+#endif
+};
+
+DLL_EXPORT void cpu_sampler_destroy(CPU_SAMPLER* s) {
+	if (!s) {
+		return;
+	}
+#if defined(_WIN32)
+	free(s->ppi);
+#else
+	if (s->fds) {
+		for (int i = 0; i < s->fd_count; ++i) {
+			if (s->fds[i] >= 0) {
+				close(s->fds[i]);
+			}
+		}
+		free(s->fds);
+	}
+#endif
+	free(s->ring);
+	free(s->int_storage);
+	free(s->u64_storage);
+	free(s->package_of);
+	free(s);
+}
+
+#if !defined(_WIN32)
+/* Signed decimal at the start of an open sysfs file; -1 if unreadable or not a number */
+static int pread_value(int fd, int64_t* out) {
+	char buf[32];
+	ssize_t n = fd >= 0 ? pread(fd, buf, sizeof(buf), 0) : -1;
+	int64_t v = 0;
+	int neg = (n > 0 && buf[0] == '-');
+	if (n <= neg || buf[neg] < '0' || buf[neg] > '9') {
+		return -1;
+	}
+	for (ssize_t i = neg; i < n && buf[i] >= '0' && buf[i] <= '9'; ++i) {
+		v = v * 10 + (buf[i] - '0');
+	}
+	*out = neg ? -v : v;
+	return 0;
+}
+
+/* Decimal counter at the start of an open sysfs file, -1 if unreadable */
+static int64_t pread_number(int fd) {
+	int64_t v;
+	return pread_value(fd, &v) == 0 ? v : -1;
+}
+
+/* Millidegrees from an open hwmon temp*_input, CPU_TEMP_UNKNOWN if the read fails */
+static int pread_temp(int fd) {
+	int64_t mc;
+	return pread_value(fd, &mc) == 0 ? (int)mc : CPU_TEMP_UNKNOWN;
+}
+
+/* Open cpuN/thermal_throttle counters, first CPU of each package for the package ones */
+static void open_throttle_counters(CPU_SAMPLER* s, int dirfd) {
+	for (int cpu = 0; cpu < s->logical_count; ++cpu) {
+		char rel[96];
+		snprintf(rel, sizeof(rel), "cpu%d/thermal_throttle/core_throttle_count", cpu);
+		s->core_thr_fd[cpu] = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+		snprintf(rel, sizeof(rel), "cpu%d/thermal_throttle/core_power_limit_count", cpu);
+		s->core_pl_fd[cpu] = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+		int p = s->package_of[cpu];
+		if (s->pkg_thr_fd[p] < 0) {
+			snprintf(rel, sizeof(rel), "cpu%d/thermal_throttle/package_throttle_count", cpu);
+			s->pkg_thr_fd[p] = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+		}
+		if (s->pkg_pl_fd[p] < 0) {
+			snprintf(rel, sizeof(rel), "cpu%d/thermal_throttle/package_power_limit_count", cpu);
+			s->pkg_pl_fd[p] = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+		}
+	}
+}
+
+/*
+ * hwmon temperatures.  coretemp.N (one per package, N = package id) has
+ * "Package id N" and "Core C" labels, C being topology/core_id; k10temp /
+ * zenpower (one per socket, in hwmon order) give Tdie, else Tctl, per
+ * package only.
+ */
+static void open_temperatures(CPU_SAMPLER* s, const int* package_id, const int* core_id) {
+	int dirfd = open("/sys/class/hwmon", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0) {
+		return;
+	}
+	int amd_package = 0;
+	for (int h = 0; h < 64; ++h) {
+		char rel[96], name[32], link[128];
+		snprintf(rel, sizeof(rel), "hwmon%d/name", h);
+		if (read_text_at(dirfd, rel, name, sizeof(name)) <= 0) {
+			continue;
+		}
+		name[strcspn(name, "\n")] = '\0';
+		int intel = !strcmp(name, "coretemp");
+		int amd = !strcmp(name, "k10temp") || !strcmp(name, "zenpower");
+		if (!intel && !amd) {
+			continue;
+		}
+		int pkg = -1;
+		if (intel) {
+			snprintf(rel, sizeof(rel), "hwmon%d/device", h);
+			ssize_t n = readlinkat(dirfd, rel, link, sizeof(link) - 1);
+			const char* dot = NULL;
+			if (n > 0) {
+				link[n] = '\0';
+				dot = strrchr(link, '.');
+			}
+			pkg = dot ? atoi(dot + 1) : 0;
+		} else {
+			pkg = amd_package++;
+		}
+		/* dense index of OS package `pkg` */
+		int dense = -1;
+		for (int cpu = 0; cpu < s->logical_count && dense < 0; ++cpu) {
+			if (package_id[cpu] == pkg) dense = s->package_of[cpu];
+		}
+		if (dense < 0) {
+			continue;
+		}
+		int package_fd = -1, tctl_fd = -1;
+		for (int t = 1; t <= 128; ++t) {
+			char label[32];
+			snprintf(rel, sizeof(rel), "hwmon%d/temp%d_label", h, t);
+			if (read_text_at(dirfd, rel, label, sizeof(label)) <= 0) {
+				continue;
+			}
+			label[strcspn(label, "\n")] = '\0';
+			snprintf(rel, sizeof(rel), "hwmon%d/temp%d_input", h, t);
+			if (package_fd < 0 && (intel ? !strncmp(label, "Package id ", 11) : !strcmp(label, "Tdie"))) {
+				package_fd = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+			} else if (amd && tctl_fd < 0 && !strcmp(label, "Tctl")) {
+				tctl_fd = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+			} else if (intel && !strncmp(label, "Core ", 5)) {
+				int core = atoi(label + 5);
+				for (int cpu = 0; cpu < s->logical_count; ++cpu) {
+					if (package_id[cpu] == pkg && core_id[cpu] == core && s->core_temp_fd[cpu] < 0) {
+						s->core_temp_fd[cpu] = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+					}
+				}
+			}
+		}
+		/* Tctl carries a fan‐curve offset on some parts; only a fallback */
+		if (package_fd < 0) {
+			package_fd = tctl_fd;
+		} else if (tctl_fd >= 0) {
+			close(tctl_fd);
+		}
+		if (s->pkg_temp_fd[dense] < 0) {
+			s->pkg_temp_fd[dense] = package_fd;
+		} else if (package_fd >= 0) {
+			close(package_fd);
+		}
+	}
+	close(dirfd);
+}
+
+/* powercap intel-rapl:N (package / psys) and intel-rapl:N:M (core, uncore, dram) */
+static void open_energy_zones(CPU_SAMPLER* s) {
+	int dirfd = open("/sys/class/powercap", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0) {
+		return;
+	}
+	for (int n = 0; n < 16 && s->zone_count < SAMPLE_MAX_ZONES; ++n) {
+		char parent[24] = "";
+		for (int m = -1; m < 16 && s->zone_count < SAMPLE_MAX_ZONES; ++m) {
+			char zone[32], rel[96], name[24], range[32];
+			if (m < 0) snprintf(zone, sizeof(zone), "intel-rapl:%d", n);
+			else snprintf(zone, sizeof(zone), "intel-rapl:%d:%d", n, m);
+			snprintf(rel, sizeof(rel), "%s/name", zone);
+			if (read_text_at(dirfd, rel, name, sizeof(name)) <= 0) {
+				if (m < 0) break;
+				continue;
+			}
+			name[strcspn(name, "\n")] = '\0';
+			if (m < 0) {
+				snprintf(parent, sizeof(parent), "%s", name);
+			}
+			snprintf(rel, sizeof(rel), "%s/energy_uj", zone);
+			int fd = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);	/* root‐only on newer kernels */
+			if (fd < 0) {
+				continue;
+			}
+			int z = s->zone_count++;
+			s->zone_fd[z] = fd;
+			if (m < 0) snprintf(s->zone_names[z], sizeof(s->zone_names[z]), "%s", name);
+			else snprintf(s->zone_names[z], sizeof(s->zone_names[z]), "%s/%s", parent, name);
+			snprintf(rel, sizeof(rel), "%s/max_energy_range_uj", zone);
+			s->zone_range_uj[z] = read_text_at(dirfd, rel, range, sizeof(range)) > 0
+				? strtoull(range, NULL, 10) : 0;
+		}
+	}
+	close(dirfd);
+}
+
+static int any_open(const int* fds, int n) {
+	for (int i = 0; i < n; ++i) {
+		if (fds[i] >= 0) return 1;
+	}
+	return 0;
+}
+#endif
+
+/* Packages of each logical CPU, dense indices in package_of */
+static int sampler_packages(CPU_SAMPLER* s, int* package_id, int* core_id) {
+	int L = s->logical_count;
+#if defined(_WIN32)
+	for (int cpu = 0; cpu < L; ++cpu) {
+		package_id[cpu] = 0;
+		core_id[cpu] = cpu;
+	}
+#else
+	int dirfd = open("/sys/devices/system/cpu", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	for (int cpu = 0; cpu < L; ++cpu) {
+		char rel[64];
+		package_id[cpu] = 0;
+		core_id[cpu] = cpu;
+		snprintf(rel, sizeof(rel), "cpu%d/topology/physical_package_id", cpu);
+		if (dirfd >= 0) read_int_at(dirfd, rel, &package_id[cpu]);
+		snprintf(rel, sizeof(rel), "cpu%d/topology/core_id", cpu);
+		if (dirfd >= 0) read_int_at(dirfd, rel, &core_id[cpu]);
+	}
+	if (dirfd >= 0) {
+		close(dirfd);
+	}
+#endif
+	return group_keys(package_id, L, s->package_of, NULL);
+}
+
+/* Point every ring slot at its part of the storage blocks */
+static void sampler_layout(CPU_SAMPLER* s) {
+	int L = s->logical_count, P = s->package_count, Z = s->zone_count;
+	size_t ints = 0, u64s = 0;
+	for (int i = 0; i < s->capacity; ++i) {
+		CPU_SAMPLE* slot = &s->ring[i];
+		memset(slot, 0, sizeof(*slot));
+		if (s->channels & CPU_SAMPLE_FREQUENCY) {
+			slot->mhz = s->int_storage + ints; ints += L;
+		}
+		if (s->channels & CPU_SAMPLE_TEMPERATURE) {
+			slot->core_temp_mc = s->int_storage + ints; ints += L;
+			slot->package_temp_mc = s->int_storage + ints; ints += P;
+		}
+		if (s->channels & CPU_SAMPLE_THROTTLE) {
+			slot->core_throttle = s->u64_storage + u64s; u64s += L;
+			slot->core_power_limit = s->u64_storage + u64s; u64s += L;
+			slot->package_throttle = s->u64_storage + u64s; u64s += P;
+			slot->package_power_limit = s->u64_storage + u64s; u64s += P;
+		}
+		if (s->channels & CPU_SAMPLE_ENERGY) {
+			slot->energy_uj = s->u64_storage + u64s; u64s += Z;
+		}
+	}
+}
+
+DLL_EXPORT int cpu_sampler_create_ex(int capacity, unsigned int channels, CPU_SAMPLER** out) {
+	if (!out || capacity <= 0) {
+		return 201;
+	}
+	*out = NULL;
+
+	CPU_SAMPLER* s = calloc(1, sizeof(*s));
+	if (!s) {
+		return 203;
+	}
+#if defined(_WIN32)
+	s->logical_count = (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+#else
+	s->logical_count = probe_logical_count();
+#endif
+	int L = s->logical_count;
+	s->capacity = capacity;
+	s->ring = calloc(capacity, sizeof(*s->ring));
+	s->package_of = malloc(L * sizeof(int));
+	int* package_id = malloc(L * sizeof(int));
+	int* core_id = malloc(L * sizeof(int));
+	if (!s->ring || !s->package_of || !package_id || !core_id) {
+		free(package_id); free(core_id);
+		cpu_sampler_destroy(s);
+		return 203;
+	}
+	s->package_count = sampler_packages(s, package_id, core_id);
+	if (s->package_count < 0) {
+		free(package_id); free(core_id);
+		cpu_sampler_destroy(s);
+		return 203;
+	}
+	int P = s->package_count;
+
+#if defined(_WIN32)
+	free(package_id); free(core_id);
+	/* throttle, temperature and energy counters have no user‐mode source */
+	s->channels = channels & CPU_SAMPLE_FREQUENCY;
+	s->ppi_bytes = (ULONG)(L * sizeof(processor_power_info));
+	s->ppi = malloc(s->ppi_bytes);
+	if (!s->ppi) {
+		cpu_sampler_destroy(s);
+		return 203;
+	}
+#else
+	s->fd_count = 4 * L + 3 * P + SAMPLE_MAX_ZONES;
+	s->fds = malloc(s->fd_count * sizeof(int));
+	if (!s->fds) {
+		free(package_id); free(core_id);
+		cpu_sampler_destroy(s);
+		return 203;
+	}
+	for (int i = 0; i < s->fd_count; ++i) {
+		s->fds[i] = -1;
+	}
+	s->freq_fd = s->fds;
+	s->core_thr_fd = s->freq_fd + L;
+	s->core_pl_fd = s->core_thr_fd + L;
+	s->core_temp_fd = s->core_pl_fd + L;
+	s->pkg_thr_fd = s->core_temp_fd + L;
+	s->pkg_pl_fd = s->pkg_thr_fd + P;
+	s->pkg_temp_fd = s->pkg_pl_fd + P;
+	s->zone_fd = s->pkg_temp_fd + P;
+
+	int dirfd = open("/sys/devices/system/cpu", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd >= 0) {
+		for (int cpu = 0; cpu < L && (channels & CPU_SAMPLE_FREQUENCY); ++cpu) {
+			char rel[64];
+			snprintf(rel, sizeof(rel), "cpu%d/cpufreq/scaling_cur_freq", cpu);
+			s->freq_fd[cpu] = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+		}
+		if (channels & CPU_SAMPLE_THROTTLE) {
+			open_throttle_counters(s, dirfd);
+		}
+		close(dirfd);
+	}
+	if (channels & CPU_SAMPLE_TEMPERATURE) {
+		open_temperatures(s, package_id, core_id);
+	}
+	if (channels & CPU_SAMPLE_ENERGY) {
+		open_energy_zones(s);
+	}
+	free(package_id); free(core_id);
+
+	/* frequency always reports (0 MHz without cpufreq); the others only with a source */
+	s->channels = channels & CPU_SAMPLE_FREQUENCY;
+	if (any_open(s->core_thr_fd, 2 * L) || any_open(s->pkg_thr_fd, 2 * P)) s->channels |= CPU_SAMPLE_THROTTLE;
+	if (any_open(s->core_temp_fd, L) || any_open(s->pkg_temp_fd, P)) s->channels |= CPU_SAMPLE_TEMPERATURE;
+	if (s->zone_count) s->channels |= channels & CPU_SAMPLE_ENERGY;
+#endif
+
+	size_t per_slot_int = 0, per_slot_u64 = 0;
+	if (s->channels & CPU_SAMPLE_FREQUENCY) per_slot_int += L;
+	if (s->channels & CPU_SAMPLE_TEMPERATURE) per_slot_int += L + P;
+	if (s->channels & CPU_SAMPLE_THROTTLE) per_slot_u64 += 2 * (size_t)(L + P);
+	if (s->channels & CPU_SAMPLE_ENERGY) per_slot_u64 += s->zone_count;
+	s->int_storage = calloc((size_t)capacity * per_slot_int + 1, sizeof(int));
+	s->u64_storage = calloc((size_t)capacity * per_slot_u64 + 1, sizeof(uint64_t));
+	if (!s->int_storage || !s->u64_storage) {
+		cpu_sampler_destroy(s);
+		return 203;
+	}
+	sampler_layout(s);
+
+	*out = s;
+	return 0;
+}
+
+DLL_EXPORT int cpu_sampler_create(int capacity, CPU_SAMPLER** out) {
+	return cpu_sampler_create_ex(capacity, CPU_SAMPLE_FREQUENCY, out);
+}
+
+/* Read every open counter into the next ring slot; no allocation */
+DLL_EXPORT int cpu_sampler_sample(CPU_SAMPLER* s, const CPU_SAMPLE** out) {
+	if (!s) {
+		return 201;
+	}
+	CPU_SAMPLE* slot = &s->ring[s->head];
+	slot->timestamp_ns = monotonic_ns();
+
+#if defined(_WIN32)
+	if (s->channels & CPU_SAMPLE_FREQUENCY) {
+		if (read_power_info(s->ppi, s->logical_count) != 0) {
+			return 207;
+		}
+		for (int cpu = 0; cpu < s->logical_count; ++cpu) {
+			slot->mhz[cpu] = (int)s->ppi[cpu].CurrentMhz;
+		}
+	}
+#else
+	int L = s->logical_count, P = s->package_count;
+	if (slot->mhz) {
+		for (int cpu = 0; cpu < L; ++cpu) {
+			int64_t khz = pread_number(s->freq_fd[cpu]);
+			slot->mhz[cpu] = khz > 0 ? (int)(khz / 1000) : 0;
+		}
+	}
+	if (slot->core_throttle) {
+		for (int cpu = 0; cpu < L; ++cpu) {
+			int64_t t = pread_number(s->core_thr_fd[cpu]), pl = pread_number(s->core_pl_fd[cpu]);
+			slot->core_throttle[cpu] = t > 0 ? (uint64_t)t : 0;
+			slot->core_power_limit[cpu] = pl > 0 ? (uint64_t)pl : 0;
+		}
+		for (int p = 0; p < P; ++p) {
+			int64_t t = pread_number(s->pkg_thr_fd[p]), pl = pread_number(s->pkg_pl_fd[p]);
+			slot->package_throttle[p] = t > 0 ? (uint64_t)t : 0;
+			slot->package_power_limit[p] = pl > 0 ? (uint64_t)pl : 0;
+		}
+	}
+	if (slot->core_temp_mc) {
+		for (int cpu = 0; cpu < L; ++cpu) {
+			slot->core_temp_mc[cpu] = pread_temp(s->core_temp_fd[cpu]);
+		}
+		for (int p = 0; p < P; ++p) {
+			slot->package_temp_mc[p] = pread_temp(s->pkg_temp_fd[p]);
+		}
+	}
+	if (slot->energy_uj) {
+		for (int z = 0; z < s->zone_count; ++z) {
+			int64_t e = pread_number(s->zone_fd[z]);
+			slot->energy_uj[z] = e > 0 ? (uint64_t)e : 0;
+		}
+	}
+#endif
+
+	s->head = (s->head + 1) % s->capacity;
+	if (s->count < s->capacity) {
+		s->count++;
+	}
+	if (out) {
+		*out = slot;
+	}
+	return 0;
+}
+
+DLL_EXPORT int cpu_sampler_count(const CPU_SAMPLER* s) {
+	return s ? s->count : 0;
+}
+
+DLL_EXPORT int cpu_sampler_logical_count(const CPU_SAMPLER* s) {
+	return s ? s->logical_count : 0;
+}
+
+DLL_EXPORT int cpu_sampler_package_count(const CPU_SAMPLER* s) {
+	return s ? s->package_count : 0;
+}
+
+/* Dense package index of a logical CPU, as used by the package_* arrays */
+DLL_EXPORT int cpu_sampler_package_of(const CPU_SAMPLER* s, int logical_cpu) {
+	return (s && logical_cpu >= 0 && logical_cpu < s->logical_count) ? s->package_of[logical_cpu] : -1;
+}
+
+DLL_EXPORT unsigned int cpu_sampler_channels(const CPU_SAMPLER* s) {
+	return s ? s->channels : 0;
+}
+
+DLL_EXPORT int cpu_sampler_energy_zone_count(const CPU_SAMPLER* s) {
+	return s ? s->zone_count : 0;
+}
+
+/* "package-0", "package-0/core", "package-0/dram", "psys", ... */
+DLL_EXPORT const char* cpu_sampler_energy_zone_name(const CPU_SAMPLER* s, int zone) {
+	return (s && zone >= 0 && zone < s->zone_count) ? s->zone_names[zone] : NULL;
+}
+
+/* age 0 is the newest sample, count-1 the oldest still in the ring */
+DLL_EXPORT const CPU_SAMPLE* cpu_sampler_get(const CPU_SAMPLER* s, int age) {
+	if (!s || age < 0 || age >= s->count) {
+		return NULL;
+	}
+	int idx = (s->head - 1 - age + 2 * s->capacity) % s->capacity;
+	return &s->ring[idx];
+}
+
+/* Average watts of a zone between the two newest samples, wrap‐around aware */
+DLL_EXPORT double cpu_sampler_power_watts(const CPU_SAMPLER* s, int zone) {
+	const CPU_SAMPLE* now = cpu_sampler_get(s, 0);
+	const CPU_SAMPLE* before = cpu_sampler_get(s, 1);
+	if (!now || !before || !now->energy_uj || zone < 0 || zone >= s->zone_count
+		|| now->timestamp_ns <= before->timestamp_ns) {
+		return 0.0;
+	}
+	uint64_t a = before->energy_uj[zone], b = now->energy_uj[zone];
+	uint64_t used = b >= a ? b - a : (s->zone_range_uj[zone] ? s->zone_range_uj[zone] - a + b : 0);
+	return (double)used * 1000.0 / (double)(now->timestamp_ns - before->timestamp_ns);
+}
+
+#if !defined(_WIN32)
+#define MSR_MPERF 0xE7
+#define MSR_APERF 0xE8
+
+/* perf_event "msr" PMU type, -1 if the kernel has none */
+static int msr_pmu_type(void) {
+	int type;
+	int fd = open("/sys/bus/event_source/devices/msr/type", O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	char buf[16];
+	ssize_t n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0) {
+		return -1;
+	}
+	buf[n] = '\0';
+	type = atoi(buf);
+	return type;
+}
+
+static int open_msr_event(int type, int config, int cpu) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = (unsigned int)type;
+	attr.config = (unsigned long long)config;	/* 1 = aperf, 2 = mperf */
+	return (int)syscall(SYS_perf_event_open, &attr, -1, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * Counter handles per CPU: two perf events per CPU, or one /dev/cpu/N/msr
+ * descriptor in fd_a.
+ */
+typedef struct {
+	int use_perf;
+	int* fd_a;
+	int* fd_m;
+} aperf_handles;
+
+static int aperf_read(const aperf_handles* h, int cpu, uint64_t* a, uint64_t* m) {
+	if (h->use_perf) {
+		if (h->fd_a[cpu] < 0 || h->fd_m[cpu] < 0) return -1;
+		if (read(h->fd_a[cpu], a, 8) != 8) return -1;
+		if (read(h->fd_m[cpu], m, 8) != 8) return -1;
+		return 0;
+	}
+	if (h->fd_a[cpu] < 0) return -1;
+	if (pread(h->fd_a[cpu], a, 8, MSR_APERF) != 8) return -1;
+	if (pread(h->fd_a[cpu], m, 8, MSR_MPERF) != 8) return -1;
+	return 0;
+}
+
+/* Try the perf msr PMU first, then the msr driver */
+static int aperf_open(aperf_handles* h, int L) {
+	int opened = 0;
+	int type = msr_pmu_type();
+	h->use_perf = (type >= 0);
+	for (int cpu = 0; cpu < L; ++cpu) {
+		h->fd_a[cpu] = h->fd_m[cpu] = -1;
+	}
+	if (h->use_perf) {
+		for (int cpu = 0; cpu < L; ++cpu) {
+			h->fd_a[cpu] = open_msr_event(type, 1, cpu);
+			h->fd_m[cpu] = open_msr_event(type, 2, cpu);
+			opened += (h->fd_a[cpu] >= 0 && h->fd_m[cpu] >= 0);
+		}
+		if (opened) {
+			return 0;
+		}
+		for (int cpu = 0; cpu < L; ++cpu) {
+			if (h->fd_a[cpu] >= 0) close(h->fd_a[cpu]);
+			if (h->fd_m[cpu] >= 0) close(h->fd_m[cpu]);
+			h->fd_a[cpu] = h->fd_m[cpu] = -1;
+		}
+	}
+
+	h->use_perf = 0;
+	for (int cpu = 0; cpu < L; ++cpu) {
+		char path[64];
+		snprintf(path, sizeof(path), "/dev/cpu/%d/msr", cpu);
+		h->fd_a[cpu] = open(path, O_RDONLY | O_CLOEXEC);
+		opened += (h->fd_a[cpu] >= 0);
+	}
+	return opened ? 0 : -1;
+}
+
+static void aperf_close(aperf_handles* h, int L) {
+	for (int cpu = 0; cpu < L; ++cpu) {
+		if (h->fd_a[cpu] >= 0) close(h->fd_a[cpu]);
+		if (h->fd_m[cpu] >= 0) close(h->fd_m[cpu]);
+	}
+}
+#endif
+
+/* Re‐measure tsc.frequency_hz over interval_ms */
+DLL_EXPORT int calibrate_tsc(CPU_DATA* data, int interval_ms) {
+	if (!data || interval_ms <= 0) {
+		return 201;
+	}
+	if (data->arena_shared) {
+		return 216;
+	}
+	uint64_t hz = read_tsc() ? measure_tsc_hz(interval_ms) : 0;
+	if (!hz) {
+		return 202;
+	}
+	store_calibrated_hz(hz);
+	tsc_set_scale(&data->tsc, hz);
+	data->tsc.source = CPU_TSC_CALIBRATED;
+	return 0;
+}
+
+/*
+ * Average busy clock per logical CPU over `interval_ms`:
+ * nominal * dAPERF / dMPERF, nominal being CPUID 0x16's base clock or,
+ * failing that, the TSC rate measured over the same interval.  Where the
+ * counters cannot be read (no msr PMU or msr driver, or Windows) the
+ * current clock at the end of the interval is stored instead.
+ */
+DLL_EXPORT int measure_effective_frequency(CPU_DATA* data, int interval_ms) {
+	if (!data || !data->effective_frequency || interval_ms <= 0) {
+		return 201;
+	}
+	if (data->arena_shared) {
+		return 216;
+	}
+	int L = data->logical_core_count;
+
+#if !defined(_WIN32)
+	aperf_handles h;
+	uint64_t* start = malloc((size_t)L * 2 * sizeof(uint64_t));
+	signed char* ok = calloc(L, 1);
+	h.fd_a = malloc(L * sizeof(int));
+	h.fd_m = malloc(L * sizeof(int));
+	if (!start || !ok || !h.fd_a || !h.fd_m) {
+		free(start); free(ok); free(h.fd_a); free(h.fd_m);
+		return 203;
+	}
+
+	if (aperf_open(&h, L) == 0) {
+		for (int cpu = 0; cpu < L; ++cpu) {
+			ok[cpu] = (aperf_read(&h, cpu, &start[2 * cpu], &start[2 * cpu + 1]) == 0);
+		}
+		uint64_t tsc0 = read_tsc(), t0 = monotonic_ns();
+		sleep_ms(interval_ms);
+		uint64_t tsc1 = read_tsc(), t1 = monotonic_ns();
+
+		int regs[4];
+		double nominal = 0.0;
+		cpu_cpuid(0, 0, regs);
+		if (regs[0] >= 0x16) {
+			cpu_cpuid(0x16, 0, regs);
+			nominal = (double)(regs[0] & 0xFFFF);
+		}
+		if (nominal <= 0.0 && t1 > t0) {
+			nominal = (double)(tsc1 - tsc0) * 1000.0 / (double)(t1 - t0);
+		}
+
+		for (int cpu = 0; cpu < L; ++cpu) {
+			uint64_t a, m;
+			data->effective_frequency[cpu] = 0;
+			if (ok[cpu] && aperf_read(&h, cpu, &a, &m) == 0 && m > start[2 * cpu + 1]) {
+				double ratio = (double)(a - start[2 * cpu]) / (double)(m - start[2 * cpu + 1]);
+				data->effective_frequency[cpu] = (int)(nominal * ratio + 0.5);
+			}
+		}
+		aperf_close(&h, L);
+		free(start); free(ok); free(h.fd_a); free(h.fd_m);
+		return 0;
+	}
+	free(start); free(ok); free(h.fd_a); free(h.fd_m);
+#endif
+
+	/* fallback: no counters, report the clock at the end of the interval */
+	sleep_ms(interval_ms);
+	read_frequency(data, data->effective_frequency);
+	return 0;
+}
+
+/*
+ * Memory hierarchy benchmark.  Working sets are sized from the caches of
+ * logical CPU 0: half of L1d, L2 and L3 (never below twice the level
+ * underneath) and at least four times all L3 instances together for DRAM.
+ * Latency is a dependent load chain through every line in random order
+ * (one Sattolo cycle, so the prefetchers cannot follow it and, for DRAM,
+ * TLB misses are included).  Bandwidth streams 64‐bit words; copy counts
+ * the bytes read plus the bytes written, as STREAM does.
+ */
+#define BENCH_DEFAULT_MS	50
+#define BENCH_DRAM_MIN		((size_t)64 << 20)
+#define BENCH_DRAM_MAX		((size_t)1 << 30)
+
+static volatile uint64_t bench_sink;
+
+/* xorshift64*, enough to defeat the prefetchers */
+static uint64_t bench_rand(uint64_t* s) {
+	*s ^= *s >> 12;
+	*s ^= *s << 25;
+	*s ^= *s >> 27;
+	return *s * 0x2545F4914F6CDD1Dull;
+}
+
+/* Link every `line`-byte slot of buf into one random cycle */
+static int build_chase(char* buf, size_t bytes, size_t line) {
+	size_t count = bytes / line;
+	uint32_t* order = malloc(count * sizeof(uint32_t));
+	if (!order || count < 2) {
+		free(order);
+		return -1;
+	}
+	uint64_t seed = 0x9E3779B97F4A7C15ull;
+	for (size_t i = 0; i < count; ++i) {
+		order[i] = (uint32_t)i;
+	}
+	for (size_t i = count - 1; i > 0; --i) {
+		size_t j = (size_t)(bench_rand(&seed) % i);
+		uint32_t t = order[i]; order[i] = order[j]; order[j] = t;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		*(void**)(buf + i * line) = buf + (size_t)order[i] * line;
+	}
+	free(order);
+	return 0;
+}
+
+static double chase_latency(char* buf, size_t bytes, size_t line, int ms) {
+	if (build_chase(buf, bytes, line) != 0) {
+		return 0.0;
+	}
+	void** p = (void**)buf;
+	uint64_t loads = 0, t0 = monotonic_ns(), t1;
+	do {
+		for (int i = 0; i < 512; ++i) {
+			p = (void**)*p; p = (void**)*p; p = (void**)*p; p = (void**)*p;
+			p = (void**)*p; p = (void**)*p; p = (void**)*p; p = (void**)*p;
+		}
+		loads += 4096;
+		t1 = monotonic_ns();
+	} while (t1 - t0 < (uint64_t)ms * 1000000ull);
+	bench_sink += (uint64_t)(uintptr_t)p;
+	return (double)(t1 - t0) / (double)loads;
+}
+
+typedef enum { BENCH_READ, BENCH_WRITE, BENCH_COPY } bench_kind;
+
+/* Stream over buf for `ms`; GB/s (1e9 bytes per second) */
+static double stream_bandwidth(uint64_t* buf, size_t bytes, bench_kind kind, int ms) {
+	size_t words = bytes / sizeof(uint64_t);
+	size_t half = words / 2;
+	uint64_t moved = 0, acc = 0, t0 = monotonic_ns(), t1;
+	do {
+		switch (kind) {
+			case BENCH_READ: {
+				uint64_t a = 0, b = 0, c = 0, d = 0;
+				for (size_t i = 0; i + 4 <= words; i += 4) {
+					a += buf[i]; b += buf[i + 1]; c += buf[i + 2]; d += buf[i + 3];
+				}
+				acc += a + b + c + d;
+				moved += (words & ~(size_t)3) * sizeof(uint64_t);
+				break;
+			}
+			case BENCH_WRITE:
+				for (size_t i = 0; i + 4 <= words; i += 4) {
+					buf[i] = acc; buf[i + 1] = acc; buf[i + 2] = acc; buf[i + 3] = acc;
+				}
+				acc++;
+				moved += (words & ~(size_t)3) * sizeof(uint64_t);
+				break;
+			case BENCH_COPY:
+				memcpy(buf + half, buf, half * sizeof(uint64_t));
+				moved += 2 * half * sizeof(uint64_t);
+				break;
+		}
+		t1 = monotonic_ns();
+	} while (t1 - t0 < (uint64_t)ms * 1000000ull);
+	bench_sink += acc + buf[words - 1];
+	return (double)moved / (double)(t1 - t0);
+}
+
+/*
+ * Pinned worker threads for the benchmarks.  Every worker arrives at the
+ * gate once per phase; the first phase releases them together, or tells
+ * them to quit when not every thread could be created.
+ */
+typedef struct {
+	volatile long arrived;
+	volatile long abort;
+	int threads;
+} worker_gate;
+
+static void atomic_inc(volatile long* v) {
+#if defined(_WIN32)
+	InterlockedIncrement(v);
+#else
+	__atomic_add_fetch(v, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static long atomic_read(volatile long* v) {
+#if defined(_WIN32)
+	return *v;		/* volatile reads acquire on x86 / MSVC */
+#else
+	return __atomic_load_n(v, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static void atomic_write(volatile long* v, long value) {
+#if defined(_WIN32)
+	InterlockedExchange(v, value);
+#else
+	__atomic_store_n(v, value, __ATOMIC_RELEASE);
+#endif
+}
+
+static void yield_thread(void) {
+#if defined(_WIN32)
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+/* Wait for every worker to reach phase ++*phase; nonzero means quit */
+static int worker_sync(worker_gate* g, int* phase) {
+	long target = (long)++*phase * g->threads;
+	atomic_inc(&g->arrived);
+	while (atomic_read(&g->arrived) < target) {
+		yield_thread();
+	}
+	return (int)atomic_read(&g->abort);
+}
+
+typedef void (*worker_fn)(void* arg);
+
+typedef struct {
+	worker_fn fn;
+	void* arg;
+} worker_start;
+
+#if defined(_WIN32)
+static DWORD WINAPI worker_main(LPVOID p) {
+	worker_start* w = p;
+	w->fn(w->arg);
+	return 0;
+}
+#else
+static void* worker_main(void* p) {
+	worker_start* w = p;
+	w->fn(w->arg);
+	return NULL;
+}
+#endif
+
+/* Run fn on n threads, argument i at args + i * stride; 214 if one failed to start */
+static int run_workers(worker_fn fn, void* args, size_t stride, int n, worker_gate* g) {
+	worker_start* st = malloc(n * sizeof(*st));
+#if defined(_WIN32)
+	HANDLE* th = calloc(n, sizeof(HANDLE));
+#else
+	pthread_t* th = calloc(n, sizeof(pthread_t));
+#endif
+	int started = 0;
+	if (!st || !th) {
+		free(st); free((void*)th);
+		return 203;
+	}
+	g->arrived = 0;
+	g->abort = 0;
+	g->threads = n;
+	for (; started < n; ++started) {
+		st[started].fn = fn;
+		st[started].arg = (char*)args + (size_t)started * stride;
+#if defined(_WIN32)
+		th[started] = CreateThread(NULL, 0, worker_main, &st[started], 0, NULL);
+		if (!th[started]) break;
+#else
+		if (pthread_create(&th[started], NULL, worker_main, &st[started]) != 0) break;
+#endif
+	}
+	if (started < n) {
+		/* stand in for the missing threads at the start gate */
+		atomic_write(&g->abort, 1);
+		for (int i = started; i < n; ++i) {
+			atomic_inc(&g->arrived);
+		}
+	}
+	for (int i = 0; i < started; ++i) {
+#if defined(_WIN32)
+		WaitForSingleObject(th[i], INFINITE);
+		CloseHandle(th[i]);
+#else
+		pthread_join(th[i], NULL);
+#endif
+	}
+	free(st); free((void*)th);
+	return started < n ? 214 : 0;
+}
+
+typedef struct {
+	int cpu;				/* logical CPU to pin to */
+	size_t bytes;			/* this thread's working set */
+	int ms;
+	worker_gate* gate;
+	double gbps[3];			/* read, write, copy */
+	int rc;					/* 211 pinning failed, 203 no buffer */
+} bench_worker;
+
+/* Pin, touch a local buffer (first touch places it on this node), then stream */
+static void bench_thread(void* arg) {
+	bench_worker* w = arg;
+	int phase = 0;
+	if (worker_sync(w->gate, &phase)) {
+		return;
+	}
+	uint64_t* buf = NULL;
+	if (pin_to_logical(w->cpu) != 0) {
+		w->rc = 211;
+	}
+	else if (!(buf = malloc(w->bytes))) {
+		w->rc = 203;
+	}
+	if (buf) {
+		memset(buf, 1, w->bytes);
+	}
+	for (int k = 0; k < 3; ++k) {
+		worker_sync(w->gate, &phase);
+		w->gbps[k] = buf ? stream_bandwidth(buf, w->bytes, (bench_kind)k, w->ms) : 0.0;
+	}
+	free(buf);
+}
+
+/* One thread per entry of cpus[], each with `per_thread[i]` bytes */
+static int bench_all_cores(const int* cpus, const size_t* per_thread, int n, int ms, double out[3]) {
+	bench_worker* w = calloc((size_t)n, sizeof(*w));
+	worker_gate gate;
+	if (!w) {
+		return 203;
+	}
+	for (int i = 0; i < n; ++i) {
+		w[i].cpu = cpus[i];
+		w[i].bytes = per_thread[i];
+		w[i].ms = ms;
+		w[i].gate = &gate;
+	}
+	int rc = run_workers(bench_thread, w, sizeof(*w), n, &gate);
+	out[0] = out[1] = out[2] = 0.0;
+	for (int i = 0; i < n && rc == 0; ++i) {
+		rc = w[i].rc;
+		for (int k = 0; k < 3; ++k) {
+			out[k] += w[i].gbps[k];
+		}
+	}
+	free(w);
+	return rc;
+}
+
+/* Cache index of `cpu` at `level` (1 = L1d), -1 if unknown */
+static int bench_cache_at(const CPU_DATA* data, int cpu, int level) {
+	const CacheDomainIndex* idx = &data->cache_of[cpu];
+	return level == 1 ? idx->l1d : level == 2 ? idx->l2 : idx->l3;
+}
+
+DLL_EXPORT int run_memory_benchmark(const CPU_DATA* data, int duration_ms, MEM_BENCH* out) {
+	if (!data || !out) {
+		return 201;
+	}
+	if (!data->caches || !data->cache_of || data->logical_core_count <= 0) {
+		return 215;
+	}
+	memset(out, 0, sizeof(*out));
+	int ms = duration_ms > 0 ? duration_ms : BENCH_DEFAULT_MS;
+	out->duration_ms = ms;
+
+	/* one thread per physical core, within what this process may use */
+	int threads = data->physical_core_count;
+	if (data->budget.recommended_parallelism > 0 && data->budget.recommended_parallelism < threads) {
+		threads = data->budget.recommended_parallelism;
+	}
+	int* plan = NULL;
+	if (threads > 0 && data->cores) {
+		plan = malloc(threads * sizeof(int));
+		if (!plan) {
+			return 203;
+		}
+		if (plan_thread_placement(data, threads, CPU_PLACE_PHYSICAL_FIRST, plan) != 0) {
+			free(plan);
+			plan = NULL;
+		}
+	}
+	size_t* per_thread = plan ? malloc(threads * sizeof(size_t)) : NULL;
+	if (plan && !per_thread) {
+		free(plan);
+		return 203;
+	}
+	out->threads_used = per_thread ? threads : 0;
+
+	/* working sets */
+	size_t ws[CPU_BENCH_LEVELS];
+	size_t below = 0, outer_total = 0;
+	int outer = 0;
+	for (int level = 1; level <= 3; ++level) {
+		int c = bench_cache_at(data, 0, level);
+		ws[level - 1] = 0;
+		if (c < 0 || data->caches[c].size_kb <= 0) {
+			continue;
+		}
+		size_t size = (size_t)data->caches[c].size_kb * 1024;
+		size_t half = size / 2;
+		if (half < 2 * below) {
+			half = 2 * below;
+		}
+		if (half < size) {
+			ws[level - 1] = half;
+			below = size;
+			outer = level;
+		}
+	}
+	for (int i = 0; i < data->cache_count; ++i) {
+		if (data->caches[i].level == outer && data->caches[i].type != CACHE_TYPE_INSTRUCTION) {
+			outer_total += (size_t)data->caches[i].size_kb * 1024;
+		}
+	}
+	ws[CPU_BENCH_DRAM] = 4 * outer_total;
+	if (ws[CPU_BENCH_DRAM] < BENCH_DRAM_MIN) ws[CPU_BENCH_DRAM] = BENCH_DRAM_MIN;
+	if (ws[CPU_BENCH_DRAM] > BENCH_DRAM_MAX) ws[CPU_BENCH_DRAM] = BENCH_DRAM_MAX;
+
+	int c0 = bench_cache_at(data, 0, 1);
+	size_t line = (c0 >= 0 && data->caches[c0].line_size > 0) ? (size_t)data->caches[c0].line_size : 64;
+	char* buf = malloc(ws[CPU_BENCH_DRAM]);
+	if (!buf) {
+		free(plan); free(per_thread);
+		return 203;
+	}
+
+	affinity_save saved;
+	save_affinity(&saved);
+	if (plan) {
+		pin_to_logical(plan[0]);
+	}
+	int rc = 0;
+	for (int level = 0; level < CPU_BENCH_LEVELS && rc == 0; ++level) {
+		MemBenchLevelResult* r = &out->level[level];
+		size_t bytes = ws[level];
+		if (!bytes) {
+			continue;
+		}
+		r->working_set_bytes = bytes;
+		memset(buf, 1, bytes);
+		r->latency_ns = chase_latency(buf, bytes, line, ms);
+		r->read_gbps = stream_bandwidth((uint64_t*)buf, bytes, BENCH_READ, ms);
+		r->write_gbps = stream_bandwidth((uint64_t*)buf, bytes, BENCH_WRITE, ms);
+		r->copy_gbps = stream_bandwidth((uint64_t*)buf, bytes, BENCH_COPY, ms);
+		if (!per_thread) {
+			continue;
+		}
+
+		/* split shared caches (and DRAM) between the threads placed on them */
+		for (int t = 0; t < threads; ++t) {
+			int sharers = 0;
+			int mine = level < CPU_BENCH_DRAM ? bench_cache_at(data, plan[t], level + 1) : -1;
+			for (int u = 0; u < threads; ++u) {
+				sharers += level == CPU_BENCH_DRAM || (mine >= 0 && bench_cache_at(data, plan[u], level + 1) == mine);
+			}
+			per_thread[t] = bytes / (sharers > 0 ? sharers : 1);
+			per_thread[t] -= per_thread[t] % (4 * sizeof(uint64_t));
+			if (per_thread[t] < 4 * sizeof(uint64_t)) {
+				per_thread[t] = 4 * sizeof(uint64_t);
+			}
+		}
+		double all[3] = { 0 };
+		rc = bench_all_cores(plan, per_thread, threads, ms, all);
+		r->read_gbps_all = all[0];
+		r->write_gbps_all = all[1];
+		r->copy_gbps_all = all[2];
+	}
+	restore_affinity(&saved);
+
+	free(buf); free(plan); free(per_thread);
+	return rc;
+}
+
+/*
+ * Core‐to‐core latency.  Two threads pinned to CPUs a and b bounce one
+ * cache line: a writes 2i+1 and waits for b's 2i+2.  Half the round trip
+ * is the one‐way latency.  Pairs are scheduled round robin (circle
+ * method), so each of the n-1 rounds measures n/2 disjoint pairs at once
+ * and every pair exactly once.
+ */
+#define LATENCY_ROUND_TRIPS	2000
+#define LATENCY_WARMUP		100
+
+/* One cache line per pair; 128 bytes so adjacent‐line prefetch cannot couple pairs */
+typedef struct {
+	volatile long flag;
+	char pad[128 - sizeof(long)];
+} pingpong_line;
+
+typedef struct {
+	int L;					/* logical CPUs, row length of latency */
+	int* cpus;				/* n participants, -1 for the bye when odd */
+	int n;
+	signed char* pinned;	/* per participant */
+	pingpong_line* lines;	/* n / 2 */
+	int round_trips;
+	double* latency;		/* L x L */
+	worker_gate gate;
+} latency_run;
 
-	char* ptr = (char*)buffer;
-	DWORD offset = 0;
-	while (offset < len) {
-		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
+typedef struct {
+	latency_run* run;
+	int me;					/* participant index */
+} latency_worker;
 
-		if (info->Relationship == RelationCache) {
-			CACHE_RELATIONSHIP* c = &info->Cache;
-			int level = c->Level;
-			int sizeKB = (int)(c->CacheSize / 1024);
-			KAFFINITY mask = c->GroupMask.Mask;
-
-			/* count how many share */
-			int shared = 0;
-			for (int b = 0; b < 64; ++b) {
-				if (mask & (1ULL << b)) {
-					shared++;
-				}
-			}
+/* Participant at position k of round r; position 0 stays, the rest rotate */
+static int round_robin_at(int n, int r, int k) {
+	return k == 0 ? 0 : 1 + (k - 1 + r) % (n - 1);
+}
 
-			for (int b = 0; b < 64; ++b) {
-				if (!(mask & (1ULL << b))) {
-					continue;
-				}
-				if (level == 1) {
-					data->l1size[b] = sizeKB;
-				}
-				else if (level == 2) {
-					data->l2size[b].l2cache_size = sizeKB;
-					data->l2size[b].shared_with_core_number = shared;
+/* Spin on the shared line; yield only if the partner was descheduled */
+static void spin_until(volatile long* flag, long value) {
+	unsigned int spins = 0;
+	while (atomic_read(flag) != value) {
+		if (++spins == (1u << 20)) {
+			yield_thread();
+			spins = 0;
+		}
+	}
+}
+
+static void latency_thread(void* arg) {
+	latency_worker* w = arg;
+	latency_run* run = w->run;
+	int phase = 0;
+	if (worker_sync(&run->gate, &phase)) {
+		return;
+	}
+	run->pinned[w->me] = run->cpus[w->me] >= 0 && pin_to_logical(run->cpus[w->me]) == 0;
+	worker_sync(&run->gate, &phase);
+
+	for (int r = 0; r < run->n - 1; ++r) {
+		int k = 0, a = 0, b = 0;
+		for (; k < run->n / 2; ++k) {
+			a = round_robin_at(run->n, r, k);
+			b = round_robin_at(run->n, r, run->n - 1 - k);
+			if (a == w->me || b == w->me) {
+				break;
+			}
+		}
+		if (run->pinned[a] && run->pinned[b]) {
+			volatile long* flag = &run->lines[k].flag;
+			int total = LATENCY_WARMUP + run->round_trips;
+			uint64_t t0 = 0;
+			for (int i = 0; i < total; ++i) {
+				if (i == LATENCY_WARMUP) {
+					t0 = monotonic_ns();
 				}
-				else if (level == 3) {
-					data->l3size = sizeKB;
+				if (a == w->me) {
+					atomic_write(flag, 2L * i + 1);
+					spin_until(flag, 2L * i + 2);
+				} else {
+					spin_until(flag, 2L * i + 1);
+					atomic_write(flag, 2L * i + 2);
 				}
 			}
+			if (a == w->me) {
+				double ns = (double)(monotonic_ns() - t0) / (2.0 * run->round_trips);
+				int ca = run->cpus[a], cb = run->cpus[b];
+				run->latency[ca * run->L + cb] = run->latency[cb * run->L + ca] = ns;
+			}
 		}
+		worker_sync(&run->gate, &phase);
+	}
+}
 
-		offset += info->Size;
-		ptr += info->Size;
+/* Single‐linkage groups of CPUs whose latency is at most threshold_ns */
+static int link_latency_groups(const CORE_LATENCY* m, double threshold_ns, int* group_of) {
+	int L = m->cpu_count;
+	int* parent = malloc(L * sizeof(int));
+	if (!parent) {
+		return -1;
+	}
+	for (int i = 0; i < L; ++i) {
+		parent[i] = i;
+	}
+	for (int i = 0; i < L; ++i) {
+		for (int j = i + 1; j < L; ++j) {
+			double v = m->latency_ns[i * L + j];
+			if (v < 0.0 || v > threshold_ns) {
+				continue;
+			}
+			int ri = i, rj = j;
+			while (parent[ri] != ri) ri = parent[ri];
+			while (parent[rj] != rj) rj = parent[rj];
+			parent[ri > rj ? ri : rj] = ri < rj ? ri : rj;
+		}
+	}
+	/* number groups in order of their lowest CPU */
+	int groups = 0;
+	for (int i = 0; i < L; ++i) {
+		int r = i;
+		while (parent[r] != r) r = parent[r];
+		group_of[i] = (r == i) ? groups++ : group_of[r];
 	}
+	free(parent);
+	return groups;
+}
 
-	free(buffer);
+static int compare_doubles(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
 }
-#else
+
 /*
- * Linux: freq from scaling_cur_freq, caches via sysfs cache/index*
+ * Automatic cut: the largest relative jump between consecutive measured
+ * latencies, e.g. same CCX -> cross CCD or same socket -> cross socket.
+ * Jumps under 1.5x are noise; with none, every CPU stays in one group.
  */
-static void parse_shared_cpu_list(const char* str, int* out, int* out_count) {
-	char* dup = strdup(str), * p = dup, * tok;
-	int idx = 0;
-	while ((tok = strsep(&p, ",")) != NULL) {
-		int a, b;
-		if (sscanf(tok, "%d-%d", &a, &b) == 2) {
-			for (int i = a; i <= b; ++i) {
-				out[idx++] = i;
+static double latency_cut(const CORE_LATENCY* m) {
+	int L = m->cpu_count, n = 0;
+	double* v = malloc((size_t)L * L * sizeof(double));
+	if (!v) {
+		return 0.0;
+	}
+	for (int i = 0; i < L; ++i) {
+		for (int j = i + 1; j < L; ++j) {
+			if (m->latency_ns[i * L + j] > 0.0) {
+				v[n++] = m->latency_ns[i * L + j];
 			}
 		}
-		else if (sscanf(tok, "%d", &a) == 1) {
-			out[idx++] = a;
+	}
+	qsort(v, n, sizeof(double), compare_doubles);
+	double cut = n ? v[n - 1] : 0.0, best = 1.5;
+	for (int i = 0; i + 1 < n; ++i) {
+		if (v[i + 1] > best * v[i]) {
+			best = v[i + 1] / v[i];
+			cut = v[i];
 		}
 	}
-	*out_count = idx;
-	free(dup);
+	free(v);
+	return cut;
 }
 
-static void populate_caches_and_freq(CPU_DATA* data) {
-	int L = data->logical_core_count;
-	for (int i = 0; i < L; ++i) {
-		data->l1size[i] = 0;
-		data->l2size[i].l2cache_size = 0;
-		data->l2size[i].shared_with_core_number = 0;
-		data->frequency[i] = 0;
+DLL_EXPORT int cluster_core_latency(CORE_LATENCY* m, double threshold_ns) {
+	if (!m || !m->latency_ns || !m->group_of) {
+		return 201;
 	}
-	data->l3size = 0;
+	m->threshold_ns = threshold_ns > 0.0 ? threshold_ns : latency_cut(m);
+	int groups = link_latency_groups(m, m->threshold_ns, m->group_of);
+	if (groups < 0) {
+		return 203;
+	}
+	m->group_count = groups;
+	return 0;
+}
 
-	/* frequency from /sys */
-	for (int cpu = 0; cpu < L; ++cpu) {
-		char path[128], buf[32];
-		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
-		FILE* f = fopen(path, "r");
-		if (f) {
-			if (fgets(buf, sizeof(buf), f)) {
-				/* file is in kHz */
-				data->frequency[cpu] = atoi(buf) / 1000;
+DLL_EXPORT void free_core_latency(CORE_LATENCY* m) {
+	if (m) {
+		free(m->latency_ns);
+		free(m->group_of);
+		memset(m, 0, sizeof(*m));
+	}
+}
+
+DLL_EXPORT int measure_core_latency(const CPU_DATA* data, int round_trips, CORE_LATENCY* out) {
+	if (!data || !out) {
+		return 201;
+	}
+	if (!data->cores || data->physical_core_count <= 0) {
+		return 210;
+	}
+	memset(out, 0, sizeof(*out));
+	int L = data->logical_core_count;
+	latency_run run;
+	memset(&run, 0, sizeof(run));
+	run.L = L;
+	run.round_trips = round_trips > 0 ? round_trips : LATENCY_ROUND_TRIPS;
+
+	/* participants: every logical CPU of cores[], plus a bye when odd */
+	run.cpus = malloc((L + 1) * sizeof(int));
+	out->latency_ns = malloc((size_t)L * L * sizeof(double));
+	out->group_of = malloc(L * sizeof(int));
+	if (!run.cpus || !out->latency_ns || !out->group_of) {
+		free(run.cpus);
+		free_core_latency(out);
+		return 203;
+	}
+	out->cpu_count = L;
+	for (int i = 0; i < L * L; ++i) {
+		out->latency_ns[i] = (i % (L + 1) == 0) ? 0.0 : -1.0;
+	}
+	for (int i = 0; i < data->physical_core_count; ++i) {
+		const PhysicalCoreInfo* pc = &data->cores[i];
+		for (int j = 0; j < pc->logical_count; ++j) {
+			if (pc->logical_ids[j] >= 0 && pc->logical_ids[j] < L) {
+				run.cpus[run.n++] = pc->logical_ids[j];
 			}
-			fclose(f);
 		}
 	}
+	if (run.n % 2) {
+		run.cpus[run.n++] = -1;
+	}
 
-	/* caches from cpu0 index */
-	for (int idx = 0; idx < L; ++idx) {
-		char dir[128], levelp[160], sizep[160], sharep[160], buf[64];
-		snprintf(dir, sizeof(dir), "/sys/devices/system/cpu/cpu0/cache/index%d", idx);
-		struct stat st;
-		if (stat(dir, &st) != 0) {
-			break;
+	int rc = 0;
+	if (run.n >= 2) {
+		latency_worker* w = malloc(run.n * sizeof(*w));
+		run.pinned = calloc(run.n, 1);
+		void* raw = malloc((run.n / 2 + 1) * sizeof(pingpong_line));
+		if (!w || !run.pinned || !raw) {
+			rc = 203;
+		} else {
+			run.lines = (pingpong_line*)(((uintptr_t)raw + sizeof(pingpong_line) - 1)
+				& ~(uintptr_t)(sizeof(pingpong_line) - 1));
+			memset(run.lines, 0, (run.n / 2) * sizeof(pingpong_line));
+			run.latency = out->latency_ns;
+			for (int i = 0; i < run.n; ++i) {
+				w[i].run = &run;
+				w[i].me = i;
+			}
+			rc = run_workers(latency_thread, w, sizeof(*w), run.n, &run.gate);
 		}
+		free(w); free(run.pinned); free(raw);
+	}
+	free(run.cpus);
+	if (rc == 0) {
+		rc = cluster_core_latency(out, 0.0);
+	}
+	if (rc != 0) {
+		free_core_latency(out);
+	}
+	return rc;
+}
 
-		snprintf(levelp, sizeof(levelp), "%s/level", dir);
-		snprintf(sizep, sizeof(sizep), "%s/size", dir);
-		snprintf(sharep, sizeof(sharep), "%s/shared_cpu_list", dir);
+/*
+ * Work‐stealing pool.  Every worker owns a Chase‐Lev deque (in the
+ * weak‐memory form of Lê et al., PPoPP 2013): the owner pushes and pops at
+ * the bottom without locking, thieves take the top with one CAS.  Tasks
+ * submitted from outside the pool and every CPU_TASK_LATENCY task go
+ * through two locked FIFOs instead, so latency work never sits in a deque
+ * where an E‐core thief could take it first.  Idle workers spin briefly,
+ * then sleep until a submit sees them.
+ */
+#define POOL_DEQUE_SIZE	4096	/* tasks per worker deque, a power of two */
+#define POOL_SPINS		64		/* empty searches before a worker sleeps */
+#define POOL_TIERS		4		/* same L2, same L3, same node, remote */
 
-		FILE* f = fopen(levelp, "r");
-		int level = 0;
-		if (f) {
-			fgets(buf, sizeof(buf), f);
-			level = atoi(buf);
-			fclose(f);
-		}
+typedef struct {
+	CpuTaskFn fn;
+	void* arg;
+} pool_task;
 
-		f = fopen(sizep, "r");
-		int sizeKB = 0;
-		if (f) {
-			fgets(buf, sizeof(buf), f);
-			sizeKB = atoi(buf);
-			if (strchr(buf, 'M') || strchr(buf, 'm')) {
-				sizeKB *= 1024;
-			}
-			fclose(f);
-		}
+typedef struct {
+	volatile int64_t top;		/* next task to steal */
+	char pad0[128 - sizeof(int64_t)];
+	volatile int64_t bottom;	/* next free slot, owner only */
+	char pad1[128 - sizeof(int64_t)];
+	pool_task slots[POOL_DEQUE_SIZE];
+} pool_deque;
 
-		f = fopen(sharep, "r");
-		char listbuf[64] = { 0 };
-		if (f) {
-			fgets(listbuf, sizeof(listbuf), f);
-			fclose(f);
+typedef struct {
+	pool_task* items;
+	int capacity;
+	int head;
+	int count;
+} pool_fifo;
+
+typedef struct {
+	CPU_POOL* pool;
+	pool_deque* deque;
+	int index;
+	int cpu;					/* logical CPU the worker is pinned to */
+	int latency;				/* takes CPU_TASK_LATENCY tasks first */
+	int* victims;				/* other workers, nearest first */
+	int tier_end[POOL_TIERS];	/* victims[tier_end[k - 1] .. tier_end[k]) at distance k */
+	uint32_t rng;
+	worker_start start;
+} pool_worker;
+
+struct CPU_POOL {
+	int threads;
+	int started;
+	pool_worker* workers;
+	int* victims;				/* threads * threads block behind workers[].victims */
+	pool_fifo fifo[2];			/* 0 = normal, 1 = latency */
+	volatile long fifo_count[2];
+	char pad0[128];				/* queued / outstanding change on every submit and finish: */
+	volatile long queued;		/* tasks in deques and FIFOs */
+	volatile long outstanding;	/* submitted and not yet finished */
+	char pad1[128];				/* keep them off workers (read by thieves) and sleepers / stop */
+	volatile long sleepers;
+	volatile long waiters;
+	volatile long stop;
+#if defined(_WIN32)
+	SRWLOCK lock;
+	CONDITION_VARIABLE work;
+	CONDITION_VARIABLE done;
+	HANDLE* handles;
+#else
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_t* handles;
+#endif
+};
+
+static PROBE_TLS pool_worker* pool_self;
+
+/* Sequentially consistent add; returns the new value */
+static long atomic_add(volatile long* v, long delta) {
+#if defined(_WIN32)
+	return InterlockedExchangeAdd(v, delta) + delta;
+#else
+	return __atomic_add_fetch(v, delta, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static int64_t atomic_load64(volatile int64_t* v) {
+#if defined(_WIN32)
+	/* a plain volatile read is neither atomic on x86 nor ordered on ARM64 */
+	return InterlockedCompareExchange64((volatile LONG64*)v, 0, 0);
+#else
+	return __atomic_load_n(v, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static void atomic_store64(volatile int64_t* v, int64_t value) {
+#if defined(_WIN32)
+	InterlockedExchange64((volatile LONG64*)v, value);
+#else
+	__atomic_store_n(v, value, __ATOMIC_RELEASE);
+#endif
+}
+
+static int atomic_cas64(volatile int64_t* v, int64_t expected, int64_t value) {
+#if defined(_WIN32)
+	return InterlockedCompareExchange64((volatile LONG64*)v, value, expected) == expected;
+#else
+	return __atomic_compare_exchange_n(v, &expected, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+#endif
+}
+
+static void atomic_fence(void) {
+#if defined(_WIN32)
+	MemoryBarrier();
+#else
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+/*
+ * A thief may read a slot while the owner refills it; its CAS on top then
+ * fails and the value is dropped, but the accesses must still be atomic.
+ * Relaxed is enough: top and bottom order them.
+ */
+static void slot_store(pool_task* slot, pool_task t) {
+#if defined(_WIN32)
+	/* aligned pointer‐sized volatile accesses are atomic on every Windows target */
+	*(CpuTaskFn volatile*)&slot->fn = t.fn;
+	*(void* volatile*)&slot->arg = t.arg;
+#else
+	__atomic_store_n(&slot->fn, t.fn, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->arg, t.arg, __ATOMIC_RELAXED);
+#endif
+}
+
+static pool_task slot_load(pool_task* slot) {
+	pool_task t;
+#if defined(_WIN32)
+	t.fn = *(CpuTaskFn volatile*)&slot->fn;
+	t.arg = *(void* volatile*)&slot->arg;
+#else
+	t.fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+	t.arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+#endif
+	return t;
+}
+
+/* Owner only; 0 when the deque is full */
+static int deque_push(pool_deque* q, pool_task t) {
+	int64_t b = q->bottom;
+	int64_t top = atomic_load64(&q->top);
+	if (b - top >= POOL_DEQUE_SIZE) {
+		return 0;
+	}
+	slot_store(&q->slots[b & (POOL_DEQUE_SIZE - 1)], t);
+	atomic_store64(&q->bottom, b + 1);
+	return 1;
+}
+
+/* Owner only, newest first */
+static int deque_pop(pool_deque* q, pool_task* out) {
+	int64_t b = q->bottom - 1;
+	atomic_store64(&q->bottom, b);
+	atomic_fence();
+	int64_t top = atomic_load64(&q->top);
+	if (top > b) {
+		atomic_store64(&q->bottom, b + 1);
+		return 0;
+	}
+	*out = slot_load(&q->slots[b & (POOL_DEQUE_SIZE - 1)]);
+	if (top == b) {
+		/* last task: race the thieves for it */
+		int won = atomic_cas64(&q->top, top, top + 1);
+		atomic_store64(&q->bottom, b + 1);
+		return won;
+	}
+	return 1;
+}
+
+/* Any thread, oldest first; 0 when empty or another thief won */
+static int deque_steal(pool_deque* q, pool_task* out) {
+	int64_t top = atomic_load64(&q->top);
+	atomic_fence();
+	int64_t b = atomic_load64(&q->bottom);
+	if (top >= b) {
+		return 0;
+	}
+	/* a slot the owner reuses is only overwritten after top moved on, so the CAS fails */
+	pool_task t = slot_load(&q->slots[top & (POOL_DEQUE_SIZE - 1)]);
+	if (!atomic_cas64(&q->top, top, top + 1)) {
+		return 0;
+	}
+	*out = t;
+	return 1;
+}
+
+static void pool_lock(CPU_POOL* p) {
+#if defined(_WIN32)
+	AcquireSRWLockExclusive(&p->lock);
+#else
+	pthread_mutex_lock(&p->lock);
+#endif
+}
+
+static void pool_unlock(CPU_POOL* p) {
+#if defined(_WIN32)
+	ReleaseSRWLockExclusive(&p->lock);
+#else
+	pthread_mutex_unlock(&p->lock);
+#endif
+}
+
+/* Caller holds the lock */
+static int fifo_push(pool_fifo* f, pool_task t) {
+	if (f->count == f->capacity) {
+		int capacity = f->capacity ? f->capacity * 2 : 256;
+		pool_task* items = malloc((size_t)capacity * sizeof(pool_task));
+		if (!items) {
+			return 203;
 		}
+		for (int i = 0; i < f->count; ++i) {
+			items[i] = f->items[(f->head + i) % f->capacity];
+		}
+		free(f->items);
+		f->items = items;
+		f->capacity = capacity;
+		f->head = 0;
+	}
+	f->items[(f->head + f->count) % f->capacity] = t;
+	f->count++;
+	return 0;
+}
+
+static int pool_fifo_pop(CPU_POOL* p, int which, pool_task* out) {
+	if (atomic_read(&p->fifo_count[which]) <= 0) {
+		return 0;
+	}
+	int got = 0;
+	pool_lock(p);
+	pool_fifo* f = &p->fifo[which];
+	if (f->count > 0) {
+		*out = f->items[f->head];
+		f->head = (f->head + 1) % f->capacity;
+		f->count--;
+		atomic_add(&p->fifo_count[which], -1);
+		got = 1;
+	}
+	pool_unlock(p);
+	return got;
+}
 
-		int cpus[256], cpuc = 0;
-		parse_shared_cpu_list(listbuf, cpus, &cpuc);
+static uint32_t pool_rand(pool_worker* w) {
+	uint32_t x = w->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return w->rng = x;
+}
 
-		/* assign */
-		for (int i = 0; i < cpuc; ++i) {
-			int c = cpus[i];
-			if (level == 1) {
-				data->l1size[c] = sizeKB;
-			}
-			else if (level == 2) {
-				data->l2size[c].l2cache_size = sizeKB;
-				data->l2size[c].shared_with_core_number = cpuc;
-			}
-			else if (level == 3) {
-				data->l3size = sizeKB;
+/* Nearest tier first; a random start within each spreads the thieves */
+static int pool_steal(pool_worker* w, pool_task* out) {
+	int from = 0;
+	for (int tier = 0; tier < POOL_TIERS; ++tier) {
+		int n = w->tier_end[tier] - from;
+		if (n > 0) {
+			int start = (int)(pool_rand(w) % (uint32_t)n);
+			for (int k = 0; k < n; ++k) {
+				int victim = w->victims[from + (start + k) % n];
+				if (deque_steal(w->pool->workers[victim].deque, out)) {
+					return 1;
+				}
 			}
 		}
+		from = w->tier_end[tier];
 	}
+	return 0;
+}
+
+static int pool_find(pool_worker* w, pool_task* out) {
+	CPU_POOL* p = w->pool;
+	return (w->latency && pool_fifo_pop(p, 1, out))
+		|| deque_pop(w->deque, out)
+		|| pool_fifo_pop(p, 0, out)
+		|| pool_steal(w, out)
+		|| (!w->latency && pool_fifo_pop(p, 1, out));
 }
+
+static void pool_run(CPU_POOL* p, pool_task t) {
+	t.fn(t.arg);
+	if (atomic_add(&p->outstanding, -1) == 0 && atomic_add(&p->waiters, 0) > 0) {
+		pool_lock(p);
+#if defined(_WIN32)
+		WakeAllConditionVariable(&p->done);
+#else
+		pthread_cond_broadcast(&p->done);
 #endif
+		pool_unlock(p);
+	}
+}
 
-/* Top‐level entry: fills CPU_DATA fields */
+/*
+ * Sleep until work is queued.  sleepers is raised before queued is read
+ * and a submit raises queued before reading sleepers, so one of the two
+ * always sees the other.
+ */
+static void pool_sleep(CPU_POOL* p) {
+	pool_lock(p);
+	atomic_add(&p->sleepers, 1);
+	while (atomic_add(&p->queued, 0) <= 0 && !atomic_read(&p->stop)) {
 #if defined(_WIN32)
-__declspec(dllexport)
+		SleepConditionVariableSRW(&p->work, &p->lock, INFINITE, 0);
+#else
+		pthread_cond_wait(&p->work, &p->lock);
 #endif
-int get_cpu_data(CPU_DATA* data) {
-	if (!data) {
-		return 201;
 	}
+	atomic_add(&p->sleepers, -1);
+	pool_unlock(p);
+}
 
-	/* brand string */
-	int rc = get_cpu_brand(&data->cpu_name);
-	if (rc != 200) {
-		return rc;
+static void pool_worker_main(void* arg) {
+	pool_worker* w = arg;
+	CPU_POOL* p = w->pool;
+	pin_current_thread(w->cpu);		/* best effort: an affinity the budget forbids runs unpinned */
+	pool_self = w;
+	int idle = 0;
+	while (!atomic_read(&p->stop)) {
+		pool_task t;
+		if (pool_find(w, &t)) {
+			atomic_add(&p->queued, -1);
+			pool_run(p, t);
+			idle = 0;
+		} else if (++idle < POOL_SPINS) {
+			yield_thread();
+		} else {
+			pool_sleep(p);
+			idle = 0;
+		}
 	}
+	pool_self = NULL;
+}
+
+/* 0 same L2, 1 same L3, 2 same NUMA node (package without NUMA), 3 remote */
+static int pool_distance(const CpuLocation* a, const CpuLocation* b) {
+	if (a->cpu == b->cpu || (a->l2 >= 0 && a->l2 == b->l2)) {
+		return 0;
+	}
+	if (a->l3 >= 0 && a->l3 == b->l3) {
+		return 1;
+	}
+	if (a->numa_node >= 0 ? a->numa_node == b->numa_node : a->package == b->package) {
+		return 2;
+	}
+	return 3;
+}
 
-	/* logical cores */
+DLL_EXPORT void cpu_pool_wait(CPU_POOL* p);
+
+/* Run every task still queued, then stop and join the workers */
+DLL_EXPORT void cpu_pool_destroy(CPU_POOL* p) {
+	if (!p) {
+		return;
+	}
+	if (p->started == p->threads) {
+		cpu_pool_wait(p);
+	}
+	pool_lock(p);
+	atomic_write(&p->stop, 1);
+#if defined(_WIN32)
+	WakeAllConditionVariable(&p->work);
+#else
+	pthread_cond_broadcast(&p->work);
+#endif
+	pool_unlock(p);
+	for (int i = 0; i < p->started; ++i) {
 #if defined(_WIN32)
-	data->logical_core_count = (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+		WaitForSingleObject(p->handles[i], INFINITE);
+		CloseHandle(p->handles[i]);
 #else
-	data->logical_core_count = get_nprocs();
+		pthread_join(p->handles[i], NULL);
 #endif
+	}
+	for (int i = 0; p->workers && i < p->threads; ++i) {
+		free(p->workers[i].deque);
+	}
+#if !defined(_WIN32)
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->work);
+	pthread_cond_destroy(&p->done);
+#endif
+	free(p->fifo[0].items);
+	free(p->fifo[1].items);
+	free(p->workers);
+	free(p->victims);
+	free((void*)p->handles);
+	free(p);
+}
 
-	/* allocate arrays */
-	data->l1size = calloc(data->logical_core_count, sizeof(int));
-	data->l2size = calloc(data->logical_core_count, sizeof(l2cache));
-	data->frequency = calloc(data->logical_core_count, sizeof(int));
-	data->l3size = 0;
-	if (!data->l1size || !data->l2size || !data->frequency) {
-		return 203;
+/*
+ * One pinned worker per entry of plan_thread_placement(data, threads,
+ * policy); threads <= 0 uses budget.recommended_parallelism (all logical
+ * CPUs without CPU_FIELD_BUDGET).  Needs CPU_FIELD_TOPOLOGY; CACHES and
+ * NUMA refine the steal order.  data is not referenced afterwards.
+ */
+DLL_EXPORT int cpu_pool_create(const CPU_DATA* data, int threads, PlacementPolicy policy, CPU_POOL** out) {
+	if (!data || !out) {
+		return 201;
+	}
+	*out = NULL;
+	if (!data->cores || !data->cpu_location || data->physical_core_count <= 0) {
+		return 210;
+	}
+	if (threads <= 0) {
+		threads = data->budget.recommended_parallelism > 0
+			? data->budget.recommended_parallelism : data->logical_core_count;
 	}
 
-	/* fill caches & frequency */
-	populate_caches_and_freq(data);
+	CPU_POOL* p = calloc(1, sizeof(*p));
+	int* cpus = malloc((size_t)threads * sizeof(int));
+	if (!p || !cpus) {
+		free(p); free(cpus);
+		return 203;
+	}
+	p->threads = threads;
+#if defined(_WIN32)
+	InitializeSRWLock(&p->lock);
+	InitializeConditionVariable(&p->work);
+	InitializeConditionVariable(&p->done);
+#else
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+#endif
+	int rc = plan_thread_placement(data, threads, policy, cpus);
+	if (rc != 0) {
+		free(cpus);
+		cpu_pool_destroy(p);
+		return rc;
+	}
+	p->workers = calloc(threads, sizeof(pool_worker));
+	p->victims = malloc((size_t)threads * threads * sizeof(int));
+	p->handles = calloc(threads, sizeof(*p->handles));
+	if (!p->workers || !p->victims || !p->handles) {
+		free(cpus);
+		cpu_pool_destroy(p);
+		return 203;
+	}
 
-	/* instruction‐set flags */
-	get_supported_algorithms(&data->algorithms);
+	/* P‐cores take latency tasks first; with none in the pool, every worker does */
+	int latency_workers = 0;
+	for (int i = 0; i < threads; ++i) {
+		pool_worker* w = &p->workers[i];
+		const CpuLocation* loc = &data->cpu_location[cpus[i]];
+		w->pool = p;
+		w->index = i;
+		w->cpu = cpus[i];
+		w->rng = 0x9E3779B9u * (uint32_t)(i + 1);
+		w->latency = loc->core >= 0 && data->cores[loc->core].type == CORE_TYPE_PERFORMANCE;
+		latency_workers += w->latency;
+		w->deque = calloc(1, sizeof(pool_deque));
+		if (!w->deque) {
+			free(cpus);
+			cpu_pool_destroy(p);
+			return 203;
+		}
+		/* counting sort of the other workers by distance, index order within a tier */
+		w->victims = p->victims + (size_t)i * threads;
+		int count[POOL_TIERS] = { 0 };
+		for (int j = 0; j < threads; ++j) {
+			if (j != i) count[pool_distance(loc, &data->cpu_location[cpus[j]])]++;
+		}
+		int fill[POOL_TIERS];
+		for (int k = 0, end = 0; k < POOL_TIERS; ++k) {
+			fill[k] = end;
+			end += count[k];
+			w->tier_end[k] = end;
+		}
+		for (int j = 0; j < threads; ++j) {
+			if (j != i) w->victims[fill[pool_distance(loc, &data->cpu_location[cpus[j]])]++] = j;
+		}
+	}
+	for (int i = 0; latency_workers == 0 && i < threads; ++i) {
+		p->workers[i].latency = 1;
+	}
+	free(cpus);
 
-	/* physical‐core topology */
-	rc = get_core_topology(data);
-	if (rc != 200) {
-		return rc;
+	for (; p->started < threads; ++p->started) {
+		pool_worker* w = &p->workers[p->started];
+		w->start.fn = pool_worker_main;
+		w->start.arg = w;
+#if defined(_WIN32)
+		p->handles[p->started] = CreateThread(NULL, 0, worker_main, &w->start, 0, NULL);
+		if (!p->handles[p->started]) break;
+#else
+		if (pthread_create(&p->handles[p->started], NULL, worker_main, &w->start) != 0) break;
+#endif
+	}
+	if (p->started < threads) {
+		cpu_pool_destroy(p);
+		return 214;
 	}
+	*out = p;
+	return 0;
+}
 
+/*
+ * Queue fn(arg).  From a worker of this pool the task goes on that
+ * worker's own deque (nearby idle workers steal it); from other threads,
+ * and for CPU_TASK_LATENCY, on the shared FIFOs.
+ */
+DLL_EXPORT int cpu_pool_submit(CPU_POOL* p, CpuTaskFn fn, void* arg, unsigned int flags) {
+	if (!p || !fn) {
+		return 201;
+	}
+	pool_task t = { fn, arg };
+	pool_worker* self = pool_self;
+	atomic_add(&p->outstanding, 1);
+	if (!(self && self->pool == p && !(flags & CPU_TASK_LATENCY) && deque_push(self->deque, t))) {
+		int which = (flags & CPU_TASK_LATENCY) ? 1 : 0;
+		pool_lock(p);
+		int rc = fifo_push(&p->fifo[which], t);
+		if (rc == 0) {
+			atomic_add(&p->fifo_count[which], 1);
+		}
+		pool_unlock(p);
+		if (rc != 0) {
+			atomic_add(&p->outstanding, -1);
+			return rc;
+		}
+	}
+	atomic_add(&p->queued, 1);
+	if (atomic_add(&p->sleepers, 0) > 0) {
+		pool_lock(p);
+#if defined(_WIN32)
+		WakeConditionVariable(&p->work);
+#else
+		pthread_cond_signal(&p->work);
+#endif
+		pool_unlock(p);
+	}
 	return 0;
 }
+
+/* Block until every submitted task has finished; not from inside a task */
+DLL_EXPORT void cpu_pool_wait(CPU_POOL* p) {
+	if (!p) {
+		return;
+	}
+	for (int spin = 0; spin < POOL_SPINS; ++spin) {
+		if (atomic_add(&p->outstanding, 0) <= 0) {
+			return;
+		}
+		yield_thread();
+	}
+	pool_lock(p);
+	atomic_add(&p->waiters, 1);
+	while (atomic_add(&p->outstanding, 0) > 0) {
+#if defined(_WIN32)
+		SleepConditionVariableSRW(&p->done, &p->lock, INFINITE, 0);
+#else
+		pthread_cond_wait(&p->done, &p->lock);
+#endif
+	}
+	atomic_add(&p->waiters, -1);
+	pool_unlock(p);
+}
+
+DLL_EXPORT int cpu_pool_size(const CPU_POOL* p) {
+	return p ? p->threads : 0;
+}
+
+/* Logical CPU worker `worker` is pinned to, -1 if out of range */
+DLL_EXPORT int cpu_pool_worker_cpu(const CPU_POOL* p, int worker) {
+	return (p && worker >= 0 && worker < p->threads) ? p->workers[worker].cpu : -1;
+}
+
+/* Index of the calling worker in p, -1 on any other thread */
+DLL_EXPORT int cpu_pool_current_worker(const CPU_POOL* p) {
+	pool_worker* self = pool_self;
+	return (p && self && self->pool == p) ? self->index : -1;
+}
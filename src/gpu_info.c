@@ -0,0 +1,686 @@
+/*
+ *
+ * Enumerate GPUs on Windows and Linux: vendor, name, memory, compute
+ * units, clocks, PCIe link and the CPUs / NUMA node each one hangs off.
+ */
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE			/* realpath, strtoull */
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define COBJMACROS
+#include <windows.h>
+#include <dxgi.h>            /* CreateDXGIFactory1 */
+#pragma comment(lib, "dxgi.lib")
+#pragma comment(lib, "dxguid.lib")
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dlfcn.h>
+#define DLL_EXPORT
+#endif
+
+/* GPU vendor, from the PCI vendor id */
+typedef enum {
+	GPU_VENDOR_UNKNOWN,
+	GPU_VENDOR_NVIDIA,
+	GPU_VENDOR_AMD,
+	GPU_VENDOR_INTEL,
+	GPU_VENDOR_OTHER
+} GpuVendor;
+
+/* Where a device's fields came from (GpuDevice.sources) */
+#define GPU_SOURCE_SYSFS	0x01u	/* /sys/class/drm + PCI sysfs */
+#define GPU_SOURCE_DXGI		0x02u	/* DXGI adapter list */
+#define GPU_SOURCE_NVML		0x04u	/* libnvidia-ml / nvml.dll */
+#define GPU_SOURCE_ROCM_SMI	0x08u	/* librocm_smi64 */
+#define GPU_SOURCE_KFD		0x10u	/* /sys/class/kfd topology (AMD compute units) */
+
+/* One GPU */
+typedef struct {
+	GpuVendor vendor;
+	unsigned int vendor_id;		/* PCI vendor id */
+	unsigned int device_id;		/* PCI device id */
+	char name[128];				/* marketing name, else the pci.ids name, else the ids */
+	char pci_address[16];		/* "0000:01:00.0", "" if unknown */
+	char driver[32];			/* kernel driver (amdgpu, i915, xe, nvidia), "" on Windows */
+	uint64_t vram_bytes;		/* dedicated memory, 0 if unknown */
+	uint64_t shared_bytes;		/* system memory the GPU may map (GTT / shared), 0 if unknown */
+	int compute_units;			/* SMs (NVIDIA), CUs (AMD), 0 if unknown */
+	int max_clock_mhz;			/* highest shader clock */
+	int current_clock_mhz;		/* shader clock now */
+	int memory_clock_mhz;		/* highest memory clock */
+	int pcie_gen;				/* current link generation, drops at idle */
+	int pcie_width;				/* current lanes */
+	int pcie_max_gen;			/* best generation device and upstream port both support */
+	int pcie_max_width;			/* lanes likewise */
+	double pcie_gbps;			/* GB/s per direction at pcie_max_gen x pcie_max_width */
+	int numa_node;				/* NUMA node id (NumaNode.id), -1 if unknown */
+	int* cpus;					/* logical CPUs local to the device */
+	int cpu_count;				/* length of cpus */
+	int is_boot_vga;			/* firmware console / primary adapter */
+	unsigned int sources;		/* GPU_SOURCE_* */
+} GpuDevice;
+
+/* Every GPU; one allocation behind all pointers */
+typedef struct {
+	GpuDevice* devices;
+	int device_count;
+	void* arena;				/* single allocation behind all pointers */
+	size_t arena_size;			/* bytes in arena */
+} GPU_DATA;
+
+#define GPU_MAX_DEVICES 64
+
+/* Probe state: devices with their own cpus mallocs until packed */
+typedef struct {
+	GpuDevice dev[GPU_MAX_DEVICES];
+	int count;
+} gpu_list;
+
+static GpuVendor vendor_of(unsigned int vendor_id) {
+	switch (vendor_id) {
+		case 0x10DE: return GPU_VENDOR_NVIDIA;
+		case 0x1002: case 0x1022: return GPU_VENDOR_AMD;
+		case 0x8086: return GPU_VENDOR_INTEL;
+		default: return vendor_id ? GPU_VENDOR_OTHER : GPU_VENDOR_UNKNOWN;
+	}
+}
+
+static GpuDevice* gpu_add(gpu_list* l) {
+	if (l->count >= GPU_MAX_DEVICES) {
+		return NULL;
+	}
+	GpuDevice* d = &l->dev[l->count++];
+	memset(d, 0, sizeof(*d));
+	d->numa_node = -1;
+	return d;
+}
+
+/* Per‐lane GB/s per direction after line coding (8b/10b, 128b/130b, FLIT) */
+static double pcie_lane_gbps(int gen) {
+	static const double lane[] = { 0.0, 0.25, 0.5, 0.985, 1.969, 3.938, 7.563 };
+	return (gen >= 1 && gen <= 6) ? lane[gen] : 0.0;
+}
+
+static void finish_link(GpuDevice* d) {
+	if (!d->pcie_max_gen) d->pcie_max_gen = d->pcie_gen;
+	if (!d->pcie_max_width) d->pcie_max_width = d->pcie_width;
+	d->pcie_gbps = pcie_lane_gbps(d->pcie_max_gen) * d->pcie_max_width;
+}
+
+/*
+ * NVML, loaded at run time.  Only calls whose signatures have been stable
+ * since the v2 entry points are used; each is optional.
+ */
+typedef struct {
+	char bus_id_legacy[16];
+	unsigned int domain;
+	unsigned int bus;
+	unsigned int device;
+	unsigned int pci_device_id;		/* (device << 16) | vendor */
+	unsigned int pci_subsystem_id;
+	char bus_id[32];
+} nvml_pci_info;
+
+typedef struct {
+	unsigned long long total;
+	unsigned long long free;
+	unsigned long long used;
+} nvml_memory;
+
+typedef int (*nvml_init_fn)(void);
+typedef int (*nvml_count_fn)(unsigned int*);
+typedef int (*nvml_handle_fn)(unsigned int, void**);
+typedef int (*nvml_pci_fn)(void*, nvml_pci_info*);
+typedef int (*nvml_name_fn)(void*, char*, unsigned int);
+typedef int (*nvml_memory_fn)(void*, nvml_memory*);
+typedef int (*nvml_clock_fn)(void*, int, unsigned int*);
+typedef int (*nvml_uint_fn)(void*, unsigned int*);
+typedef int (*nvml_cc_fn)(void*, int*, int*);
+
+#define NVML_CLOCK_GRAPHICS	0
+#define NVML_CLOCK_MEM		2
+
+#if defined(_WIN32)
+typedef HMODULE gpu_lib;
+static gpu_lib gpu_lib_open(const char* const* names) {
+	for (; *names; ++names) {
+		HMODULE h = LoadLibraryA(*names);
+		if (h) return h;
+	}
+	return NULL;
+}
+#define gpu_lib_sym(h, name) ((void*)GetProcAddress((h), (name)))
+#define gpu_lib_close(h) FreeLibrary(h)
+#else
+typedef void* gpu_lib;
+static gpu_lib gpu_lib_open(const char* const* names) {
+	for (; *names; ++names) {
+		void* h = dlopen(*names, RTLD_NOW | RTLD_LOCAL);
+		if (h) return h;
+	}
+	return NULL;
+}
+#define gpu_lib_sym(h, name) dlsym((h), (name))
+#define gpu_lib_close(h) dlclose(h)
+#endif
+
+/* FP32 lanes per SM by compute capability, to turn NVML's core count into SMs */
+static int nvidia_cores_per_sm(int major, int minor) {
+	if (major == 6) return minor == 0 ? 64 : 128;
+	if (major == 7) return 64;
+	if (major == 8) return minor == 0 ? 64 : 128;
+	return major >= 5 ? 128 : 0;
+}
+
+/* Match by PCI address, else by ids among devices NVML has not claimed yet */
+static GpuDevice* find_device(gpu_list* l, const char* address, unsigned int vendor, unsigned int device, unsigned int claimed) {
+	for (int i = 0; i < l->count; ++i) {
+		if (address[0] && !strcmp(l->dev[i].pci_address, address)) {
+			return &l->dev[i];
+		}
+	}
+	for (int i = 0; i < l->count; ++i) {
+		GpuDevice* d = &l->dev[i];
+		if (!d->pci_address[0] && !(d->sources & claimed) && d->vendor_id == vendor && d->device_id == device) {
+			return d;
+		}
+	}
+	return NULL;
+}
+
+static void probe_nvml(gpu_list* l) {
+#if defined(_WIN32)
+	static const char* const names[] = { "nvml.dll", NULL };
+#else
+	static const char* const names[] = { "libnvidia-ml.so.1", "libnvidia-ml.so", NULL };
+#endif
+	gpu_lib h = gpu_lib_open(names);
+	if (!h) {
+		return;
+	}
+	nvml_init_fn init = (nvml_init_fn)gpu_lib_sym(h, "nvmlInit_v2");
+	nvml_init_fn shutdown = (nvml_init_fn)gpu_lib_sym(h, "nvmlShutdown");
+	nvml_count_fn count = (nvml_count_fn)gpu_lib_sym(h, "nvmlDeviceGetCount_v2");
+	nvml_handle_fn handle = (nvml_handle_fn)gpu_lib_sym(h, "nvmlDeviceGetHandleByIndex_v2");
+	nvml_pci_fn pci = (nvml_pci_fn)gpu_lib_sym(h, "nvmlDeviceGetPciInfo_v3");
+	if (!pci) pci = (nvml_pci_fn)gpu_lib_sym(h, "nvmlDeviceGetPciInfo_v2");
+	nvml_name_fn name = (nvml_name_fn)gpu_lib_sym(h, "nvmlDeviceGetName");
+	nvml_memory_fn memory = (nvml_memory_fn)gpu_lib_sym(h, "nvmlDeviceGetMemoryInfo");
+	nvml_clock_fn max_clock = (nvml_clock_fn)gpu_lib_sym(h, "nvmlDeviceGetMaxClockInfo");
+	nvml_clock_fn clock = (nvml_clock_fn)gpu_lib_sym(h, "nvmlDeviceGetClockInfo");
+	nvml_uint_fn gen = (nvml_uint_fn)gpu_lib_sym(h, "nvmlDeviceGetCurrPcieLinkGeneration");
+	nvml_uint_fn width = (nvml_uint_fn)gpu_lib_sym(h, "nvmlDeviceGetCurrPcieLinkWidth");
+	nvml_uint_fn max_gen = (nvml_uint_fn)gpu_lib_sym(h, "nvmlDeviceGetMaxPcieLinkGeneration");
+	nvml_uint_fn max_width = (nvml_uint_fn)gpu_lib_sym(h, "nvmlDeviceGetMaxPcieLinkWidth");
+	nvml_uint_fn cores = (nvml_uint_fn)gpu_lib_sym(h, "nvmlDeviceGetNumGpuCores");
+	nvml_cc_fn cc = (nvml_cc_fn)gpu_lib_sym(h, "nvmlDeviceGetCudaComputeCapability");
+
+	unsigned int n = 0;
+	if (!init || !count || !handle || init() != 0) {
+		gpu_lib_close(h);
+		return;
+	}
+	if (count(&n) != 0) {
+		n = 0;
+	}
+	for (unsigned int i = 0; i < n; ++i) {
+		void* dev;
+		nvml_pci_info info;
+		char address[16] = "";
+		if (handle(i, &dev) != 0) {
+			continue;
+		}
+		memset(&info, 0, sizeof(info));
+		if (pci && pci(dev, &info) == 0) {
+			snprintf(address, sizeof(address), "%04x:%02x:%02x.0", info.domain & 0xFFFF, info.bus & 0xFF, info.device & 0x1F);
+		}
+		unsigned int vendor = info.pci_device_id & 0xFFFF, device = info.pci_device_id >> 16;
+		GpuDevice* d = find_device(l, address, vendor ? vendor : 0x10DE, device, GPU_SOURCE_NVML);
+		if (!d && !(d = gpu_add(l))) {
+			break;
+		}
+		d->sources |= GPU_SOURCE_NVML;
+		d->vendor_id = vendor ? vendor : 0x10DE;
+		d->vendor = vendor_of(d->vendor_id);
+		if (device) d->device_id = device;
+		if (address[0]) snprintf(d->pci_address, sizeof(d->pci_address), "%s", address);
+		if (name) name(dev, d->name, sizeof(d->name));
+
+		nvml_memory mem;
+		unsigned int v;
+		int major, minor;
+		if (memory && memory(dev, &mem) == 0) d->vram_bytes = mem.total;
+		if (max_clock && max_clock(dev, NVML_CLOCK_GRAPHICS, &v) == 0) d->max_clock_mhz = (int)v;
+		if (max_clock && max_clock(dev, NVML_CLOCK_MEM, &v) == 0) d->memory_clock_mhz = (int)v;
+		if (clock && clock(dev, NVML_CLOCK_GRAPHICS, &v) == 0) d->current_clock_mhz = (int)v;
+		if (gen && gen(dev, &v) == 0) d->pcie_gen = (int)v;
+		if (width && width(dev, &v) == 0) d->pcie_width = (int)v;
+		/* NVML's maximum already accounts for the slot */
+		if (max_gen && max_gen(dev, &v) == 0) d->pcie_max_gen = (int)v;
+		if (max_width && max_width(dev, &v) == 0) d->pcie_max_width = (int)v;
+		if (cores && cc && cores(dev, &v) == 0 && cc(dev, &major, &minor) == 0) {
+			int per_sm = nvidia_cores_per_sm(major, minor);
+			if (per_sm) d->compute_units = (int)(v / per_sm);
+		}
+		finish_link(d);
+	}
+	if (shutdown) shutdown();
+	gpu_lib_close(h);
+}
+
+/* ROCm‐SMI: marketing name and VRAM size; clocks come from amdgpu sysfs */
+typedef int (*rsmi_init_fn)(uint64_t);
+typedef int (*rsmi_shutdown_fn)(void);
+typedef int (*rsmi_count_fn)(uint32_t*);
+typedef int (*rsmi_bdf_fn)(uint32_t, uint64_t*);
+typedef int (*rsmi_name_fn)(uint32_t, char*, size_t);
+typedef int (*rsmi_memory_fn)(uint32_t, int, uint64_t*);
+
+#define RSMI_MEM_TYPE_VRAM 0
+
+static void probe_rocm_smi(gpu_list* l) {
+#if defined(_WIN32)
+	(void)l;
+#else
+	static const char* const names[] = { "librocm_smi64.so.1", "librocm_smi64.so.7",
+		"librocm_smi64.so.6", "librocm_smi64.so.5", "librocm_smi64.so", NULL };
+	gpu_lib h = gpu_lib_open(names);
+	if (!h) {
+		return;
+	}
+	rsmi_init_fn init = (rsmi_init_fn)gpu_lib_sym(h, "rsmi_init");
+	rsmi_shutdown_fn shutdown = (rsmi_shutdown_fn)gpu_lib_sym(h, "rsmi_shut_down");
+	rsmi_count_fn count = (rsmi_count_fn)gpu_lib_sym(h, "rsmi_num_monitor_devices");
+	rsmi_bdf_fn bdf = (rsmi_bdf_fn)gpu_lib_sym(h, "rsmi_dev_pci_id_get");
+	rsmi_name_fn name = (rsmi_name_fn)gpu_lib_sym(h, "rsmi_dev_name_get");
+	rsmi_memory_fn memory = (rsmi_memory_fn)gpu_lib_sym(h, "rsmi_dev_memory_total_get");
+	uint32_t n = 0;
+	if (!init || !count || !bdf || init(0) != 0) {
+		gpu_lib_close(h);
+		return;
+	}
+	if (count(&n) != 0) {
+		n = 0;
+	}
+	for (uint32_t i = 0; i < n; ++i) {
+		uint64_t id;
+		char address[16];
+		if (bdf(i, &id) != 0) {
+			continue;
+		}
+		/* domain in bits 32+, bus 8‐15, device 3‐7, function 0‐2 */
+		snprintf(address, sizeof(address), "%04x:%02x:%02x.%x", (unsigned)(id >> 32) & 0xFFFF,
+			(unsigned)(id >> 8) & 0xFF, (unsigned)(id >> 3) & 0x1F, (unsigned)id & 0x7);
+		GpuDevice* d = find_device(l, address, 0, 0, 0);
+		if (!d) {
+			continue;		/* sysfs found every amdgpu device already */
+		}
+		d->sources |= GPU_SOURCE_ROCM_SMI;
+		char buf[128];
+		uint64_t bytes;
+		if (name && name(i, buf, sizeof(buf)) == 0 && buf[0]) {
+			snprintf(d->name, sizeof(d->name), "%s", buf);
+		}
+		if (memory && memory(i, RSMI_MEM_TYPE_VRAM, &bytes) == 0 && bytes) {
+			d->vram_bytes = bytes;
+		}
+	}
+	if (shutdown) shutdown();
+	gpu_lib_close(h);
+#endif
+}
+
+#if defined(_WIN32)
+/*
+ * Windows: DXGI lists the adapters with their memory; it has no bus
+ * address, PCIe link, clocks or NUMA node, so those only come from NVML.
+ */
+static int probe_platform(gpu_list* l) {
+	IDXGIFactory1* factory = NULL;
+	if (FAILED(CreateDXGIFactory1(&IID_IDXGIFactory1, (void**)&factory))) {
+		return 221;
+	}
+	IDXGIAdapter1* adapter;
+	for (UINT i = 0; IDXGIFactory1_EnumAdapters1(factory, i, &adapter) != DXGI_ERROR_NOT_FOUND; ++i) {
+		DXGI_ADAPTER_DESC1 desc;
+		if (SUCCEEDED(IDXGIAdapter1_GetDesc1(adapter, &desc)) && !(desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE)) {
+			GpuDevice* d = gpu_add(l);
+			if (d) {
+				d->sources = GPU_SOURCE_DXGI;
+				d->vendor_id = desc.VendorId;
+				d->device_id = desc.DeviceId;
+				d->vendor = vendor_of(desc.VendorId);
+				d->vram_bytes = desc.DedicatedVideoMemory;
+				d->shared_bytes = desc.SharedSystemMemory;
+				d->is_boot_vga = (i == 0);		/* DXGI lists the primary adapter first */
+				WideCharToMultiByte(CP_UTF8, 0, desc.Description, -1, d->name, sizeof(d->name), NULL, NULL);
+			}
+		}
+		IDXGIAdapter1_Release(adapter);
+	}
+	IDXGIFactory1_Release(factory);
+	return 0;
+}
+
+static void name_from_pci_ids(GpuDevice* d) {
+	(void)d;
+}
+#else
+/* Whole small sysfs file, NUL‐terminated and without the trailing newline */
+static int read_attr(const char* dir, const char* name, char* buf, size_t size) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		buf[0] = '\0';
+		return -1;
+	}
+	ssize_t n = read(fd, buf, size - 1);
+	close(fd);
+	if (n < 0) n = 0;
+	buf[n] = '\0';
+	while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' ')) buf[--n] = '\0';
+	return (int)n;
+}
+
+static unsigned long long read_attr_num(const char* dir, const char* name, int base) {
+	char buf[64];
+	return read_attr(dir, name, buf, sizeof(buf)) > 0 ? strtoull(buf, NULL, base) : 0;
+}
+
+/* "16.0 GT/s PCIe" -> 4 */
+static int link_gen(const char* dir, const char* name) {
+	char buf[64];
+	if (read_attr(dir, name, buf, sizeof(buf)) <= 0) {
+		return 0;
+	}
+	double gts = strtod(buf, NULL);
+	return gts >= 64 ? 6 : gts >= 32 ? 5 : gts >= 16 ? 4 : gts >= 8 ? 3 : gts >= 5 ? 2 : gts > 0 ? 1 : 0;
+}
+
+/* Expand a "0-3,8,10-11" list; returns the count, *out malloc'd */
+static int parse_cpulist(const char* list, int** out) {
+	int cap = 16, n = 0;
+	int* cpus = malloc(cap * sizeof(int));
+	const char* p = list;
+	while (cpus && *p) {
+		char* end;
+		long a = strtol(p, &end, 10), b;
+		if (end == p) {
+			break;
+		}
+		b = a;
+		if (*end == '-') {
+			p = end + 1;
+			b = strtol(p, &end, 10);
+		}
+		for (long c = a; c <= b && c >= 0; ++c) {
+			if (n == cap) {
+				int* grown = realloc(cpus, 2 * cap * sizeof(int));
+				if (!grown) {
+					free(cpus);
+					cpus = NULL;
+					break;
+				}
+				cpus = grown;
+				cap *= 2;
+			}
+			cpus[n++] = (int)c;
+		}
+		if (!cpus || *end != ',') {
+			break;
+		}
+		p = end + 1;
+	}
+	*out = cpus;
+	return cpus ? n : 0;
+}
+
+/* Highest and "*"‐marked current level of an amdgpu pp_dpm_* table ("1: 2100Mhz *") */
+static void dpm_levels(const char* dir, const char* name, int* max_mhz, int* cur_mhz) {
+	char buf[1024];
+	if (read_attr(dir, name, buf, sizeof(buf)) <= 0) {
+		return;
+	}
+	for (char* line = buf; line && *line; ) {
+		char* colon = strchr(line, ':');
+		char* next = strchr(line, '\n');
+		if (colon && (!next || colon < next)) {
+			int mhz = atoi(colon + 1);
+			if (mhz > *max_mhz) *max_mhz = mhz;
+			char* star = strchr(colon, '*');
+			if (cur_mhz && star && (!next || star < next)) *cur_mhz = mhz;
+		}
+		line = next ? next + 1 : NULL;
+	}
+}
+
+/* AMD compute units from the KFD topology node with this PCI location */
+static void kfd_compute_units(GpuDevice* d, unsigned int domain, unsigned int location) {
+	for (int node = 0; node < 64; ++node) {
+		char dir[96], props[4096];
+		snprintf(dir, sizeof(dir), "/sys/class/kfd/kfd/topology/nodes/%d", node);
+		if (read_attr(dir, "properties", props, sizeof(props)) <= 0) {
+			if (node > 0) break;
+			continue;
+		}
+		long loc = -1, dom = 0, simd = 0, simd_per_cu = 0, clk = 0;
+		for (char* line = props; line && *line; ) {
+			char key[48];
+			long v;
+			if (sscanf(line, "%47s %ld", key, &v) == 2) {
+				if (!strcmp(key, "location_id")) loc = v;
+				else if (!strcmp(key, "domain")) dom = v;
+				else if (!strcmp(key, "simd_count")) simd = v;
+				else if (!strcmp(key, "simd_per_cu")) simd_per_cu = v;
+				else if (!strcmp(key, "max_engine_clk_fcompute")) clk = v;
+			}
+			line = strchr(line, '\n');
+			if (line) line++;
+		}
+		if (loc == (long)location && dom == (long)domain && simd > 0 && simd_per_cu > 0) {
+			d->compute_units = (int)(simd / simd_per_cu);
+			if (!d->max_clock_mhz) d->max_clock_mhz = (int)clk;
+			d->sources |= GPU_SOURCE_KFD;
+			return;
+		}
+	}
+}
+
+/* Device name from the system pci.ids database, if one is installed */
+static void name_from_pci_ids(GpuDevice* d) {
+	static const char* const paths[] = { "/usr/share/hwdata/pci.ids", "/usr/share/misc/pci.ids", "/usr/share/pci.ids" };
+	FILE* f = NULL;
+	for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]) && !f; ++i) {
+		f = fopen(paths[i], "r");
+	}
+	if (!f) {
+		return;
+	}
+	char line[256], vendor[128] = "";
+	int in_vendor = 0;
+	while (fgets(line, sizeof(line), f)) {
+		unsigned int id;
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		if (line[0] != '\t') {
+			if (in_vendor) break;
+			if (sscanf(line, "%x", &id) == 1 && id == d->vendor_id && strlen(line) > 6) {
+				in_vendor = 1;
+				snprintf(vendor, sizeof(vendor), "%.127s", line + 6);
+				vendor[strcspn(vendor, "\n")] = '\0';
+			}
+		} else if (in_vendor && line[1] != '\t' && sscanf(line + 1, "%x", &id) == 1 && id == d->device_id && strlen(line) > 7) {
+			char* model = line + 7;
+			model[strcspn(model, "\n")] = '\0';
+			snprintf(d->name, sizeof(d->name), "%.60s %.60s", vendor, model);
+			break;
+		}
+	}
+	fclose(f);
+}
+
+/*
+ * Linux: every /sys/class/drm/cardN is one display‐class PCI function.
+ * The PCI device directory has ids, NUMA node, local CPUs and the link;
+ * the maximum link is the lower of the device's and its upstream port's.
+ */
+static int probe_platform(gpu_list* l) {
+	for (int card = 0; card < 256; ++card) {
+		char link[64], dev[PATH_MAX], buf[4096];
+		snprintf(link, sizeof(link), "/sys/class/drm/card%d/device", card);
+		if (!realpath(link, dev)) {
+			continue;
+		}
+		const char* bdf = strrchr(dev, '/');
+		bdf = bdf ? bdf + 1 : dev;
+		if ((read_attr_num(dev, "class", 16) >> 16) != 0x03) {
+			continue;		/* not a display controller */
+		}
+		int duplicate = 0;
+		for (int i = 0; i < l->count; ++i) duplicate |= !strcmp(l->dev[i].pci_address, bdf);
+		GpuDevice* d = duplicate ? NULL : gpu_add(l);
+		if (!d) {
+			continue;
+		}
+		d->sources = GPU_SOURCE_SYSFS;
+		snprintf(d->pci_address, sizeof(d->pci_address), "%.15s", bdf);
+		d->vendor_id = (unsigned int)read_attr_num(dev, "vendor", 16);
+		d->device_id = (unsigned int)read_attr_num(dev, "device", 16);
+		d->vendor = vendor_of(d->vendor_id);
+		d->is_boot_vga = (int)read_attr_num(dev, "boot_vga", 10);
+		if (read_attr(dev, "numa_node", buf, sizeof(buf)) > 0) {
+			d->numa_node = atoi(buf);		/* -1 on single‐node machines */
+		}
+		if (read_attr(dev, "local_cpulist", buf, sizeof(buf)) > 0) {
+			d->cpu_count = parse_cpulist(buf, &d->cpus);
+		}
+
+		char driver[PATH_MAX], path[PATH_MAX + 32];
+		snprintf(path, sizeof(path), "%s/driver", dev);
+		if (realpath(path, driver)) {
+			const char* base = strrchr(driver, '/');
+			snprintf(d->driver, sizeof(d->driver), "%.31s", base ? base + 1 : driver);
+		}
+
+		d->pcie_gen = link_gen(dev, "current_link_speed");
+		d->pcie_width = (int)read_attr_num(dev, "current_link_width", 10);
+		d->pcie_max_gen = link_gen(dev, "max_link_speed");
+		d->pcie_max_width = (int)read_attr_num(dev, "max_link_width", 10);
+		char parent[PATH_MAX];
+		snprintf(parent, sizeof(parent), "%s", dev);
+		char* slash = strrchr(parent, '/');
+		if (slash) {
+			*slash = '\0';
+			int up_gen = link_gen(parent, "max_link_speed");
+			int up_width = (int)read_attr_num(parent, "max_link_width", 10);
+			if (up_gen && up_gen < d->pcie_max_gen) d->pcie_max_gen = up_gen;
+			if (up_width && up_width < d->pcie_max_width) d->pcie_max_width = up_width;
+		}
+		finish_link(d);
+
+		if (!strcmp(d->driver, "amdgpu")) {
+			d->vram_bytes = read_attr_num(dev, "mem_info_vram_total", 10);
+			d->shared_bytes = read_attr_num(dev, "mem_info_gtt_total", 10);
+			dpm_levels(dev, "pp_dpm_sclk", &d->max_clock_mhz, &d->current_clock_mhz);
+			dpm_levels(dev, "pp_dpm_mclk", &d->memory_clock_mhz, NULL);
+			if (read_attr(dev, "product_name", buf, sizeof(buf)) > 0) {
+				snprintf(d->name, sizeof(d->name), "%.127s", buf);
+			}
+			unsigned int domain, bus, slot, fn;
+			if (sscanf(bdf, "%x:%x:%x.%x", &domain, &bus, &slot, &fn) == 4) {
+				kfd_compute_units(d, domain, (bus << 8) | (slot << 3) | fn);
+			}
+		} else if (!strcmp(d->driver, "i915")) {
+			snprintf(path, sizeof(path), "/sys/class/drm/card%d", card);
+			d->max_clock_mhz = (int)read_attr_num(path, "gt_max_freq_mhz", 10);
+			d->current_clock_mhz = (int)read_attr_num(path, "gt_cur_freq_mhz", 10);
+		} else if (!strcmp(d->driver, "xe")) {
+			snprintf(path, sizeof(path), "%s/tile0/gt0/freq0", dev);
+			d->max_clock_mhz = (int)read_attr_num(path, "max_freq", 10);
+			d->current_clock_mhz = (int)read_attr_num(path, "cur_freq", 10);
+		}
+	}
+	return 0;
+}
+#endif
+
+static void free_list(gpu_list* l) {
+	for (int i = 0; i < l->count; ++i) {
+		free(l->dev[i].cpus);
+	}
+}
+
+/* Devices followed by every cpus array, in one allocation */
+static int pack_gpu_data(const gpu_list* l, GPU_DATA* out) {
+	size_t bytes = (size_t)l->count * sizeof(GpuDevice);
+	for (int i = 0; i < l->count; ++i) {
+		bytes += (size_t)l->dev[i].cpu_count * sizeof(int);
+	}
+	char* base = malloc(bytes ? bytes : 1);
+	if (!base) {
+		return 203;
+	}
+	GpuDevice* devices = (GpuDevice*)base;
+	int* cpus = (int*)(base + (size_t)l->count * sizeof(GpuDevice));
+	for (int i = 0; i < l->count; ++i) {
+		devices[i] = l->dev[i];
+		devices[i].cpus = l->dev[i].cpu_count ? cpus : NULL;
+		if (l->dev[i].cpu_count) {
+			memcpy(cpus, l->dev[i].cpus, l->dev[i].cpu_count * sizeof(int));
+		}
+		cpus += l->dev[i].cpu_count;
+	}
+	out->devices = l->count ? devices : NULL;
+	out->device_count = l->count;
+	out->arena = base;
+	out->arena_size = bytes;
+	return 0;
+}
+
+/* Top‐level entry: every GPU the OS lists, enriched by NVML / ROCm‐SMI */
+DLL_EXPORT int get_gpu_data(GPU_DATA* data) {
+	if (!data) {
+		return 201;
+	}
+	memset(data, 0, sizeof(*data));
+
+	gpu_list* l = calloc(1, sizeof(*l));
+	if (!l) {
+		return 203;
+	}
+	int rc = probe_platform(l);
+	if (rc == 0) {
+		probe_nvml(l);
+		probe_rocm_smi(l);
+		for (int i = 0; i < l->count; ++i) {
+			GpuDevice* d = &l->dev[i];
+			if (!d->name[0]) name_from_pci_ids(d);
+			if (!d->name[0]) snprintf(d->name, sizeof(d->name), "GPU [%04x:%04x]", d->vendor_id, d->device_id);
+		}
+		rc = pack_gpu_data(l, data);
+	}
+	free_list(l);
+	free(l);
+	return rc;
+}
+
+/* Release a GPU_DATA filled by get_gpu_data */
+DLL_EXPORT void free_gpu_data(GPU_DATA* data) {
+	if (!data) {
+		return;
+	}
+	free(data->arena);
+	memset(data, 0, sizeof(*data));
+}
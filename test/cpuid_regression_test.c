@@ -0,0 +1,418 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CPU_Info.h"
+
+/*
+ * Replays recorded CPUID dumps through set_cpuid_hook() and checks the
+ * detected feature set and x86-64 level against what each part supports,
+ * then the CPUID cache, TLB and tiling results of the parts that carry
+ * cache leaves.  Add a row whenever a detection bug is fixed so it cannot
+ * come back.
+ */
+
+typedef struct {
+	int leaf, subleaf;
+	unsigned int eax, ebx, ecx, edx;
+} cpuid_row;
+
+typedef struct {
+	const char* name;
+	const cpuid_row* rows;
+	int row_count;
+	uint64_t xcr0;
+	int level;
+	CpuFeature expect[64];		/* terminated by CPU_FEAT_COUNT */
+} cpu_dump;
+
+#define INTEL 0x756E6547u, 0x6C65746Eu, 0x49656E69u	/* ebx, ecx, edx */
+#define AMD   0x68747541u, 0x444D4163u, 0x69746E65u
+#define END   CPU_FEAT_COUNT
+
+/* CPU_Algorithms field of each mirrored feature, matched by name */
+#define ALG_FIELD(name) { CPU_FEAT_##name, offsetof(CPU_Algorithms, name) }
+static const struct { CpuFeature id; size_t offset; } algorithm_fields[] = {
+	ALG_FIELD(SSE),
+	ALG_FIELD(SSE2),
+	ALG_FIELD(SSE3),
+	ALG_FIELD(SSSE3),
+	ALG_FIELD(SSE4_1),
+	ALG_FIELD(SSE4_2),
+	ALG_FIELD(AVX),
+	ALG_FIELD(POPCNT),
+	ALG_FIELD(PCLMULQDQ),
+	ALG_FIELD(AES),
+	ALG_FIELD(FMA),
+	ALG_FIELD(F16C),
+	ALG_FIELD(XSAVE),
+	ALG_FIELD(OSXSAVE),
+	ALG_FIELD(RDRAND),
+	ALG_FIELD(RDSEED),
+	ALG_FIELD(ADX),
+	ALG_FIELD(MPX),
+	ALG_FIELD(PREFETCHWT1),
+	ALG_FIELD(AVX2),
+	ALG_FIELD(BMI1),
+	ALG_FIELD(BMI2),
+	ALG_FIELD(AVX512F),
+	ALG_FIELD(SHA),
+	ALG_FIELD(SSE4A),
+	ALG_FIELD(XOP),
+	ALG_FIELD(FMA4),
+	ALG_FIELD(THREEDNOW_PLUS),
+	ALG_FIELD(CX16),
+	ALG_FIELD(LAHF_SAHF),
+	ALG_FIELD(LZCNT),
+	ALG_FIELD(MOVBE),
+	ALG_FIELD(AVX512CD),
+	ALG_FIELD(AVX512BW),
+	ALG_FIELD(AVX512DQ),
+	ALG_FIELD(AVX512VL),
+};
+#undef ALG_FIELD
+
+#define COMMON_SSE CPU_FEAT_SSE, CPU_FEAT_SSE2, CPU_FEAT_SSE3, CPU_FEAT_SSSE3, \
+	CPU_FEAT_SSE4_1, CPU_FEAT_SSE4_2, CPU_FEAT_CX16, CPU_FEAT_POPCNT, CPU_FEAT_LAHF_SAHF
+
+static const char* feature_names[CPU_FEAT_COUNT] = {
+	"SSE", "SSE2", "SSE3", "SSSE3", "SSE4_1", "SSE4_2", "AVX", "POPCNT",
+	"PCLMULQDQ", "AES", "FMA", "F16C", "XSAVE", "OSXSAVE", "RDRAND", "RDSEED",
+	"ADX", "MPX", "PREFETCHWT1", "AVX2", "BMI1", "BMI2", "AVX512F", "SHA",
+	"SSE4A", "XOP", "FMA4", "THREEDNOW_PLUS",
+	"CX16", "LAHF_SAHF", "LZCNT", "MOVBE", "AVX512CD", "AVX512BW", "AVX512DQ", "AVX512VL",
+	"AVX512_IFMA", "AVX512_VBMI", "AVX512_VBMI2", "AVX512_VNNI",
+	"AVX512_BITALG", "AVX512_VPOPCNTDQ", "AVX512_BF16", "AVX512_FP16",
+	"AVX_VNNI", "AVX_IFMA", "AVX_VNNI_INT8", "AVX_NE_CONVERT",
+	"AMX_TILE", "AMX_INT8", "AMX_BF16", "AMX_FP16",
+	"VAES", "VPCLMULQDQ", "GFNI"
+};
+
+/* Core 2 Duo E6600: SSSE3, no POPCNT, no XSAVE */
+static const cpuid_row conroe[] = {
+	{ 0x00000000, 0, 0x0000000A, INTEL },
+	{ 0x00000001, 0, 0x000006F6, 0x00020800, 0x0000E3BD, 0xBFEBFBFF },
+	{ 0x80000000, 0, 0x80000008, 0, 0, 0 },
+	{ 0x80000001, 0, 0x00000000, 0x00000000, 0x00000001, 0x20100800 },
+};
+
+/* Core i7-6700K (Skylake): AVX2 and MPX, no SHA; TLBs from leaf 2 */
+static const cpuid_row skylake[] = {
+	{ 0x00000000, 0, 0x00000016, INTEL },
+	{ 0x00000001, 0, 0x000506E3, 0x00100800, 0x7FFAFBFF, 0xBFEBFBFF },
+	{ 0x00000002, 0, 0x76036301, 0x00F0B5FF, 0x00000000, 0x00C30000 },
+	{ 0x00000004, 0, 0x0C004121, 0x01C0003F, 0x0000003F, 0x00000000 },
+	{ 0x00000004, 1, 0x0C004122, 0x01C0003F, 0x0000003F, 0x00000000 },
+	{ 0x00000004, 2, 0x0C004143, 0x00C0003F, 0x000003FF, 0x00000000 },
+	{ 0x00000004, 3, 0x0C03C163, 0x03C0003F, 0x00001FFF, 0x00000006 },
+	{ 0x00000007, 0, 0x00000000, 0x029C6FBF, 0x00000000, 0x9C000000 },
+	{ 0x0000000B, 0, 0x00000001, 0x00000002, 0x00000100, 0x00000000 },
+	{ 0x0000000B, 1, 0x00000004, 0x00000008, 0x00000201, 0x00000000 },
+	{ 0x80000000, 0, 0x80000008, 0, 0, 0 },
+	{ 0x80000001, 0, 0x00000000, 0x00000000, 0x00000121, 0x2C100800 },
+};
+
+/* Xeon Sapphire Rapids (under a hypervisor): AVX-512 FP16, AMX; TLBs from leaf 0x18 */
+static const cpuid_row sapphire_rapids[] = {
+	{ 0x00000000, 0, 0x00000020, INTEL },
+	{ 0x00000001, 0, 0x000C06F2, 0x00010800, 0xFFFA3203, 0x0F8BFBFF },
+	{ 0x00000004, 0, 0xFC004121, 0x02C0003F, 0x0000003F, 0x00000000 },
+	{ 0x00000004, 1, 0xFC004122, 0x01C0003F, 0x0000003F, 0x00000000 },
+	{ 0x00000004, 2, 0xFC004143, 0x03C0003F, 0x000007FF, 0x00000000 },
+	{ 0x00000004, 3, 0xFC1FC163, 0x0380003F, 0x0001BFFF, 0x00000004 },
+	{ 0x00000007, 0, 0x00000002, 0xF1BF27EB, 0x1B415FDE, 0xBFD14410 },
+	{ 0x00000007, 1, 0x00001C30, 0x00000000, 0x00000000, 0x00000000 },
+	{ 0x0000000B, 0, 0x00000001, 0x00000002, 0x00000100, 0x00000000 },
+	{ 0x0000000B, 1, 0x00000007, 0x00000070, 0x00000201, 0x00000000 },
+	{ 0x00000018, 0, 0x00000003, 0x00080001, 0x00000020, 0x00000022 },
+	{ 0x00000018, 1, 0x00000000, 0x00100001, 0x00000004, 0x00000024 },
+	{ 0x00000018, 2, 0x00000000, 0x00100006, 0x00000001, 0x00000125 },
+	{ 0x00000018, 3, 0x00000000, 0x00080003, 0x00000100, 0x00000043 },
+	{ 0x80000000, 0, 0x80000008, 0, 0, 0 },
+	{ 0x80000001, 0, 0x00000000, 0x00000000, 0x00000121, 0x2C100800 },
+};
+
+/* FX-8350 (Piledriver): XOP, FMA4, SSE4A, no AVX2 */
+static const cpuid_row piledriver[] = {
+	{ 0x00000000, 0, 0x0000000D, AMD },
+	{ 0x00000001, 0, 0x00600F20, 0x00080800, 0x3E98320B, 0x178BFBFF },
+	{ 0x00000007, 0, 0x00000000, 0x00000008, 0x00000000, 0x00000000 },
+	{ 0x80000000, 0, 0x8000001E, 0, 0, 0 },
+	{ 0x80000001, 0, 0x00600F20, 0x10000000, 0x01EBBFFF, 0x2FD3FBFF },
+};
+
+/* Ryzen 9 5950X (Zen 3): AES/POPCNT/FMA/RDSEED/ADX/SHA on AMD, VAES */
+static const cpuid_row zen3[] = {
+	{ 0x00000000, 0, 0x00000010, AMD },
+	{ 0x00000001, 0, 0x00A20F10, 0x00200800, 0x7ED8320B, 0x178BFBFF },
+	{ 0x00000007, 0, 0x00000000, 0x219C97A9, 0x0040068C, 0x00000010 },
+	{ 0x80000000, 0, 0x80000023, 0, 0, 0 },
+	{ 0x80000001, 0, 0x00A20F10, 0x20000000, 0x75C237FF, 0x2FD3FBFF },
+};
+
+/* Ryzen 9 7950X (Zen 4): AVX-512 incl. BF16, no FP16 */
+static const cpuid_row zen4[] = {
+	{ 0x00000000, 0, 0x00000010, AMD },
+	{ 0x00000001, 0, 0x00A60F12, 0x00200800, 0x7EF8320B, 0x178BFBFF },
+	{ 0x00000007, 0, 0x00000001, 0xF1BF97A9, 0x00405FCE, 0x10000010 },
+	{ 0x00000007, 1, 0x00000020, 0x00000000, 0x00000000, 0x00000000 },
+	{ 0x80000000, 0, 0x80000028, 0, 0, 0 },
+	{ 0x80000001, 0, 0x00A60F12, 0x20000000, 0x75C237FF, 0x2FD3FBFF },
+};
+
+/*
+ * EPYC 7003 guest with TOPOEXT hidden: caches come from 0x80000005/6,
+ * whose L2/L3 associativity of 9 means "see leaf 0x8000001D", and the
+ * L2 DTLB for 2M pages carries the same code.
+ */
+static const cpuid_row milan_guest[] = {
+	{ 0x00000000, 0, 0x00000010, AMD },
+	{ 0x00000001, 0, 0x00A00F11, 0x00020800, 0x7ED8320B, 0x178BFBFF },
+	{ 0x00000007, 0, 0x00000000, 0x219C97A9, 0x0040068C, 0x00000010 },
+	{ 0x0000000B, 0, 0x00000000, 0x00000001, 0x00000100, 0x00000000 },
+	{ 0x0000000B, 1, 0x00000004, 0x00000008, 0x00000201, 0x00000000 },
+	{ 0x80000000, 0, 0x80000021, 0, 0, 0 },
+	{ 0x80000001, 0, 0x00A00F11, 0x00000000, 0x758237FF, 0x2FD3FBFF },
+	{ 0x80000005, 0, 0xFF40FF40, 0xFF40FF40, 0x20080140, 0x20080140 },
+	{ 0x80000006, 0, 0x98002200, 0x68004200, 0x02009140, 0x01009040 },
+	{ 0x80000008, 0, 0x00003030, 0x00000000, 0x00004007, 0x00000000 },
+	{ 0x8000001D, 0, 0x00000121, 0x01C0003F, 0x0000003F, 0x00000000 },
+	{ 0x8000001D, 1, 0x00000122, 0x01C0003F, 0x0000003F, 0x00000000 },
+	{ 0x8000001D, 2, 0x00000143, 0x01C0003F, 0x000003FF, 0x00000002 },
+	{ 0x8000001D, 3, 0x0003C163, 0x03C0003F, 0x00007FFF, 0x00000001 },
+};
+
+#define ROWS(r) r, (int)(sizeof(r) / sizeof(r[0]))
+
+static const cpu_dump dumps[] = {
+	{ "Core 2 E6600", ROWS(conroe), 0x0, 1,
+		{ CPU_FEAT_SSE, CPU_FEAT_SSE2, CPU_FEAT_SSE3, CPU_FEAT_SSSE3, CPU_FEAT_CX16,
+		  CPU_FEAT_LAHF_SAHF, END } },
+	{ "Core i7-6700K", ROWS(skylake), 0x1F, 3,
+		{ COMMON_SSE, CPU_FEAT_AVX, CPU_FEAT_PCLMULQDQ, CPU_FEAT_AES, CPU_FEAT_FMA, CPU_FEAT_F16C,
+		  CPU_FEAT_XSAVE, CPU_FEAT_OSXSAVE, CPU_FEAT_RDRAND, CPU_FEAT_RDSEED, CPU_FEAT_ADX,
+		  CPU_FEAT_MPX, CPU_FEAT_AVX2, CPU_FEAT_BMI1, CPU_FEAT_BMI2, CPU_FEAT_LZCNT,
+		  CPU_FEAT_MOVBE, END } },
+	{ "Xeon Sapphire Rapids", ROWS(sapphire_rapids), 0x602E7, 4,
+		{ COMMON_SSE, CPU_FEAT_AVX, CPU_FEAT_PCLMULQDQ, CPU_FEAT_AES, CPU_FEAT_FMA, CPU_FEAT_F16C,
+		  CPU_FEAT_XSAVE, CPU_FEAT_OSXSAVE, CPU_FEAT_RDRAND, CPU_FEAT_RDSEED, CPU_FEAT_ADX,
+		  CPU_FEAT_AVX2, CPU_FEAT_BMI1, CPU_FEAT_BMI2, CPU_FEAT_SHA, CPU_FEAT_LZCNT, CPU_FEAT_MOVBE,
+		  CPU_FEAT_AVX512F, CPU_FEAT_AVX512CD, CPU_FEAT_AVX512BW, CPU_FEAT_AVX512DQ, CPU_FEAT_AVX512VL,
+		  CPU_FEAT_AVX512_IFMA, CPU_FEAT_AVX512_VBMI, CPU_FEAT_AVX512_VBMI2, CPU_FEAT_AVX512_VNNI,
+		  CPU_FEAT_AVX512_BITALG, CPU_FEAT_AVX512_VPOPCNTDQ, CPU_FEAT_AVX512_BF16, CPU_FEAT_AVX512_FP16,
+		  CPU_FEAT_AVX_VNNI, CPU_FEAT_AMX_TILE, CPU_FEAT_AMX_INT8, CPU_FEAT_AMX_BF16,
+		  CPU_FEAT_VAES, CPU_FEAT_VPCLMULQDQ, CPU_FEAT_GFNI, END } },
+	/* same part, OS that never enabled AVX state: no AVX-class bits, v2 */
+	{ "Sapphire Rapids, XCR0=3", ROWS(sapphire_rapids), 0x3, 2,
+		{ COMMON_SSE, CPU_FEAT_PCLMULQDQ, CPU_FEAT_AES, CPU_FEAT_XSAVE, CPU_FEAT_OSXSAVE,
+		  CPU_FEAT_RDRAND, CPU_FEAT_RDSEED, CPU_FEAT_ADX, CPU_FEAT_BMI1, CPU_FEAT_BMI2,
+		  CPU_FEAT_SHA, CPU_FEAT_LZCNT, CPU_FEAT_MOVBE, CPU_FEAT_GFNI, END } },
+	{ "FX-8350", ROWS(piledriver), 0x7, 2,
+		{ COMMON_SSE, CPU_FEAT_AVX, CPU_FEAT_PCLMULQDQ, CPU_FEAT_AES, CPU_FEAT_FMA, CPU_FEAT_F16C,
+		  CPU_FEAT_XSAVE, CPU_FEAT_OSXSAVE, CPU_FEAT_BMI1, CPU_FEAT_LZCNT,
+		  CPU_FEAT_SSE4A, CPU_FEAT_XOP, CPU_FEAT_FMA4, END } },
+	{ "Ryzen 9 5950X", ROWS(zen3), 0x207, 3,
+		{ COMMON_SSE, CPU_FEAT_AVX, CPU_FEAT_PCLMULQDQ, CPU_FEAT_AES, CPU_FEAT_FMA, CPU_FEAT_F16C,
+		  CPU_FEAT_XSAVE, CPU_FEAT_OSXSAVE, CPU_FEAT_RDRAND, CPU_FEAT_RDSEED, CPU_FEAT_ADX,
+		  CPU_FEAT_AVX2, CPU_FEAT_BMI1, CPU_FEAT_BMI2, CPU_FEAT_SHA, CPU_FEAT_LZCNT, CPU_FEAT_MOVBE,
+		  CPU_FEAT_SSE4A, CPU_FEAT_VAES, CPU_FEAT_VPCLMULQDQ, END } },
+	{ "Ryzen 9 7950X", ROWS(zen4), 0x2E7, 4,
+		{ COMMON_SSE, CPU_FEAT_AVX, CPU_FEAT_PCLMULQDQ, CPU_FEAT_AES, CPU_FEAT_FMA, CPU_FEAT_F16C,
+		  CPU_FEAT_XSAVE, CPU_FEAT_OSXSAVE, CPU_FEAT_RDRAND, CPU_FEAT_RDSEED, CPU_FEAT_ADX,
+		  CPU_FEAT_AVX2, CPU_FEAT_BMI1, CPU_FEAT_BMI2, CPU_FEAT_SHA, CPU_FEAT_LZCNT, CPU_FEAT_MOVBE,
+		  CPU_FEAT_SSE4A, CPU_FEAT_AVX512F, CPU_FEAT_AVX512CD, CPU_FEAT_AVX512BW, CPU_FEAT_AVX512DQ,
+		  CPU_FEAT_AVX512VL, CPU_FEAT_AVX512_IFMA, CPU_FEAT_AVX512_VBMI, CPU_FEAT_AVX512_VBMI2,
+		  CPU_FEAT_AVX512_VNNI, CPU_FEAT_AVX512_BITALG, CPU_FEAT_AVX512_VPOPCNTDQ, CPU_FEAT_AVX512_BF16,
+		  CPU_FEAT_VAES, CPU_FEAT_VPCLMULQDQ, CPU_FEAT_GFNI, END } },
+};
+
+/* Expected TLB and tiling results of a dump, probed with CPU_PROBE_CPUID */
+typedef struct {
+	int level;
+	CacheType type;
+	int page_size_kb;
+	int entries;
+	int associativity;
+} tlb_row;
+
+typedef struct {
+	const char* name;
+	const cpuid_row* rows;
+	int row_count;
+	int false_sharing_bytes;
+	int l2_ways;
+	size_t l1_budget;			/* cpu_cache_budget(level 1), not concurrent */
+	size_t l2_budget;
+	int l2_square_tile;			/* doubles, three arrays, not concurrent */
+	tlb_row tlbs[16];
+	int tlb_count;
+} cache_dump;
+
+#define D CACHE_TYPE_DATA
+#define I CACHE_TYPE_INSTRUCTION
+#define U CACHE_TYPE_UNIFIED
+#define G1 1048576
+
+static const cache_dump cache_dumps[] = {
+	{ "Core i7-6700K", ROWS(skylake), 128, 4, 28672, 196608, 88,
+		{ { 1, D, 2048, 32, 4 }, { 1, D, 4096, 32, 4 }, { 1, D, G1, 4, 4 }, { 1, D, 4, 64, 4 },
+		  { 1, I, 2048, 8, 0 }, { 1, I, 4096, 8, 0 }, { 1, I, 4, 64, 8 },
+		  { 2, U, 4, 1536, 6 }, { 2, U, 2048, 1536, 6 }, { 2, U, G1, 16, 4 } }, 10 },
+	{ "Xeon Sapphire Rapids", ROWS(sapphire_rapids), 128, 16, 45056, 1966080, 280,
+		{ { 1, I, 4, 256, 8 }, { 1, D, 4, 64, 16 }, { 1, D, 2048, 16, 0 }, { 1, D, 4096, 16, 0 },
+		  { 2, U, 4, 2048, 8 }, { 2, U, 2048, 2048, 8 } }, 6 },
+	{ "EPYC 7003 guest, no TOPOEXT", ROWS(milan_guest), 64, 8, 28672, 458752, 136,
+		{ { 1, D, 2048, 64, 0 }, { 1, I, 2048, 64, 0 }, { 1, D, 4, 64, 0 }, { 1, I, 4, 64, 0 },
+		  { 2, D, 2048, 2048, 0 }, { 2, I, 2048, 512, 2 }, { 2, D, 4, 2048, 8 }, { 2, I, 4, 512, 4 } }, 8 },
+};
+
+#undef D
+#undef I
+#undef U
+#undef G1
+
+/* Leaves whose subleaf selects the answer */
+static int indexed_leaf(int leaf) {
+	return leaf == 4 || leaf == 7 || leaf == 0xB || leaf == 0x18 || leaf == (int)0x8000001D;
+}
+
+/* Leaves missing from a dump read as zero, like leaves above the maximum */
+static void replay_cpuid(void* ctx, int leaf, int subleaf, int regs[4]) {
+	const cpu_dump* d = ctx;
+	memset(regs, 0, 4 * sizeof(int));
+	for (int i = 0; i < d->row_count; ++i) {
+		const cpuid_row* r = &d->rows[i];
+		if (r->leaf == leaf && (r->subleaf == subleaf || !indexed_leaf(leaf))) {
+			regs[0] = (int)r->eax;
+			regs[1] = (int)r->ebx;
+			regs[2] = (int)r->ecx;
+			regs[3] = (int)r->edx;
+			return;
+		}
+	}
+}
+
+static uint64_t replay_xgetbv(void* ctx, unsigned int index) {
+	const cpu_dump* d = ctx;
+	return index == 0 ? d->xcr0 : 0;
+}
+
+static int check_dump(const cpu_dump* d) {
+	CpuidHook hook = { replay_cpuid, replay_xgetbv, (void*)d };
+	CPU_DATA data;
+	CpuFeatures want;
+	int failures = 0;
+
+	memset(&want, 0, sizeof(want));
+	for (int i = 0; d->expect[i] != END; ++i) {
+		cpu_feature_add(&want, d->expect[i]);
+	}
+
+	set_cpuid_hook(&hook);
+	int rc = get_cpu_data_ex(&data, CPU_FIELD_ALGORITHMS);
+	set_cpuid_hook(NULL);
+	if (rc != 0) {
+		printf("FAIL %s: get_cpu_data_ex returned %d\n", d->name, rc);
+		return 1;
+	}
+
+	for (int id = 0; id < CPU_FEAT_COUNT; ++id) {
+		int got = cpu_feature_has(&data.features, (CpuFeature)id);
+		int exp = cpu_feature_has(&want, (CpuFeature)id);
+		if (got != exp) {
+			printf("FAIL %s: %s is %d, expected %d\n", d->name, feature_names[id], got, exp);
+			failures++;
+		}
+	}
+	/* CPU_Algorithms must mirror the mask field for field */
+	for (size_t i = 0; i < sizeof(algorithm_fields) / sizeof(algorithm_fields[0]); ++i) {
+		CpuFeature id = algorithm_fields[i].id;
+		char flag = ((const char*)&data.algorithms)[algorithm_fields[i].offset];
+		if (flag != cpu_feature_has(&data.features, id)) {
+			printf("FAIL %s: CPU_Algorithms.%s disagrees with features\n", d->name, feature_names[id]);
+			failures++;
+		}
+	}
+	if (data.isa_level != d->level) {
+		printf("FAIL %s: x86-64 level v%d, expected v%d\n", d->name, data.isa_level, d->level);
+		failures++;
+	}
+	if (failures == 0) {
+		printf("ok   %s (v%d)\n", d->name, data.isa_level);
+	}
+	free_cpu_data(&data);
+	return failures;
+}
+
+static int check_cache_dump(const cache_dump* d) {
+	cpu_dump replay = { d->name, d->rows, d->row_count, 0x7, 0, { END } };
+	CpuidHook hook = { replay_cpuid, replay_xgetbv, &replay };
+	CPU_DATA data;
+	int failures = 0;
+
+	set_cpuid_hook(&hook);
+	set_cpu_probe_mode(CPU_PROBE_CPUID);
+	int rc = get_cpu_data_ex(&data, CPU_FIELD_CACHES);
+	set_cpu_probe_mode(CPU_PROBE_AUTO);
+	set_cpuid_hook(NULL);
+	if (rc != 0) {
+		printf("FAIL %s caches: get_cpu_data_ex returned %d\n", d->name, rc);
+		return 1;
+	}
+
+	if (data.false_sharing_bytes != d->false_sharing_bytes) {
+		printf("FAIL %s: false_sharing_bytes %d, expected %d\n", d->name,
+			data.false_sharing_bytes, d->false_sharing_bytes);
+		failures++;
+	}
+	int l2 = data.cache_of[0].l2;
+	int ways = l2 >= 0 ? data.caches[l2].associativity : -1;
+	if (ways != d->l2_ways) {
+		printf("FAIL %s: L2 %d-way, expected %d-way\n", d->name, ways, d->l2_ways);
+		failures++;
+	}
+	size_t b1 = cpu_cache_budget(&data, 1, 0), b2 = cpu_cache_budget(&data, 2, 0);
+	if (b1 != d->l1_budget || b2 != d->l2_budget) {
+		printf("FAIL %s: budgets L1 %zu L2 %zu, expected %zu %zu\n", d->name,
+			b1, b2, d->l1_budget, d->l2_budget);
+		failures++;
+	}
+	int side = cpu_square_tile(&data, 2, sizeof(double), 3, 0);
+	if (side != d->l2_square_tile) {
+		printf("FAIL %s: L2 square tile %d, expected %d\n", d->name, side, d->l2_square_tile);
+		failures++;
+	}
+
+	if (data.tlb_count != d->tlb_count) {
+		printf("FAIL %s: %d TLBs, expected %d\n", d->name, data.tlb_count, d->tlb_count);
+		failures++;
+	}
+	for (int i = 0; i < data.tlb_count && i < d->tlb_count; ++i) {
+		const TlbInfo* t = &data.tlbs[i];
+		const tlb_row* e = &d->tlbs[i];
+		if (t->level != e->level || t->type != e->type || t->page_size_kb != e->page_size_kb
+			|| t->entries != e->entries || t->associativity != e->associativity) {
+			printf("FAIL %s: TLB %d is L%d type %d %d KiB %d entries %d-way, expected L%d type %d %d KiB %d entries %d-way\n",
+				d->name, i, t->level, (int)t->type, t->page_size_kb, t->entries, t->associativity,
+				e->level, (int)e->type, e->page_size_kb, e->entries, e->associativity);
+			failures++;
+		}
+	}
+	if (failures == 0) {
+		printf("ok   %s caches (%d TLBs)\n", d->name, data.tlb_count);
+	}
+	free_cpu_data(&data);
+	return failures;
+}
+
+int main(void) {
+	int failures = 0;
+	for (size_t i = 0; i < sizeof(dumps) / sizeof(dumps[0]); ++i) {
+		failures += check_dump(&dumps[i]);
+	}
+	for (size_t i = 0; i < sizeof(cache_dumps) / sizeof(cache_dumps[0]); ++i) {
+		failures += check_cache_dump(&cache_dumps[i]);
+	}
+	printf("%d failure(s)\n", failures);
+	return failures ? 1 : 0;
+}
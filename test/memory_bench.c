@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "CPU_Info.h"
+
+/*
+ * Standalone memory hierarchy bench: prints latency and bandwidth of each
+ * cache level and DRAM, single-threaded and on every physical core.
+ * Usage: memory_bench [milliseconds per measurement]
+ */
+
+static const char* level_names[CPU_BENCH_LEVELS] = { "L1d", "L2", "L3", "DRAM" };
+
+int main(int argc, char** argv) {
+	int ms = argc > 1 ? atoi(argv[1]) : 0;
+
+	CPU_DATA data = { 0 };
+	int rc = get_cpu_data(&data);
+	if (rc != 0) {
+		fprintf(stderr, "get_cpu_data failed: %d\n", rc);
+		return 1;
+	}
+
+	MEM_BENCH bench;
+	rc = run_memory_benchmark(&data, ms, &bench);
+	if (rc != 0) {
+		fprintf(stderr, "run_memory_benchmark failed: %d\n", rc);
+		free_cpu_data(&data);
+		return 1;
+	}
+
+	printf("CPU: %s\n", data.cpu_name ? data.cpu_name : "unknown");
+	printf("%d ms per measurement, %d thread(s) in the all-core columns\n\n",
+		bench.duration_ms, bench.threads_used);
+	printf("%-5s %10s %9s %9s %9s %9s %9s %9s %9s\n", "Level", "Set KiB", "Lat ns",
+		"Read", "Write", "Copy", "Read*", "Write*", "Copy*");
+	for (int i = 0; i < CPU_BENCH_LEVELS; ++i) {
+		const MemBenchLevelResult* r = &bench.level[i];
+		if (!r->working_set_bytes) {
+			continue;
+		}
+		printf("%-5s %10zu %9.2f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", level_names[i],
+			r->working_set_bytes / 1024, r->latency_ns, r->read_gbps, r->write_gbps,
+			r->copy_gbps, r->read_gbps_all, r->write_gbps_all, r->copy_gbps_all);
+	}
+	printf("\nBandwidth in GB/s; * = all cores together\n");
+
+	free_cpu_data(&data);
+	return 0;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "CPU_Info.h"
+
+/*
+ * Work-stealing pool stress: nested submits deep and wide enough to spill
+ * a deque into the shared FIFO, CPU_TASK_LATENCY tasks from inside and
+ * outside the pool, create / wait / destroy cycles with work still queued,
+ * and a pool with four workers per logical CPU.  Every task is counted, so
+ * a lost or doubled task, or a wait that returns early, is a failure.
+ * Usage: pool_stress [rounds]
+ */
+
+#if defined(_WIN32)
+#include <windows.h>
+#define COUNT(v)	InterlockedIncrement(&(v))
+#define LOAD(v)		InterlockedCompareExchange(&(v), 0, 0)
+#else
+#define COUNT(v)	__atomic_add_fetch(&(v), 1, __ATOMIC_RELAXED)
+#define LOAD(v)		__atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#endif
+
+#define TREE_DEPTH	12			/* 2^13 - 1 tasks, 2^12 leaves */
+#define FAN_OUT		10000		/* children of one task, more than a deque holds */
+#define LATENCY		500
+
+static CPU_POOL* pool;
+static volatile long leaves, nodes, fanned, latency, outside, misplaced;
+
+static void check_worker(void) {
+	int self = cpu_pool_current_worker(pool);
+	if (self < 0 || self >= cpu_pool_size(pool)) {
+		COUNT(misplaced);
+	}
+}
+
+static void count_latency(void* arg) {
+	(void)arg;
+	check_worker();
+	COUNT(latency);
+}
+
+/* Binary tree of submits from inside the pool; every 16th node adds a latency task */
+static void tree(void* arg) {
+	intptr_t depth = (intptr_t)arg;
+	check_worker();
+	long n = COUNT(nodes);
+	if (n % 16 == 0) {
+		cpu_pool_submit(pool, count_latency, NULL, CPU_TASK_LATENCY);
+	}
+	if (depth == 0) {
+		COUNT(leaves);
+		return;
+	}
+	cpu_pool_submit(pool, tree, (void*)(depth - 1), 0);
+	cpu_pool_submit(pool, tree, (void*)(depth - 1), 0);
+}
+
+static void fan_leaf(void* arg) {
+	(void)arg;
+	COUNT(fanned);
+}
+
+static void fan(void* arg) {
+	(void)arg;
+	for (int i = 0; i < FAN_OUT; ++i) {
+		cpu_pool_submit(pool, fan_leaf, NULL, 0);
+	}
+}
+
+static void count_outside(void* arg) {
+	(void)arg;
+	COUNT(outside);
+}
+
+static void reset(void) {
+	leaves = nodes = fanned = latency = outside = misplaced = 0;
+}
+
+/* One round of every pattern on `pool`; returns the failures */
+static int run_round(const char* name, int round) {
+	int failures = 0;
+	reset();
+	cpu_pool_submit(pool, tree, (void*)(intptr_t)TREE_DEPTH, 0);
+	cpu_pool_submit(pool, fan, NULL, 0);
+	for (int i = 0; i < LATENCY; ++i) {
+		cpu_pool_submit(pool, count_latency, NULL, CPU_TASK_LATENCY);
+		cpu_pool_submit(pool, count_outside, NULL, 0);
+	}
+	cpu_pool_wait(pool);
+
+	long want_nodes = (2L << TREE_DEPTH) - 1;
+	long want_latency = LATENCY + want_nodes / 16;
+	if (LOAD(nodes) != want_nodes || LOAD(leaves) != (1L << TREE_DEPTH)) {
+		printf("FAIL %s round %d: tree ran %ld nodes, %ld leaves, expected %ld, %ld\n", name, round,
+			LOAD(nodes), LOAD(leaves), want_nodes, 1L << TREE_DEPTH);
+		failures++;
+	}
+	if (LOAD(fanned) != FAN_OUT) {
+		printf("FAIL %s round %d: fan-out ran %ld of %d\n", name, round, LOAD(fanned), FAN_OUT);
+		failures++;
+	}
+	if (LOAD(latency) != want_latency || LOAD(outside) != LATENCY) {
+		printf("FAIL %s round %d: %ld latency and %ld outside tasks, expected %ld and %d\n", name, round,
+			LOAD(latency), LOAD(outside), want_latency, LATENCY);
+		failures++;
+	}
+	if (LOAD(misplaced) != 0) {
+		printf("FAIL %s round %d: %ld tasks ran outside a worker\n", name, round, LOAD(misplaced));
+		failures++;
+	}
+	return failures;
+}
+
+/* create, submit, maybe wait, destroy: destroy must run what is still queued */
+static int cycle(const CPU_DATA* data, int threads, int wait, int round) {
+	int rc = cpu_pool_create(data, threads, CPU_PLACE_PACK_CACHE, &pool);
+	if (rc != 0) {
+		printf("FAIL cycle %d: cpu_pool_create returned %d\n", round, rc);
+		return 1;
+	}
+	reset();
+	cpu_pool_submit(pool, tree, (void*)(intptr_t)6, 0);
+	for (int i = 0; i < 64; ++i) {
+		cpu_pool_submit(pool, count_outside, NULL, (i & 1) ? CPU_TASK_LATENCY : 0);
+	}
+	if (wait) {
+		cpu_pool_wait(pool);
+	}
+	cpu_pool_destroy(pool);
+	pool = NULL;
+	if (LOAD(nodes) != 127 || LOAD(outside) != 64) {
+		printf("FAIL cycle %d (%s): %ld tree nodes and %ld tasks after destroy, expected 127 and 64\n",
+			round, wait ? "wait" : "no wait", LOAD(nodes), LOAD(outside));
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	int rounds = argc > 1 ? atoi(argv[1]) : 20;
+	if (rounds <= 0) {
+		rounds = 20;
+	}
+
+	CPU_DATA data = { 0 };
+	int rc = get_cpu_data(&data);
+	if (rc != 0) {
+		fprintf(stderr, "get_cpu_data failed: %d\n", rc);
+		return 1;
+	}
+
+	int failures = 0;
+	int sizes[2] = { 0, 4 * data.logical_core_count };
+	const char* names[2] = { "default pool", "oversubscribed pool" };
+	for (int s = 0; s < 2; ++s) {
+		rc = cpu_pool_create(&data, sizes[s], CPU_PLACE_PHYSICAL_FIRST, &pool);
+		if (rc != 0) {
+			printf("FAIL %s: cpu_pool_create returned %d\n", names[s], rc);
+			failures++;
+			continue;
+		}
+		int before = failures;
+		for (int r = 0; r < rounds; ++r) {
+			failures += run_round(names[s], r);
+		}
+		if (failures == before) {
+			printf("ok   %s (%d workers, %d rounds)\n", names[s], cpu_pool_size(pool), rounds);
+		}
+		cpu_pool_destroy(pool);
+		pool = NULL;
+	}
+
+	int before = failures;
+	for (int r = 0; r < rounds; ++r) {
+		failures += cycle(&data, (r % 3) + 1, r & 1, r);
+	}
+	if (failures == before) {
+		printf("ok   create / wait / destroy (%d cycles)\n", rounds);
+	}
+
+	free_cpu_data(&data);
+	printf("%d failure(s)\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,582 @@
+#if !defined(_WIN32)
+#define _XOPEN_SOURCE 700		/* nftw, mkdtemp */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "CPU_Info.h"
+
+/*
+ * Probe latency and scaling bench.  Builds a sysfs / procfs tree and a
+ * matching CPUID dump for each synthetic machine below (1 to 512 CPUs,
+ * hybrid, multi‐CCD, multi‐socket, a CPU offline), replays them through
+ * set_cpu_sysfs_root() and set_cpuid_hook(), and prints the median wall
+ * time and the opens, system calls and allocations of every probe phase.
+ * The counts are deterministic, so each phase is also checked against a
+ * bound linear in CPUs, cores and cache instances: a probe that starts
+ * reading every CPU x index again fails on any build machine.
+ * Usage: probe_bench [iterations] [scratch directory]
+ */
+
+#if defined(_WIN32)
+int main(void) {
+	printf("probe_bench replays Linux sysfs trees; nothing to run on Windows\n");
+	return 0;
+}
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ftw.h>
+
+enum { INTEL, AMD };
+
+typedef struct {
+	const char* name;
+	int vendor;
+	int packages;
+	int nodes;					/* NUMA nodes, an equal share of each package's cores */
+	int p_cores;				/* per package */
+	int e_cores;				/* per package, four to an L2 */
+	int smt;					/* threads per P‐core */
+	int cores_per_l3;			/* P‐cores per L3 (CCD / CCX), 0 = one per package */
+	int siblings_adjacent;		/* client numbering: SMT siblings get consecutive ids */
+	int max_mhz;
+	const char* brand;
+	int offline;				/* CPU taken offline, neither first nor last; 0 = none */
+} machine;
+
+static const machine machines[] = {
+	{ "1 CPU VM", INTEL, 1, 1, 1, 0, 1, 0, 0, 2100, "Intel(R) Xeon(R) Processor", 0 },
+	{ "16 CPU desktop", INTEL, 1, 1, 8, 0, 2, 0, 1, 5100, "Intel(R) Core(TM) i7-10700K CPU @ 3.80GHz", 0 },
+	{ "hybrid 8P+8E", INTEL, 1, 1, 8, 8, 2, 0, 1, 5200, "12th Gen Intel(R) Core(TM) i9-12900K", 0 },
+	{ "multi-CCD 2x8", AMD, 1, 1, 16, 0, 2, 8, 0, 5700, "AMD Ryzen 9 7950X 16-Core Processor", 0 },
+	{ "128 CPU NPS4", AMD, 1, 4, 64, 0, 2, 8, 0, 3500, "AMD EPYC 7763 64-Core Processor", 0 },
+	{ "multi-socket 2x56", INTEL, 2, 2, 56, 0, 2, 0, 0, 3800, "Intel(R) Xeon(R) Platinum 8480+", 0 },
+	{ "512 CPU 2x128", AMD, 2, 2, 128, 0, 2, 8, 0, 3100, "AMD EPYC 9754 128-Core Processor", 0 },
+	{ "8 CPU, CPU 3 offline", INTEL, 1, 1, 4, 0, 2, 0, 1, 4700, "Intel(R) Core(TM) i3-10100 CPU @ 3.60GHz", 3 },
+};
+
+/* Where every logical CPU of a machine sits */
+typedef struct {
+	int cpus;
+	int offline;				/* 0 = all online */
+	int cores;
+	int l2_count;
+	int l3_count;
+	int* package;				/* per CPU */
+	int* core;					/* per CPU, global core index */
+	int* l2;
+	int* l3;
+	int* node;
+	int* efficiency;			/* per CPU, 1 on E‐cores */
+} layout;
+
+static int build_layout(const machine* m, layout* t) {
+	int per_pkg = m->p_cores + m->e_cores;
+	int cores = m->packages * per_pkg;
+	int cpus = m->packages * (m->p_cores * m->smt + m->e_cores);
+	memset(t, 0, sizeof(*t));
+	int* block = malloc((size_t)cpus * 6 * sizeof(int));
+	int* first = malloc((size_t)cores * sizeof(int));
+	if (!block || !first) {
+		free(block); free(first);
+		return -1;
+	}
+	t->cpus = cpus;
+	t->offline = m->offline;
+	t->cores = cores;
+	t->package = block;
+	t->core = block + cpus;
+	t->l2 = block + 2 * cpus;
+	t->l3 = block + 3 * cpus;
+	t->node = block + 4 * cpus;
+	t->efficiency = block + 5 * cpus;
+
+	/* client parts number siblings together, servers all first threads first */
+	int id = 0;
+	for (int pass = 0; pass < (m->siblings_adjacent ? 1 : m->smt); ++pass) {
+		for (int c = 0; c < cores; ++c) {
+			int e = c % per_pkg >= m->p_cores;
+			int threads = e ? 1 : m->smt;
+			int from = m->siblings_adjacent ? 0 : pass, to = m->siblings_adjacent ? threads : pass + 1;
+			for (int th = from; th < to && th < threads; ++th) {
+				t->core[id++] = c;
+			}
+		}
+	}
+	int l3_per_pkg = m->cores_per_l3 ? (m->p_cores + m->cores_per_l3 - 1) / m->cores_per_l3 : 1;
+	int e_l2 = (m->e_cores + 3) / 4;
+	for (int cpu = 0; cpu < cpus; ++cpu) {
+		int c = t->core[cpu], pkg = c / per_pkg, k = c % per_pkg;
+		int e = k >= m->p_cores;
+		t->package[cpu] = pkg;
+		t->efficiency[cpu] = e;
+		t->l2[cpu] = pkg * (m->p_cores + e_l2) + (e ? m->p_cores + (k - m->p_cores) / 4 : k);
+		t->l3[cpu] = pkg * l3_per_pkg + (m->cores_per_l3 && !e ? k / m->cores_per_l3 : 0);
+		int per_node = m->nodes / m->packages;
+		t->node[cpu] = pkg * per_node + k * per_node / per_pkg;
+	}
+	t->l2_count = m->packages * (m->p_cores + e_l2);
+	t->l3_count = m->packages * l3_per_pkg;
+	free(first);
+	return 0;
+}
+
+/* ---- tree writer ---- */
+
+static char root_dir[512];
+
+static int make_dirs(const char* path) {
+	char tmp[1024];
+	snprintf(tmp, sizeof(tmp), "%s", path);
+	for (char* p = tmp + 1; *p; ++p) {
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(tmp, 0755);
+			*p = '/';
+		}
+	}
+	return mkdir(tmp, 0755) == 0 || access(tmp, F_OK) == 0 ? 0 : -1;
+}
+
+/* Write root_dir/<rel> with printf‐style content, creating its directories */
+static int put(const char* rel, const char* fmt, ...) {
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/%s", root_dir, rel);
+	char* slash = strrchr(path, '/');
+	*slash = '\0';
+	if (make_dirs(path) != 0) {
+		return -1;
+	}
+	*slash = '/';
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		return -1;
+	}
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(f, fmt, ap);
+	va_end(ap);
+	return fclose(f);
+}
+
+/* Whether an online CPU has key[cpu] == value; sysfs lists leave offline CPUs out */
+static int listed(const layout* t, const int* key, int value, int cpu) {
+	return cpu >= 0 && cpu < t->cpus && (cpu != t->offline || !t->offline) && key[cpu] == value;
+}
+
+/* "0-3,8,10-11" of the online CPUs whose key[] equals value */
+static void cpu_list(const layout* t, const int* key, int value, char* out, size_t size) {
+	size_t n = 0;
+	out[0] = '\0';
+	for (int cpu = 0; cpu < t->cpus; ++cpu) {
+		if (!listed(t, key, value, cpu) || listed(t, key, value, cpu - 1)) {
+			continue;
+		}
+		int end = cpu;
+		while (listed(t, key, value, end + 1)) {
+			end++;
+		}
+		n += (size_t)snprintf(out + n, n < size ? size - n : 0, end > cpu ? "%s%d-%d" : "%s%d",
+			n ? "," : "", cpu, end);
+	}
+	if (n < size) {
+		snprintf(out + n, size - n, "\n");
+	}
+}
+
+static int write_cache(const layout* t, int cpu, int index, int level, const char* type,
+	int size_kb, int ways, const int* key) {
+	static char list[8192];
+	char rel[128];
+	cpu_list(t, key, key[cpu], list, sizeof(list));
+	const char* base = "sys/devices/system/cpu";
+	int rc = 0;
+	snprintf(rel, sizeof(rel), "%s/cpu%d/cache/index%d/level", base, cpu, index);
+	rc |= put(rel, "%d\n", level);
+	snprintf(rel, sizeof(rel), "%s/cpu%d/cache/index%d/type", base, cpu, index);
+	rc |= put(rel, "%s\n", type);
+	snprintf(rel, sizeof(rel), "%s/cpu%d/cache/index%d/size", base, cpu, index);
+	rc |= put(rel, "%dK\n", size_kb);
+	snprintf(rel, sizeof(rel), "%s/cpu%d/cache/index%d/coherency_line_size", base, cpu, index);
+	rc |= put(rel, "64\n");
+	snprintf(rel, sizeof(rel), "%s/cpu%d/cache/index%d/ways_of_associativity", base, cpu, index);
+	rc |= put(rel, "%d\n", ways);
+	snprintf(rel, sizeof(rel), "%s/cpu%d/cache/index%d/number_of_sets", base, cpu, index);
+	rc |= put(rel, "%d\n", size_kb * 1024 / 64 / ways);
+	snprintf(rel, sizeof(rel), "%s/cpu%d/cache/index%d/shared_cpu_list", base, cpu, index);
+	rc |= put(rel, "%s", list);
+	return rc;
+}
+
+static int write_tree(const machine* m, const layout* t) {
+	static char list[8192];
+	char rel[128];
+	const char* base = "sys/devices/system/cpu";
+	int rc = 0;
+
+	if (t->offline) {
+		rc |= put("sys/devices/system/cpu/online", "0-%d,%d-%d\n", t->offline - 1, t->offline + 1, t->cpus - 1);
+	} else {
+		rc |= put("sys/devices/system/cpu/online", "0-%d\n", t->cpus - 1);
+	}
+	rc |= put("sys/devices/system/cpu/cpu0/cpufreq/scaling_driver", "%s\n",
+		m->vendor == INTEL ? "intel_pstate" : "amd-pstate-epp");
+	for (int cpu = 0; cpu < t->cpus && rc == 0; ++cpu) {
+		int e = t->efficiency[cpu];
+		if (t->offline && cpu == t->offline) {
+			continue;	/* an offline CPU has no topology, cache or cpufreq directory */
+		}
+		int per_pkg = m->p_cores + m->e_cores;
+		snprintf(rel, sizeof(rel), "%s/cpu%d/topology/physical_package_id", base, cpu);
+		rc |= put(rel, "%d\n", t->package[cpu]);
+		snprintf(rel, sizeof(rel), "%s/cpu%d/topology/core_id", base, cpu);
+		rc |= put(rel, "%d\n", t->core[cpu] % per_pkg);
+
+		/* L1d, L1i private; L2 per P‐core or E‐cluster; L3 per package or CCD */
+		rc |= write_cache(t, cpu, 0, 1, "Data", e ? 32 : 48, 12, t->core);
+		rc |= write_cache(t, cpu, 1, 1, "Instruction", e ? 64 : 32, 8, t->core);
+		rc |= write_cache(t, cpu, 2, 2, "Unified", e ? 2048 : m->vendor == AMD ? 1024 : 2048, 16, t->l2);
+		rc |= write_cache(t, cpu, 3, 3, "Unified", 32768, 16, t->l3);
+
+		int max_khz = (e ? m->max_mhz * 3 / 4 : m->max_mhz) * 1000;
+		snprintf(rel, sizeof(rel), "%s/cpu%d/cpufreq/scaling_cur_freq", base, cpu);
+		rc |= put(rel, "%d\n", max_khz / 2);
+		snprintf(rel, sizeof(rel), "%s/cpu%d/cpufreq/cpuinfo_min_freq", base, cpu);
+		rc |= put(rel, "800000\n");
+		snprintf(rel, sizeof(rel), "%s/cpu%d/cpufreq/cpuinfo_max_freq", base, cpu);
+		rc |= put(rel, "%d\n", max_khz);
+		snprintf(rel, sizeof(rel), "%s/cpu%d/cpufreq/scaling_max_freq", base, cpu);
+		rc |= put(rel, "%d\n", max_khz);
+		snprintf(rel, sizeof(rel), "%s/cpu%d/cpufreq/scaling_governor", base, cpu);
+		rc |= put(rel, "performance\n");
+		snprintf(rel, sizeof(rel), "%s/cpu%d/cpufreq/energy_performance_preference", base, cpu);
+		rc |= put(rel, "performance\n");
+		if (m->vendor == INTEL) {
+			snprintf(rel, sizeof(rel), "%s/cpu%d/cpufreq/base_frequency", base, cpu);
+			rc |= put(rel, "%d\n", e ? 2400000 : 3200000);
+		} else {
+			/* two preferred cores per CCD, as amd‐pstate ranks them */
+			snprintf(rel, sizeof(rel), "%s/cpu%d/acpi_cppc/highest_perf", base, cpu);
+			rc |= put(rel, "%d\n", t->core[cpu] % (m->cores_per_l3 ? m->cores_per_l3 : 8) < 2 ? 166 : 158);
+		}
+	}
+	if (m->e_cores) {
+		cpu_list(t, t->efficiency, 0, list, sizeof(list));
+		rc |= put("sys/devices/cpu_core/cpus", "%s", list);
+		cpu_list(t, t->efficiency, 1, list, sizeof(list));
+		rc |= put("sys/devices/cpu_atom/cpus", "%s", list);
+	}
+
+	rc |= put("sys/devices/system/node/online", m->nodes > 1 ? "0-%d\n" : "0\n", m->nodes - 1);
+	for (int k = 0; k < m->nodes && rc == 0; ++k) {
+		char distance[512];
+		size_t n = 0;
+		for (int j = 0; j < m->nodes; ++j) {
+			int d = j == k ? 10 : j / (m->nodes / m->packages) == k / (m->nodes / m->packages) ? 12 : 32;
+			n += (size_t)snprintf(distance + n, sizeof(distance) - n, j ? " %d" : "%d", d);
+		}
+		cpu_list(t, t->node, k, list, sizeof(list));
+		snprintf(rel, sizeof(rel), "sys/devices/system/node/node%d/cpulist", k);
+		rc |= put(rel, "%s", list);
+		snprintf(rel, sizeof(rel), "sys/devices/system/node/node%d/distance", k);
+		rc |= put(rel, "%s\n", distance);
+		snprintf(rel, sizeof(rel), "sys/devices/system/node/node%d/meminfo", k);
+		rc |= put(rel, "Node %d MemTotal:       67108864 kB\nNode %d MemFree:        50331648 kB\n", k, k);
+		snprintf(rel, sizeof(rel), "sys/devices/system/node/node%d/hugepages/hugepages-2048kB/nr_hugepages", k);
+		rc |= put(rel, "0\n");
+		snprintf(rel, sizeof(rel), "sys/devices/system/node/node%d/hugepages/hugepages-2048kB/free_hugepages", k);
+		rc |= put(rel, "0\n");
+	}
+
+	rc |= put("proc/meminfo", "MemTotal:       %d kB\nMemFree:        %d kB\nMemAvailable:   %d kB\n",
+		67108864 * m->nodes / 1024 * 1024, 50331648 * m->nodes, 50331648 * m->nodes);
+	rc |= put("proc/self/cgroup", "0::/\n");
+	rc |= put("sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages", "0\n");
+	rc |= put("sys/kernel/mm/hugepages/hugepages-2048kB/free_hugepages", "0\n");
+	rc |= put("sys/kernel/mm/hugepages/hugepages-2048kB/resv_hugepages", "0\n");
+	rc |= put("sys/kernel/mm/hugepages/hugepages-2048kB/surplus_hugepages", "0\n");
+	rc |= put("sys/kernel/mm/transparent_hugepage/enabled", "always [madvise] never\n");
+	rc |= put("sys/kernel/mm/transparent_hugepage/defrag", "always defer defer+madvise [madvise] never\n");
+	rc |= put("sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "2097152\n");
+	return rc;
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+	(void)st; (void)flag; (void)ftw;
+	return remove(path);
+}
+
+/* ---- CPUID dump ---- */
+
+typedef struct {
+	int leaf;
+	unsigned int eax, ebx, ecx, edx;
+} cpuid_row;
+
+typedef struct {
+	cpuid_row rows[16];
+	int count;
+} cpuid_dump;
+
+static void add_row(cpuid_dump* d, int leaf, unsigned int a, unsigned int b, unsigned int c, unsigned int e) {
+	cpuid_row r = { leaf, a, b, c, e };
+	d->rows[d->count++] = r;
+}
+
+static void build_cpuid(const machine* m, cpuid_dump* d) {
+	unsigned int brand[12] = { 0 };
+	memcpy(brand, m->brand, strlen(m->brand) < 47 ? strlen(m->brand) : 47);
+	d->count = 0;
+	if (m->vendor == INTEL) {
+		add_row(d, 0, 0x20, 0x756E6547u, 0x6C65746Eu, 0x49656E69u);
+		add_row(d, 1, 0x90672, 0x00100800, 0x7FFAFBFF, 0xBFEBFBFF);
+		add_row(d, 7, 0, 0x239CA7EB, 0x98C007BC, m->e_cores ? 0xFC18C410 : 0xFC184410);
+		add_row(d, 0x15, 2, 250, 38400000, 0);	/* 38.4 MHz crystal * 125 = 4.8 GHz */
+		add_row(d, 0x16, 3200, (unsigned int)m->max_mhz, 100, 0);
+	} else {
+		add_row(d, 0, 0x10, 0x68747541u, 0x444D4163u, 0x69746E65u);
+		add_row(d, 1, 0xA60F12, 0x00200800, 0x7EF8320B, 0x178BFBFF);
+		add_row(d, 7, 0, 0xF1BF97A9, 0x00405FCE, 0x10000010);
+	}
+	add_row(d, (int)0x80000000, 0x80000008, 0, 0, 0);
+	add_row(d, (int)0x80000001, 0, 0, m->vendor == AMD ? 0x75C237FF : 0x121, 0x2C100800);
+	for (int i = 0; i < 3; ++i) {
+		add_row(d, (int)(0x80000002 + i), brand[4 * i], brand[4 * i + 1], brand[4 * i + 2], brand[4 * i + 3]);
+	}
+	add_row(d, (int)0x80000007, 0, 0, 0, 0x100);
+}
+
+static void replay_cpuid(void* ctx, int leaf, int subleaf, int regs[4]) {
+	const cpuid_dump* d = ctx;
+	memset(regs, 0, 4 * sizeof(int));
+	for (int i = 0; i < d->count; ++i) {
+		if (d->rows[i].leaf == leaf && (leaf != 7 || subleaf == 0)) {
+			regs[0] = (int)d->rows[i].eax;
+			regs[1] = (int)d->rows[i].ebx;
+			regs[2] = (int)d->rows[i].ecx;
+			regs[3] = (int)d->rows[i].edx;
+			return;
+		}
+	}
+}
+
+static uint64_t replay_xgetbv(void* ctx, unsigned int index) {
+	(void)ctx;
+	return index == 0 ? 0xE7 : 0;
+}
+
+/* ---- measurement ---- */
+
+static const char* phase_names[CPU_PHASE_COUNT] = {
+	"brand", "setup", "frequency", "algorithms", "caches", "topology",
+	"cpuid-topology", "numa", "budget", "pack", "memory"
+};
+
+typedef struct {
+	CPU_PROBE_STATS last;
+	uint64_t* wall;				/* iterations x (CPU_PHASE_COUNT + 1) */
+	int runs;
+} collector;
+
+static void collect(void* ctx, const CPU_PROBE_STATS* stats) {
+	collector* c = ctx;
+	c->last = *stats;
+	if (c->wall) {
+		uint64_t* row = c->wall + (size_t)c->runs * (CPU_PHASE_COUNT + 1);
+		for (int p = 0; p < CPU_PHASE_COUNT; ++p) {
+			row[p] = stats->phase[p].wall_ns;
+		}
+		row[CPU_PHASE_COUNT] = stats->total_ns;
+		c->runs++;
+	}
+}
+
+static int compare_u64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static double median_ms(collector* c, int column) {
+	uint64_t* v = malloc((size_t)c->runs * sizeof(uint64_t));
+	if (!v || !c->runs) {
+		free(v);
+		return 0.0;
+	}
+	for (int i = 0; i < c->runs; ++i) {
+		v[i] = c->wall[(size_t)i * (CPU_PHASE_COUNT + 1) + column];
+	}
+	qsort(v, c->runs, sizeof(uint64_t), compare_u64);
+	double ms = (double)v[c->runs / 2] / 1e6;
+	free(v);
+	return ms;
+}
+
+/* Allowed cost of one phase: constant + per CPU + per core + per cache instance */
+typedef struct {
+	int phase;
+	int files[4];
+	int syscalls[4];
+	int allocations[4];
+} phase_bound;
+
+/*
+ * Topology reads two attributes per CPU and frequency a fixed set of
+ * cpufreq attributes per CPU; caches scale with cache instances, not
+ * with CPUs x indices.  NUMA and memory scale with nodes, which never
+ * exceed cores here.
+ */
+static const phase_bound bounds[] = {
+	{ CPU_PHASE_TOPOLOGY,  { 4, 2, 0, 0 },  { 8, 7, 0, 0 },  { 16, 0, 2, 0 } },
+	{ CPU_PHASE_CACHES,    { 12, 0, 0, 6 }, { 40, 0, 0, 18 }, { 24, 0, 0, 2 } },
+	{ CPU_PHASE_FREQUENCY, { 8, 10, 0, 0 }, { 16, 30, 0, 0 }, { 16, 0, 0, 0 } },
+	{ CPU_PHASE_NUMA,      { 4, 0, 4, 0 },  { 8, 0, 12, 0 }, { 8, 0, 1, 0 } },
+	{ CPU_PHASE_PACK,      { 0, 0, 0, 0 },  { 0, 0, 0, 0 },  { 2, 0, 0, 0 } },
+	{ CPU_PHASE_MEMORY,    { 16, 0, 4, 0 }, { 40, 0, 12, 0 }, { 8, 0, 1, 0 } },
+};
+
+static int over(const int k[4], unsigned int got, int cpus, int cores, int caches) {
+	long limit = k[0] + (long)k[1] * cpus + (long)k[2] * cores + (long)k[3] * caches;
+	return (long)got > limit;
+}
+
+static int run_machine(const machine* m, int iterations, const char* scratch, int index) {
+	layout t;
+	cpuid_dump dump;
+	int failures = 0;
+	if (build_layout(m, &t) != 0) {
+		printf("FAIL %s: out of memory\n", m->name);
+		return 1;
+	}
+	snprintf(root_dir, sizeof(root_dir), "%s/machine%d", scratch, index);
+	if (write_tree(m, &t) != 0) {
+		printf("FAIL %s: cannot write %s\n", m->name, root_dir);
+		free(t.package);
+		return 1;
+	}
+	build_cpuid(m, &dump);
+
+	CpuidHook hook = { replay_cpuid, replay_xgetbv, &dump };
+	collector c = { 0 };
+	c.wall = malloc((size_t)iterations * (CPU_PHASE_COUNT + 1) * sizeof(uint64_t));
+	CPU_DATA data = { 0 };
+	int rc = c.wall ? 0 : 203;
+
+	set_cpu_sysfs_root(root_dir);
+	set_cpuid_hook(&hook);
+	set_cpu_probe_hook(collect, &c);
+	/* sysfs alone must cope with the hole; a CPUID fallback would hide a 202 */
+	set_cpu_probe_mode(m->offline ? CPU_PROBE_OS : CPU_PROBE_AUTO);
+	/* one untimed probe warms the page cache and the TSC calibration */
+	uint64_t* wall = c.wall;
+	c.wall = NULL;
+	if (rc == 0) {
+		rc = get_cpu_data(&data);
+	}
+	c.wall = wall;
+	for (int i = 0; i < iterations && rc == 0; ++i) {
+		free_cpu_data(&data);
+		rc = get_cpu_data(&data);
+	}
+	set_cpu_probe_hook(NULL, NULL);
+	set_cpuid_hook(NULL);
+	set_cpu_sysfs_root(NULL);
+	set_cpu_probe_mode(CPU_PROBE_AUTO);
+
+	int caches = 2 * t.cores + t.l2_count + t.l3_count;
+	if (rc != 0) {
+		printf("FAIL %s: get_cpu_data returned %d\n", m->name, rc);
+		failures++;
+	} else {
+		int packages = 0, l3 = 0, threads = 0, misplaced = 0;
+		for (int i = 0; i < data.physical_core_count; ++i) {
+			packages = data.cores[i].package + 1 > packages ? data.cores[i].package + 1 : packages;
+			threads += data.cores[i].logical_count;
+			for (int j = 0; j < data.cores[i].logical_count; ++j) {
+				misplaced += t.offline && data.cores[i].logical_ids[j] == t.offline;
+			}
+		}
+		for (int i = 0; i < data.cache_count; ++i) {
+			l3 += data.caches[i].level == 3;
+			for (int j = 0; j < data.caches[i].cpu_count; ++j) {
+				misplaced += t.offline && data.caches[i].cpus[j] == t.offline;
+			}
+		}
+		int online = t.cpus - (t.offline != 0);
+		int e_expected = m->packages * m->e_cores;
+		const char* wrong = data.logical_core_count != t.cpus ? "logical CPUs"
+			: data.physical_core_count != t.cores ? "physical cores"
+			: packages != m->packages ? "packages"
+			: data.cache_count != caches ? "cache instances"
+			: l3 != t.l3_count ? "L3 domains"
+			: data.numa_node_count != m->nodes ? "NUMA nodes"
+			: data.efficiency_core_count != e_expected ? "E-cores"
+			: data.performance_core_count != t.cores - e_expected ? "P-cores"
+			: !data.cpu_name || strcmp(data.cpu_name, m->brand) != 0 ? "brand"
+			: !data.cpu_location || data.cpu_location[t.cpus - 1].l3 < 0 ? "cpu_location"
+			: threads != online || data.budget.host_cpus != online ? "online CPUs"
+			: misplaced || (t.offline && data.cpu_location[t.offline].core != -1) ? "offline CPU"
+			: NULL;
+		if (wrong) {
+			printf("FAIL %s: %s differ from the recorded machine\n", m->name, wrong);
+			failures++;
+		}
+	}
+
+	printf("\n%s: %d CPUs, %d cores, %d cache instances, %d node(s)\n",
+		m->name, t.cpus, t.cores, caches, m->nodes);
+	printf("  %-15s %9s %7s %9s %7s\n", "phase", "ms", "files", "syscalls", "allocs");
+	for (int p = 0; p < CPU_PHASE_COUNT && rc == 0; ++p) {
+		const CpuPhaseStats* ps = &c.last.phase[p];
+		if (!ps->runs) {
+			continue;
+		}
+		printf("  %-15s %9.3f %7u %9u %7u\n", phase_names[p], median_ms(&c, p),
+			ps->files_opened, ps->syscalls, ps->allocations);
+	}
+	if (rc == 0) {
+		printf("  %-15s %9.3f\n", "total", median_ms(&c, CPU_PHASE_COUNT));
+	}
+	for (size_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]) && rc == 0; ++b) {
+		const CpuPhaseStats* ps = &c.last.phase[bounds[b].phase];
+		const char* what = over(bounds[b].files, ps->files_opened, t.cpus, t.cores, caches) ? "files"
+			: over(bounds[b].syscalls, ps->syscalls, t.cpus, t.cores, caches) ? "syscalls"
+			: over(bounds[b].allocations, ps->allocations, t.cpus, t.cores, caches) ? "allocations"
+			: NULL;
+		if (what) {
+			printf("FAIL %s: %s phase exceeds its %s bound\n", m->name, phase_names[bounds[b].phase], what);
+			failures++;
+		}
+	}
+
+	free_cpu_data(&data);
+	free(c.wall);
+	free(t.package);
+	nftw(root_dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	return failures;
+}
+
+int main(int argc, char** argv) {
+	int iterations = argc > 1 ? atoi(argv[1]) : 0;
+	const char* parent = argc > 2 ? argv[2] : getenv("TMPDIR");
+	char scratch[256];
+	if (iterations <= 0) {
+		iterations = 20;
+	}
+	snprintf(scratch, sizeof(scratch), "%s/probe_bench.XXXXXX", parent ? parent : "/tmp");
+	if (!mkdtemp(scratch)) {
+		fprintf(stderr, "cannot create a scratch directory under %s\n", parent ? parent : "/tmp");
+		return 1;
+	}
+
+	printf("%d probes per machine, median wall time\n", iterations);
+	int failures = 0;
+	for (size_t i = 0; i < sizeof(machines) / sizeof(machines[0]); ++i) {
+		failures += run_machine(&machines[i], iterations, scratch, (int)i);
+	}
+	rmdir(scratch);
+	printf("\n%d failure(s)\n", failures);
+	return failures ? 1 : 0;
+}
+#endif
@@ -5,6 +5,7 @@
 #include "CPU_Info.h"
 
 typedef int (*get_cpu_data_fn)(CPU_DATA*);
+typedef void (*free_cpu_data_fn)(CPU_DATA*);
 
 static const char* core_type_to_string(CoreType t) {
 	switch (t) {
@@ -28,9 +29,16 @@ int main(void) {
 		return 2;
 	}
 
+	free_cpu_data_fn free_cpu_data = (free_cpu_data_fn)GetProcAddress(lib, "free_cpu_data");
+	if (!free_cpu_data) {
+		fprintf(stderr, "Failed to find free_cpu_data\n");
+		FreeLibrary(lib);
+		return 2;
+	}
+
 	CPU_DATA data = { 0 };
 	int rc = get_cpu_data(&data);
-	if (rc != 200) {
+	if (rc != 0) {
 		fprintf(stderr, "get_cpu_data failed with code %d\n", rc);
 		FreeLibrary(lib);
 		return 3;
@@ -39,6 +47,7 @@ int main(void) {
 	FILE* f = fopen("CPU_Info.txt", "w");
 	if (!f) {
 		fprintf(stderr, "Failed to open output file\n");
+		free_cpu_data(&data);
 		FreeLibrary(lib);
 		return 4;
 	}
@@ -47,6 +56,10 @@ int main(void) {
 	fprintf(f, "CPU Brand String: %s\n", data.cpu_name);
 	fprintf(f, "Physical Cores   : %d\n", data.physical_core_count);
 	fprintf(f, "Logical Cores    : %d\n", data.logical_core_count);
+	fprintf(f, "P / E Cores      : %d / %d\n", data.performance_core_count, data.efficiency_core_count);
+	fprintf(f, "x86-64 Level     : v%d\n", data.isa_level);
+	fprintf(f, "Usable CPUs      : %d (affinity %d, job cap %.2f)\n",
+			data.budget.recommended_parallelism, data.budget.affinity_cpus, data.budget.job_cpus);
 	fprintf(f, "L3 Cache         : %d KB\n\n", data.l3size);
 
 	// Physical core topology
@@ -65,6 +78,39 @@ int main(void) {
 	}
 	fprintf(f, "\n");
 
+	// Cache instances
+	fprintf(f, "Cache Domains:\n");
+	for (int i = 0; i < data.cache_count; ++i) {
+		CacheDomain* cd = &data.caches[i];
+		fprintf(f, "  L%d %-11s: %6d KB, %d B lines, %2d-way, %d logical cores\n",
+				cd->level,
+				cd->type == CACHE_TYPE_DATA ? "Data" : cd->type == CACHE_TYPE_INSTRUCTION ? "Instruction" : "Unified",
+				cd->size_kb, cd->line_size, cd->associativity, cd->cpu_count);
+	}
+	fprintf(f, "\n");
+
+	// TLBs
+	fprintf(f, "TLBs (false sharing stride %d B):\n", data.false_sharing_bytes);
+	for (int i = 0; i < data.tlb_count; ++i) {
+		TlbInfo* t = &data.tlbs[i];
+		fprintf(f, "  L%d %-11s: %4d entries, %2d-way, %d KB pages\n",
+				t->level,
+				t->type == CACHE_TYPE_DATA ? "Data" : t->type == CACHE_TYPE_INSTRUCTION ? "Instruction" : "Unified",
+				t->entries, t->associativity, t->page_size_kb);
+	}
+	fprintf(f, "\n");
+
+	// NUMA nodes
+	fprintf(f, "NUMA Nodes:\n");
+	for (int i = 0; i < data.numa_node_count; ++i) {
+		NumaNode* nn = &data.numa_nodes[i];
+		fprintf(f, "  Node %d: %d logical cores, %llu MB free of %llu MB\n",
+				nn->id, nn->cpu_count,
+				(unsigned long long)(nn->mem_free_bytes >> 20),
+				(unsigned long long)(nn->mem_total_bytes >> 20));
+	}
+	fprintf(f, "\n");
+
 	// Per‐logical‐core details
 	fprintf(f, "Per‐Logical‐Core Details:\n");
 	for (int i = 0; i < data.logical_core_count; ++i) {
@@ -123,14 +169,7 @@ int main(void) {
 	fclose(f);
 
 	// cleanup
-	free(data.cpu_name);
-	free(data.frequency);
-	free(data.l1size);
-	free(data.l2size);
-	for (int i = 0; i < data.physical_core_count; ++i) {
-		free(data.cores[i].logical_ids);
-	}
-	free(data.cores);
+	free_cpu_data(&data);
 
 	FreeLibrary(lib);
 	return 0;